@@ -57,11 +57,79 @@ build_suite('fstream', {})
 push_options()
 table.insert(OPTIONS.includes, tup.getcwd() .. '/../reckless/include')
 build_suite('reckless', {libreckless}, {}, {}, {})
+build_suite('reckless_per_thread', {libreckless})
+build_suite('reckless_async', {libreckless})
+build_suite('reckless_binary', {libreckless})
+build_suite('reckless_fmt', {libreckless})
 
 link('nanolog_benchmark', {
   compile('nanolog_benchmark.cpp', 'nanolog_benchmark' .. OBJSUFFIX),
   libreckless
 })
+
+link('wakeup_signal', {
+  compile('wakeup_signal.cpp', 'wakeup_signal' .. OBJSUFFIX),
+  libreckless
+})
+
+push_options()
+table.insert(OPTIONS.libs, 'dl')
+link('wakeup_syscalls', {
+  compile('wakeup_syscalls.cpp', 'wakeup_syscalls' .. OBJSUFFIX),
+  libreckless
+})
+pop_options()
+
+link('saturated_disk', {
+  compile('saturated_disk.cpp', 'saturated_disk' .. OBJSUFFIX),
+  libreckless
+})
+
+link('writer_throughput', {
+  compile('writer_throughput.cpp', 'writer_throughput' .. OBJSUFFIX),
+  libreckless
+})
+
+link('float_format', {
+  compile('float_format.cpp', 'float_format' .. OBJSUFFIX),
+  compile('ftoa_legacy.cpp', 'ftoa_legacy' .. OBJSUFFIX),
+  libreckless
+})
+
+link('integer_format', {
+  compile('integer_format.cpp', 'integer_format' .. OBJSUFFIX),
+  libreckless
+})
+
+link('frame_packing', {
+  compile('frame_packing.cpp', 'frame_packing' .. OBJSUFFIX),
+  libreckless
+})
+
+link('string_capture', {
+  compile('string_capture.cpp', 'string_capture' .. OBJSUFFIX),
+  libreckless
+})
+
+link('ring_memory', {
+  compile('ring_memory.cpp', 'ring_memory' .. OBJSUFFIX),
+  libreckless
+})
+
+link('formatter_threads', {
+  compile('formatter_threads.cpp', 'formatter_threads' .. OBJSUFFIX),
+  libreckless
+})
+
+link('write_batch', {
+  compile('write_batch.cpp', 'write_batch' .. OBJSUFFIX),
+  libreckless
+})
+
+link('timestamp_format', {
+  compile('timestamp_format.cpp', 'timestamp_format' .. OBJSUFFIX),
+  libreckless
+})
 pop_options()
 
 SPDLOG = tup.getconfig('SPDLOG')
@@ -0,0 +1,154 @@
+// Measures the cost per call of converting a double to text, which is what
+// the output worker spends most of its time on when the log is full of
+// prices and latencies. Compares the integer-only conversion in ntoa.cpp,
+// the long-double conversion it replaced (ftoa_legacy.cpp) and snprintf.
+//
+// Legacy %g is given a precision of 17 since it has no shortest mode; the
+// new %g is measured both with a precision of 17 and without one (shortest
+// round-trip).
+
+#include "ftoa_legacy.hpp"
+
+#include <reckless/ntoa.hpp>
+#include <reckless/writer.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+class null_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count, std::error_code& ec) noexcept override
+    {
+        ec.clear();
+        return count;
+    }
+};
+
+class benchmark_buffer : public reckless::output_buffer {
+public:
+    benchmark_buffer(reckless::writer* pwriter) :
+        output_buffer(pwriter, 1024*1024)
+    {
+    }
+
+    void flush()
+    {
+        frame_end();
+        output_buffer::flush();
+    }
+};
+
+null_writer g_writer;
+benchmark_buffer g_buffer(&g_writer);
+std::size_t const BATCH_SIZE = 1000;
+
+using conversion_function = void (*)(reckless::output_buffer*, double,
+    reckless::conversion_specification const&);
+
+reckless::conversion_specification precision(unsigned p)
+{
+    reckless::conversion_specification cs;
+    cs.precision = p;
+    return cs;
+}
+
+template <class Convert>
+void measure(char const* name, std::vector<double> const& values,
+    Convert convert)
+{
+    unsigned const ROUNDS = 5;
+    double best = 0;
+    for(unsigned round=0; round!=ROUNDS; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for(std::size_t i=0; i!=values.size(); ++i) {
+            convert(values[i]);
+            if(i % BATCH_SIZE == BATCH_SIZE-1)
+                g_buffer.flush();
+        }
+        g_buffer.flush();
+        auto end = std::chrono::steady_clock::now();
+        double ns = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                end - start).count())/values.size();
+        if(round == 0 || ns < best)
+            best = ns;
+    }
+    std::printf("  %-24s %8.1f ns/value\n", name, best);
+}
+
+void measure_reckless(char const* name, std::vector<double> const& values,
+    conversion_function f, reckless::conversion_specification const& cs)
+{
+    measure(name, values, [&](double v) { f(&g_buffer, v, cs); });
+}
+
+void measure_snprintf(char const* name, std::vector<double> const& values,
+    char const* format)
+{
+    measure(name, values, [&](double v) {
+        char* p = g_buffer.reserve(512);
+        int n = std::snprintf(p, 512, format, v);
+        g_buffer.commit(static_cast<std::size_t>(n));
+    });
+}
+
+void run(char const* title, std::vector<double> const& values,
+    unsigned fixed_precision)
+{
+    std::printf("%s\n", title);
+    char format[16];
+    std::sprintf(format, "%%.%uf", fixed_precision);
+    measure_reckless("%f legacy", values, legacy::ftoa_base10_f,
+        precision(fixed_precision));
+    measure_reckless("%f", values, reckless::ftoa_base10_f,
+        precision(fixed_precision));
+    measure_snprintf("%f snprintf", values, format);
+    measure_reckless("%e", values, reckless::ftoa_base10_e, precision(6));
+    measure_snprintf("%e snprintf", values, "%e");
+    measure_reckless("%.17g legacy", values, legacy::ftoa_base10_g,
+        precision(17));
+    measure_reckless("%.17g", values, reckless::ftoa_base10_g, precision(17));
+    measure_snprintf("%.17g snprintf", values, "%.17g");
+    measure_reckless("%g shortest", values, reckless::ftoa_base10_g,
+        reckless::conversion_specification());
+}
+
+}   // anonymous namespace
+
+int main()
+{
+    std::size_t const COUNT = 1000000;
+    std::mt19937_64 rng;
+
+    // Prices with two decimals, up to 100000.
+    std::vector<double> prices(COUNT);
+    for(auto& v : prices)
+        v = static_cast<double>(rng() % 10000000)/100;
+    run("prices (%.2f)", prices, 2);
+
+    // Latencies in seconds, from a microsecond to a few seconds.
+    std::vector<double> latencies(COUNT);
+    std::uniform_real_distribution<double> log_latency(-6, 0.5);
+    for(auto& v : latencies)
+        v = std::pow(10.0, log_latency(rng));
+    run("latencies (%.6f)", latencies, 6);
+
+    // Any finite double.
+    std::vector<double> random_bits;
+    random_bits.reserve(COUNT);
+    while(random_bits.size() != COUNT) {
+        std::uint64_t bits = rng();
+        double v;
+        std::memcpy(&v, &bits, sizeof(v));
+        if(std::isfinite(v))
+            random_bits.push_back(v);
+    }
+    run("random bit patterns (%.6f)", random_bits, 6);
+    return 0;
+}
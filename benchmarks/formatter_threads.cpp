@@ -0,0 +1,86 @@
+// Measures how fast the output worker gets through records that are
+// expensive to format, with and without log_options::formatter_threads. The
+// records look like the ones in the mandelbrot benchmark, with two doubles
+// each. They are written up front by a few threads into an input buffer
+// that is large enough to hold all of them, so that the time from the first
+// write to the end of close() is mostly formatting. The writer throws the
+// output away.
+//
+// Usage: formatter_threads [max formatter threads]
+
+#include <reckless/severity_log.hpp>
+#include <reckless/writer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>  // atoi
+#include <thread>
+#include <vector>
+
+namespace {
+
+class null_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count, std::error_code& ec) noexcept override
+    {
+        ec.clear();
+        return count;
+    }
+};
+
+typedef reckless::severity_log<reckless::no_indent, ' ',
+    reckless::severity_field> log_t;
+
+unsigned const PRODUCER_THREADS = 4;
+unsigned const RECORDS_PER_THREAD = 250000;
+unsigned const ROUNDS = 5;
+
+double run(unsigned formatter_threads)
+{
+    null_writer writer;
+    reckless::log_options options;
+    options.input_buffer_capacity = 128*1024*1024;
+    options.formatter_threads = formatter_threads;
+    log_t log(&writer, options);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(unsigned t=0; t!=PRODUCER_THREADS; ++t) {
+        threads.emplace_back([&log, t]
+        {
+            for(unsigned i=0; i!=RECORDS_PER_THREAD; ++i) {
+                double x = -2.0 + i*(3.0/RECORDS_PER_THREAD);
+                double y = -1.0 + t*(2.0/PRODUCER_THREADS);
+                log.info("[T%d] %d,%d/%f,%f: %d iterations", t, i, t, x, y,
+                    static_cast<int>(i % 1000));
+            }
+        });
+    }
+    for(auto& thread : threads)
+        thread.join();
+    log.close();
+    auto end = std::chrono::steady_clock::now();
+    return static_cast<double>(std::chrono::duration_cast<
+        std::chrono::nanoseconds>(end - start).count())
+        /(PRODUCER_THREADS*RECORDS_PER_THREAD);
+}
+
+}   // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    unsigned max_threads = argc > 1? static_cast<unsigned>(std::atoi(argv[1]))
+        : std::thread::hardware_concurrency();
+    std::printf("%u records, %u CPUs\n", PRODUCER_THREADS*RECORDS_PER_THREAD,
+        std::thread::hardware_concurrency());
+    for(unsigned threads=0; threads<=max_threads; ++threads) {
+        double best = 0;
+        for(unsigned round=0; round!=ROUNDS; ++round) {
+            double ns = run(threads);
+            if(round == 0 || ns < best)
+                best = ns;
+        }
+        std::printf("  %u formatter threads %8.1f ns/record\n", threads, best);
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Compares input frame granularities (log_options::frame_granularity). Each
+// thread writes bursts of records as fast as it can and waits for the
+// worker to catch up in between, like call_burst does. We report the
+// average cost per call, how full the input buffer got
+// (input_buffer_high_watermark()) and how often a thread had to wait for
+// the worker because the buffer was full.
+//
+// Two kinds of records are written: the one from call_burst, which takes
+// up a whole cache line either way, and a small one that only needs half.
+// Records are formatted to a writer that discards them.
+
+#include <reckless/severity_log.hpp>
+#include <reckless/writer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class null_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count, std::error_code& ec) noexcept override
+    {
+        ec.clear();
+        return count;
+    }
+};
+
+unsigned const BURSTS = 200;
+unsigned const BURST_SIZE = 500;
+unsigned const ROUNDS = 5;
+
+struct call_burst_record {
+    typedef reckless::severity_log<reckless::no_indent, ' ',
+        reckless::severity_field, reckless::timestamp_field> log_t;
+    static char const* name() { return "call_burst"; }
+    static void write(log_t& log, unsigned i)
+    {
+        log.info("Hello World! %s %d %f", 'A', i, 3.1415f);
+    }
+};
+
+struct small_record {
+    typedef reckless::policy_log<> log_t;
+    static char const* name() { return "small"; }
+    static void write(log_t& log, unsigned i)
+    {
+        log.write("%d", i);
+    }
+};
+
+template <class Record>
+void measure(reckless::input_queue_mode mode, std::size_t granularity,
+    unsigned thread_count)
+{
+    double best = 0;
+    std::size_t watermark = 0;
+    unsigned full_count = 0;
+    for(unsigned round=0; round!=ROUNDS; ++round) {
+        null_writer writer;
+        reckless::log_options options;
+        options.input_queue = mode;
+        options.input_buffer_capacity = 16*1024;
+        options.frame_granularity = granularity;
+        typename Record::log_t log(&writer, options);
+
+        std::vector<std::thread> threads;
+        std::vector<double> ns(thread_count, 0.0);
+        for(unsigned t=0; t!=thread_count; ++t) {
+            threads.emplace_back([&, t]
+            {
+                for(unsigned burst=0; burst!=BURSTS; ++burst) {
+                    auto start = std::chrono::steady_clock::now();
+                    for(unsigned i=0; i!=BURST_SIZE; ++i)
+                        Record::write(log, i);
+                    auto end = std::chrono::steady_clock::now();
+                    ns[t] += static_cast<double>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            end - start).count());
+                    log.flush();
+                }
+            });
+        }
+        double total = 0;
+        for(unsigned t=0; t!=thread_count; ++t) {
+            threads[t].join();
+            total += ns[t];
+        }
+        log.close();
+        total /= double(thread_count)*BURSTS*BURST_SIZE;
+        if(round == 0 || total < best) {
+            best = total;
+            watermark = log.input_buffer_high_watermark();
+            full_count = log.input_buffer_full_count();
+        }
+    }
+    std::printf("  %-10s %-10s %2u bytes %u threads %7.1f ns/call"
+        " %6u bytes high watermark %6u full\n", Record::name(),
+        mode == reckless::input_queue_mode::shared? "shared" : "per_thread",
+        static_cast<unsigned>(granularity), thread_count, best,
+        static_cast<unsigned>(watermark), full_count);
+}
+
+}   // anonymous namespace
+
+int main()
+{
+    for(auto mode : {reckless::input_queue_mode::shared,
+            reckless::input_queue_mode::per_thread})
+    {
+        for(unsigned threads : {1u, 4u}) {
+            for(std::size_t granularity : {64u, 16u, 8u})
+                measure<call_burst_record>(mode, granularity, threads);
+            for(std::size_t granularity : {64u, 16u, 8u})
+                measure<small_record>(mode, granularity, threads);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,597 @@
+// A frozen copy of the floating-point conversion in ntoa.cpp from before it
+// was rewritten to use integer arithmetic. It uses fxtract and long double
+// to produce an (approximate) 18-digit decimal mantissa. Only used by
+// float_format.cpp to compare against; don't fix bugs here.
+
+#include "ftoa_legacy.hpp"
+
+#include <reckless/ntoa.hpp>
+
+#include <algorithm>    // max, min
+#include <type_traits>  // make_unsigned, enable_if, is_unsigned
+#include <cassert>
+#include <cstring>      // memset, memcpy
+#include <cmath>        // lrint, llrint, frexp, modf, powl
+
+namespace legacy {
+namespace {
+
+using reckless::output_buffer;
+using reckless::conversion_specification;
+using reckless::UNSPECIFIED_PRECISION;
+namespace detail = reckless::detail;
+
+template <typename T>
+typename std::make_unsigned<T>::type unsigned_cast(T v)
+{
+    return static_cast<typename std::make_unsigned<T>::type>(v);
+}
+
+template <typename Unsigned>
+typename std::enable_if<std::is_unsigned<Unsigned>::value, unsigned>::type
+utoa_generic_base10_preallocated(char* str, unsigned pos, Unsigned value)
+{
+    using detail::decimal_digits;
+
+    if(value == 0)
+        return pos;
+    // FIXME is this right? What if value /= 100 yields 0 here? Do we get an
+    // additional unnecessary 0?
+    while(value >= 100) {
+        Unsigned remainder = value % 100;
+        value /= 100;
+        std::size_t offset = 2*static_cast<std::size_t>(remainder);
+        char d1 = decimal_digits[offset];
+        char d2 = decimal_digits[offset+1];
+        str[pos-1] = d2;
+        str[pos-2] = d1;
+        pos -= 2;
+    }
+    if(value < 10) {
+        --pos;
+        str[pos] = '0' + static_cast<char>(unsigned_cast(value));
+    } else {
+        std::size_t offset = static_cast<std::size_t>(2*value);
+        char d1 = decimal_digits[offset];
+        char d2 = decimal_digits[offset+1];
+        pos -= 2;
+        str[pos+1] = d2;
+        str[pos] = d1;
+    }
+    return pos;
+}
+
+template <typename Unsigned>
+typename std::enable_if<std::is_unsigned<Unsigned>::value, Unsigned>::type
+utoa_generic_base10_preallocated(char* str, unsigned pos, Unsigned value, unsigned digits)
+{
+    using detail::decimal_digits;
+
+    while(digits >= 2) {
+        Unsigned remainder = value % 100;
+        value /= 100;
+        std::size_t offset = 2*static_cast<std::size_t>(remainder);
+        char d1 = decimal_digits[offset];
+        char d2 = decimal_digits[offset+1];
+        str[pos-1] = d2;
+        str[pos-2] = d1;
+        pos -= 2;
+        digits -= 2;
+    }
+    if(digits == 1) {
+        --pos;
+        str[pos] = '0' + static_cast<char>(unsigned_cast(value % 10));
+        value /= 10;
+    }
+    return value;
+}
+
+#if defined(__GNUC__)
+template <typename Float>
+Float fxtract(Float v, Float* exp)
+{
+    Float significand;
+    asm("fxtract" : "=t"(significand), "=u"(*exp) : "0"(v));
+    return significand;
+}
+#elif defined(_MSC_VER)
+
+double fxtract(long double v, long double* exp)
+{
+    // So here's what you might think we can do.
+    //  long double significand;
+    //  long double exp;
+    //  __asm {
+    //      fld [v]
+    //      fxtract
+    //      fstp [exp]
+    //      fstp [significand]
+    //  }
+    //
+    // But MSVC does not support inline asm on x64, and don't have fxtract as
+    // an intrinsic, so we're kinda screwed. Additionally, they decided they
+    // don't need no 80-bit long double any longer, so we're even more screwed.
+    // I'm not sure how they expect anyone to be able to do this kind of stuff
+    // with the same quality and speed as e.g. gcc, but... their call. Instead
+    // we'll just extract the bits from the in-memory representation.
+
+    int iexp;
+    auto significand = std::frexp(v, &iexp);
+    *exp = iexp - 1;
+    return static_cast<double>(2*significand);
+
+    //std::uint16_t const* pv = reinterpret_cast<std::uint16_t const*>(&v);
+    //// Highest 16 bits is seeeeeee eeeemmmm. We want the e part which is the
+    //// exponent.
+    //unsigned exponent = pv[3];
+    //exponent = (exponent >> 4) & 0x7ff;
+    //*exp = static_cast<int>(exponent) - 1023;
+}
+
+#else
+static_assert(false, "fxtract is not implemented for this compiler")
+#endif
+
+template <typename Float>
+inline std::uint_fast64_t u64_rint(Float value)
+{
+    if(std::is_convertible<std::uint64_t, long>::value)
+        return static_cast<std::uint_fast64_t>(std::lrint(value));
+    else
+        return static_cast<std::uint_fast64_t>(std::llrint(value));
+}
+
+struct decimal18
+{
+    bool sign;
+    std::uint64_t mantissa;
+    int exponent;
+};
+
+decimal18 binary64_to_decimal18(double v)
+{
+    if(v == 0)
+        return {std::signbit(v), 0, 0};
+
+    long double e2;
+    long double m2 = fxtract(static_cast<long double>(v), &e2);
+
+    // We have
+    //   v = m2 * 2^e2  [1 <= m2 < 2] (1)
+    // and want a new representation
+    //   v = m10 * 10^e10  [1 <= m10 < 10].
+    //
+    // (1) can be rewritten as
+    //   m2 * 10^(C*e2)  [C = log(2)/log(10)] =
+    //   m2 * 10^(e10i + e10f)  [e10i = trunc(C*e2), e10f=frac(C*e2)] =
+    //   m2 * 10^e10i * 10^e10f.
+    //
+    // If m2 * 10^e10f turns out to be in the range [1, 10) then this gives us
+    // a value for m10 (and consequently for e10=C*e2i). But assuming e2f is a
+    // positive fraction, we have
+    //   0 <= e2f < 1
+    //   1 <= 10^e2f < 10.
+    //   1 <= m2 * 10^e2f < 20.
+    //
+    // We can adjust for m2 * 10^e2f >= 10 by dividing m2 by 10 and increasing
+    // e10 by one. Hence, with D = e2*log(2)/log(10) we have
+    //   m10 = m2 * 10^(frac(D))
+    //   e10 = trunc(D).
+    // when m2*10^(frac(D)) < 10, or
+    //   m10 = m2 * 10^(frac(D)) / 10
+    //   e10 = trunc(D) + 1.
+    // when m2*10^(frac(D)) >= 10, i.e. normalization requires at most a shift
+    // to the right by 1 digit.
+    //
+    // If e2f is a negative fraction we get
+    //   -1 < e2f <= 0
+    //   0.1 <= 10^e2f <= 1.
+    //   0.1 <= m2 * 10^e2f < 2.
+    // Note that this is the range obtained for a positive exponent except
+    // divided by 10. If we multiply this by 10 and subtract 1 from the
+    // exponent then we get the same situation as above, i.e.
+    //   1 <= 10 * m2 * 10^e2f < 20.
+
+    long double d = e2;
+    d *=  0.30102999566398119521L;
+    long double e10i;
+    long double e10f = std::modf(d, &e10i);
+    long double m10;
+    if(e2 < 0) {
+        e10f += 1;
+        e10i -= 1;
+    }
+
+    m10 = m2*powl(10, e10f + 16);
+    std::uint64_t mantissa = static_cast<std::uint64_t>(std::llrint(std::abs(m10)));
+    if(mantissa < 100000000000000000u)
+        mantissa *= 10;
+    else
+        e10i += 1.0L;
+    // TODO rounding of m10 might cause it to overflow, right?. We need to
+    // adjust again in that case. But try to reproduce this scenario first so
+    // we know it's needed.
+
+    return {std::signbit(v), mantissa, static_cast<int>(e10i)};
+}
+
+std::uint64_t rounded_divide(bool sign, std::uint64_t value, std::uint64_t divisor)
+{
+    if(!sign) {
+        // +divisor/2 to turn truncation into rounding.
+        return (value + divisor/2) / divisor;
+    } else {
+        // This is the same rounding as above but we must pretend that the
+        // value is negative and reproduce the corresponding behavior.
+        // Adding divisor-1 turns the flooring behavior of integer division
+        // into a ceiling behavior.
+        return (value + (divisor-1) - divisor/2) / divisor;
+    }
+}
+std::uint64_t rounded_rshift(bool sign, std::uint64_t value, unsigned digits)
+{
+    return rounded_divide(sign, value, detail::power_lut[digits]);
+}
+
+unsigned count_trailing_zeroes(decimal18 const& dv, unsigned truncated_digits)
+{
+    std::uint64_t mantissa = rounded_rshift(dv.sign, dv.mantissa, truncated_digits);
+    unsigned low = 0;
+    unsigned high = 18u-truncated_digits;
+    // Find the lowest x such that mantissa % 10^x != 0.
+    // Then the number of trailing zeroes is x-1.
+    while(low < high) {
+        unsigned pos = (low + high)/2;
+        if(mantissa % detail::power_lut[pos] == 0)
+            low = pos + 1;
+        else
+            high = pos;
+    }
+
+    return low-1;
+}
+
+unsigned count_trailing_zeroes_after_dot(decimal18 const& dv)
+{
+    // We need to get rid of the least significant digit because a double can't
+    // always represent a zero digit at that position.
+    // (e.g. 123.456 becomes 123.456000000000003).
+    std::uint64_t mantissa = rounded_divide(dv.sign, dv.mantissa, 10);
+    unsigned digits_before_dot = unsigned_cast(std::max(0, dv.exponent+1));
+    if(digits_before_dot>17) {
+        // All significant digits are in front of the dots. No trailing zeroes
+        return 0;
+    }
+    unsigned max_trailing_zeroes = unsigned_cast(17 - digits_before_dot);
+    unsigned low = 0;
+    unsigned high = max_trailing_zeroes+1;
+    // Find the lowest x such that mantissa % 10^x != 0.
+    // Then the number of trailing zeroes is x-1.
+    while(low < high) {
+        unsigned pos = (low + high)/2;
+        if(mantissa % detail::power_lut[pos] == 0)
+            low = pos + 1;
+        else
+            high = pos;
+    }
+
+    // +1 because we always treat the least significant digit (that we stripped
+    // at function entry) as if it were zero.
+    return low-1 + 1;
+}
+
+void write_special_category(output_buffer* pbuffer, double value, conversion_specification const& cs, char const* category)
+{
+    char sign = std::signbit(value)? '-' : cs.plus_sign;
+    unsigned content_size = 3 + (sign? 1 : 0);
+    unsigned size = std::max(content_size, cs.minimum_field_width);
+    unsigned padding = size - content_size;
+    char* str = pbuffer->reserve(size);
+    unsigned pos = 0;
+    if(cs.left_justify) {
+        if(sign)
+            str[pos++] = sign;
+        memcpy(str+pos, category, 3);
+        pos += 3;
+        std::memset(str+pos, ' ', padding);
+    } else {
+        std::memset(str, ' ', padding);
+        pos += padding;
+        if(sign)
+            str[pos++] = sign;
+        memcpy(str+pos, category, 3);
+    }
+    pbuffer->commit(size);
+}
+
+void write_nan(output_buffer* pbuffer, double value, conversion_specification const& cs)
+{
+    return write_special_category(pbuffer, value, cs, "nan");
+}
+
+void write_inf(output_buffer* pbuffer, double value, conversion_specification const& cs)
+{
+    return write_special_category(pbuffer, value, cs, "inf");
+}
+
+void ftoa_base10_f_normal(output_buffer* pbuffer, decimal18 dv, unsigned precision, conversion_specification const& cs)
+{
+    // [sign] [digits_before_dot] [zeroes_before_dot] [dot] [zeroes_after_dot] [digits_after_dot] [suffix_zeroes]
+    char sign = dv.sign? '-' : cs.plus_sign;
+    unsigned digits_before_dot;
+    unsigned zeroes_before_dot;
+    unsigned zeroes_after_dot;
+    unsigned digits_after_dot;
+
+    if(dv.exponent>=17) {
+        // All digits from the mantissa are on the left-hand side of the dot.
+        digits_before_dot = 18;
+        zeroes_before_dot = unsigned_cast(dv.exponent)+1 - 18;
+        zeroes_after_dot = precision;
+        digits_after_dot = 0;
+    } else if(dv.exponent < 0) {
+        // All digits from the mantissa are on the right-hand side of the dot.
+        // We set zeroes_before_dot=1 to generate a zero on the left-hand side,
+        // since this is what people expect and it's what stdio does.
+        digits_before_dot = 0;
+        zeroes_before_dot = 1;
+        zeroes_after_dot = std::min(unsigned_cast(-dv.exponent)-1, precision);
+        digits_after_dot = std::min(18u, precision - zeroes_after_dot);
+    } else {
+        // There are digits from the mantissa both on the left- and right-hand
+        // sides of the dot.
+        if(dv.mantissa == 0) {
+            // Special case for +-0: utoa_generic_base10_preallocated does not
+            // output any digits for a zero value, so we need to fake it in by
+            // using zeroes_before_dot instead.
+            digits_before_dot = 0;
+            zeroes_before_dot = 1;
+            zeroes_after_dot = 0;
+            digits_after_dot = 0;
+        } else {
+            digits_before_dot = unsigned_cast(dv.exponent+1);
+            zeroes_before_dot = 0;
+            zeroes_after_dot = 0;
+            digits_after_dot = std::min(18 - digits_before_dot, precision);
+        }
+    }
+    unsigned suffix_zeroes = precision - (zeroes_after_dot + digits_after_dot);
+
+    bool dot = cs.alternative_form
+        || (zeroes_after_dot + digits_after_dot + suffix_zeroes != 0);
+
+    // Reduce the mantissa part to the requested number of digits.
+    auto mantissa_digits = digits_before_dot + digits_after_dot;
+    std::uint64_t mantissa = rounded_rshift(dv.sign, dv.mantissa, 18-mantissa_digits);
+    auto order = detail::power_lut[mantissa_digits];
+    bool carry = mantissa >= order;
+    if(carry) {
+        // When reducing the mantissa, rounding caused it to overflow. For
+        // example, when formatting 0.095 with precision=2, we have
+        // zeroes_before_dot=1, zeroes_after_dot=1, mantissa_digits=1 and
+        // suffix_zeroes=0. When trying to reduce the mantissa to 1 digit we
+        // end up not with 9, but with 10 due to rounding. In this case we need
+        // to make room for an extra digit from the mantissa, which we'll take
+        // from zeroes_after_dot or by increasing digits_before_dot.
+        //
+        // Logically this can only happen if there are actual digits from the
+        // mantissa on the right-hand side of the dot. If all the digits are on
+        // the left-hand side then no reduction will take place, because only
+        // the number of fractional digits are user-controllable. So, if
+        // zeroes_before_dot is nonzero then that's only to generate a filler
+        // zero (see if clause above where dv.exponent < 0). If the overflow
+        // now produces a digit on the left-hand side of the dot then we must
+        // cancel out that zero by setting zeroes_before_dot=0.
+        if(zeroes_after_dot) {
+            --zeroes_after_dot;
+            ++digits_after_dot;
+        } else {
+            ++digits_before_dot;
+            zeroes_before_dot = 0;
+        }
+        ++mantissa_digits;
+    }
+
+    unsigned content_size = !!sign + digits_before_dot + zeroes_before_dot
+        + dot + zeroes_after_dot + digits_after_dot + suffix_zeroes;
+    unsigned size = std::max(cs.minimum_field_width, content_size);
+    unsigned padding = size - content_size;
+    unsigned pad_zeroes = 0;
+    if(cs.pad_with_zeroes && !cs.left_justify) {
+        pad_zeroes = padding;
+        padding = 0;
+    }
+
+    char* str = pbuffer->reserve(size);
+    unsigned pos = size;
+    if(cs.left_justify) {
+        pos -= padding;
+        std::memset(str+pos, ' ', padding);
+    }
+
+    if(dot) {
+        pos -= suffix_zeroes;
+        std::memset(str+pos, '0', suffix_zeroes);
+        mantissa = utoa_generic_base10_preallocated(str, pos, mantissa,
+                digits_after_dot);
+        pos -= digits_after_dot;
+
+        pos -= zeroes_after_dot;
+        std::memset(str+pos, '0', zeroes_after_dot);
+        str[--pos] = '.';
+    }
+
+    pos -= zeroes_before_dot;
+    std::memset(str+pos, '0', zeroes_before_dot);
+    pos = utoa_generic_base10_preallocated(str, pos, mantissa);
+    pos -= pad_zeroes;
+    std::memset(str+pos, '0', pad_zeroes);
+    if(sign)
+        str[--pos] = sign;
+
+    if(!cs.left_justify) {
+        pos -= padding;
+        std::memset(str+pos, ' ', padding);
+    }
+    pbuffer->commit(size);
+    assert(pos == 0);
+}
+
+void ftoa_base10_e_normal(output_buffer* pbuffer, decimal18 dv,
+        unsigned precision, conversion_specification const& cs)
+{
+    // We have either
+    // [sign] [digit] [dot] [digits_after_dot] [e] [exponent sign] [exponent_digits]
+    // or
+    // [padding] [sign] [zero_padding] [digit] [dot] [digits_after_dot] [e] [exponent sign] [exponent_digits]
+    // depending on if it's left-justified or not.
+
+    char exponent_sign;
+    unsigned exponent;
+    if(dv.exponent < 0) {
+        exponent_sign = '-';
+        exponent = unsigned_cast(-dv.exponent);
+    } else {
+        exponent_sign = '+';
+        exponent = unsigned_cast(dv.exponent);
+    }
+    unsigned digits_after_dot = precision;
+    int dot = digits_after_dot!=0 || cs.alternative_form;
+
+    int exponent_digits;
+    // Apparently stdio never prints less than two digits for the exponent,
+    // so we'll do the same to stay consistent. Maximum value of the exponent
+    // in a double is 308 so we won't get more than 3 digits.
+    if(exponent < 100)
+        exponent_digits = 2;
+    else
+        exponent_digits = 3;
+
+    char sign = dv.sign? '-' : cs.plus_sign;
+    unsigned content_size = !!sign + 1 + dot + digits_after_dot + 1 + 1 + exponent_digits;
+    unsigned size = std::max(cs.minimum_field_width, content_size);
+    unsigned padding = size - content_size;
+    unsigned pad_zeroes = 0;
+    if(cs.pad_with_zeroes && !cs.left_justify) {
+        pad_zeroes = padding;
+        padding = 0;
+    }
+
+    // Get rid of digits we don't want in the mantissa.
+    std::uint64_t mantissa = rounded_rshift(dv.sign, dv.mantissa,
+            18-(digits_after_dot+1));
+
+    char* str = pbuffer->reserve(size);
+
+    unsigned pos = size;
+    if(cs.left_justify) {
+        pos -= padding;
+        std::memset(str+pos, ' ', padding);
+    }
+
+    utoa_generic_base10_preallocated(str, pos, exponent, exponent_digits);
+    pos -= exponent_digits;
+    str[--pos] = exponent_sign;
+    str[--pos] = 'e';
+
+    mantissa = utoa_generic_base10_preallocated(str, pos, mantissa, digits_after_dot);
+    pos -= digits_after_dot;
+
+    if(dot)
+        str[--pos] = '.';
+
+    str[--pos] = '0' + static_cast<char>(mantissa);
+
+    pos -= pad_zeroes;
+    std::memset(str+pos, '0', pad_zeroes);
+    if(sign)
+        str[0] = sign;
+
+    if(!cs.left_justify) {
+        pos -= padding;
+        std::memset(str+pos, ' ', padding);
+    }
+    pbuffer->commit(size);
+}
+
+}   // anonymous namespace
+
+void ftoa_base10_f(output_buffer* pbuffer, double value, conversion_specification const& cs)
+{
+    // TODO measure if these prefetches help
+    //prefetch_digits();
+    //prefetch_power_lut();
+    auto category = std::fpclassify(value);
+    if(category == FP_NAN) {
+        return write_nan(pbuffer, value, cs);
+    } else if(category == FP_INFINITE) {
+        return write_inf(pbuffer, value, cs);
+    } else {
+        decimal18 dv = binary64_to_decimal18(value);
+        int p = cs.precision == UNSPECIFIED_PRECISION? 6 : cs.precision;
+        return ftoa_base10_f_normal(pbuffer, dv, p, cs);
+    }
+}
+
+void ftoa_base10_g(output_buffer* pbuffer, double value, conversion_specification const& cs)
+{
+    // The idea of %g is that the precision says how many significant digits we
+    // want in the string representation. If the number of significant digits is
+    // not enough to represent all the digits up to the dot (i.e. it is higher than
+    // the number's exponent), then %e notation is used instead.
+    //
+    // A special feature of %g which is not present in %e and %f is that if there
+    // are trailing zeroes in the fraction then those will be removed, unless
+    // alternative mode is requested. Alternative mode also means that the period
+    // stays, no matter if there are any fractional decimals remaining or
+    // not.
+    //prefetch_digits();
+    //prefetch_power_lut();
+    auto category = std::fpclassify(value);
+    if(category == FP_NAN) {
+        return write_nan(pbuffer, value, cs);
+    } else if(category == FP_INFINITE) {
+        return write_inf(pbuffer, value, cs);
+    } else {
+        int const minimum_exponent = -4;
+        decimal18 dv = binary64_to_decimal18(value);
+
+        int p;
+        if(cs.precision == UNSPECIFIED_PRECISION)
+            p = 6;
+        else if(cs.precision == 0)
+            p = 1;
+        else {
+            p = cs.precision;
+            if(!cs.alternative_form) {
+                // We are supposed to remove trailing zeroes, so we can't ever
+                // get more than 18 digits because the rest will be zero
+                // anyway, as this is the number of digits in the mantissa.
+                p = std::min(p, 18);
+            }
+        }
+        unsigned truncated_digits = 18 - p;
+
+        if(p > dv.exponent && dv.exponent >= minimum_exponent) {
+            unsigned trailing_zeroes = 0;
+            if(!cs.alternative_form) {
+                trailing_zeroes = count_trailing_zeroes_after_dot(dv);
+                if(trailing_zeroes > truncated_digits)
+                    trailing_zeroes -= truncated_digits;
+                else
+                    trailing_zeroes = 0;
+            }
+            p = p - 1 - dv.exponent - trailing_zeroes;
+            p = std::max(0, p);
+            return ftoa_base10_f_normal(pbuffer, dv, p, cs);
+        } else {
+            unsigned trailing_zeroes = 0;
+            if(!cs.alternative_form)
+                trailing_zeroes = count_trailing_zeroes(dv, truncated_digits);
+            p = p - 1 - trailing_zeroes;
+            return ftoa_base10_e_normal(pbuffer, dv, p, cs);
+        }
+    }
+}
+
+}   // namespace legacy
@@ -0,0 +1,15 @@
+#ifndef FTOA_LEGACY_HPP
+#define FTOA_LEGACY_HPP
+
+#include <reckless/ntoa.hpp>
+
+namespace legacy {
+
+void ftoa_base10_f(reckless::output_buffer* pbuffer, double value,
+    reckless::conversion_specification const& cs);
+void ftoa_base10_g(reckless::output_buffer* pbuffer, double value,
+    reckless::conversion_specification const& cs);
+
+}   // namespace legacy
+
+#endif  // FTOA_LEGACY_HPP
@@ -0,0 +1,123 @@
+// Measures the cost per call of converting an integer to text with %d and
+// %x, which dominates formatting for records full of order ids, sequence
+// numbers and counters. Compares itoa_base10/itoa_base16 in ntoa.cpp with
+// snprintf for a few ranges of values.
+
+#include <reckless/ntoa.hpp>
+#include <reckless/writer.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+class null_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count, std::error_code& ec) noexcept override
+    {
+        ec.clear();
+        return count;
+    }
+};
+
+class benchmark_buffer : public reckless::output_buffer {
+public:
+    benchmark_buffer(reckless::writer* pwriter) :
+        output_buffer(pwriter, 1024*1024)
+    {
+    }
+
+    void flush()
+    {
+        frame_end();
+        output_buffer::flush();
+    }
+};
+
+null_writer g_writer;
+benchmark_buffer g_buffer(&g_writer);
+std::size_t const BATCH_SIZE = 1000;
+
+template <class Convert>
+void measure(char const* name, std::vector<unsigned long long> const& values,
+    Convert convert)
+{
+    unsigned const ROUNDS = 5;
+    double best = 0;
+    for(unsigned round=0; round!=ROUNDS; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for(std::size_t i=0; i!=values.size(); ++i) {
+            convert(values[i]);
+            if(i % BATCH_SIZE == BATCH_SIZE-1)
+                g_buffer.flush();
+        }
+        g_buffer.flush();
+        auto end = std::chrono::steady_clock::now();
+        double ns = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                end - start).count())/values.size();
+        if(round == 0 || ns < best)
+            best = ns;
+    }
+    std::printf("  %-24s %8.1f ns/value\n", name, best);
+}
+
+void measure_snprintf(char const* name,
+    std::vector<unsigned long long> const& values, char const* format)
+{
+    measure(name, values, [&](unsigned long long v) {
+        char* p = g_buffer.reserve(32);
+        int n = std::snprintf(p, 32, format, v);
+        g_buffer.commit(static_cast<std::size_t>(n));
+    });
+}
+
+void run(char const* title, std::vector<unsigned long long> const& values)
+{
+    std::printf("%s\n", title);
+    reckless::conversion_specification cs;
+    measure("%d", values, [&](unsigned long long v) {
+        reckless::itoa_base10(&g_buffer, v, cs);
+    });
+    measure_snprintf("%d snprintf", values, "%llu");
+    measure("%x", values, [&](unsigned long long v) {
+        reckless::itoa_base16(&g_buffer, v, cs);
+    });
+    measure_snprintf("%x snprintf", values, "%llx");
+}
+
+}   // anonymous namespace
+
+int main()
+{
+    std::size_t const COUNT = 1000000;
+    std::mt19937_64 rng;
+
+    // Small counters such as retry counts and queue depths.
+    std::vector<unsigned long long> small(COUNT);
+    for(auto& v : small)
+        v = rng() % 1000;
+    run("small (0-999)", small);
+
+    // Order ids and sequence numbers.
+    std::vector<unsigned long long> ids(COUNT);
+    for(auto& v : ids)
+        v = 1000000000 + rng() % 9000000000;
+    run("ids (10 digits)", ids);
+
+    // Hashes, addresses and the like.
+    std::vector<unsigned long long> full(COUNT);
+    for(auto& v : full)
+        v = rng();
+    run("full 64-bit range", full);
+
+    // Every bit length equally likely.
+    std::vector<unsigned long long> mixed(COUNT);
+    for(auto& v : mixed)
+        v = rng() >> (rng() % 64);
+    run("mixed bit lengths", mixed);
+    return 0;
+}
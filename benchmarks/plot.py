@@ -5,7 +5,7 @@ from getopt import gnu_getopt
 import os.path
 from math import pi, sqrt, exp
 
-ALL_LIBS = ['nop', 'reckless', 'stdio', 'fstream', 'boost_log', 'spdlog', 'g3log']
+ALL_LIBS = ['nop', 'reckless', 'reckless_per_thread', 'reckless_async', 'reckless_binary', 'reckless_fmt', 'stdio', 'fstream', 'boost_log', 'spdlog', 'g3log']
 ALL_TESTS = ['periodic_calls', 'call_burst', 'write_files'] #, 'mandelbrot']
 
 THREADED_TESTS = {'call_burst', 'mandelbrot'}
@@ -19,6 +19,10 @@ COLORS = [
     '#66a61e',
     '#e6ab02',
     '#a6761d',
+    '#666666',
+    '#1f78b4',
+    '#b2df8a',
+    '#fb9a99',
 ]
 
 def get_rdtsc_frequency():
@@ -44,6 +48,10 @@ def pretty_name(name):
             'stdio': 'fprintf (C)',
             'fstream': 'std::fstream (C++)',
             'reckless': 'reckless',
+            'reckless_per_thread': 'reckless (per-thread input)',
+            'reckless_async': 'reckless (asynchronous writer)',
+            'reckless_binary': 'reckless (binary_log)',
+            'reckless_fmt': 'reckless (RECKLESS_FMT)',
             'periodic_calls': 'periodic calls',
             'call_burst': 'single call burst',
             'write_files': 'heavy disk I/O',
@@ -60,7 +68,11 @@ def lib_color(name):
             'stdio': COLORS[1],
             'fstream': COLORS[4],
             'boost_log': COLORS[5],
-            'g3log': COLORS[6]
+            'g3log': COLORS[6],
+            'reckless_per_thread': COLORS[7],
+            'reckless_async': COLORS[8],
+            'reckless_binary': COLORS[9],
+            'reckless_fmt': COLORS[10]
             }
     return color_table[name]
 
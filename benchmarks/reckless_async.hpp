@@ -0,0 +1,45 @@
+#include <reckless/severity_log.hpp>
+#include <reckless/file_writer.hpp>
+#include <reckless/aio_writer.hpp>
+#if defined(__linux__)
+#include <reckless/io_uring_writer.hpp>
+#endif
+
+#include <memory>
+
+#ifdef LOG_ONLY_DECLARE
+extern reckless::severity_log<reckless::no_indent, ' ', reckless::severity_field, reckless::timestamp_field> g_log;
+#else
+       reckless::severity_log<reckless::no_indent, ' ', reckless::severity_field, reckless::timestamp_field> g_log;
+#endif
+
+// Same as reckless.hpp, but the output worker hands its writes off to
+// io_uring, or to a helper thread if io_uring isn't available.
+inline std::unique_ptr<reckless::writer> make_async_writer(
+    reckless::file_writer* pfile_writer)
+{
+#if defined(__linux__)
+    try {
+        return std::unique_ptr<reckless::writer>(
+            new reckless::io_uring_writer("log.txt"));
+    } catch(std::system_error const&) {
+    }
+#endif
+    return std::unique_ptr<reckless::writer>(
+        new reckless::aio_writer(pfile_writer));
+}
+
+#define LOG_INIT(queue_size) \
+    reckless::file_writer file_writer("log.txt"); \
+    auto pwriter = make_async_writer(&file_writer); \
+    g_log.open(pwriter.get(), 64*queue_size, 64*queue_size);
+
+#define LOG_CLEANUP() g_log.close()
+
+#define LOG( c, i, f ) g_log.info("Hello World! %s %d %f", c, i, f)
+
+#define LOG_FILE_WRITE(FileNumber, Percent) \
+    g_log.info("file %d (%f%%)", FileNumber, Percent)
+
+#define LOG_MANDELBROT(Thread, X, Y, FloatX, FloatY, Iterations) \
+    g_log.info("[T%d] %d,%d/%f,%f: %d iterations", Thread, X, Y, FloatX, FloatY, Iterations)
@@ -0,0 +1,24 @@
+#include <reckless/binary_log.hpp>
+#include <reckless/file_writer.hpp>
+
+#ifdef LOG_ONLY_DECLARE
+extern reckless::binary_log g_log;
+#else
+       reckless::binary_log g_log;
+#endif
+
+// Same as reckless.hpp, but with binary_log. Nothing is formatted; the
+// output is a binary file that has to be run through reckless-decode.
+#define LOG_INIT(queue_size) \
+    reckless::file_writer writer("log.txt"); \
+    g_log.open(&writer, 64*queue_size, 64*queue_size);
+
+#define LOG_CLEANUP() g_log.close()
+
+#define LOG( c, i, f ) g_log.write("Hello World! %s %d %f", c, i, f)
+
+#define LOG_FILE_WRITE(FileNumber, Percent) \
+    g_log.write("file %d (%f%%)", FileNumber, Percent)
+
+#define LOG_MANDELBROT(Thread, X, Y, FloatX, FloatY, Iterations) \
+    g_log.write("[T%d] %d,%d/%f,%f: %d iterations", Thread, X, Y, FloatX, FloatY, Iterations)
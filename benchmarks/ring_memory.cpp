@@ -0,0 +1,72 @@
+// Measures what log_options::input_buffer_huge_pages and input_buffer_locked
+// do for a large input buffer. For each combination we time how long it
+// takes to map and prefault the buffer, which is what basic_log::open pays,
+// and then the cost per record of pushing 64-byte records through it while
+// reading them back half a buffer behind, like a producer running ahead of
+// the output worker. The two positions are far apart, so with ordinary pages
+// both of them keep missing the TLB.
+//
+// Huge pages have to be reserved first for them to make a difference, e.g.
+// sysctl vm.nr_hugepages=300 for the default 256 MiB buffer. The flags that
+// actually took effect are printed with the result.
+
+#include <reckless/basic_log.hpp>   // mpsc_ring_buffer
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>  // atoi
+
+namespace {
+
+std::size_t const RECORD_SIZE = 64;
+unsigned const LAPS = 4;
+
+void run(std::size_t capacity, unsigned flags)
+{
+    using namespace reckless::detail;
+    auto start = std::chrono::steady_clock::now();
+    mpsc_ring_buffer buffer(capacity, flags);
+    auto mapped = std::chrono::steady_clock::now();
+
+    std::uint64_t const count = LAPS*capacity/RECORD_SIZE;
+    std::uint64_t const lag = capacity/2/RECORD_SIZE;
+    std::uint64_t sum = 0;
+    for(std::uint64_t i=0; i!=count; ++i) {
+        auto p = static_cast<std::uint64_t*>(buffer.push(RECORD_SIZE));
+        p[0] = i;
+        p[7] = i;
+        if(i >= lag) {
+            auto pfront = static_cast<std::uint64_t*>(buffer.front());
+            sum += pfront[0] + pfront[7];
+            buffer.pop_release(RECORD_SIZE);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double map_ms = std::chrono::duration_cast<std::chrono::microseconds>(
+        mapped - start).count()/1000.0;
+    double ns = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end - mapped).count())/count;
+    unsigned actual = buffer.memory_flags();
+    std::printf("  %-12s %-8s %8.1f ms to map %6.2f ns/record%s\n",
+        (actual & ring_memory_huge_pages)? "huge pages" : "small pages",
+        (actual & ring_memory_locked)? "locked" : "",
+        map_ms, ns, sum == 0? " (?)" : "");
+}
+
+}   // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    using namespace reckless::detail;
+    std::size_t megabytes = argc > 1? std::atoi(argv[1]) : 256;
+    std::printf("%u MiB input buffer\n", static_cast<unsigned>(megabytes));
+    std::size_t capacity = round_ring_capacity(megabytes*1024*1024);
+    run(capacity, 0);
+    run(capacity, ring_memory_locked);
+    run(capacity, ring_memory_huge_pages);
+    run(capacity, ring_memory_huge_pages | ring_memory_locked);
+    return 0;
+}
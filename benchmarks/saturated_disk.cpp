@@ -0,0 +1,64 @@
+// Measures log throughput when the writer cannot keep up and keeps returning
+// short writes, as happens with a saturated disk or a full pipe. Every other
+// call to the writer only accepts half of the data and reports a temporary
+// failure; the retry that follows succeeds. The output buffer is left with a
+// large unwritten tail after each short write, which used to be moved to the
+// front of the buffer before the next attempt.
+//
+// Run with a record size argument to see how the cost scales, e.g.
+//   ./saturated_disk 100
+//   ./saturated_disk 1000
+
+#include <reckless/policy_log.hpp>
+#include <reckless/writer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+class saturated_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count,
+            std::error_code& ec) noexcept override
+    {
+        ++calls;
+        if(calls % 2 == 0 || count < 2) {
+            ec.clear();
+            bytes += count;
+            return count;
+        }
+        ec = make_error_code(temporary_failure);
+        bytes += count/2;
+        return count/2;
+    }
+
+    unsigned long calls = 0;
+    unsigned long long bytes = 0;
+};
+
+int main(int argc, char* argv[])
+{
+    std::size_t record_size = argc > 1? std::atoi(argv[1]) : 100;
+    unsigned const record_count = 2000000;
+
+    saturated_writer writer;
+    std::string payload(record_size, 'x');
+    auto start = std::chrono::steady_clock::now();
+    {
+        reckless::log_options options;
+        options.output_buffer_capacity = 1024*1024;
+        reckless::policy_log<> log(&writer, options);
+        log.temporary_error_policy(reckless::error_policy::block);
+        for(unsigned i=0; i!=record_count; ++i)
+            log.write("%d %s", i, payload);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+        end - start).count()/1e6;
+    std::printf("%u records of %u bytes in %.3f s: %.1f MiB/s, %lu writer calls\n",
+        record_count, static_cast<unsigned>(record_size), seconds,
+        writer.bytes/seconds/(1024*1024), writer.calls);
+    return 0;
+}
@@ -5,7 +5,7 @@ from sys import argv, stderr, stdout
 from getopt import gnu_getopt
 import numpy as np
 
-ALL_LIBS = ['nop', 'reckless', 'stdio', 'fstream', 'boost_log', 'spdlog', 'g3log']
+ALL_LIBS = ['nop', 'reckless', 'reckless_per_thread', 'reckless_async', 'reckless_binary', 'reckless_fmt', 'stdio', 'fstream', 'boost_log', 'spdlog', 'g3log']
 ALL_TESTS = ['periodic_calls', 'call_burst', 'write_files', 'mandelbrot']
 THREADED_TESTS = {'call_burst', 'mandelbrot'}
 
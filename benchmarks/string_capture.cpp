@@ -0,0 +1,145 @@
+// Compares writing string arguments with and without
+// log_options::inline_strings. Counts heap allocations and frees per record,
+// on the writing thread and in total (the output worker frees what the
+// writing thread allocated), and measures the cost per call.
+//
+// Records are formatted to a writer that discards them. Each burst is
+// flushed before the next, so the input buffer never fills up.
+
+#include <reckless/policy_log.hpp>
+#include <reckless/writer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>  // malloc, free
+#include <cstring>  // memset
+#include <new>
+#include <string>
+
+namespace {
+std::atomic<unsigned long> g_allocations(0);
+std::atomic<unsigned long> g_frees(0);
+thread_local unsigned long g_thread_allocations = 0;
+}
+
+void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    ++g_thread_allocations;
+    if(void* p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    if(p)
+        g_frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+namespace {
+
+class null_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count, std::error_code& ec) noexcept override
+    {
+        ec.clear();
+        return count;
+    }
+};
+
+unsigned const BURSTS = 1000;
+unsigned const BURST_SIZE = 200;
+unsigned const ROUNDS = 5;
+
+std::string const g_short_string = "short";
+std::string const g_long_string(64, 'x');
+char g_array[64];
+
+struct short_string {
+    static char const* name() { return "std::string, 5 chars"; }
+    static void write(reckless::policy_log<>& log, unsigned i)
+    {
+        log.write("%s %d", g_short_string, i);
+    }
+};
+
+struct long_string {
+    static char const* name() { return "std::string, 64 chars"; }
+    static void write(reckless::policy_log<>& log, unsigned i)
+    {
+        log.write("%s %d", g_long_string, i);
+    }
+};
+
+struct char_array {
+    static char const* name() { return "char[64], 63 chars"; }
+    static void write(reckless::policy_log<>& log, unsigned i)
+    {
+        log.write("%s %d", g_array, i);
+    }
+};
+
+template <class Record>
+void measure(bool inline_strings)
+{
+    double best = 0;
+    double thread_allocations = 0;
+    double allocations = 0;
+    double frees = 0;
+    for(unsigned round=0; round!=ROUNDS; ++round) {
+        null_writer writer;
+        reckless::log_options options;
+        options.inline_strings = inline_strings;
+        reckless::policy_log<> log(&writer, options);
+        log.flush();
+
+        double ns = 0;
+        unsigned long thread_start = g_thread_allocations;
+        unsigned long allocations_start = g_allocations;
+        unsigned long frees_start = g_frees;
+        for(unsigned burst=0; burst!=BURSTS; ++burst) {
+            auto start = std::chrono::steady_clock::now();
+            for(unsigned i=0; i!=BURST_SIZE; ++i)
+                Record::write(log, i);
+            auto end = std::chrono::steady_clock::now();
+            ns += static_cast<double>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    end - start).count());
+            log.flush();
+        }
+        double const count = double(BURSTS)*BURST_SIZE;
+        ns /= count;
+        if(round == 0 || ns < best) {
+            best = ns;
+            thread_allocations = (g_thread_allocations - thread_start)/count;
+            allocations = (g_allocations - allocations_start)/count;
+            frees = (g_frees - frees_start)/count;
+        }
+        log.close();
+    }
+    std::printf("  %-22s %-7s %6.1f ns/call %5.2f allocations/record"
+        " (%.2f on writing thread) %5.2f frees/record\n", Record::name(),
+        inline_strings? "inline" : "copy", best, allocations,
+        thread_allocations, frees);
+}
+
+}   // anonymous namespace
+
+int main()
+{
+    std::memset(g_array, 'a', sizeof(g_array) - 1);
+    for(bool inline_strings : {false, true}) {
+        measure<short_string>(inline_strings);
+        measure<long_string>(inline_strings);
+        measure<char_array>(inline_strings);
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+// Measures the cost per record of formatting the timestamp header field on
+// the output worker. Compares the timestamp_field styles, which render the
+// date and time once per second and then only the fraction, with the old
+// approach of calling localtime_r for every record.
+//
+// The fields are captured up front, 1M records spread evenly over a given
+// number of seconds, so that only the formatting is measured. Separately,
+// measures what it costs the producer to capture the time for
+// timestamp_field and tsc_timestamp_field, and what it costs the worker to
+// format the latter.
+
+#include <reckless/timestamp_field.hpp>
+#include <reckless/tsc_timestamp_field.hpp>
+#include <reckless/writer.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+namespace {
+
+class null_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count, std::error_code& ec) noexcept override
+    {
+        ec.clear();
+        return count;
+    }
+};
+
+class benchmark_buffer : public reckless::output_buffer {
+public:
+    benchmark_buffer(reckless::writer* pwriter) :
+        output_buffer(pwriter, 1024*1024)
+    {
+    }
+
+    void flush()
+    {
+        frame_end();
+        output_buffer::flush();
+    }
+};
+
+null_writer g_writer;
+benchmark_buffer g_buffer(&g_writer);
+std::size_t const BATCH_SIZE = 1000;
+
+// What timestamp_field::format used to do.
+class legacy_timestamp_field {
+public:
+    legacy_timestamp_field(std::int64_t seconds, unsigned nanoseconds)
+    {
+        ts_.tv_sec = static_cast<time_t>(seconds);
+        ts_.tv_nsec = static_cast<long>(nanoseconds);
+    }
+
+    bool format(reckless::output_buffer* pbuffer)
+    {
+        struct tm tm;
+        localtime_r(&ts_.tv_sec, &tm);
+        unsigned year = static_cast<unsigned>(tm.tm_year + 1900);
+        unsigned milliseconds = static_cast<unsigned>(ts_.tv_nsec/1000000);
+        char* p = pbuffer->reserve(23);
+        write_digit_pair(p, year/100);
+        write_digit_pair(p + 2, year%100);
+        p[4] = '-';
+        write_digit_pair(p + 5, static_cast<unsigned>(tm.tm_mon + 1));
+        p[7] = '-';
+        write_digit_pair(p + 8, static_cast<unsigned>(tm.tm_mday));
+        p[10] = ' ';
+        write_digit_pair(p + 11, static_cast<unsigned>(tm.tm_hour));
+        p[13] = ':';
+        write_digit_pair(p + 14, static_cast<unsigned>(tm.tm_min));
+        p[16] = ':';
+        write_digit_pair(p + 17, static_cast<unsigned>(tm.tm_sec));
+        p[19] = '.';
+        write_digit_pair(p + 20, milliseconds/10);
+        p[22] = reckless::detail::decimal_digits[2*(milliseconds%10)+1];
+        pbuffer->commit(23);
+        return true;
+    }
+
+private:
+    static void write_digit_pair(char* ptarget, unsigned digits)
+    {
+        ptarget[0] = reckless::detail::decimal_digits[2*digits];
+        ptarget[1] = reckless::detail::decimal_digits[2*digits+1];
+    }
+
+    struct timespec ts_;
+};
+
+std::size_t const COUNT = 1000000;
+unsigned const ROUNDS = 5;
+
+template <class Field>
+void measure_format(char const* name, std::vector<Field>& fields)
+{
+    double best = 0;
+    for(unsigned round=0; round!=ROUNDS; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for(std::size_t i=0; i!=fields.size(); ++i) {
+            fields[i].format(&g_buffer);
+            if(i % BATCH_SIZE == BATCH_SIZE-1)
+                g_buffer.flush();
+        }
+        g_buffer.flush();
+        auto end = std::chrono::steady_clock::now();
+        double ns = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                end - start).count())/fields.size();
+        if(round == 0 || ns < best)
+            best = ns;
+    }
+    std::printf("  %-24s %8.1f ns/record\n", name, best);
+}
+
+template <class Field>
+void measure(char const* name, unsigned seconds)
+{
+    std::int64_t const start_second = std::time(nullptr);
+    std::uint64_t const span = std::uint64_t(1000000000)*seconds;
+    std::vector<Field> fields;
+    fields.reserve(COUNT);
+    for(std::size_t i=0; i!=COUNT; ++i) {
+        std::uint64_t ns = span*i/COUNT;
+        fields.emplace_back(start_second + static_cast<std::int64_t>(ns/1000000000),
+            static_cast<unsigned>(ns%1000000000));
+    }
+    measure_format(name, fields);
+}
+
+// Time how long it takes to construct the fields, which is what the producer
+// pays in policy_log::write, then how long it takes to format them.
+template <class Field>
+void measure_capture(char const* name)
+{
+    std::vector<Field> fields;
+    double best = 0;
+    for(unsigned round=0; round!=ROUNDS; ++round) {
+        fields.clear();
+        fields.reserve(COUNT);
+        auto start = std::chrono::steady_clock::now();
+        for(std::size_t i=0; i!=COUNT; ++i)
+            fields.emplace_back();
+        auto end = std::chrono::steady_clock::now();
+        double ns = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                end - start).count())/COUNT;
+        if(round == 0 || ns < best)
+            best = ns;
+    }
+    std::printf("  %-24s %8.1f ns/record to capture\n", name, best);
+    measure_format(name, fields);
+}
+
+void run(unsigned seconds)
+{
+    using namespace reckless;
+    std::printf("1M records over %u seconds\n", seconds);
+    measure<legacy_timestamp_field>("legacy localtime_r", seconds);
+    measure<timestamp_field>("local, ms", seconds);
+    measure<basic_timestamp_field<timestamp_style::local, 6>>("local, us", seconds);
+    measure<basic_timestamp_field<timestamp_style::local, 9>>("local, ns", seconds);
+    measure<basic_timestamp_field<timestamp_style::utc, 3>>("utc, ms", seconds);
+    measure<basic_timestamp_field<timestamp_style::iso8601_local, 6>>("iso8601 local, us", seconds);
+    measure<basic_timestamp_field<timestamp_style::iso8601_utc, 9>>("iso8601 utc, ns", seconds);
+}
+
+}   // anonymous namespace
+
+int main()
+{
+    // A busy log with many records per second, a moderately busy one, and
+    // the worst case where every record has a new second.
+    run(1);
+    run(1000);
+    run(1000000);
+
+    using namespace reckless;
+    std::printf("1M records captured now (%s)\n",
+        detail::tsc_is_reliable? "TSC is reliable" : "TSC is not reliable");
+    measure_capture<timestamp_field>("timestamp_field");
+    measure_capture<basic_timestamp_field<timestamp_style::local, 9>>(
+        "timestamp_field, ns");
+    measure_capture<tsc_timestamp_field>("tsc_timestamp_field");
+    return 0;
+}
@@ -0,0 +1,41 @@
+// Measures the cost of signaling the events that are used to wake up the
+// output worker and blocked writer threads, when nobody is actually waiting
+// on them. This is the common case: flush(), close(), and writers that find
+// the input buffer full all signal the worker, which is usually busy rather
+// than asleep. When no waiter is registered the wake-up system call is
+// skipped, so the numbers here should be on the order of an atomic
+// operation rather than a system call.
+//
+// The wakeup_syscalls benchmark shows the effect on the number of system
+// calls in workloads like periodic_calls and call_burst.
+
+#include <reckless/detail/spsc_event.hpp>
+#include <reckless/detail/lockless_cv.hpp>
+
+#include <chrono>
+#include <cstdio>
+
+int const ITERATIONS = 10000000;
+
+template <class Function>
+void measure(char const* name, Function f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(int i=0; i!=ITERATIONS; ++i)
+        f();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count();
+    std::printf("%-28s %8.1f ns/call %12.0f calls/s\n", name,
+        ns/ITERATIONS, 1e9*ITERATIONS/ns);
+}
+
+int main()
+{
+    reckless::detail::spsc_event event;
+    reckless::detail::lockless_cv cv;
+
+    measure("spsc_event::signal", [&]() { event.signal(); });
+    measure("lockless_cv::notify_all", [&]() { cv.notify_all(); });
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Counts the futex system calls that reckless makes in workloads modeled on
+// the periodic_calls and call_burst benchmarks, split into wake-ups and
+// waits. Wake-ups that nobody was waiting for are the ones that skipping
+// signals without waiters gets rid of, so compare the numbers with those
+// from a build before that change. The count comes from interposing
+// syscall(), which is what the library uses for futexes, so this only works
+// on Linux.
+//
+// Usage: wakeup_syscalls [burst threads]
+
+#include <reckless/severity_log.hpp>
+#include <reckless/file_writer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>  // atoi
+#include <thread>
+#include <vector>
+
+#include <dlfcn.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+std::atomic<unsigned> g_futex_wakes(0);
+std::atomic<unsigned> g_futex_waits(0);
+}
+
+extern "C" long syscall(long number, ...)
+{
+    typedef long (*syscall_t)(long, ...);
+    static syscall_t const real_syscall = reinterpret_cast<syscall_t>(
+        dlsym(RTLD_NEXT, "syscall"));
+    va_list ap;
+    va_start(ap, number);
+    long args[6];
+    for(auto& arg : args)
+        arg = va_arg(ap, long);
+    va_end(ap);
+    if(number == SYS_futex) {
+        int op = static_cast<int>(args[1]) & FUTEX_CMD_MASK;
+        if(op == FUTEX_WAKE)
+            ++g_futex_wakes;
+        else if(op == FUTEX_WAIT)
+            ++g_futex_waits;
+    }
+    return real_syscall(number, args[0], args[1], args[2], args[3], args[4],
+        args[5]);
+}
+
+namespace {
+
+typedef reckless::severity_log<reckless::no_indent, ' ',
+    reckless::severity_field, reckless::timestamp_field> log_t;
+
+char c = 'A';
+float pi = 3.1415f;
+
+void report(char const* name, unsigned records)
+{
+    std::printf("%-16s %8u records %8u futex wakes %8u futex waits\n", name,
+        records, g_futex_wakes.exchange(0), g_futex_waits.exchange(0));
+}
+
+// One record every other millisecond, as in periodic_calls.
+void periodic_calls()
+{
+    unsigned const records = 1000;
+    {
+        reckless::file_writer writer("log.txt");
+        log_t log(&writer, 64*6000, 64*6000);
+        g_futex_wakes = 0;
+        g_futex_waits = 0;
+        for(unsigned i=0; i!=records; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            auto busywait_end = std::chrono::steady_clock::now()
+                + std::chrono::milliseconds(1);
+            while(std::chrono::steady_clock::now() < busywait_end)
+                ;
+            log.info("Hello World! %s %d %f", c, i, pi);
+        }
+    }
+    report("periodic_calls", records);
+}
+
+// Bursts from several threads into a small input buffer, as in call_burst.
+void call_burst(unsigned thread_count)
+{
+    unsigned const records_per_thread = 100000;
+    {
+        reckless::file_writer writer("log.txt");
+        log_t log(&writer, 64*128, 64*128);
+        g_futex_wakes = 0;
+        g_futex_waits = 0;
+        std::vector<std::thread> threads;
+        for(unsigned t=0; t!=thread_count; ++t) {
+            threads.emplace_back([&log]() {
+                for(unsigned i=0; i!=records_per_thread; ++i)
+                    log.info("Hello World! %s %d %f", c, i, pi);
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "call_burst-%u", thread_count);
+    report(name, thread_count*records_per_thread);
+}
+
+}   // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    unsigned max_threads = argc > 1? static_cast<unsigned>(std::atoi(argv[1]))
+        : 4;
+    unlink("log.txt");
+    periodic_calls();
+    for(unsigned threads=1; threads<=max_threads; threads*=2)
+        call_burst(threads);
+    unlink("log.txt");
+    return 0;
+}
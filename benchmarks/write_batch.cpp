@@ -0,0 +1,91 @@
+// Measures the time it takes writing threads to push bursts of records, one
+// record at a time and with write_batch. Every thread writes bursts of
+// BURST_SIZE records, and the input buffer is large enough to hold all of
+// them, so that only the producer side is measured. The writer throws the
+// output away.
+//
+// Usage: write_batch [threads]
+
+#include <reckless/policy_log.hpp>
+#include <reckless/writer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>  // atoi
+#include <thread>
+#include <vector>
+
+namespace {
+
+class null_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count, std::error_code& ec) noexcept override
+    {
+        ec.clear();
+        return count;
+    }
+};
+
+unsigned const RECORDS_PER_THREAD = 1000000;
+unsigned const BURST_SIZE = 64;
+unsigned const ROUNDS = 5;
+
+double run(unsigned thread_count, bool batch)
+{
+    null_writer writer;
+    reckless::log_options options;
+    options.input_buffer_capacity = 256*1024*1024;
+    reckless::policy_log<> log(&writer, options);
+
+    std::vector<double> ns(thread_count);
+    std::vector<std::thread> threads;
+    for(unsigned t=0; t!=thread_count; ++t) {
+        threads.emplace_back([&, t]
+        {
+            auto start = std::chrono::steady_clock::now();
+            for(unsigned i=0; i!=RECORDS_PER_THREAD; i+=BURST_SIZE) {
+                if(batch) {
+                    reckless::write_batch b(log);
+                    for(unsigned j=0; j!=BURST_SIZE; ++j)
+                        log.write("level %d: %d @ %d", j, i, t);
+                } else {
+                    for(unsigned j=0; j!=BURST_SIZE; ++j)
+                        log.write("level %d: %d @ %d", j, i, t);
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            ns[t] = static_cast<double>(std::chrono::duration_cast<
+                std::chrono::nanoseconds>(end - start).count())
+                /RECORDS_PER_THREAD;
+        });
+    }
+    for(auto& thread : threads)
+        thread.join();
+    log.close();
+
+    double sum = 0;
+    for(double n : ns)
+        sum += n;
+    return sum/thread_count;
+}
+
+}   // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    unsigned thread_count = argc > 1? static_cast<unsigned>(std::atoi(argv[1]))
+        : std::thread::hardware_concurrency();
+    std::printf("%u threads, %u CPUs\n", thread_count,
+        std::thread::hardware_concurrency());
+    for(int batch=0; batch!=2; ++batch) {
+        double best = 0;
+        for(unsigned round=0; round!=ROUNDS; ++round) {
+            double ns = run(thread_count, batch != 0);
+            if(round == 0 || ns < best)
+                best = ns;
+        }
+        std::printf("  %-12s %8.1f ns/record\n", batch? "write_batch" : "write",
+            best);
+    }
+    return 0;
+}
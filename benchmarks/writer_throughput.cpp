@@ -0,0 +1,66 @@
+// Measures the cost per call of writing a flush-sized chunk with file_writer
+// and mmap_file_writer, i.e. the time the output worker spends in the writer
+// for each flush. file_writer makes one write() system call per flush while
+// mmap_file_writer copies into a mapping of the file and only makes system
+// calls when it moves on to a new extent. It does however take a page fault
+// for every page it writes to, unless mmap_advice::populate is used.
+//
+// The output is written to writer_throughput.tmp in the current directory,
+// which is removed afterwards.
+
+#include <reckless/file_writer.hpp>
+#include <reckless/mmap_file_writer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+char const* const PATH = "writer_throughput.tmp";
+std::size_t const TOTAL_SIZE = 512*1024*1024;
+
+template <class Writer>
+void measure(char const* name, Writer& writer, std::size_t chunk_size)
+{
+    std::vector<char> chunk(chunk_size, 'x');
+    std::size_t const iterations = TOTAL_SIZE/chunk_size;
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i=0; i!=iterations; ++i) {
+        std::error_code ec;
+        writer.write(chunk.data(), chunk.size(), ec);
+        if(ec) {
+            std::printf("%s: write error %d\n", name, ec.value());
+            return;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count();
+    std::printf("%-18s %8u bytes/write %10.1f ns/write %8.1f MiB/s\n", name,
+        static_cast<unsigned>(chunk_size), ns/iterations,
+        1e9*TOTAL_SIZE/ns/(1024*1024));
+}
+
+int main()
+{
+    for(std::size_t chunk_size : {512u, 4096u, 65536u}) {
+        std::remove(PATH);
+        {
+            reckless::file_writer writer(PATH);
+            measure("file_writer", writer, chunk_size);
+        }
+        std::remove(PATH);
+        {
+            reckless::mmap_file_writer writer(PATH);
+            measure("mmap_file_writer", writer, chunk_size);
+        }
+        std::remove(PATH);
+        {
+            reckless::mmap_file_writer writer(PATH, 32*1024*1024,
+                reckless::mmap_sync_policy::none,
+                reckless::mmap_advice::populate);
+            measure("  (populate)", writer, chunk_size);
+        }
+    }
+    std::remove(PATH);
+    return 0;
+}
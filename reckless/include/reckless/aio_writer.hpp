@@ -0,0 +1,72 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_AIO_WRITER_HPP
+#define RECKLESS_AIO_WRITER_HPP
+
+#include "detail/async_writer.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reckless {
+
+// Passes data on to another writer from a helper thread, so that a slow
+// target does not hold up the log's output worker. At most chunk_count
+// chunks of up to chunk_size bytes each are queued at any time; beyond that
+// writes block until the helper thread catches up. This works with any
+// writer on any platform. On Linux, io_uring_writer gets the same effect
+// for files without the extra thread.
+//
+// Note that the log's flush() only guarantees that the data has been handed
+// over to this writer. It reaches the target writer shortly after, and at
+// the latest when the aio_writer is destroyed. The target must outlive the
+// aio_writer.
+class aio_writer : public detail::async_writer {
+public:
+    aio_writer(writer* ptarget, std::size_t chunk_count = 4,
+            std::size_t chunk_size = 256*1024);
+    ~aio_writer();
+
+private:
+    void submit(chunk* pchunk) noexcept override;
+    chunk* complete(bool block) noexcept override;
+    void resume() noexcept override;
+    void helper_thread();
+
+    writer* ptarget_;
+    std::mutex mutex_;
+    std::condition_variable submitted_cv_;
+    std::condition_variable completed_cv_;
+    // Both are reserved to chunk_count entries up front, so pushing to them
+    // never allocates.
+    std::vector<chunk*> submitted_;
+    std::vector<chunk*> completed_;
+    std::error_code error_;     // Set after a failed write until resume().
+    bool shutdown_ = false;
+    std::thread thread_;
+};
+
+}   // namespace reckless
+
+#endif  // RECKLESS_AIO_WRITER_HPP
@@ -27,40 +27,88 @@
 #include <reckless/detail/platform.hpp> // likely, RECKLESS_CACHE_LINE_SIZE
 #include <reckless/detail/utility.hpp>  // index_sequence
 #include <reckless/detail/mpsc_ring_buffer.hpp>
+#include <reckless/detail/formatter_pool.hpp>
+#include <reckless/log_worker_pool.hpp>
 #include <reckless/output_buffer.hpp>
 
 #include <thread>
+#include <chrono>       // steady_clock
 #include <functional>
 #include <tuple>
 #include <system_error> // system_error, error_code
 #include <exception>    // current_exception, exception_ptr
 #include <typeinfo>     // type_info
 #include <mutex>
+#include <memory>       // shared_ptr, unique_ptr
+#include <vector>
+#include <string>
+#include <cstring>      // memcpy, memchr
+#if RECKLESS_HAS_STRING_VIEW
+#include <string_view>
+#endif
+#include <cstdint>      // uint64_t
 
 #if defined(__unix__)
 #include <pthread.h>    // pthread_self
 #endif
 
 namespace reckless {
+class basic_log;
+class write_batch;
+
+// A string argument whose characters were copied into the input frame, see
+// log_options::inline_strings. This is what the formatter receives instead
+// of the std::string, std::string_view or char array that was passed to
+// write(). It points into the frame and is only valid during formatting.
+class captured_string {
+public:
+    captured_string(char const* s, std::size_t size) :
+        s_(s),
+        size_(size)
+    {
+    }
+
+    char const* data() const
+    {
+        return s_;
+    }
+    // The copy is always null-terminated.
+    char const* c_str() const
+    {
+        return s_;
+    }
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    char const* s_;
+    std::size_t size_;
+};
+
 namespace detail {
 #if defined(_WIN32)
     extern "C" unsigned long __stdcall GetCurrentThreadId();
 #endif
 
     enum class frame_status : char {
-        // The frame is currently free for use.
+        // The frame is still being written, or was left over from an earlier
+        // lap around the buffer.
         uninitialized,
         // Frame was allocated but then the error_flag_ check failed, leaving
-        // the frame uninitialized and it should be skipped by using
-        // frame_header::frame_size.
+        // the frame uninitialized and it should be skipped.
         failed_error_check,
         // Frame was allocated but then the constructor failed, leaving the
         // dispatch pointer valid but without initialized data. It should be
-        // skipped by using frame_header::pdispatch_funtion and
-        // dispatch_operation::get_typeid.
+        // skipped.
         failed_initialization,
         // Frame is initialized and valid.
         initialized,
+        // Frame is initialized and valid, but the formatter needs the log
+        // itself rather than just an output buffer, so it must be called by
+        // the output worker even if there are formatter threads.
+        initialized_on_worker,
         // Frame is a shutdown marker, telling the worker thread to finish up
         // and exit.
         shutdown_marker,
@@ -74,27 +122,464 @@ namespace detail {
         // The dispatch function should call the formatter to write to the
         // output buffer.
         invoke_formatter,
-        // The dispatch function should return frame size type information for
-        // the formatter instead of calling it. This is used during error
+        // The dispatch function should return type information for the
+        // formatter instead of calling it. This is used during error
         // handling.
         get_typeid
     };
 
-    typedef std::size_t formatter_dispatch_function_t(dispatch_operation, void*, void*);
+    typedef void formatter_dispatch_function_t(dispatch_operation, void*, void*);
 
     struct frame_header {
-        union {
-            formatter_dispatch_function_t* pdispatch_function;  // valid when status is failed_initialization or initialized
-            std::size_t frame_size; // valid when status == failed_error_check
-        };
-        frame_status status;
+        formatter_dispatch_function_t* pdispatch_function;  // valid when status is failed_initialization or initialized
+        // The lap tag of the frame's position in the input buffer (see
+        // mpsc_ring_buffer::lap_tag), with the frame_status in the lowest 3
+        // bits. The worker only trusts the status if the tag is the one it
+        // expects at that position. Anything else is left over from an
+        // earlier lap, either as an old header or as argument data, so the
+        // worker never has to clear the memory after reading a frame.
+        std::uint64_t status_word;
+        // Size of the whole frame, including this header.
+        std::uint32_t frame_size;
     };
 
+    std::uint64_t const frame_status_mask = 7;
+
+    // Called by the producer right after it has allocated the frame. The
+    // status is uninitialized until set_frame_status() is called.
+    inline void init_frame_header(frame_header* pframe, std::uint64_t lap_tag)
+    {
+        atomic_store_relaxed(&pframe->status_word, lap_tag);
+    }
+
+    // Publish the frame to the worker. Only the producer that allocated the
+    // frame writes the status word, so we can read it back without
+    // synchronization.
+    inline void set_frame_status(frame_header* pframe, frame_status status)
+    {
+        atomic_store_release(&pframe->status_word, (pframe->status_word
+            & ~frame_status_mask) | static_cast<std::uint64_t>(status));
+    }
+
+    // The frame's status if it was written on the lap identified by
+    // lap_tag, otherwise uninitialized.
+    inline frame_status load_frame_status(frame_header const* pframe,
+        std::uint64_t lap_tag)
+    {
+        auto status_word = atomic_load_acquire(&pframe->status_word);
+        if((status_word & ~frame_status_mask) != lap_tag)
+            return frame_status::uninitialized;
+        return static_cast<frame_status>(status_word & frame_status_mask);
+    }
+
+    // Frames start at a multiple of log_options::frame_granularity, which is
+    // never less than this.
+    std::size_t const min_frame_granularity = 8;
+
+    // Returns where the arguments are stored in a frame. The frame start is
+    // only aligned to the frame granularity, so arguments with stricter
+    // alignment than min_frame_granularity need to be placed based on the
+    // frame address. construct_frame() reserves room for the worst case.
+    template <class Args>
+    char* frame_arguments(frame_header* pframe)
+    {
+        std::size_t const args_align = alignof(Args);
+        auto pcframe = static_cast<char*>(static_cast<void*>(pframe));
+        if(args_align <= min_frame_granularity) {
+            std::size_t const args_offset = (sizeof(frame_header) +
+                args_align-1)/args_align*args_align;
+            return pcframe + args_offset;
+        } else {
+            auto address = reinterpret_cast<std::uintptr_t>(pcframe)
+                + sizeof(frame_header);
+            address = (address + args_align - 1) & ~(args_align - 1);
+            return pcframe + (address - reinterpret_cast<std::uintptr_t>(pcframe));
+        }
+    }
+
     template <class Formatter, typename... Args>
-    std::size_t input_frame_dispatch(dispatch_operation operation, void* arg1, void* arg2);
+    void input_frame_dispatch(dispatch_operation operation, void* arg1, void* arg2);
+
+    // Copy a string to the end of the input frame, with a null terminator,
+    // and advance pstrings past it.
+    inline captured_string capture_string(char const* s, std::size_t size,
+        char*& pstrings)
+    {
+        char* p = pstrings;
+        std::memcpy(p, s, size);
+        p[size] = '\0';
+        pstrings += size + 1;
+        return captured_string(p, size);
+    }
 
+    // The string types that can be captured in the input frame, and how
+    // much room they need there.
+    template <class T>
+    struct string_capture {
+        static bool const is_string = false;
+    };
+
+    template <>
+    struct string_capture<std::string> {
+        static bool const is_string = true;
+        static std::size_t size(std::string const& s)
+        {
+            return s.size() + 1;
+        }
+        static captured_string capture(std::string const& s, char*& pstrings)
+        {
+            return capture_string(s.data(), s.size(), pstrings);
+        }
+    };
+
+#if RECKLESS_HAS_STRING_VIEW
+    template <>
+    struct string_capture<std::string_view> {
+        static bool const is_string = true;
+        static std::size_t size(std::string_view s)
+        {
+            return s.size() + 1;
+        }
+        static captured_string capture(std::string_view s, char*& pstrings)
+        {
+            return capture_string(s.data(), s.size(), pstrings);
+        }
+    };
+#endif
+
+    // A char array holds a string up to the first null character, or fills
+    // the whole array if it has none.
+    template <std::size_t N>
+    struct string_capture<char[N]> {
+        static bool const is_string = true;
+        static std::size_t length(char const* s)
+        {
+            auto p = static_cast<char const*>(std::memchr(s, '\0', N));
+            return p? static_cast<std::size_t>(p - s) : N;
+        }
+        static std::size_t size(char const* s)
+        {
+            return length(s) + 1;
+        }
+        static captured_string capture(char const* s, char*& pstrings)
+        {
+            return capture_string(s, length(s), pstrings);
+        }
+    };
+
+    template <class Arg>
+    struct string_capture_for : string_capture<typename std::remove_cv<
+        typename std::remove_reference<Arg>::type>::type> {};
+
+    // How an argument to write() is stored in the input frame. Normally
+    // it's a decayed copy. With CaptureStrings, strings are copied to the
+    // end of the frame and stored as a captured_string.
+    template <class Arg, bool CaptureStrings,
+        bool IsString = string_capture_for<Arg>::is_string>
+    struct frame_argument {
+        typedef typename std::decay<Arg>::type type;
+        static std::size_t string_size(Arg const&)
+        {
+            return 0;
+        }
+        static Arg&& store(Arg&& arg, char*&)
+        {
+            return std::forward<Arg>(arg);
+        }
+    };
+
+    template <class Arg>
+    struct frame_argument<Arg, true, true> {
+        typedef captured_string type;
+        static std::size_t string_size(Arg const& arg)
+        {
+            return string_capture_for<Arg>::size(arg);
+        }
+        static captured_string store(Arg&& arg, char*& pstrings)
+        {
+            return string_capture_for<Arg>::capture(arg, pstrings);
+        }
+    };
+
+    template <typename... Args>
+    struct has_string_argument;
+    template <>
+    struct has_string_argument<> {
+        static bool const value = false;
+    };
+    template <class Arg, typename... Args>
+    struct has_string_argument<Arg, Args...> {
+        static bool const value = string_capture_for<Arg>::is_string
+            || has_string_argument<Args...>::value;
+    };
+
+    inline std::size_t captured_strings_size()
+    {
+        return 0;
+    }
+    template <class Arg, typename... Args>
+    std::size_t captured_strings_size(Arg const& arg, Args const&... args)
+    {
+        return frame_argument<Arg, true>::string_size(arg)
+            + captured_strings_size(args...);
+    }
+
+    // Formatters that can handle captured_string in place of a string
+    // argument declare a static member accepts_captured_strings = true.
+    // For any other formatter, strings are stored as usual even if
+    // log_options::inline_strings is set.
+    template <class Formatter, class = void>
+    struct accepts_captured_strings : std::false_type {};
+    template <class Formatter>
+    struct accepts_captured_strings<Formatter, typename std::enable_if<
+        Formatter::accepts_captured_strings>::type> : std::true_type {};
+
+    // Set in thread_stage::next_position when there is no region to put the
+    // next frame in.
+    std::uint64_t const stage_sealed = std::uint64_t(1) << 63;
+
+    // The region of the log's input buffer that one thread stages its
+    // records in, with log_options::thread_staging_capacity. It works like a
+    // write_batch, except that other threads may seal it at any time.
+    struct thread_stage {
+        // Position of the next frame in the region, or'ed with stage_sealed
+        // once the region has been sealed. The owning thread allocates
+        // frames with an uncontended compare-and-swap, so that it agrees
+        // with whoever seals the region on where the frames end.
+        std::uint64_t next_position = stage_sealed;
+        // The rest is only changed by the owning thread while it holds the
+        // mutex, and read by other threads while they hold it.
+        std::mutex mutex;
+        basic_log* plog = nullptr;
+        // The region starts with a filler frame that has the wrong lap tag
+        // until it is published, so the worker stops there until then.
+        char* pregion = nullptr;
+        std::uint64_t region_position = 0;
+        std::uint64_t end_position = 0;
+        // Frames fit if they end before this position, or exactly at
+        // end_position.
+        std::uint64_t fit_position = 0;
+    };
+
+    // Private input buffer for one producer thread, used when the log is
+    // opened with input_queue_mode::per_thread, or its stage with
+    // log_options::thread_staging_capacity. Ownership is shared between
+    // the log and the thread, since either of them may go away first.
+    struct thread_input_buffer {
+        mpsc_ring_buffer buffer;
+        thread_stage stage;
+        // Set by the owning thread when it exits. The output worker
+        // releases the buffer once it has been drained.
+        bool abandoned = false;
+        // Set by the log when it is closed. The thread drops the buffer the
+        // next time it looks for one.
+        bool closed = false;
+    };
+
+    // Each thread remembers the input buffer it used last, so that writing
+    // repeatedly to the same log only costs a TLS load and a compare. The
+    // serial number identifies a particular open() of a particular log and
+    // is never reused, which protects against a stale buffer being picked up
+    // after the log was closed and reopened, or destroyed and another log
+    // constructed in its place.
+    struct thread_input_buffer_cache {
+        std::uint64_t log_serial;
+        thread_input_buffer* pbuffer;
+    };
+    extern RECKLESS_TLS thread_input_buffer_cache tls_input_buffer_cache;
+
+    // Called for each of its input buffers when a thread exits.
+    void abandon_thread_input_buffer(thread_input_buffer* pbuffer);
+
+    // The write_batch that is open on this thread, or nullptr.
+    extern RECKLESS_TLS write_batch* tls_write_batch;
 }
 
+// Determines how threads that write to the log hand their input frames over
+// to the output worker.
+enum class input_queue_mode {
+    // All threads share one lock-free ring buffer. Records are formatted in
+    // the order that they were pushed on the buffer, regardless of thread.
+    shared,
+    // Each thread lazily gets its own single-producer ring buffer the first
+    // time it writes to the log, and the output worker drains them
+    // round-robin. This avoids the contended compare-and-swap on the shared
+    // buffer when many threads log at the same time. Records from one thread
+    // are still written in order, but records from different threads may be
+    // interleaved differently from the order they were written in.
+    per_thread
+};
+
+// Determines what the output worker does while it waits for log entries to
+// arrive. The spinning policies trade CPU time for latency and are mainly
+// useful when the worker has a core of its own.
+enum class worker_wait_policy {
+    // Sleep on an event with a timeout that grows exponentially up to one
+    // second, and poll the input buffer each time it expires. Threads that
+    // fill up the input buffer or call flush() wake the worker by signaling
+    // the event.
+    backoff,
+    // Poll the input buffer in a busy loop with a CPU pause instruction
+    // between each poll. The worker never sleeps, so writing threads never
+    // need to make a system call to wake it up.
+    spin,
+    // Busy-poll for worker_spin_count iterations, then call
+    // std::this_thread::yield() between polls. Like spin, this never needs
+    // a wake-up call from writing threads.
+    spin_then_yield,
+    // Busy-poll for worker_spin_count iterations, then fall back to the
+    // backoff policy.
+    spin_then_block
+};
+
+// Determines what a thread that writes to the log does when the input
+// buffer is full.
+enum class input_full_policy {
+    // Wait until the output worker has made room. Nothing is lost, but the
+    // writing thread is held up for as long as the worker is, for example
+    // by a slow disk.
+    block,
+    // Drop the record and return right away. Dropped records are counted,
+    // see basic_log::input_buffer_drop_count().
+    drop,
+    // Like drop, but once it has made room the output worker also writes a
+    // line saying how many records were dropped.
+    drop_and_report
+};
+
+// Overrides the input_full_policy of every log for writes made by the
+// current thread while this object exists. For example, a thread that must
+// never wait can use this around calls to a log that otherwise blocks.
+class scoped_input_full_policy {
+public:
+    explicit scoped_input_full_policy(input_full_policy policy) :
+        policy_(policy),
+        pprevious_(pcurrent_)
+    {
+        pcurrent_ = &policy_;
+    }
+    ~scoped_input_full_policy()
+    {
+        pcurrent_ = pprevious_;
+    }
+
+    scoped_input_full_policy(scoped_input_full_policy const&) = delete;
+    scoped_input_full_policy& operator=(scoped_input_full_policy const&) = delete;
+
+    // The policy in effect on this thread, or nullptr if there is none.
+    static input_full_policy const* current()
+    {
+        return pcurrent_;
+    }
+
+private:
+    input_full_policy policy_;
+    input_full_policy const* pprevious_;
+    static RECKLESS_TLS input_full_policy const* pcurrent_;
+};
+
+struct log_options {
+    // See basic_log::open for the meaning of zero capacities.
+    std::size_t input_buffer_capacity = 0;
+    std::size_t output_buffer_capacity = 0;
+
+    input_queue_mode input_queue = input_queue_mode::shared;
+    // Capacity of each per-thread input buffer when input_queue is
+    // per_thread. If 0 then input_buffer_capacity is used.
+    std::size_t thread_input_buffer_capacity = 0;
+    // If nonzero, each thread stages its records in a region of the input
+    // buffer that it reserves for itself, this many bytes at a time but
+    // never more than a quarter of the input buffer, much like an implicit
+    // write_batch. Threads then only contend for the input buffer once per
+    // region instead of once per record. The output worker gets the records
+    // in a region when it is full, when any thread calls flush(), close()
+    // or start_panic_flush() or has to wait for room in the input buffer,
+    // when the thread exits, or once the worker has waited
+    // thread_staging_delay_ms for them. Ignored with
+    // input_queue_mode::per_thread.
+    std::size_t thread_staging_capacity = 0;
+    unsigned thread_staging_delay_ms = 1;
+
+    worker_wait_policy worker_wait = worker_wait_policy::backoff;
+    // Number of polls that spin_then_yield and spin_then_block spend
+    // spinning before they start yielding or blocking. If 0 then a default
+    // of a few tens of microseconds worth of polling is used.
+    unsigned worker_spin_count = 0;
+
+    // CPUs that the output worker may run on, numbered as by the OS. If
+    // empty, it may run on any CPU. Use this to keep the worker off cores
+    // that are reserved for other threads.
+    std::vector<unsigned> worker_cpus;
+    // If nonzero, the output worker runs with the real-time SCHED_FIFO
+    // policy at this priority (1-99), which usually needs privileges.
+    int worker_realtime_priority = 0;
+    // Nice value for the output worker when worker_realtime_priority is 0.
+    // Going below 0 usually needs privileges.
+    int worker_nice = 0;
+    // Allocate the input and output buffers on the NUMA node of the first
+    // CPU in worker_cpus, so that the output worker reads and writes local
+    // memory. Linux only.
+    bool worker_numa_local = false;
+
+    // Number of threads that help the output worker format records. If 0
+    // then the output worker formats every record itself. Otherwise it hands
+    // runs of records to these threads, and writes what they produce in the
+    // same order as before. This pays off when formatting is what keeps the
+    // worker busy, e.g. with many floating-point arguments. Formatters then
+    // have to cope with being called on several threads at once, which the
+    // ones in this library do, except for binary_log which ignores this
+    // setting. The threads are restricted to worker_cpus too.
+    unsigned formatter_threads = 0;
+
+    // If set, the log gets no output worker thread of its own. Instead the
+    // threads of this pool process its input, taking turns with the other
+    // logs that use the pool. worker_wait, worker_cpus, worker_realtime_priority
+    // and worker_nice are then ignored; the pool threads wait as with
+    // worker_wait_policy::backoff. The pool must stay alive until the log
+    // has been closed.
+    log_worker_pool* worker_pool = nullptr;
+
+    // Strings and byte buffers of at least this many bytes are passed to
+    // the writer straight from the input frame instead of being copied into
+    // the output buffer first. If 0 then a default of 64 KiB is used.
+    std::size_t zero_copy_threshold = 0;
+
+    // Input frames are rounded up to a multiple of this many bytes, which
+    // must be a power of two between 8 and RECKLESS_CACHE_LINE_SIZE. If 0
+    // then RECKLESS_CACHE_LINE_SIZE is used, which means two frames never
+    // share a cache line. A smaller granularity packs more frames into the
+    // input buffer and into each cache line the output worker reads, but
+    // with input_queue_mode::shared, threads that write at the same time
+    // may then write to the same cache line. Use input_queue_mode::per_thread
+    // to avoid that: each thread then fills cache lines of its own.
+    std::size_t frame_granularity = 0;
+
+    // Copy the characters of std::string, std::string_view and char array
+    // arguments into the input frame instead of storing the string object
+    // itself. This avoids a heap allocation for std::string, and makes it
+    // safe to log a char array that is overwritten right afterwards. Strings
+    // that would take up more than a quarter of the input buffer are stored
+    // as usual. Only applies to formatters that accept captured_string,
+    // which the ones in policy_log, severity_log and binary_log do.
+    bool inline_strings = false;
+
+    // What writing threads do when the input buffer is full. Can be
+    // changed later with basic_log::input_buffer_full_policy(), and
+    // overridden for a thread with scoped_input_full_policy.
+    input_full_policy input_buffer_full = input_full_policy::block;
+
+    // Back the input buffers with huge pages (usually 2 MiB) so that writing
+    // threads take fewer TLB misses in a large buffer. Only buffers whose
+    // capacity is a multiple of the huge page size use them, and only on
+    // Linux. The huge pages must have been reserved (vm.nr_hugepages);
+    // otherwise ordinary pages are used.
+    bool input_buffer_huge_pages = false;
+    // Lock the input buffers in RAM with mlock (VirtualLock on Windows) so
+    // that they are never paged out. If RLIMIT_MEMLOCK doesn't allow it, the
+    // buffers are left unlocked.
+    bool input_buffer_locked = false;
+};
+
 using format_error_callback_t = std::function<void (output_buffer*, std::exception_ptr const&, std::type_info const&)>;
 
 class basic_log : private output_buffer {
@@ -110,6 +595,10 @@ public:
     {
         open(pwriter, input_buffer_capacity, output_buffer_capacity);
     }
+    basic_log(writer* pwriter, log_options const& options)
+    {
+        open(pwriter, options);
+    }
     virtual ~basic_log();
 
     basic_log(basic_log const&) = delete;
@@ -119,6 +608,7 @@ public:
     void open(writer* pwriter,
         std::size_t input_buffer_capacity,
         std::size_t output_buffer_capacity);
+    void open(writer* pwriter, log_options const& options);
 
     // Wait for the output worker to flush its remaining output queue, then shut
     // down the background thread and release all buffers. Writing to the log
@@ -157,7 +647,8 @@ public:
 
     // Provide access to the internal worker-thread object. The intent is to
     // allow platform-specific manipulation of the thread, such as setting
-    // priority or affinity.
+    // priority or affinity. There is no such thread if the log uses a
+    // log_worker_pool.
     std::thread& worker_thread()
     {
         return output_thread_;
@@ -173,22 +664,96 @@ public:
         return detail::atomic_load_relaxed(&input_buffer_high_watermark_);
     }
 
+    // Number of records that were dropped because the input buffer was full
+    // and the input_full_policy said not to wait.
+    unsigned input_buffer_drop_count() const
+    {
+        return detail::atomic_load_relaxed(&input_buffer_drop_count_);
+    }
+
+    input_full_policy input_buffer_full_policy() const
+    {
+        return detail::atomic_load_relaxed(&input_full_policy_);
+    }
+
+    void input_buffer_full_policy(input_full_policy policy)
+    {
+        detail::atomic_store_relaxed(&input_full_policy_, policy);
+    }
+
+    // Whether log_options::input_buffer_huge_pages and input_buffer_locked
+    // took effect for the input buffer.
+    bool input_buffer_huge_pages() const
+    {
+        return (input_buffer_.memory_flags() & detail::ring_memory_huge_pages) != 0;
+    }
+
+    bool input_buffer_locked() const
+    {
+        return (input_buffer_.memory_flags() & detail::ring_memory_locked) != 0;
+    }
+
     using output_buffer::output_buffer_full_count;
     using output_buffer::output_buffer_high_watermark;
 
 protected:
     template <class Formatter, typename... Args>
     void write(Args&&... args)
+    {
+        write_frame<Formatter, false>(std::forward<Args>(args)...);
+    }
+
+    // Called by the output worker to write a record saying that count
+    // records were dropped with input_full_policy::drop_and_report. The
+    // default writes a line of text. Logs whose output isn't text, such as
+    // binary_log, override this to write a record in their own format. Like
+    // a formatter, this may throw flush_error.
+    virtual void write_dropped_input_report(output_buffer* pbuffer,
+        unsigned count);
+
+private:
+    // If SharedInput is true then the frame always goes on the shared input
+    // buffer, even when per-thread input buffers are enabled. This is used
+    // for frames that must be ordered after everything that was written
+    // before them by any thread, such as the flush marker.
+    template <class Formatter, bool SharedInput, typename... Args>
+    void write_frame(Args&&... args)
     {
         using namespace detail;
-        typedef std::tuple<typename std::decay<Args>::type...> args_t;
+        if(accepts_captured_strings<Formatter>::value
+            && has_string_argument<Args...>::value
+            && inline_string_limit_ != 0)
+        {
+            std::size_t strings_size = captured_strings_size(args...);
+            if(likely(strings_size <= inline_string_limit_)) {
+                construct_frame<Formatter, SharedInput, true>(strings_size,
+                    std::forward<Args>(args)...);
+                return;
+            }
+        }
+        construct_frame<Formatter, SharedInput, false>(0,
+            std::forward<Args>(args)...);
+    }
+
+    // strings_size is the room needed at the end of the frame for
+    // captured strings, if CaptureStrings is true.
+    template <class Formatter, bool SharedInput, bool CaptureStrings,
+        typename... Args>
+    void construct_frame(std::size_t strings_size, Args&&... args)
+    {
+        using namespace detail;
+        typedef std::tuple<typename frame_argument<Args, CaptureStrings>::type...>
+            args_t;
         std::size_t const args_align = alignof(args_t);
         std::size_t const args_offset = (sizeof(frame_header) +
             args_align-1)/args_align*args_align;
-        std::size_t const frame_size_unaligned = args_offset + sizeof(args_t);
-        std::size_t const frame_size = (frame_size_unaligned +
-            RECKLESS_CACHE_LINE_SIZE-1)/RECKLESS_CACHE_LINE_SIZE*
-            RECKLESS_CACHE_LINE_SIZE;
+        std::size_t frame_size = args_offset + sizeof(args_t) + strings_size;
+        std::size_t const granularity = frame_granularity_;
+        // If the frame start isn't aligned for the arguments then they end
+        // up further in; see frame_arguments().
+        if(args_align > min_frame_granularity && args_align > granularity)
+            frame_size += args_align - granularity;
+        frame_size = (frame_size + granularity-1) & ~(granularity-1);
 
 #ifdef RECKLESS_DEBUG
         // If this assert triggers then you have tried to write to the log from
@@ -204,39 +769,127 @@ protected:
 
 #endif  // RECKLESS_DEBUG
 
-        frame_header* pframe = push_input_frame(frame_size);
+        // Frames on the shared input buffer are used for flush() and must
+        // never be dropped.
+        frame_header* pframe;
+        if(!SharedInput && thread_input_buffers_)
+            pframe = push_thread_input_frame(frame_size);
+        else if(!SharedInput && unlikely(tls_write_batch != nullptr))
+            pframe = push_batch_frame(frame_size);
+        else if(!SharedInput && thread_staging_capacity_ != 0)
+            pframe = push_staged_frame(frame_size);
+        else
+            pframe = push_input_frame(frame_size, !SharedInput);
+        if(unlikely(pframe == nullptr))
+            return;     // Dropped; see input_full_policy.
         pframe->pdispatch_function = &detail::input_frame_dispatch<
                 Formatter,
-                typename std::decay<Args>::type...
+                typename frame_argument<Args, CaptureStrings>::type...
             >;
+        pframe->frame_size = static_cast<std::uint32_t>(frame_size);
 
-        void* pargs = static_cast<char*>(static_cast<void*>(pframe))
-            + args_offset;
+        char* pargs = frame_arguments<args_t>(pframe);
+        char* pstrings = pargs + sizeof(args_t);
         // Let the compiler know that the placement-new call below
         // doesn't need to perform a null-pointer check.
         assume(pargs != nullptr);
 
         try {
-            new (pargs) args_t(std::forward<Args>(args)...);
+            new (pargs) args_t{frame_argument<Args, CaptureStrings>::store(
+                std::forward<Args>(args), pstrings)...};
         } catch(...) {
-            atomic_store_release(&pframe->status, frame_status::failed_initialization);
+            set_frame_status(pframe, frame_status::failed_initialization);
             throw;
         }
-        atomic_store_release(&pframe->status, frame_status::initialized);
+        // The frames that SharedInput is used for are flush markers and the
+        // like, whose formatters work on the log's own output buffer.
+        set_frame_status(pframe, SharedInput?
+            frame_status::initialized_on_worker : frame_status::initialized);
     }
 
-private:
-    detail::frame_header* push_input_frame(std::size_t size);
+    // These return nullptr if the buffer is full and may_drop is true and
+    // the input_full_policy says to drop the record.
+    detail::frame_header* push_input_frame(std::size_t size, bool may_drop);
+    detail::frame_header* push_thread_input_frame(std::size_t size);
     detail::frame_header* push_input_frame_blind(std::size_t frame_size);
+    // If pframe is not null then it was allocated at position but failed
+    // the error check. On success, position is where the frame ended up.
     detail::frame_header* push_input_frame_slow_path(
-        detail::frame_header * pframe, bool error, std::size_t size);
+        detail::mpsc_ring_buffer* pbuffer, detail::frame_header* pframe,
+        std::uint64_t& position, bool error, std::size_t size, bool may_drop);
+    // Allocates the frame from the write_batch that is open on this thread,
+    // if it is for this log.
+    detail::frame_header* push_batch_frame(std::size_t size);
+    detail::frame_header* push_batch_frame_slow_path(write_batch* pbatch,
+        std::size_t size);
+    void publish_batch(write_batch* pbatch);
+    // Allocates the frame from this thread's stage, see
+    // log_options::thread_staging_capacity.
+    detail::frame_header* push_staged_frame(std::size_t size);
+    detail::frame_header* push_staged_frame_slow_path(
+        detail::thread_input_buffer* pbuffer, std::size_t size);
+    // Publishes the region of the stage. The caller must hold its mutex.
+    void seal_stage(detail::thread_stage* pstage);
+    // Seals the stages of all threads. With try_lock, stages that somebody
+    // else is busy with are left alone, which is what start_panic_flush()
+    // needs, since that thread may have crashed with the mutex held.
+    void seal_stages(bool try_lock = false);
+    // Called by the worker while it waits for a frame that isn't ready.
+    void on_stalled_frame(void* pframe, std::uint64_t lap_tag);
+    // Takes up the rest of a region with a frame that the worker skips.
+    void write_region_filler(char* pregion, std::uint64_t region_position,
+        std::uint64_t position, std::uint64_t end_position);
+    // Publishes the write_batch that is open on this thread, whichever log
+    // it is for, so that whatever we are about to push or wait for doesn't
+    // end up waiting behind it.
+    void publish_thread_batch();
+    bool drop_input_frame();
+    void report_dropped_input_frames();
+    detail::thread_input_buffer* acquire_thread_input_buffer();
+
+    // Wake the output worker if the wait policy allows it to sleep.
+    void signal_input()
+    {
+        if(pworker_pool_)
+            pworker_pool_->signal();
+        else if(worker_wait_ == worker_wait_policy::backoff
+                || worker_wait_ == worker_wait_policy::spin_then_block)
+        {
+            input_buffer_full_event_.signal();
+        }
+    }
+
+    friend class log_worker_pool;
+    friend class write_batch;
+    friend void detail::abandon_thread_input_buffer(
+        detail::thread_input_buffer* pbuffer);
 
     void output_worker();
+    void setup_output_worker();
     std::size_t wait_for_input();
-    detail::frame_status acquire_frame(void* pframe);
-    std::size_t process_frame(void* pframe);
-    std::size_t skip_frame(void* pframe);
-    void clear_frame(void* pframe, std::size_t frame_size);
+    // Processes one batch from the input buffer, and everything that is in
+    // the per-thread buffers, and returns the status of the last frame.
+    detail::frame_status process_input(std::size_t batch_size);
+    void finish_output();
+    // Called by log_worker_pool threads in place of the output worker loop.
+    // Returns true if there was any input and all of it was processed.
+    // Returns false with input_stalled_ set if processing stopped at a frame
+    // that wasn't ready.
+    bool service_input();
+    bool has_thread_input();
+    void process_thread_input();
+    // Return where processing stopped, which is pend unless acquire_frame()
+    // gave up on a frame.
+    char* process_frames(detail::mpsc_ring_buffer* pbuffer, char* pbegin,
+        char* pend, detail::frame_status* pstatus);
+    char* process_frames_parallel(detail::mpsc_ring_buffer* pbuffer,
+        char* pbegin, char* pend, detail::frame_status* pstatus);
+    // Returns uninitialized only on a log_worker_pool thread, if the frame
+    // doesn't become ready within worker_spin_count polls.
+    detail::frame_status acquire_frame(void* pframe, std::uint64_t lap_tag);
+    void process_frame(void* pframe);
+    void commit_format_job();
+    void report_format_error(void* pframe, std::exception_ptr const& error);
 
     void flush_output_buffer();
 
@@ -244,10 +897,60 @@ private:
     void on_panic_flush_done();
     bool is_open()
     {
-        return output_thread_.joinable();
+        return output_thread_.joinable() || pool_registration_;
     }
 
     detail::mpsc_ring_buffer input_buffer_;
+    // Everything below up to thread_input_mutex_ is only used in
+    // input_queue_mode::per_thread or with thread staging.
+    bool thread_input_buffers_ = false;
+    std::uint64_t serial_ = 0;
+    std::size_t thread_input_buffer_capacity_ = 0;
+    // ring_memory_flags for the input buffers.
+    unsigned input_buffer_memory_flags_ = 0;
+    std::vector<std::shared_ptr<detail::thread_input_buffer>> thread_input_buffers_list_; // access synchronized by thread_input_mutex_
+    unsigned thread_input_buffers_version_ = 0;
+    std::mutex thread_input_mutex_;
+    // The output worker's private copy of thread_input_buffers_list_.
+    std::vector<std::shared_ptr<detail::thread_input_buffer>> worker_thread_input_buffers_;
+    unsigned worker_thread_input_buffers_version_ = 0;
+    // Region size for the thread stages, or 0 if they are not used.
+    std::size_t thread_staging_capacity_ = 0;
+    unsigned thread_staging_delay_ms_ = 0;
+    // Size of the filler frames at the start and end of a stage's region.
+    std::size_t stage_filler_size_ = 0;
+    // The frame that the worker has been waiting for since stalled_since_,
+    // used to decide when to seal the stages.
+    void* pstalled_frame_ = nullptr;
+    std::uint64_t stalled_lap_tag_ = 0;
+    std::chrono::steady_clock::time_point stalled_since_;
+
+    std::size_t frame_granularity_ = RECKLESS_CACHE_LINE_SIZE;
+    // Strings are captured in the input frame if they need no more than
+    // this many bytes altogether. 0 if log_options::inline_strings is off.
+    std::size_t inline_string_limit_ = 0;
+    worker_wait_policy worker_wait_ = worker_wait_policy::backoff;
+    unsigned worker_spin_count_ = 0;
+    // Settings that the output worker applies to itself when it starts.
+    // If any are set, open() waits for worker_started_event_ and throws
+    // worker_setup_error_ if they couldn't be applied.
+    std::vector<unsigned> worker_cpus_;
+    int worker_realtime_priority_ = 0;
+    int worker_nice_ = 0;
+    std::error_code worker_setup_error_;
+    detail::spsc_event worker_started_event_;
+    // NUMA node to allocate the input buffers on, or -1.
+    int numa_node_ = -1;
+    // Only exists with log_options::formatter_threads.
+    std::unique_ptr<detail::formatter_pool> formatter_pool_;
+    // Only set with log_options::worker_pool. worker_finished_ and
+    // input_stalled_ are only accessed by whichever pool thread is working
+    // on the log.
+    log_worker_pool* pworker_pool_ = nullptr;
+    std::shared_ptr<detail::pooled_log> pool_registration_;
+    bool worker_finished_ = false;
+    bool input_stalled_ = false;
+    detail::spsc_event worker_done_event_;
     detail::spsc_event input_buffer_full_event_;
     detail::lockless_cv input_buffer_empty_event_;
 
@@ -258,6 +961,12 @@ private:
 
     unsigned input_buffer_full_count_ = 0;
     std::size_t input_buffer_high_watermark_ = 0;
+    input_full_policy input_full_policy_ = input_full_policy::block;
+    unsigned input_buffer_drop_count_ = 0;
+    // Records dropped with input_full_policy::drop_and_report, and how many
+    // of those the output worker has reported so far.
+    unsigned input_buffer_reportable_drop_count_ = 0;
+    unsigned input_buffer_reported_drop_count_ = 0;
 
 #if defined(_POSIX_VERSION)
     pthread_t output_worker_native_handle_;
@@ -277,8 +986,65 @@ public:
     char const* what() const noexcept override;
 };
 
+// Writes made to a log by the current thread while this object exists are
+// collected in one region of the input buffer, which is reserved with a
+// single atomic operation, instead of each of them reserving its own frame.
+// The output worker gets to see them all at once when the batch is
+// published, which happens when the region is full, when the batch is
+// destroyed or publish() is called, and before the thread calls flush(),
+// close() or start_panic_flush().
+// Use this for bursts of records, such as dumping a table one row at a
+// time.
+//
+// Everything that comes after the reserved region, including writes by other
+// threads and their flush() calls, waits for the batch to be published
+// before it is written, so keep batches short. Output that came before the
+// region is still written while the worker waits. Writing to another log, or
+// having to wait for room in any log's input buffer, publishes the batch
+// first, so a thread can't end up waiting for its own batch.
+// Only one batch can be open on a thread at a time. With
+// input_queue_mode::per_thread or log_options::thread_staging_capacity,
+// each thread already has a buffer of its own and the batch makes no
+// difference.
+class write_batch {
+public:
+    // Regions of capacity bytes are reserved at a time, but never more than
+    // a quarter of the input buffer. If 0, then 4 KiB is used. Records that
+    // don't fit in a region of their own are pushed one by one as usual.
+    explicit write_batch(basic_log& log, std::size_t capacity = 0);
+    ~write_batch();
+
+    write_batch(write_batch const&) = delete;
+    write_batch& operator=(write_batch const&) = delete;
+
+    // Let the output worker have the records that were written so far.
+    void publish()
+    {
+        plog_->publish_batch(this);
+    }
+
+private:
+    friend class basic_log;
+
+    basic_log* plog_;
+    std::size_t capacity_;
+    // Room needed for a filler frame that takes up the unused end of the
+    // region when it is published.
+    std::size_t filler_size_;
+    // The reserved region, if any, as positions in the input buffer. The
+    // first frame header doesn't get its proper lap tag until the region
+    // is published, so the worker stops there until then.
+    char* pregion_ = nullptr;
+    std::uint64_t region_position_ = 0;
+    std::uint64_t next_position_ = 0;
+    std::uint64_t end_position_ = 0;
+    // Frames fit if they end before this position, or exactly at
+    // end_position_.
+    std::uint64_t fit_position_ = 0;
+};
+
 inline detail::frame_header* basic_log::push_input_frame(
-        std::size_t size)
+        std::size_t size, bool may_drop)
 {
     using namespace detail;
     // This is possibly useless micro-optimization but after all, making this
@@ -287,25 +1053,116 @@ inline detail::frame_header* basic_log::push_input_frame(
     // input_buffer_.push and another for checking the error flag, we combine
     // both checks into one. That means we have to mark the allocated input
     // frame as failed_error_check if it succeeds but the error check does not.
-    auto pframe = static_cast<frame_header*>(input_buffer_.push(size));
+    std::uint64_t position = 0;
+    auto pframe = static_cast<frame_header*>(input_buffer_.push(size,
+        &position));
     auto error = atomic_load_acquire(&error_flag_);
     std::uint64_t no_error = ~static_cast<std::uint64_t>(error);
     no_error &= reinterpret_cast<std::uintptr_t>(pframe);
-    if(likely(no_error != 0))
+    if(likely(no_error != 0)) {
+        init_frame_header(pframe, input_buffer_.lap_tag(position));
         return pframe;
+    } else {
+        return push_input_frame_slow_path(&input_buffer_, pframe, position,
+            error, size, may_drop);
+    }
+}
+
+inline detail::frame_header* basic_log::push_thread_input_frame(
+        std::size_t size)
+{
+    using namespace detail;
+    thread_input_buffer* pbuffer;
+    if(likely(tls_input_buffer_cache.log_serial == serial_))
+        pbuffer = tls_input_buffer_cache.pbuffer;
     else
-        return push_input_frame_slow_path(pframe, error, size);
+        pbuffer = acquire_thread_input_buffer();
+
+    // Same single-branch trick as in push_input_frame.
+    std::uint64_t position = 0;
+    auto pframe = static_cast<frame_header*>(pbuffer->buffer.push_exclusive(
+        size, &position));
+    auto error = atomic_load_acquire(&error_flag_);
+    std::uint64_t no_error = ~static_cast<std::uint64_t>(error);
+    no_error &= reinterpret_cast<std::uintptr_t>(pframe);
+    if(likely(no_error != 0)) {
+        init_frame_header(pframe, pbuffer->buffer.lap_tag(position));
+        return pframe;
+    } else {
+        return push_input_frame_slow_path(&pbuffer->buffer, pframe, position,
+            error, size, true);
+    }
 }
 
 inline detail::frame_header* basic_log::push_input_frame_blind(
         std::size_t size)
 {
     using namespace detail;
-    auto pframe = static_cast<frame_header*>(input_buffer_.push(size));
+    std::uint64_t position = 0;
+    auto pframe = static_cast<frame_header*>(input_buffer_.push(size,
+        &position));
     if(likely(pframe != nullptr))
-        return pframe;
+        init_frame_header(pframe, input_buffer_.lap_tag(position));
     else
-        return push_input_frame_slow_path(nullptr, false, size);
+        pframe = push_input_frame_slow_path(&input_buffer_, nullptr, position,
+            false, size, false);
+    pframe->frame_size = static_cast<std::uint32_t>(size);
+    return pframe;
+}
+
+inline detail::frame_header* basic_log::push_batch_frame(std::size_t size)
+{
+    using namespace detail;
+    write_batch* pbatch = tls_write_batch;
+    std::uint64_t position = pbatch->next_position_;
+    std::uint64_t next_position = position + size;
+    bool fits = next_position <= pbatch->fit_position_
+        || next_position == pbatch->end_position_;
+    // The error check is the same as in push_input_frame.
+    if(unlikely(pbatch->plog_ != this || !fits
+            || atomic_load_acquire(&error_flag_)))
+    {
+        return push_batch_frame_slow_path(pbatch, size);
+    }
+
+    pbatch->next_position_ = next_position;
+    auto pframe = static_cast<frame_header*>(input_buffer_.wrap(
+        pbatch->pregion_ + (position - pbatch->region_position_)));
+    if(likely(position != pbatch->region_position_))
+        init_frame_header(pframe, input_buffer_.lap_tag(position));
+    else
+        init_frame_header(pframe, ~input_buffer_.lap_tag(position));
+    return pframe;
+}
+
+inline detail::frame_header* basic_log::push_staged_frame(std::size_t size)
+{
+    using namespace detail;
+    thread_input_buffer* pbuffer;
+    if(likely(tls_input_buffer_cache.log_serial == serial_))
+        pbuffer = tls_input_buffer_cache.pbuffer;
+    else
+        pbuffer = acquire_thread_input_buffer();
+
+    // Nobody else changes the region, so we can read it without the mutex.
+    // A sealed position never fits, since stage_sealed is set in it.
+    thread_stage& stage = pbuffer->stage;
+    std::uint64_t position = atomic_load_relaxed(&stage.next_position);
+    std::uint64_t next_position = position + size;
+    bool fits = next_position <= stage.fit_position
+        || next_position == stage.end_position;
+    // The error check is the same as in push_input_frame.
+    if(unlikely(!fits || atomic_load_acquire(&error_flag_)
+            || !atomic_compare_exchange_weak_relaxed(&stage.next_position,
+                position, next_position)))
+    {
+        return push_staged_frame_slow_path(pbuffer, size);
+    }
+
+    auto pframe = static_cast<frame_header*>(input_buffer_.wrap(
+        stage.pregion + (position - stage.region_position)));
+    init_frame_header(pframe, input_buffer_.lap_tag(position));
+    return pframe;
 }
 
 namespace detail {
@@ -317,24 +1174,16 @@ void formatter_dispatch_helper(output_buffer* poutput, std::tuple<Args...>&& arg
 }
 
 template <class Formatter, typename... Args>
-std::size_t input_frame_dispatch(dispatch_operation operation, void* arg1, void* arg2)
+void input_frame_dispatch(dispatch_operation operation, void* arg1, void* arg2)
 {
     using namespace detail;
     typedef std::tuple<Args...> args_t;
-    std::size_t const args_align = alignof(args_t);
-    std::size_t const status_offset = sizeof(formatter_dispatch_function_t*);
-    std::size_t const args_offset = (status_offset + sizeof(frame_status) +
-        args_align-1)/args_align*args_align;
-    std::size_t const frame_size_unaligned = args_offset + sizeof(args_t);
-    std::size_t const frame_size = (frame_size_unaligned +
-        RECKLESS_CACHE_LINE_SIZE-1)/RECKLESS_CACHE_LINE_SIZE*
-        RECKLESS_CACHE_LINE_SIZE;
 
     typename make_index_sequence<sizeof...(Args)>::type indexes;
 
     if(likely(operation == invoke_formatter)) {
         auto poutput = static_cast<output_buffer*>(arg1);
-        auto pinput = static_cast<char*>(arg2);
+        auto pinput = static_cast<frame_header*>(arg2);
         struct args_owner {
             args_owner(args_t& args) :
                 args(args)
@@ -351,13 +1200,12 @@ std::size_t input_frame_dispatch(dispatch_operation operation, void* arg1, void*
             args_t& args;
         };
 
-        args_owner args(*reinterpret_cast<args_t*>(pinput + args_offset));
+        args_owner args(*reinterpret_cast<args_t*>(
+            frame_arguments<args_t>(pinput)));
         formatter_dispatch_helper<Formatter>(poutput, move(args.args), indexes);
-        return frame_size;
     } else {
         // operation == get_typeid
         *static_cast<std::type_info const**>(arg1) = &typeid(args_t);
-        return frame_size;
     }
 }
 
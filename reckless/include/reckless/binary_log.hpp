@@ -0,0 +1,422 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_BINARY_LOG_HPP
+#define RECKLESS_BINARY_LOG_HPP
+
+#include <reckless/basic_log.hpp>
+
+#include <chrono>
+#include <cstdint>      // int64_t, uint32_t, ...
+#include <cstring>      // memcpy, strlen
+#include <string>
+#include <type_traits>  // conditional, is_signed
+#include <unordered_map>
+#include <utility>      // forward
+#if defined(__unix__)
+#include <time.h>       // clock_gettime
+#endif
+
+namespace reckless {
+
+// Layout of the files written by binary_log, for use by reckless-decode or
+// anyone else who wants to read them. The file is a sequence of records that
+// each start with a record_type byte:
+//
+// header:  "\x7fRKLBIN\0", uint32 version, uint32 0x01020304 (byte order),
+//          uint8 sizeof(long double), 3 bytes padding.
+//          Starts a new session and discards all format definitions seen so
+//          far. Appending to an existing file thus works as expected.
+// format:  uint32 id, uint32 length, then the format string (no terminator).
+// entry:   uint32 format id, int64 nanoseconds since the epoch (UTC), uint8
+//          argument count, then the arguments.
+//
+// Each argument is an arg_type byte followed by the value. Strings are a
+// uint32 length followed by the characters, everything else is stored as
+// is. All numbers are in the byte order of the machine that wrote the file.
+namespace binary_format {
+    char const magic[8] = {'\x7f', 'R', 'K', 'L', 'B', 'I', 'N', '\0'};
+    std::uint32_t const version = 1;
+    std::uint32_t const byte_order_mark = 0x01020304;
+    std::size_t const header_size = 8 + 4 + 4 + 4;
+
+    enum class record_type : std::uint8_t {
+        format = 1,
+        entry = 2,
+        header = 0x7f
+    };
+
+    enum class arg_type : std::uint8_t {
+        char_ = 1,
+        signed_char,
+        unsigned_char,
+        int16,
+        uint16,
+        int32,
+        uint32,
+        int64,
+        uint64,
+        float_,
+        double_,
+        long_double,
+        string,
+        pointer
+    };
+}
+
+namespace detail {
+
+// Keeps track of which format strings have been written to the file so far,
+// and the id that each one got. Only used by the output worker. Format
+// strings are identified by their address, which is fine since they have to
+// outlive the log call anyway.
+class binary_format_table {
+public:
+    // Return the id for pformat. If this is the first time we see it, then
+    // write a format record for it first, preceded by a header record if
+    // this is the first thing written in this session.
+    std::uint32_t lookup(output_buffer* pbuffer, char const* pformat)
+    {
+        auto it = ids_.find(pformat);
+        if(likely(it != ids_.end()))
+            return it->second;
+        return define(pbuffer, pformat);
+    }
+
+    // Called once the record that looked up a format string has been
+    // written to the output buffer in full.
+    void frame_end()
+    {
+        pending_ = nullptr;
+    }
+
+    // Called when the output of the current record is thrown away. If the
+    // record defined its format string then the definition (and the header,
+    // if this was the first record) went with it, so forget about it and
+    // define it again next time.
+    void revert_frame()
+    {
+        if(pending_) {
+            ids_.erase(pending_);
+            pending_ = nullptr;
+        }
+    }
+
+    // Start over with a new session. Must only be called while the worker
+    // thread is not running.
+    void reset()
+    {
+        ids_.clear();
+        pending_ = nullptr;
+    }
+
+private:
+    std::uint32_t define(output_buffer* pbuffer, char const* pformat);
+
+    std::unordered_map<char const*, std::uint32_t> ids_;
+    // Format string defined by the current record, if any.
+    char const* pending_ = nullptr;
+};
+
+template <typename T>
+void put(output_buffer* pbuffer, T const& value)
+{
+    char* p = pbuffer->reserve(sizeof(value));
+    std::memcpy(p, &value, sizeof(value));
+    pbuffer->commit(sizeof(value));
+}
+
+template <typename T>
+void put_arg(output_buffer* pbuffer, binary_format::arg_type type,
+    T const& value)
+{
+    char* p = pbuffer->reserve(1 + sizeof(value));
+    p[0] = static_cast<char>(type);
+    std::memcpy(p + 1, &value, sizeof(value));
+    pbuffer->commit(1 + sizeof(value));
+}
+
+inline void put_string_arg(output_buffer* pbuffer, char const* s,
+    std::size_t length)
+{
+    put_arg(pbuffer, binary_format::arg_type::string,
+        static_cast<std::uint32_t>(length));
+    pbuffer->write(s, length);
+}
+
+// Encoding for each argument type that binary_log supports. These are the
+// types that template_formatter has built-in support for; custom format()
+// overloads can't be used since formatting happens in another program.
+template <typename T>
+struct binary_arg {
+    static bool const supported = false;
+};
+
+template <typename T, binary_format::arg_type Type, typename Stored = T>
+struct binary_scalar_arg {
+    static bool const supported = true;
+    static void encode(output_buffer* pbuffer, T value)
+    {
+        put_arg(pbuffer, Type, static_cast<Stored>(value));
+    }
+};
+
+// Integers are stored by size, so that e.g. long has the same encoding as
+// either int or long long depending on the platform.
+template <typename T>
+struct binary_integer_arg : binary_scalar_arg<T,
+    sizeof(T) == 2? (std::is_signed<T>::value?
+        binary_format::arg_type::int16 : binary_format::arg_type::uint16) :
+    sizeof(T) == 4? (std::is_signed<T>::value?
+        binary_format::arg_type::int32 : binary_format::arg_type::uint32) :
+        (std::is_signed<T>::value?
+        binary_format::arg_type::int64 : binary_format::arg_type::uint64),
+    T>
+{
+    static_assert(sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8,
+        "unsupported integer size");
+};
+
+template <> struct binary_arg<char> :
+    binary_scalar_arg<char, binary_format::arg_type::char_> {};
+template <> struct binary_arg<signed char> :
+    binary_scalar_arg<signed char, binary_format::arg_type::signed_char> {};
+template <> struct binary_arg<unsigned char> :
+    binary_scalar_arg<unsigned char, binary_format::arg_type::unsigned_char> {};
+
+// template_formatter formats bool as int, by way of integral promotion.
+template <> struct binary_arg<bool> :
+    binary_scalar_arg<bool, binary_format::arg_type::int32, std::int32_t> {};
+template <> struct binary_arg<short> : binary_integer_arg<short> {};
+template <> struct binary_arg<unsigned short> : binary_integer_arg<unsigned short> {};
+template <> struct binary_arg<int> : binary_integer_arg<int> {};
+template <> struct binary_arg<unsigned int> : binary_integer_arg<unsigned int> {};
+template <> struct binary_arg<long> : binary_integer_arg<long> {};
+template <> struct binary_arg<unsigned long> : binary_integer_arg<unsigned long> {};
+template <> struct binary_arg<long long> : binary_integer_arg<long long> {};
+template <> struct binary_arg<unsigned long long> : binary_integer_arg<unsigned long long> {};
+
+template <> struct binary_arg<float> :
+    binary_scalar_arg<float, binary_format::arg_type::float_> {};
+template <> struct binary_arg<double> :
+    binary_scalar_arg<double, binary_format::arg_type::double_> {};
+template <> struct binary_arg<long double> :
+    binary_scalar_arg<long double, binary_format::arg_type::long_double> {};
+
+// Strings are copied into the file, so %p on a char const* will show the
+// address of the string in the decoder rather than in the logging process.
+template <> struct binary_arg<char const*> {
+    static bool const supported = true;
+    static void encode(output_buffer* pbuffer, char const* s)
+    {
+        put_string_arg(pbuffer, s, s? std::strlen(s) : 0);
+    }
+};
+template <> struct binary_arg<char*> : binary_arg<char const*> {};
+template <> struct binary_arg<std::string> {
+    static bool const supported = true;
+    static void encode(output_buffer* pbuffer, std::string const& s)
+    {
+        put_string_arg(pbuffer, s.data(), s.size());
+    }
+};
+
+template <> struct binary_arg<captured_string> {
+    static bool const supported = true;
+    static void encode(output_buffer* pbuffer, captured_string const& s)
+    {
+        put_string_arg(pbuffer, s.data(), s.size());
+    }
+};
+#if RECKLESS_HAS_STRING_VIEW
+template <> struct binary_arg<std::string_view> {
+    static bool const supported = true;
+    static void encode(output_buffer* pbuffer, std::string_view s)
+    {
+        put_string_arg(pbuffer, s.data(), s.size());
+    }
+};
+#endif
+
+template <typename T>
+struct binary_arg<T*> {
+    static bool const supported = true;
+    static void encode(output_buffer* pbuffer, T const* p)
+    {
+        put_arg(pbuffer, binary_format::arg_type::pointer,
+            static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p)));
+    }
+};
+
+template <typename T>
+struct binary_arg_supported : binary_arg<typename std::decay<T>::type> {};
+
+inline std::int64_t binary_timestamp()
+{
+#if defined(__unix__)
+    struct timespec ts;
+#if defined(__linux__)
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+    return static_cast<std::int64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+#endif
+}
+
+template <bool... Values>
+struct all_true;
+template <>
+struct all_true<> {
+    static bool const value = true;
+};
+template <bool Value, bool... Values>
+struct all_true<Value, Values...> {
+    static bool const value = Value && all_true<Values...>::value;
+};
+
+}   // namespace detail
+
+class binary_formatter {
+public:
+    static bool const accepts_captured_strings = true;
+
+    template <typename... Args>
+    static void format(output_buffer* pbuffer,
+        detail::binary_format_table* ptable, std::int64_t timestamp,
+        char const* pformat, Args&&... args)
+    {
+        // Any exception that leaves here makes the log revert the output of
+        // this record, or count it as lost.
+        try {
+            std::uint32_t id = ptable->lookup(pbuffer, pformat);
+            char* p = pbuffer->reserve(1 + 4 + 8 + 1);
+            p[0] = static_cast<char>(binary_format::record_type::entry);
+            std::memcpy(p + 1, &id, 4);
+            std::memcpy(p + 5, &timestamp, 8);
+            p[13] = static_cast<char>(sizeof...(Args));
+            pbuffer->commit(1 + 4 + 8 + 1);
+            encode(pbuffer, args...);
+        } catch(...) {
+            ptable->revert_frame();
+            throw;
+        }
+        ptable->frame_end();
+    }
+
+private:
+    template <typename T, typename... Remaining>
+    static void encode(output_buffer* pbuffer, T const& value,
+        Remaining const&... remaining)
+    {
+        detail::binary_arg<T>::encode(pbuffer, value);
+        encode(pbuffer, remaining...);
+    }
+
+    static void encode(output_buffer*)
+    {
+    }
+};
+
+// A log that does not format anything. Instead it writes the format string
+// and the raw argument values, together with a timestamp, to a compact
+// binary file. Use reckless-decode to turn the file into text. The result
+// looks like what policy_log<no_indent, ' ', timestamp_field> would have
+// written.
+//
+// Only argument types with built-in formatting support can be used (see
+// binary_format::arg_type). The format string must be a string literal or
+// otherwise stay valid, and at the same address, for as long as the log is
+// open; after the first use, only an id for it is written to the file.
+class binary_log : public basic_log {
+public:
+    binary_log() = default;
+    binary_log(writer* pwriter)
+    {
+        open(pwriter);
+    }
+    binary_log(writer* pwriter,
+        std::size_t input_buffer_capacity,
+        std::size_t output_buffer_capacity)
+    {
+        open(pwriter, input_buffer_capacity, output_buffer_capacity);
+    }
+    binary_log(writer* pwriter, log_options const& options)
+    {
+        open(pwriter, options);
+    }
+
+    // Each open() starts a new session in the file.
+    void open(writer* pwriter)
+    {
+        format_table_.reset();
+        basic_log::open(pwriter);
+    }
+    void open(writer* pwriter,
+        std::size_t input_buffer_capacity,
+        std::size_t output_buffer_capacity)
+    {
+        format_table_.reset();
+        basic_log::open(pwriter, input_buffer_capacity,
+            output_buffer_capacity);
+    }
+    void open(writer* pwriter, log_options const& options)
+    {
+        // Records refer to format strings that an earlier record defined, so
+        // they have to be formatted one at a time, in order.
+        log_options binary_options = options;
+        binary_options.formatter_threads = 0;
+        format_table_.reset();
+        basic_log::open(pwriter, binary_options);
+    }
+
+    template <typename... Args>
+    void write(char const* fmt, Args&&... args)
+    {
+        static_assert(detail::all_true<
+            detail::binary_arg_supported<Args>::supported...>::value,
+            "binary_log only supports argument types that have built-in "
+            "formatting");
+        static_assert(sizeof...(Args) < 256,
+            "binary_log supports at most 255 arguments");
+        basic_log::write<binary_formatter>(
+            &format_table_,
+            detail::binary_timestamp(),
+            fmt,
+            std::forward<Args>(args)...);
+    }
+
+protected:
+    // Written as an ordinary entry, so that reckless-decode shows it like
+    // any other record.
+    void write_dropped_input_report(reckless::output_buffer* pbuffer,
+        unsigned count) override;
+
+private:
+    detail::binary_format_table format_table_;
+};
+
+}   // namespace reckless
+
+#endif  // RECKLESS_BINARY_LOG_HPP
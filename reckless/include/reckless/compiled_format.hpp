@@ -0,0 +1,448 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_COMPILED_FORMAT_HPP
+#define RECKLESS_COMPILED_FORMAT_HPP
+
+#include <reckless/template_formatter.hpp>
+#include <reckless/output_buffer.hpp>
+#include <reckless/ntoa.hpp>    // itoa_base10, conversion_specification
+
+#include <cstddef>      // size_t
+#include <cstdint>      // uintptr_t
+#include <cstring>      // strlen
+#include <string>
+#include <type_traits>  // decay, integral_constant
+#include <utility>      // forward
+
+// A format string that is parsed at compile time. Use it in place of a string
+// literal when writing to the log:
+//
+//     g_log.write(RECKLESS_FMT("%d items at %.2f"), count, price);
+//
+// Literal text between conversions is copied with a fixed-size write, and
+// each argument goes straight to the right conversion function with flags,
+// width and precision already worked out. So the output worker doesn't have
+// to scan the format string. Also, having too few or too many arguments for
+// the format string is a compile error, and so is a conversion that the
+// argument type doesn't support, such as %d for a string.
+//
+// The argument must be a string literal.
+#define RECKLESS_FMT(s) \
+    ([] { \
+        struct reckless_format_string { \
+            static constexpr char const* data() { return s; } \
+            static constexpr std::size_t size() { return sizeof(s) - 1; } \
+        }; \
+        return ::reckless::compiled_format<reckless_format_string>(); \
+    }())
+
+namespace reckless {
+
+template <class String>
+struct compiled_format {
+    static constexpr char const* c_str()
+    {
+        return String::data();
+    }
+};
+
+namespace detail {
+
+// C++11 constexpr functions have to be a single return statement, so we
+// recurse. The search for the next '%' splits the range in half at each
+// level, to keep the recursion depth down for long format strings.
+constexpr std::size_t find_percent(char const* s, std::size_t begin,
+    std::size_t end)
+{
+    return end - begin == 0? end :
+        end - begin == 1? (s[begin] == '%'? begin : end) :
+        find_percent(s, begin, begin + (end - begin)/2) != begin + (end - begin)/2?
+            find_percent(s, begin, begin + (end - begin)/2) :
+            find_percent(s, begin + (end - begin)/2, end);
+}
+
+constexpr bool is_format_flag(char c)
+{
+    return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0';
+}
+
+constexpr bool is_format_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr std::size_t skip_format_flags(char const* s, std::size_t i)
+{
+    return is_format_flag(s[i])? skip_format_flags(s, i+1) : i;
+}
+
+constexpr std::size_t skip_format_digits(char const* s, std::size_t i)
+{
+    return is_format_digit(s[i])? skip_format_digits(s, i+1) : i;
+}
+
+constexpr bool has_format_flag(char const* s, std::size_t begin,
+    std::size_t end, char flag)
+{
+    return begin != end && (s[begin] == flag ||
+        has_format_flag(s, begin+1, end, flag));
+}
+
+constexpr unsigned parse_format_number(char const* s, std::size_t begin,
+    std::size_t end, unsigned value)
+{
+    return begin == end? value :
+        parse_format_number(s, begin+1, end, 10*value + (s[begin] - '0'));
+}
+
+enum class format_piece_kind {
+    end,        // No more conversions.
+    percent,    // "%%"
+    conversion  // Anything else starting with '%'.
+};
+
+// Parse the format string from position Pos up to and including the next
+// conversion. The conversion syntax is the same as parse_conversion_specification()
+// in template_formatter.cpp: flags, width, optional precision, then the
+// conversion character.
+template <class String, std::size_t Pos>
+struct format_piece {
+    using string = String;
+    static constexpr std::size_t size = String::size();
+
+    // Literal text is [Pos, literal_end).
+    static constexpr std::size_t literal_end = find_percent(String::data(), Pos, size);
+    static constexpr format_piece_kind kind =
+        literal_end == size? format_piece_kind::end :
+        String::data()[literal_end+1] == '%'? format_piece_kind::percent :
+            format_piece_kind::conversion;
+
+    // Conversion specification, starting after the '%'. If there is no
+    // conversion we point it at the terminating null character, just so
+    // everything below stays inside the string.
+    static constexpr std::size_t spec =
+        kind == format_piece_kind::conversion? literal_end + 1 : size;
+    static constexpr std::size_t flags_end = skip_format_flags(String::data(), spec);
+    static constexpr std::size_t width_end = skip_format_digits(String::data(), flags_end);
+    static constexpr bool has_precision = String::data()[width_end] == '.';
+    static constexpr std::size_t precision_end = has_precision?
+        skip_format_digits(String::data(), width_end + 1) : width_end;
+    static constexpr std::size_t conversion_pos = precision_end;
+    static constexpr char conversion = String::data()[conversion_pos];
+    // Where to continue after this piece.
+    static constexpr std::size_t next =
+        kind == format_piece_kind::percent? literal_end + 2 :
+        conversion_pos + (conversion == '\0'? 0 : 1);
+
+    static constexpr bool left_justify = has_format_flag(String::data(), spec, flags_end, '-');
+    static constexpr bool alternative_form = has_format_flag(String::data(), spec, flags_end, '#');
+    static constexpr bool pad_with_zeroes = has_format_flag(String::data(), spec, flags_end, '0');
+    static constexpr char plus_sign =
+        has_format_flag(String::data(), spec, flags_end, '+')? '+' :
+        has_format_flag(String::data(), spec, flags_end, ' ')? ' ' : 0;
+    static constexpr unsigned minimum_field_width =
+        parse_format_number(String::data(), flags_end, width_end, 0);
+    static constexpr unsigned precision =
+        !has_precision || precision_end == width_end + 1?
+            UNSPECIFIED_PRECISION :
+            parse_format_number(String::data(), width_end + 1, precision_end, 0);
+    // True for a bare conversion character with no flags, width or precision,
+    // which is all that e.g. %s supports.
+    static constexpr bool is_plain = conversion_pos == spec;
+
+    static conversion_specification specification()
+    {
+        conversion_specification cs;
+        cs.minimum_field_width = minimum_field_width;
+        cs.precision = precision;
+        cs.plus_sign = plus_sign;
+        cs.left_justify = left_justify;
+        cs.alternative_form = alternative_form;
+        cs.pad_with_zeroes = pad_with_zeroes;
+        cs.uppercase = conversion == 'X' || conversion == 'F'
+            || conversion == 'E' || conversion == 'G';
+        return cs;
+    }
+};
+
+template <class String, std::size_t Begin, std::size_t End>
+inline void write_format_literal(output_buffer* pbuffer)
+{
+    if(End != Begin)
+        pbuffer->write(String::data() + Begin, End - Begin);
+}
+
+// How each argument type is formatted. This mirrors the format() overloads
+// in template_formatter.cpp, and each check below accepts exactly what they
+// accept.
+enum class format_arg_category {
+    integer,
+    floating_point,
+    character,
+    c_string,
+    string,
+    pointer,
+    custom
+};
+
+template <typename T>
+struct format_arg_category_of {
+    static constexpr format_arg_category value = format_arg_category::custom;
+};
+
+template <format_arg_category Category>
+struct format_arg_category_constant {
+    static constexpr format_arg_category value = Category;
+};
+
+#define RECKLESS_FORMAT_ARG_CATEGORY(Type, Category) \
+    template <> struct format_arg_category_of<Type> : \
+        format_arg_category_constant<format_arg_category::Category> {}
+
+RECKLESS_FORMAT_ARG_CATEGORY(bool, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(short, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(unsigned short, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(int, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(unsigned int, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(long, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(unsigned long, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(long long, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(unsigned long long, integer);
+RECKLESS_FORMAT_ARG_CATEGORY(float, floating_point);
+RECKLESS_FORMAT_ARG_CATEGORY(double, floating_point);
+RECKLESS_FORMAT_ARG_CATEGORY(long double, floating_point);
+RECKLESS_FORMAT_ARG_CATEGORY(char, character);
+RECKLESS_FORMAT_ARG_CATEGORY(signed char, character);
+RECKLESS_FORMAT_ARG_CATEGORY(unsigned char, character);
+RECKLESS_FORMAT_ARG_CATEGORY(char const*, c_string);
+RECKLESS_FORMAT_ARG_CATEGORY(char*, c_string);
+RECKLESS_FORMAT_ARG_CATEGORY(std::string, string);
+
+#undef RECKLESS_FORMAT_ARG_CATEGORY
+
+template <typename T>
+struct format_arg_category_of<T*> :
+    format_arg_category_constant<format_arg_category::pointer> {};
+
+template <class Piece, format_arg_category Category>
+struct format_arg;
+
+template <class Piece>
+struct format_arg<Piece, format_arg_category::integer> {
+    static_assert(Piece::conversion == 'd' || Piece::conversion == 'x'
+        || Piece::conversion == 'X',
+        "integer arguments need a %d, %x or %X conversion");
+
+    template <typename T>
+    static void format(output_buffer* pbuffer, T value)
+    {
+        // Unary + gives us the same integral promotion as when calling the
+        // format() overloads.
+        if(Piece::conversion == 'd')
+            itoa_base10(pbuffer, +value, Piece::specification());
+        else
+            itoa_base16(pbuffer, +value, Piece::specification());
+    }
+};
+
+template <class Piece>
+struct format_arg<Piece, format_arg_category::floating_point> {
+    static_assert(Piece::conversion == 'f' || Piece::conversion == 'F'
+        || Piece::conversion == 'e' || Piece::conversion == 'E'
+        || Piece::conversion == 'g' || Piece::conversion == 'G',
+        "floating-point arguments need a %f, %e or %g conversion");
+
+    template <typename T>
+    static void format(output_buffer* pbuffer, T value)
+    {
+        if(Piece::conversion == 'f' || Piece::conversion == 'F')
+            ftoa_base10_f(pbuffer, static_cast<double>(value),
+                Piece::specification());
+        else if(Piece::conversion == 'e' || Piece::conversion == 'E')
+            ftoa_base10_e(pbuffer, static_cast<double>(value),
+                Piece::specification());
+        else
+            ftoa_base10_g(pbuffer, static_cast<double>(value),
+                Piece::specification());
+    }
+};
+
+template <class Piece>
+struct format_arg<Piece, format_arg_category::character> {
+    static_assert((Piece::conversion == 's' && Piece::is_plain)
+        || Piece::conversion == 'd' || Piece::conversion == 'x'
+        || Piece::conversion == 'X',
+        "character arguments need a %s (without flags or width), %d, %x or "
+        "%X conversion");
+
+    template <typename T>
+    static void format(output_buffer* pbuffer, T value)
+    {
+        format(pbuffer, value, std::integral_constant<bool,
+            Piece::conversion == 's'>());
+    }
+
+private:
+    template <typename T>
+    static void format(output_buffer* pbuffer, T value, std::true_type)
+    {
+        pbuffer->write(static_cast<char>(value));
+    }
+
+    template <typename T>
+    static void format(output_buffer* pbuffer, T value, std::false_type)
+    {
+        format_arg<Piece, format_arg_category::integer>::format(pbuffer,
+            static_cast<int>(value));
+    }
+};
+
+inline void format_pointer(output_buffer* pbuffer, void const* p)
+{
+    conversion_specification cs;
+    cs.precision = 1;
+    cs.alternative_form = true;
+    itoa_base16(pbuffer, reinterpret_cast<std::uintptr_t>(p), cs);
+}
+
+template <class Piece>
+struct format_arg<Piece, format_arg_category::c_string> {
+    static_assert((Piece::conversion == 's' || Piece::conversion == 'p')
+        && Piece::is_plain,
+        "string arguments need a %s or %p conversion without flags or width");
+
+    static void format(output_buffer* pbuffer, char const* s)
+    {
+        if(Piece::conversion == 's')
+            pbuffer->write(s, std::strlen(s));
+        else
+            format_pointer(pbuffer, s);
+    }
+};
+
+template <class Piece>
+struct format_arg<Piece, format_arg_category::string> {
+    static_assert(Piece::conversion == 's' && Piece::is_plain,
+        "std::string arguments need a %s conversion without flags or width");
+
+    static void format(output_buffer* pbuffer, std::string const& s)
+    {
+        pbuffer->write(s.data(), s.size());
+    }
+};
+
+template <class Piece>
+struct format_arg<Piece, format_arg_category::pointer> {
+    static_assert((Piece::conversion == 'p' || Piece::conversion == 's')
+        && Piece::is_plain,
+        "pointer arguments need a %p conversion without flags or width");
+
+    static void format(output_buffer* pbuffer, void const* p)
+    {
+        format_pointer(pbuffer, p);
+    }
+};
+
+// For types with a custom format() function we can't check anything. We
+// assume that the conversion follows the usual syntax, so that we know where
+// the literal text after it starts.
+template <class Piece>
+struct format_arg<Piece, format_arg_category::custom> {
+    static_assert(Piece::conversion != '\0',
+        "the format string ends in the middle of a conversion");
+
+    template <typename T>
+    static void format(output_buffer* pbuffer, T&& value)
+    {
+        char const* pspec = Piece::string::data() + Piece::spec;
+        if(!invoke_custom_format(pbuffer, pspec, std::forward<T>(value))) {
+            // Same as template_formatter: output the conversion as is.
+            pbuffer->write('%');
+            pbuffer->write(pspec, Piece::next - Piece::spec);
+        }
+    }
+};
+
+template <class String, std::size_t Pos,
+    format_piece_kind Kind = format_piece<String, Pos>::kind>
+struct compiled_formatter;
+
+template <class String, std::size_t Pos>
+struct compiled_formatter<String, Pos, format_piece_kind::end> {
+    template <typename... Args>
+    static void format(output_buffer* pbuffer, Args&&...)
+    {
+        static_assert(sizeof...(Args) == 0,
+            "too many arguments for the format string");
+        write_format_literal<String, Pos, String::size()>(pbuffer);
+    }
+};
+
+template <class String, std::size_t Pos>
+struct compiled_formatter<String, Pos, format_piece_kind::percent> {
+    using piece = format_piece<String, Pos>;
+
+    template <typename... Args>
+    static void format(output_buffer* pbuffer, Args&&... args)
+    {
+        // Include the first '%' in the literal text.
+        write_format_literal<String, Pos, piece::literal_end + 1>(pbuffer);
+        compiled_formatter<String, piece::next>::format(pbuffer,
+            std::forward<Args>(args)...);
+    }
+};
+
+template <class String, std::size_t Pos>
+struct compiled_formatter<String, Pos, format_piece_kind::conversion> {
+    using piece = format_piece<String, Pos>;
+
+    template <typename T, typename... Args>
+    static void format(output_buffer* pbuffer, T&& value, Args&&... args)
+    {
+        write_format_literal<String, Pos, piece::literal_end>(pbuffer);
+        format_arg<piece, format_arg_category_of<
+            typename std::decay<T>::type>::value>::format(pbuffer,
+                std::forward<T>(value));
+        compiled_formatter<String, piece::next>::format(pbuffer,
+            std::forward<Args>(args)...);
+    }
+
+    static void format(output_buffer*)
+    {
+        static_assert(sizeof(String) == 0,
+            "too few arguments for the format string");
+    }
+};
+
+}   // namespace detail
+
+template <class String, typename... Args>
+void template_formatter::format(output_buffer* pbuffer,
+        compiled_format<String>, Args&&... args)
+{
+    detail::compiled_formatter<String, 0>::format(pbuffer,
+        std::forward<Args>(args)...);
+}
+
+}   // namespace reckless
+
+#endif  // RECKLESS_COMPILED_FORMAT_HPP
@@ -0,0 +1,99 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_DETAIL_ASYNC_WRITER_HPP
+#define RECKLESS_DETAIL_ASYNC_WRITER_HPP
+
+#include <reckless/writer.hpp>
+
+#include <cstddef>  // size_t
+#include <cstdint>  // uint64_t
+#include <vector>
+#include <memory>   // unique_ptr
+
+namespace reckless {
+namespace detail {
+
+// Common machinery for writers that do their actual writing in the
+// background, so the output worker can go on formatting while the disk is
+// busy. Data passed to write() is copied into one of a fixed number of
+// chunks, the chunk is submitted, and write() returns. write() only blocks
+// when every chunk is in flight, which bounds both memory use and how far
+// ahead of the disk the log can get.
+//
+// A failed background write is reported by a later call to write(). The
+// failed chunks are then resubmitted, in order, on each call until they go
+// through, and until that happens write() accepts no new data. From the
+// log's point of view it looks just like a synchronous writer that keeps
+// failing, so the usual error policies apply.
+class async_writer : public writer {
+public:
+    std::size_t write(void const* pbuffer, std::size_t count,
+            std::error_code& ec) noexcept override;
+
+protected:
+    struct chunk {
+        char* pdata;
+        std::size_t size;       // Number of bytes in pdata.
+        std::size_t written;    // Number of bytes written so far.
+        std::uint64_t offset;   // Stream position of pdata[0].
+        std::error_code error;  // Set if the last attempt failed.
+    };
+
+    async_writer(std::size_t chunk_count, std::size_t chunk_size);
+    ~async_writer();
+
+    // Start writing bytes [written, size) of the chunk in the background.
+    // Chunks are submitted in stream order, except when failed chunks are
+    // resubmitted (which also happens in stream order, but after chunks
+    // with a higher offset).
+    virtual void submit(chunk* pchunk) noexcept = 0;
+    // Return a submitted chunk once it has been completely written or has
+    // failed, in which case its error member is set. If block is false and
+    // no chunk has finished yet then return nullptr.
+    virtual chunk* complete(bool block) noexcept = 0;
+    // Called before failed chunks are resubmitted, once no chunks are in
+    // flight.
+    virtual void resume() noexcept;
+
+    // Wait for all chunks in flight. If some of them fail, retry them once.
+    // Derived classes must call this in their destructor, since we can't
+    // call submit() and complete() from ours.
+    void drain() noexcept;
+
+private:
+    void finish(chunk* pchunk) noexcept;
+    void wait_in_flight() noexcept;
+    void retry_failed(std::error_code& ec) noexcept;
+
+    std::size_t chunk_size_;
+    std::unique_ptr<char[]> storage_;
+    std::vector<chunk> chunks_;
+    std::vector<chunk*> free_chunks_;
+    std::vector<chunk*> failed_chunks_;
+    std::size_t in_flight_ = 0;
+    std::uint64_t position_ = 0;
+};
+
+}   // namespace detail
+}   // namespace reckless
+
+#endif  // RECKLESS_DETAIL_ASYNC_WRITER_HPP
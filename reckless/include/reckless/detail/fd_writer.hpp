@@ -27,6 +27,11 @@
 namespace reckless {
 namespace detail {
 
+// Error category for errno (or GetLastError() on Windows) values from file
+// writes. Codes in this category compare equal to writer::temporary_failure
+// or writer::permanent_failure as appropriate.
+std::error_category const& fd_error_category();
+
 class fd_writer : public writer {
 public:
 #if defined(__unix__)
@@ -36,6 +41,10 @@ public:
 #endif
 
     std::size_t write(void const* pbuffer, std::size_t count, std::error_code& ec) noexcept override;
+#if defined(__unix__)
+    std::size_t writev(write_segment const* psegments,
+            std::size_t segment_count, std::error_code& ec) noexcept override;
+#endif
 
 #if defined(__unix__)
     int fd_;
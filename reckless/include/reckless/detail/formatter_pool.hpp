@@ -0,0 +1,159 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_DETAIL_FORMATTER_POOL_HPP
+#define RECKLESS_DETAIL_FORMATTER_POOL_HPP
+
+#include <reckless/output_buffer.hpp>
+#include <reckless/writer.hpp>
+
+#include <condition_variable>
+#include <cstddef>      // size_t
+#include <exception>    // exception_ptr
+#include <memory>       // unique_ptr
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reckless {
+namespace detail {
+
+class mpsc_ring_buffer;
+
+// What became of one input frame in a format_job.
+struct formatted_frame {
+    void* pframe;           // The frame, at its address in the first mapping.
+    std::size_t output_end; // Where the frame's output ends in the job output.
+    std::exception_ptr error;   // Set if the formatter threw.
+    bool lost;              // The formatter got a flush_error.
+};
+
+// A run of initialized input frames that a formatter thread formats into
+// memory of its own. The output worker then copies the result to the real
+// output buffer, one frame at a time, so that it can deal with writer errors
+// and format errors the same way as when it formats the frames itself.
+//
+// The job formats into an output_buffer with the same capacity as the log's,
+// so that a formatter that produces more than fits in the buffer fails the
+// same way. Whatever doesn't fit is moved to output_ by flush(), through
+// the writer interface.
+class format_job : private writer, private output_buffer {
+public:
+    explicit format_job(std::size_t output_capacity);
+
+    void assign(mpsc_ring_buffer* pinput, char* pbegin, char* pend)
+    {
+        pinput_ = pinput;
+        pbegin_ = pbegin;
+        pend_ = pend;
+    }
+
+    void format();
+
+    char const* output() const
+    {
+        return output_.data();
+    }
+    std::vector<formatted_frame> const& frames() const
+    {
+        return frames_;
+    }
+
+private:
+    std::size_t write(void const* pbuffer, std::size_t count,
+            std::error_code& ec) noexcept override;
+
+    friend class formatter_pool;
+    mpsc_ring_buffer* pinput_ = nullptr;
+    char* pbegin_ = nullptr;
+    char* pend_ = nullptr;
+    std::vector<char> output_;
+    std::vector<formatted_frame> frames_;
+    bool discard_ = false;  // Make write() throw the data away.
+    bool done_ = false;     // access synchronized by formatter_pool::mutex_
+};
+
+// Threads that format jobs for one output worker, which submits the jobs and
+// commits them in the same order. The worker helps out with any job that
+// nobody has claimed yet when it gets to it, so that it never sits idle
+// waiting for a formatter thread that hasn't been scheduled.
+class formatter_pool {
+public:
+    formatter_pool(unsigned thread_count, std::size_t output_capacity,
+        std::vector<unsigned> const& cpus);
+    ~formatter_pool();
+
+    formatter_pool(formatter_pool const&) = delete;
+    formatter_pool& operator=(formatter_pool const&) = delete;
+
+    unsigned thread_count() const
+    {
+        return static_cast<unsigned>(threads_.size());
+    }
+
+    // The job to fill in and submit next, or nullptr if all jobs are in
+    // flight and the oldest one has to be committed first.
+    format_job* next_job()
+    {
+        if(submitted_ - retired_ == jobs_.size())
+            return nullptr;
+        return jobs_[submitted_ % jobs_.size()].get();
+    }
+    void submit();
+
+    // The oldest job that has been submitted but not retired, or nullptr.
+    format_job* oldest_job()
+    {
+        if(submitted_ == retired_)
+            return nullptr;
+        return jobs_[retired_ % jobs_.size()].get();
+    }
+    // Wait for the oldest job to be formatted and return it. It stays in
+    // flight until retire() is called.
+    format_job* wait_oldest_job();
+    void retire()
+    {
+        ++retired_;
+    }
+
+private:
+    void thread_main(std::vector<unsigned> const& cpus);
+    format_job* claim_job();    // Needs mutex_.
+    void run_job(std::unique_lock<std::mutex>& lk, format_job* pjob);
+
+    std::vector<std::unique_ptr<format_job>> jobs_;
+    // Jobs are submitted, claimed and retired in order. Only the output
+    // worker changes submitted_, and it does so while holding mutex_.
+    // retired_ is only used by the output worker.
+    std::size_t submitted_ = 0;
+    std::size_t retired_ = 0;
+    std::size_t claimed_ = 0;       // access synchronized by mutex_
+    bool stop_ = false;             // access synchronized by mutex_
+    std::mutex mutex_;
+    std::condition_variable job_submitted_;
+    std::condition_variable job_done_;
+    std::vector<std::thread> threads_;
+};
+
+}   // namespace detail
+}   // namespace reckless
+
+#endif  // RECKLESS_DETAIL_FORMATTER_POOL_HPP
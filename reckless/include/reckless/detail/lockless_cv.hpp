@@ -57,9 +57,13 @@ namespace detail {
 //
 // Note that, just like with ordinary condition variables, a completed wait()
 // does not guarantee that the desired condition is fulfilled.
+//
+// Waiting threads register themselves in a waiter count before going to
+// sleep, which lets notify_all() skip the wake-up system call entirely when
+// nobody is waiting. See atomic_fetch_add_seq_cst() for how that works.
 class lockless_cv {
 public:
-    lockless_cv() : notify_count_(0) {}
+    lockless_cv() : notify_count_(0), waiters_(0) {}
 
     unsigned notify_count() const
     {
@@ -72,6 +76,7 @@ public:
 
 private:
     unsigned notify_count_;
+    int waiters_;
 };
 
 }   // namespace detail
@@ -23,11 +23,37 @@
 
 #include <cstdlib>  // size_t
 #include <cstdint>  // uint64_t, uintptr_t
-#include <cstring>  // memset
 
 namespace reckless {
 namespace detail {
 
+// Round capacity up to a size that map_ring_memory() can handle, i.e. a
+// power-of-two multiple of the page size (or allocation granularity on
+// Windows).
+std::size_t round_ring_capacity(std::size_t capacity);
+
+// Flags for map_ring_memory().
+enum ring_memory_flags : unsigned {
+    // Use huge pages if the capacity is a multiple of the huge page size and
+    // the system has enough of them available (Linux only). Otherwise
+    // ordinary pages are used.
+    ring_memory_huge_pages = 1,
+    // Lock the memory in RAM with mlock, if RLIMIT_MEMLOCK allows it.
+    ring_memory_locked = 2,
+    // Fault in every page of both mappings up front, so that nobody takes a
+    // page fault when they first write to it.
+    ring_memory_prefault = 4
+};
+
+// Map the same capacity bytes of memory twice, at consecutive addresses, so
+// that pbase[i] and pbase[i+capacity] refer to the same byte. Capacity must
+// come from round_ring_capacity(). The memory is zero-filled. Throws
+// bad_alloc on failure. Huge pages and locking are best effort; if
+// pactual_flags is given, it receives the flags that took effect.
+char* map_ring_memory(std::size_t capacity, unsigned flags = 0,
+    unsigned* pactual_flags = nullptr);
+void unmap_ring_memory(char* pbase, std::size_t capacity);
+
 // This is a lock-free, multiple-producer, single-consumer "magic ring buffer":
 // a ring buffer / circular buffer that takes advantage of the virtual memory
 // system to map the same physical memory twice to consecutive memory addresses.
@@ -48,11 +74,13 @@ public:
         rewind();
         pbuffer_start_ = nullptr;
         capacity_ = 0;
+        lap_tag_offset_ = 0;
+        memory_flags_ = 0;
     }
 
-    mpsc_ring_buffer(std::size_t capacity)
+    mpsc_ring_buffer(std::size_t capacity, unsigned memory_flags = 0)
     {
-        init(capacity);
+        init(capacity, memory_flags);
     }
 
     ~mpsc_ring_buffer()
@@ -60,13 +88,28 @@ public:
         destroy();
     }
 
-    void reserve(std::size_t capacity)
+    // memory_flags are ring_memory_flags for map_ring_memory(). The memory
+    // is always prefaulted.
+    void reserve(std::size_t capacity, unsigned memory_flags = 0)
     {
         destroy();
-        init(capacity);
+        init(capacity, memory_flags);
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return capacity_;
     }
 
-    void* push(std::size_t size) noexcept
+    // The ring_memory_flags that took effect when the memory was mapped.
+    unsigned memory_flags() const noexcept
+    {
+        return memory_flags_;
+    }
+
+    // If pposition is given, it receives the position of the pushed block,
+    // for use with lap_tag().
+    void* push(std::size_t size, std::uint64_t* pposition = nullptr) noexcept
     {
         auto capacity = capacity_;
         for(;;pause()) {
@@ -78,9 +121,38 @@ public:
                 return nullptr;
             }
 
-            if(atomic_compare_exchange_weak_relaxed(&next_write_position_, wp, nwp))
+            if(atomic_compare_exchange_weak_relaxed(&next_write_position_, wp, nwp)) {
+                if(pposition)
+                    *pposition = wp;
                 return pbuffer_start_ + (wp & (capacity-1));
+            }
+        }
+    }
+
+    // Same as push(), but for buffers that only ever have a single producer
+    // thread. Since nobody else can move the write position we can skip the
+    // compare-and-swap loop and just store the new position. The producer
+    // also keeps its own copy of the read position and only reads the real
+    // one when the copy says the buffer is full, so that it doesn't have to
+    // touch the consumer's cache line for every block. Mixing this with
+    // push() or deplete() on the same buffer is a race.
+    void* push_exclusive(std::size_t size,
+        std::uint64_t* pposition = nullptr) noexcept
+    {
+        auto capacity = capacity_;
+        auto wp = next_write_position_;
+        auto nwp = wp + size;
+        if(unlikely(nwp - next_read_position_cached_ > capacity)) {
+            next_read_position_cached_ =
+                atomic_load_relaxed(&next_read_position_);
+            if(nwp - next_read_position_cached_ > capacity)
+                return nullptr;
         }
+
+        atomic_store_relaxed(&next_write_position_, nwp);
+        if(pposition)
+            *pposition = wp;
+        return pbuffer_start_ + (wp & (capacity-1));
     }
 
     // Allocate all remaining space, filling the buffer to its capacity.
@@ -103,6 +175,37 @@ public:
         return pbuffer_start_ + (next_read_position_ & (capacity_ - 1));
     }
 
+    // Map an address in the second mapping of the buffer to the
+    // corresponding address in the first mapping, which is where push()
+    // hands out memory.
+    void* wrap(void* p) const noexcept
+    {
+        auto offset = static_cast<std::size_t>(static_cast<char*>(p) - pbuffer_start_);
+        return pbuffer_start_ + (offset & (capacity_ - 1));
+    }
+
+    // The position of an address in [front(), front() + size()).
+    std::uint64_t position_of(void const* p) const noexcept
+    {
+        auto pfront = pbuffer_start_ + (next_read_position_ & (capacity_ - 1));
+        return next_read_position_ + static_cast<std::uint64_t>(
+            static_cast<char const*>(p) - pfront);
+    }
+
+    // A value that is the same for every position on the same lap around
+    // the buffer, and different for positions on different laps, so that
+    // whoever reads the memory can tell data that was written on this lap
+    // from whatever was left there on an earlier one. The lowest 3 bits are
+    // always zero. Each buffer gets a random offset so that the tags are
+    // unlikely to turn up in the data itself.
+    std::uint64_t lap_tag(std::uint64_t position) const noexcept
+    {
+        // Multiplying by an odd number keeps different laps apart, since
+        // position/capacity_ can't reach 2^64/capacity_.
+        return (position & ~static_cast<std::uint64_t>(capacity_ - 1))
+            *0x9e3779b97f4a7c15 + lap_tag_offset_;
+    }
+
     std::size_t size() noexcept
     {
         auto wp = atomic_load_relaxed(&next_write_position_);
@@ -120,11 +223,12 @@ public:
     }
 
 private:
-    void init(std::size_t capacity);
+    void init(std::size_t capacity, unsigned memory_flags);
     void destroy();
     void rewind()
     {
         next_write_position_ = 0;
+        next_read_position_cached_ = 0;
         next_read_position_ = 0;
     }
 
@@ -134,15 +238,18 @@ private:
     char padding1_[RECKLESS_CACHE_LINE_SIZE];
     char* pbuffer_start_;
     std::size_t capacity_;
-    char padding2_[RECKLESS_CACHE_LINE_SIZE
-        - sizeof(char*) - sizeof(std::size_t)];
+    std::uint64_t lap_tag_offset_;
+    unsigned memory_flags_;
+    char padding2_[RECKLESS_CACHE_LINE_SIZE - sizeof(char*)
+        - sizeof(std::size_t) - sizeof(std::uint64_t) - sizeof(unsigned)];
 
     // Next, variables that are updated by the producer and read by
     // the consumer. Strictly the consumer does not access
     // next_read_position_cached_ at all, but when it is updated it
     // always happens together with next_write_position_ anyway.
     std::uint64_t next_write_position_;
-    char padding3_[RECKLESS_CACHE_LINE_SIZE - 1*8];
+    std::uint64_t next_read_position_cached_;
+    char padding3_[RECKLESS_CACHE_LINE_SIZE - 2*8];
 
     // Finally, next_read_position_ is updated by the consumer and
     // somtimes read by the producer.
@@ -26,9 +26,18 @@
 #define RECKLESS_CACHE_LINE_SIZE 64
 #endif
 
+#include <cstddef>  // size_t
 #include <cstdint>  // uint64_t, int64_t
 #include <type_traits>  // enable_if, underlying_type
 
+// The library itself is C++11, but std::string_view arguments are supported
+// when the application is compiled as C++17.
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define RECKLESS_HAS_STRING_VIEW 1
+#else
+#define RECKLESS_HAS_STRING_VIEW 0
+#endif
+
 #if defined(__GNUC__)
 #define RECKLESS_TLS __thread
 #elif defined(_MSC_VER)
@@ -208,6 +217,57 @@ inline unsigned atomic_fetch_add_release(unsigned* ptarget, unsigned value)
 static_assert(false, "atomic_add_relaxed is not implemented for this compiler");
 #endif
 
+// Waking a sleeping thread costs a system call, so the wake-up primitives
+// (lockless_cv, spsc_event) keep a count of registered waiters and skip the
+// call when there are none. That is a Dekker-style handshake: each side
+// writes its own variable (the waiter count, or the signal) and then reads
+// the other side's. It only works if neither side's read can be ordered
+// before its own write, so both writes must be done with
+// atomic_fetch_add_seq_cst() and both reads with atomic_load_seq_cst().
+// On x86 the former is a locked instruction, which is a full barrier
+// anyway, and the latter is a plain load.
+#if defined(__GNUC__)
+
+template <typename T, typename U>
+T atomic_fetch_add_seq_cst(T* ptarget, U value)
+{
+    return __atomic_fetch_add(ptarget, value, __ATOMIC_SEQ_CST);
+}
+
+template <typename T>
+T atomic_load_seq_cst(T const* pvalue)
+{
+    return __atomic_load_n(pvalue, __ATOMIC_SEQ_CST);
+}
+
+#elif defined(_MSC_VER)
+
+// Interlocked operations are full barriers.
+inline long atomic_fetch_add_seq_cst(long* ptarget, long value)
+{
+    return _InterlockedExchangeAdd(ptarget, value);
+}
+
+inline int atomic_fetch_add_seq_cst(int* ptarget, int value)
+{
+    return atomic_fetch_add_seq_cst(reinterpret_cast<long*>(ptarget), static_cast<long>(value));
+}
+
+inline unsigned atomic_fetch_add_seq_cst(unsigned* ptarget, unsigned value)
+{
+    return atomic_fetch_add_seq_cst(reinterpret_cast<int*>(ptarget), static_cast<int>(value));
+}
+
+template <typename T>
+T atomic_load_seq_cst(T const* pvalue)
+{
+    return *pvalue;
+}
+
+#else
+static_assert(false, "atomic_fetch_add_seq_cst is not implemented for this compiler");
+#endif
+
 #if defined(__GNUC__)
 template <typename T>
 T atomic_increment_fetch_relaxed(T* ptarget)
@@ -383,11 +443,45 @@ inline void pause()
 #endif
 }
 
+// Execute the cpuid instruction for the given leaf and subleaf, and store
+// eax, ebx, ecx and edx in registers. Returns false without touching
+// registers if the processor does not support the leaf, or is not x86.
+bool cpuid(std::uint32_t leaf, std::uint32_t subleaf, std::uint32_t registers[4]);
+
 unsigned get_page_size();
 extern unsigned const page_size;
 
 void set_thread_name(char const* name);
 
+// Restrict the calling thread to the given CPUs. Returns 0 on success or an
+// error number for std::system_category().
+int set_thread_affinity(unsigned const* cpus, std::size_t count);
+// Run the calling thread with the real-time SCHED_FIFO policy at
+// realtime_priority if it is nonzero, otherwise give it the nice value. On
+// Windows these are mapped to the closest thread priority. Returns 0 on
+// success or an error number for std::system_category().
+int set_thread_priority(int realtime_priority, int nice);
+// The NUMA node that a CPU belongs to, or -1 if it isn't known.
+int numa_node_of_cpu(unsigned cpu);
+
+// While this is alive, memory that the calling thread faults in is taken
+// from the given NUMA node if it has any to spare. Does nothing if node is
+// -1 or if the OS lacks NUMA support (and on Windows).
+class scoped_numa_preference {
+public:
+    explicit scoped_numa_preference(int node);
+    ~scoped_numa_preference();
+
+    scoped_numa_preference(scoped_numa_preference const&) = delete;
+    scoped_numa_preference& operator=(scoped_numa_preference const&) = delete;
+
+private:
+    static std::size_t const max_nodes = 1024;
+    bool active_;
+    int previous_mode_;
+    unsigned long previous_nodes_[max_nodes/(8*sizeof(unsigned long))];
+};
+
 }   // detail
 }   // reckless
 
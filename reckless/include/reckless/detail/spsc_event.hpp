@@ -21,6 +21,8 @@
  */
 #ifndef RECKLESS_DETAIL_SPSC_EVENT_HPP
 #define RECKLESS_DETAIL_SPSC_EVENT_HPP
+#include <reckless/detail/platform.hpp>
+
 #include <atomic>
 #include <system_error>
 
@@ -38,27 +40,37 @@ namespace detail {
 // should really be mpmc_event.
 class spsc_event {
 public:
-    spsc_event() : signal_(0)
+    spsc_event() : signal_(0), waiters_(0)
     {
     }
 
     void signal()
     {
-        // TODO possible performance improvement: If we know nobody is waiting,
-        // then we don't need to signal the futex.
+        // We only need to make the futex system call if somebody is actually
+        // sleeping on it. A waiter registers itself in waiters_ before it
+        // checks signal_, and we set signal_ before we check waiters_, so
+        // either we see the waiter or the waiter sees the signal and doesn't
+        // go to sleep; see atomic_fetch_add_seq_cst(). The exchange below is
+        // an xchg instruction, which is a full barrier like a locked add.
         atomic_exchange_explicit(&signal_, 1, std::memory_order_release);
-        sys_futex(&signal_, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        if(atomic_load_seq_cst(&waiters_) != 0)
+            sys_futex(&signal_, FUTEX_WAKE, 1, nullptr, nullptr, 0);
     }
 
     void wait()
     {
         int signal = atomic_exchange_explicit(&signal_, 0, std::memory_order_acquire);
+        if(signal)
+            return;
+        atomic_fetch_add_seq_cst(&waiters_, 1);
+        signal = atomic_exchange_explicit(&signal_, 0, std::memory_order_acquire);
         while(not signal) {
             // TODO may be beneficial to just put a cpu pause here before
             // reading the value again, i.e. a spinlock kind of construction.
             sys_futex(&signal_, FUTEX_WAIT, 0, nullptr, nullptr, 0);
             signal = atomic_exchange_explicit(&signal_, 0, std::memory_order_acquire);
         }
+        atomic_fetch_add_relaxed(&waiters_, -1);
     }
 
     bool wait(unsigned milliseconds)
@@ -73,6 +85,20 @@ public:
         unsigned elapsed_ms = 0;
         struct timespec timeout = {0, 0};
 
+        // Registered waiter; see signal().
+        struct waiter_registration {
+            waiter_registration(int* pwaiters) :
+                pwaiters_(pwaiters)
+            {
+                atomic_fetch_add_seq_cst(pwaiters_, 1);
+            }
+            ~waiter_registration()
+            {
+                atomic_fetch_add_relaxed(pwaiters_, -1);
+            }
+            int* pwaiters_;
+        } registration(&waiters_);
+
         do {
             unsigned remaining_ms = milliseconds - elapsed_ms;
             timeout.tv_sec = remaining_ms/1000;
@@ -111,6 +137,7 @@ private:
     }
 
     int signal_;
+    int waiters_;
 };
 
 #elif defined(_WIN32)
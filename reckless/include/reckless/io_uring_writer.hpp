@@ -0,0 +1,90 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_IO_URING_WRITER_HPP
+#define RECKLESS_IO_URING_WRITER_HPP
+
+#include "detail/async_writer.hpp"
+
+#include <cstdint>  // uint64_t
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace reckless {
+
+// Linux only. Writes to a file through io_uring, so that the log's output
+// worker only has to copy the data and queue it instead of waiting for the
+// write to finish. At most chunk_count chunks of up to chunk_size bytes each
+// are in flight at any time; beyond that writes block until one of them
+// completes.
+//
+// Each chunk is written at an explicit offset, starting from the end of the
+// file as it was when it was opened, so chunks that complete out of order
+// still end up in the right place. The flip side is that, unlike
+// file_writer, this writer should be the only one appending to the file.
+//
+// The constructor throws std::system_error if the file can't be opened or if
+// io_uring is not available, e.g. on kernels before 5.6 or when it is
+// disabled by a seccomp policy. aio_writer on top of a file_writer is a
+// reasonable fallback in that case.
+//
+// Note that the log's flush() only guarantees that the data has been
+// submitted. It is written shortly after, and at the latest when the
+// io_uring_writer is destroyed.
+class io_uring_writer : public detail::async_writer {
+public:
+    io_uring_writer(char const* path, std::size_t chunk_count = 4,
+            std::size_t chunk_size = 256*1024);
+    ~io_uring_writer();
+
+private:
+    void submit(chunk* pchunk) noexcept override;
+    chunk* complete(bool block) noexcept override;
+    void close_ring() noexcept;
+
+    int fd_ = -1;
+    int ring_fd_ = -1;
+    std::uint64_t file_offset_ = 0;
+
+    void* psq_ring_ = nullptr;
+    std::size_t sq_ring_size_ = 0;
+    void* pcq_ring_ = nullptr;
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe* psqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+
+    unsigned* psq_tail_ = nullptr;
+    unsigned* psq_mask_ = nullptr;
+    unsigned* psq_array_ = nullptr;
+    unsigned* pcq_head_ = nullptr;
+    unsigned* pcq_tail_ = nullptr;
+    unsigned* pcq_mask_ = nullptr;
+    io_uring_cqe* pcqes_ = nullptr;
+
+    // Chunks that we failed to even submit. They are handed back as failed
+    // by complete().
+    std::vector<chunk*> failed_submissions_;
+};
+
+}   // namespace reckless
+
+#endif  // RECKLESS_IO_URING_WRITER_HPP
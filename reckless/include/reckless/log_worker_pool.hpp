@@ -0,0 +1,100 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_LOG_WORKER_POOL_HPP
+#define RECKLESS_LOG_WORKER_POOL_HPP
+
+#include <reckless/detail/lockless_cv.hpp>
+
+#include <atomic>
+#include <memory>   // shared_ptr
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reckless {
+class basic_log;
+
+namespace detail {
+// A log that is attached to a log_worker_pool. The pool threads take turns
+// with it, but only one of them works on it at a time.
+struct pooled_log {
+    explicit pooled_log(basic_log* plog) :
+        plog(plog),
+        busy(false)
+    {
+    }
+    basic_log* plog;    // nullptr once the log has been detached.
+    std::atomic<bool> busy;
+};
+}   // namespace detail
+
+// Threads that do the work of the output worker for any number of logs, as
+// an alternative to giving each log a thread of its own. Pass the pool in
+// log_options::worker_pool when opening the logs. Each pool thread goes
+// round the attached logs and processes one batch of input from every log
+// that has any, so a busy log can't starve the others. Only one thread works
+// on a log at a time, so its records are written in the same order as with
+// a thread of its own.
+//
+// A log that blocks its worker, for example with error_policy::block while
+// the writer is failing, holds up one pool thread for as long as it does.
+// The pool must outlive every log that is attached to it.
+class log_worker_pool {
+public:
+    explicit log_worker_pool(unsigned thread_count = 1);
+    ~log_worker_pool();
+
+    log_worker_pool(log_worker_pool const&) = delete;
+    log_worker_pool& operator=(log_worker_pool const&) = delete;
+
+    unsigned thread_count() const
+    {
+        return static_cast<unsigned>(threads_.size());
+    }
+
+private:
+    friend class basic_log;
+
+    std::shared_ptr<detail::pooled_log> attach(basic_log* plog);
+    // Waits until no pool thread is working on the log.
+    void detach(std::shared_ptr<detail::pooled_log> const& plog);
+    // Called by writing threads when a log needs attention right away.
+    void signal()
+    {
+        input_event_.notify_all();
+    }
+
+    void thread_main(unsigned index);
+
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<detail::pooled_log>> logs_;  // access synchronized by mutex_
+    // Changes whenever logs_ does, so that the pool threads know when to
+    // take a new copy of it.
+    unsigned logs_version_ = 0;
+    bool stop_ = false;
+    detail::lockless_cv input_event_;
+    std::vector<std::thread> threads_;
+};
+
+}   // namespace reckless
+
+#endif  // RECKLESS_LOG_WORKER_POOL_HPP
@@ -0,0 +1,84 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_MMAP_FILE_WRITER_HPP
+#define RECKLESS_MMAP_FILE_WRITER_HPP
+
+#include "writer.hpp"
+
+#include <cstdint>  // uint64_t
+
+namespace reckless {
+
+// What to do with a window of the file once we are done writing to it.
+enum class mmap_sync_policy {
+    none,   // Leave write-back to the kernel.
+    async,  // Start write-back right away (msync with MS_ASYNC).
+    sync    // Wait for write-back to finish (msync with MS_SYNC).
+};
+
+// Access pattern advice given for each newly mapped window (see madvise()).
+enum class mmap_advice {
+    normal,     // No advice.
+    sequential, // MADV_SEQUENTIAL; pages may be dropped soon after use.
+    populate    // Fault the whole window in when it is mapped.
+};
+
+// Unix only. Writes to a file by copying into a shared memory mapping of it,
+// which avoids a system call per flush. The file is extended with
+// fallocate() one extent at a time, and each extent is mapped as a window
+// that we fill before moving on to the next. Since the disk space is
+// allocated up front, running out of it is reported as an error when the
+// next extent is allocated rather than as a SIGBUS while copying.
+//
+// The file is truncated to the amount of data actually written when the
+// writer is destroyed. If the process dies before that (e.g. after a crash
+// handler's panic flush), the file keeps its preallocated size and the
+// unused part is filled with zero bytes.
+class mmap_file_writer : public writer {
+public:
+    mmap_file_writer(char const* path,
+        std::size_t extent_size = 32*1024*1024,
+        mmap_sync_policy sync = mmap_sync_policy::none,
+        mmap_advice advice = mmap_advice::normal);
+    ~mmap_file_writer();
+
+    std::size_t write(void const* pbuffer, std::size_t count,
+            std::error_code& ec) noexcept override;
+
+private:
+    bool next_window(std::error_code& ec) noexcept;
+    void release_window() noexcept;
+
+    int fd_ = -1;
+    std::size_t extent_size_;
+    mmap_sync_policy sync_;
+    mmap_advice advice_;
+    std::uint64_t size_ = 0;        // Bytes of actual data in the file.
+    std::uint64_t allocated_ = 0;   // Bytes allocated with fallocate().
+    char* pwindow_ = nullptr;
+    std::uint64_t window_offset_ = 0;
+    std::size_t window_size_ = 0;
+};
+
+}   // namespace reckless
+
+#endif  // RECKLESS_MMAP_FILE_WRITER_HPP
@@ -106,7 +106,22 @@ public:
         pcommit_end_ += size;
     }
 
-    void write(void const* buf, std::size_t count);
+    // Payloads that are at least zero_copy_threshold() bytes and are the
+    // first output of the current frame are not copied. Instead they are
+    // handed to the writer directly from the caller's memory, after the
+    // complete frames that are already in the buffer, via writer::writev().
+    // The caller's buffer only needs to stay valid for the duration of the
+    // call.
+    void write(void const* buf, std::size_t count)
+    {
+        std::size_t remaining = pbuffer_end_ - pcommit_end_;
+        if(detail::likely(count <= remaining && count < zero_copy_threshold_)) {
+            std::memcpy(pcommit_end_, buf, count);
+            pcommit_end_ += count;
+        } else {
+            write_slow_path(buf, count);
+        }
+    }
 
     void write(char const* s)
     {
@@ -158,6 +173,12 @@ protected:
         return pframe_end_ != pbuffer_;
     }
 
+    // Number of bytes in complete frames that have not been flushed yet.
+    std::size_t complete_frames_size() const
+    {
+        return pframe_end_ - pbuffer_;
+    }
+
     // Need to make flush() public because of g++ bug 66957
     // <https://gcc.gnu.org/bugzilla/show_bug.cgi?id=66957>
 #ifdef __GNUC__
@@ -198,6 +219,17 @@ protected:
         permanent_error_policy_.store(ep, std::memory_order_relaxed);
     }
 
+    std::size_t zero_copy_threshold() const
+    {
+        return zero_copy_threshold_;
+    }
+
+    // Must only be called while the worker thread is not running.
+    void zero_copy_threshold(std::size_t threshold)
+    {
+        zero_copy_threshold_ = threshold;
+    }
+
     detail::spsc_event shared_input_queue_full_event_; // FIXME rename to something that indicates this is used for all "notifications" to the worker thread
 
     std::atomic<error_policy> temporary_error_policy_{error_policy::ignore};
@@ -210,17 +242,25 @@ private:
     output_buffer(output_buffer const&) = delete;
     output_buffer& operator=(output_buffer const&) = delete;
 
+    void release() noexcept;
+    void discard(std::size_t count);
     char* reserve_slow_path(std::size_t size);
+    void write_slow_path(void const* buf, std::size_t count);
+    void write_external(char const* pinput, std::size_t count);
+    void handle_flush_error(std::error_code const& error,
+        unsigned* pblock_time_ms);
     void increment_output_buffer_full_count()
     {
         detail::atomic_increment_fetch_relaxed(&output_buffer_full_count_);
     }
 
     writer* pwriter_ = nullptr;
+    char* pring_ = nullptr;     // Start of the double-mapped buffer memory.
     char* pbuffer_ = nullptr;
     char* pframe_end_ = nullptr;
     char* pcommit_end_ = nullptr;
     char* pbuffer_end_ = nullptr;
+    std::size_t zero_copy_threshold_ = ~std::size_t(0);
     unsigned lost_input_frames_ = 0;
     std::error_code initial_error_;         // Keeps track of the first error that caused lost_input_frames_ to become non-zero.
     std::mutex writer_error_callback_mutex_;
@@ -0,0 +1,128 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_ROTATING_FILE_WRITER_HPP
+#define RECKLESS_ROTATING_FILE_WRITER_HPP
+
+#include "detail/fd_writer.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>      // uint64_t
+#include <functional>   // function
+#include <mutex>
+#include <string>
+#include <system_error> // error_code
+#include <thread>
+#include <vector>
+
+namespace reckless {
+
+class rotating_file_writer;
+
+struct rotation_policy {
+    // Start a new file before a write would make the current one larger
+    // than this. 0 means no limit.
+    std::uint64_t max_size = 0;
+    // Start a new file whenever the wall clock passes a multiple of this
+    // interval since the epoch, e.g. at the top of every hour (UTC) for one
+    // hour. 0 means no time-based rotation.
+    std::chrono::seconds interval{0};
+    // If set, this program is run with the path of each rotated-out file as
+    // its only argument, e.g. "gzip" or "xz".
+    std::string compress_command;
+};
+
+// Called from the writer's background thread after a file has been rotated
+// out, with the path it was renamed to, or when something went wrong in the
+// background (ec is set, and path is the file involved). Unlike the writer
+// error callback this may write to the log, but it must not throw.
+using rotation_callback_t = std::function<void (rotating_file_writer* pwriter,
+    char const* path, std::error_code ec)>;
+
+// Unix only. Writes to the file at path like file_writer, but moves on to a
+// fresh file according to a rotation_policy. The rotated-out file is
+// renamed to path.YYYYMMDD-HHMMSS (UTC time of rotation, with a counter
+// appended if that name is taken) and the new file takes its place at path.
+//
+// Everything that involves the file system happens on a background thread:
+// the next file is opened ahead of time under the name path.next, and
+// closing, renaming and compressing the old file happens after the switch.
+// The rotation itself, on the output worker, is just a swap of file
+// descriptors. Should the background thread ever fall behind, we keep
+// writing to the current file and rotate once it has caught up.
+//
+// Rotation only happens between calls to write() or writev(), and the log only passes
+// complete records to the writer, so records are never split across files.
+class rotating_file_writer : public detail::fd_writer {
+public:
+    rotating_file_writer(char const* path,
+        rotation_policy const& policy = rotation_policy());
+    ~rotating_file_writer();
+
+    std::size_t write(void const* pbuffer, std::size_t count,
+            std::error_code& ec) noexcept override;
+    // Large records are passed to the writer with writev(), see
+    // output_buffer::write(), so this has to honor the policy too.
+    std::size_t writev(write_segment const* psegments,
+            std::size_t segment_count, std::error_code& ec) noexcept override;
+
+    void rotation_callback(rotation_callback_t callback = rotation_callback_t());
+
+private:
+    struct retired_file {
+        int fd;
+        std::chrono::system_clock::time_point time;
+    };
+
+    void rotate_if_due(std::size_t count) noexcept;
+    void rotate(std::chrono::system_clock::time_point now) noexcept;
+    void update_next_rotation_time(std::chrono::system_clock::time_point now);
+    void background_thread();
+    void retire(retired_file const& file);
+    void notify(char const* path, std::error_code ec);
+
+    std::string path_;
+    std::string next_path_;
+    rotation_policy policy_;
+
+    // Only used by the output worker.
+    std::uint64_t size_ = 0;
+    std::chrono::system_clock::time_point next_rotation_time_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int next_fd_ = -1;
+    // Reserved up front, and the worker only rotates when next_fd_ is ready,
+    // which the background thread only provides after emptying this. So it
+    // never holds more than one entry and pushing never allocates.
+    std::vector<retired_file> retired_files_;
+    bool shutdown_ = false;
+
+    std::mutex callback_mutex_;
+    rotation_callback_t rotation_callback_;
+
+    std::thread thread_;
+};
+
+}   // namespace reckless
+
+#endif  // RECKLESS_ROTATING_FILE_WRITER_HPP
@@ -23,8 +23,39 @@
 #define RECKLESS_SEVERITY_LOG_HPP
 
 #include <reckless/policy_log.hpp>
+#include <reckless/detail/platform.hpp> // atomic_load_relaxed, atomic_store_relaxed
+
+// Calls below this severity level are compiled out: 0 = debug, 1 = info,
+// 2 = warn, 3 = error. 4 compiles out all of them. Define it before
+// including this file, or on the command line.
+#ifndef RECKLESS_MINIMUM_SEVERITY
+#define RECKLESS_MINIMUM_SEVERITY 0
+#endif
+
+// Write to a severity_log only if the level is enabled. Unlike calling
+// log.debug() etc. directly, this skips evaluating the arguments too.
+#define RECKLESS_LOG_DEBUG(log, ...) RECKLESS_LOG_AT_LEVEL(log, debug, __VA_ARGS__)
+#define RECKLESS_LOG_INFO(log, ...) RECKLESS_LOG_AT_LEVEL(log, info, __VA_ARGS__)
+#define RECKLESS_LOG_WARN(log, ...) RECKLESS_LOG_AT_LEVEL(log, warn, __VA_ARGS__)
+#define RECKLESS_LOG_ERROR(log, ...) RECKLESS_LOG_AT_LEVEL(log, error, __VA_ARGS__)
+#define RECKLESS_LOG_AT_LEVEL(log, level, ...) \
+    do { \
+        if((log).enabled(::reckless::severity_level::level)) \
+            (log).level(__VA_ARGS__); \
+    } while(false)
 
 namespace reckless {
+enum class severity_level : unsigned char {
+    debug,
+    info,
+    warn,
+    error,
+    none    // For threshold(): disables all levels.
+};
+
+severity_level const minimum_severity =
+    static_cast<severity_level>(RECKLESS_MINIMUM_SEVERITY);
+
 class severity_field {
 public:
     severity_field(char severity) : severity_(severity) {}
@@ -59,30 +90,81 @@ class severity_log : public basic_log {
 public:
     using basic_log::basic_log;
 
+    // Discard calls below the given level without queuing them. The default
+    // is severity_level::debug, i.e. everything is written.
+    void threshold(severity_level level)
+    {
+        detail::atomic_store_relaxed(&threshold_,
+            static_cast<unsigned char>(level));
+    }
+
+    severity_level threshold() const
+    {
+        return static_cast<severity_level>(
+            detail::atomic_load_relaxed(&threshold_));
+    }
+
+    // True if calls at this level are written. For levels below
+    // minimum_severity this is false at compile time.
+    bool enabled(severity_level level) const
+    {
+        return level >= minimum_severity
+            && static_cast<unsigned char>(level) >=
+                detail::atomic_load_relaxed(&threshold_);
+    }
+
     template <typename... Args>
     void debug(char const* fmt, Args&&... args)
     {
-        write('D', fmt, std::forward<Args>(args)...);
+        if(enabled(severity_level::debug))
+            write('D', fmt, std::forward<Args>(args)...);
+    }
+    template <class String, typename... Args>
+    void debug(compiled_format<String> fmt, Args&&... args)
+    {
+        if(enabled(severity_level::debug))
+            write('D', fmt, std::forward<Args>(args)...);
     }
     template <typename... Args>
     void info(char const* fmt, Args&&... args)
     {
-        write('I', fmt, std::forward<Args>(args)...);
+        if(enabled(severity_level::info))
+            write('I', fmt, std::forward<Args>(args)...);
+    }
+    template <class String, typename... Args>
+    void info(compiled_format<String> fmt, Args&&... args)
+    {
+        if(enabled(severity_level::info))
+            write('I', fmt, std::forward<Args>(args)...);
     }
     template <typename... Args>
     void warn(char const* fmt, Args&&... args)
     {
-        write('W', fmt, std::forward<Args>(args)...);
+        if(enabled(severity_level::warn))
+            write('W', fmt, std::forward<Args>(args)...);
+    }
+    template <class String, typename... Args>
+    void warn(compiled_format<String> fmt, Args&&... args)
+    {
+        if(enabled(severity_level::warn))
+            write('W', fmt, std::forward<Args>(args)...);
     }
     template <typename... Args>
     void error(char const* fmt, Args&&... args)
     {
-        write('E', fmt, std::forward<Args>(args)...);
+        if(enabled(severity_level::error))
+            write('E', fmt, std::forward<Args>(args)...);
+    }
+    template <class String, typename... Args>
+    void error(compiled_format<String> fmt, Args&&... args)
+    {
+        if(enabled(severity_level::error))
+            write('E', fmt, std::forward<Args>(args)...);
     }
 
 private:
-    template <typename... Args>
-    void write(char severity, char const* fmt, Args&&... args)
+    template <typename Format, typename... Args>
+    void write(char severity, Format fmt, Args&&... args)
     {
         basic_log::write<policy_formatter<IndentPolicy, FieldSeparator, HeaderFields...>>(
                 detail::construct_header_field<HeaderFields>(severity)...,
@@ -90,6 +172,8 @@ private:
                 fmt,
                 std::forward<Args>(args)...);
     }
+
+    unsigned char threshold_ = 0;
 };
 
 }   // namespace reckless
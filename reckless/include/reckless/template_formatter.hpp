@@ -22,13 +22,21 @@
 #ifndef RECKLESS_TEMPLATE_FORMATTER_HPP
 #define RECKLESS_TEMPLATE_FORMATTER_HPP
 
+#include <reckless/detail/platform.hpp> // RECKLESS_HAS_STRING_VIEW
+
 #include <utility>    // forward
 #include <string>
 #include <type_traits>  // is_convertible
+#if RECKLESS_HAS_STRING_VIEW
+#include <string_view>
+#endif
 
 namespace reckless {
 
 class output_buffer;
+class captured_string;
+template <class String>
+struct compiled_format;
 namespace detail {
     template <typename T>
     char const* invoke_custom_format(output_buffer* pbuffer,
@@ -43,18 +51,38 @@ public:
     static void format(output_buffer* pbuffer, char const* pformat,
             T&& value, Args&&... args)
     {
-        pformat = next_specifier(pbuffer, pformat);
+        pformat = format_argument(pbuffer, pformat, std::forward<T>(value));
         if(!pformat)
             return;
+        return template_formatter::format(pbuffer, pformat,
+                std::forward<Args>(args)...);
+    }
+
+    // Format using a string that was parsed at compile time, see
+    // RECKLESS_FMT. Defined in compiled_format.hpp.
+    template <class String, typename... Args>
+    static void format(output_buffer* pbuffer, compiled_format<String>,
+            Args&&... args);
+
+    // Write the format string up to the next conversion specification, and
+    // format value according to it. Returns the rest of the format string,
+    // or nullptr if it had no more specifications. This is for callers who
+    // don't know the arguments until run time, such as reckless-decode.
+    // Finish off by calling format(pbuffer, pformat) with what is left.
+    template <typename T>
+    static char const* format_argument(output_buffer* pbuffer,
+            char const* pformat, T&& value)
+    {
+        pformat = next_specifier(pbuffer, pformat);
+        if(!pformat)
+            return nullptr;
 
         char const* pnext_format = detail::invoke_custom_format(pbuffer,
                 pformat, std::forward<T>(value));
         if(pnext_format)
-            pformat = pnext_format;
-        else
-            append_percent(pbuffer);
-        return template_formatter::format(pbuffer, pformat,
-                std::forward<Args>(args)...);
+            return pnext_format;
+        append_percent(pbuffer);
+        return pformat;
     }
 
 private:
@@ -85,6 +113,15 @@ char const* format(output_buffer* pbuffer, char const* pformat, long double v);
 
 char const* format(output_buffer* pbuffer, char const* pformat, char const* v);
 char const* format(output_buffer* pbuffer, char const* pformat, std::string const& v);
+char const* format(output_buffer* pbuffer, char const* pformat, captured_string const& v);
+char const* format_string(output_buffer* pbuffer, char const* pformat,
+    char const* s, std::size_t size);
+#if RECKLESS_HAS_STRING_VIEW
+inline char const* format(output_buffer* pbuffer, char const* pformat, std::string_view v)
+{
+    return format_string(pbuffer, pformat, v.data(), v.size());
+}
+#endif
 
 char const* format(output_buffer* pbuffer, char const* pformat, void const* p);
 
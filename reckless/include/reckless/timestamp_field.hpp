@@ -0,0 +1,193 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_TIMESTAMP_FIELD_HPP
+#define RECKLESS_TIMESTAMP_FIELD_HPP
+
+#include <reckless/output_buffer.hpp>
+#include <reckless/detail/platform.hpp> // RECKLESS_TLS, unlikely
+#include <reckless/ntoa.hpp>    // detail::decimal_digits
+
+#include <cstdint>  // int64_t, uint64_t
+#include <cstring>  // memcpy
+#if defined(__unix__)
+#include <time.h>   // clock_gettime
+#endif
+
+namespace reckless {
+
+#if defined(_WIN32)
+namespace detail {
+extern "C" {
+    void __stdcall GetSystemTimeAsFileTime(void* lpSystemTimeAsFileTime);
+}
+}
+#endif
+
+// How basic_timestamp_field renders the time.
+enum class timestamp_style {
+    local,          // 2020-01-31 13:14:15.123 in local time
+    utc,            // 2020-01-31 12:14:15.123 in UTC
+    iso8601_local,  // 2020-01-31T13:14:15.123+01:00
+    iso8601_utc     // 2020-01-31T12:14:15.123Z
+};
+
+namespace detail {
+// The part of a timestamp that only changes once per second, i.e. everything
+// except the fraction. Converting seconds to a calendar date and time is
+// expensive, and for local time it means taking a lock inside the C library,
+// so each thread that formats timestamps keeps the last one it rendered for
+// each style. Records written during the same second only need to copy it.
+struct timestamp_prefix {
+    std::int64_t second;    // Seconds since the epoch (UTC).
+    char date_time[19];     // YYYY-MM-DD HH:MM:SS, with a T for ISO 8601.
+    char zone[6];           // Z or +hh:mm for ISO 8601, otherwise nothing.
+};
+
+extern RECKLESS_TLS timestamp_prefix timestamp_prefixes[4];
+
+// Renders the prefix for the given second and style.
+void update_timestamp_prefix(timestamp_prefix* pprefix, std::int64_t second,
+    timestamp_style style);
+
+inline constexpr std::size_t timestamp_zone_size(timestamp_style style)
+{
+    return style == timestamp_style::iso8601_local? 6 :
+        style == timestamp_style::iso8601_utc? 1 : 0;
+}
+
+// Writes the Digits most significant digits of nanoseconds (which is less
+// than 10^9) to ptarget.
+template <unsigned Digits>
+void write_timestamp_fraction(char* ptarget, unsigned nanoseconds)
+{
+    static_assert(Digits >= 1 && Digits <= 9,
+        "the timestamp fraction must have 1-9 digits");
+    unsigned divisor = 1;
+    for(unsigned i=Digits; i!=9; ++i)
+        divisor *= 10;
+    unsigned fraction = nanoseconds/divisor;
+    unsigned i = Digits;
+    while(i >= 2) {
+        i -= 2;
+        unsigned pair = fraction % 100;
+        fraction /= 100;
+        ptarget[i] = decimal_digits[2*pair];
+        ptarget[i+1] = decimal_digits[2*pair+1];
+    }
+    if(i == 1)
+        ptarget[0] = decimal_digits[2*fraction+1];
+}
+}   // namespace detail
+
+// A header field for policy_log and severity_log that captures the time when
+// the record is written, and renders it with Digits digits of fractional
+// seconds: 3 for milliseconds, 6 for microseconds, 9 for nanoseconds.
+template <timestamp_style Style = timestamp_style::local, unsigned Digits = 3>
+class basic_timestamp_field {
+public:
+#if defined(__unix__)
+    basic_timestamp_field()
+    {
+        // The coarse clock is much cheaper to read but only updates every
+        // few milliseconds, which is fine for millisecond timestamps.
+#if defined(__linux__)
+        if(Digits <= 3)
+            clock_gettime(CLOCK_REALTIME_COARSE, &ts_);
+        else
+            clock_gettime(CLOCK_REALTIME, &ts_);
+#else
+        clock_gettime(CLOCK_REALTIME, &ts_);
+#endif
+    }
+
+    // Use a specific time instead of the current time.
+    basic_timestamp_field(std::int64_t seconds, unsigned nanoseconds)
+    {
+        ts_.tv_sec = static_cast<time_t>(seconds);
+        ts_.tv_nsec = static_cast<long>(nanoseconds);
+    }
+
+    bool format(output_buffer* pbuffer)
+    {
+        format(pbuffer, static_cast<std::int64_t>(ts_.tv_sec),
+            static_cast<unsigned>(ts_.tv_nsec));
+        return true;
+    }
+
+private:
+    struct timespec ts_;
+
+#elif defined(_WIN32)
+    basic_timestamp_field()
+    {
+        reckless::detail::GetSystemTimeAsFileTime(&ft_);
+    }
+
+    basic_timestamp_field(std::int64_t seconds, unsigned nanoseconds)
+    {
+        ft_ = static_cast<std::uint64_t>((seconds + EPOCH_DIFFERENCE)*10000000
+            + nanoseconds/100);
+    }
+
+    bool format(output_buffer* pbuffer)
+    {
+        // FILETIME counts 100-nanosecond intervals since 1601-01-01.
+        std::int64_t seconds = static_cast<std::int64_t>(ft_/10000000);
+        unsigned ticks = static_cast<unsigned>(ft_%10000000);
+        format(pbuffer, seconds - EPOCH_DIFFERENCE, 100*ticks);
+        return true;
+    }
+
+private:
+    // Seconds from 1601-01-01 to 1970-01-01.
+    static std::int64_t const EPOCH_DIFFERENCE = 11644473600;
+    std::uint64_t ft_;
+#else
+    static_assert(false, "timestamp_field is not implemented for this OS")
+#endif
+
+    static void format(output_buffer* pbuffer, std::int64_t second,
+        unsigned nanoseconds)
+    {
+        // YYYY-MM-DD HH:MM:SS.FFF[zone]
+        std::size_t const zone_size = detail::timestamp_zone_size(Style);
+        std::size_t const size = 19 + 1 + Digits + zone_size;
+        detail::timestamp_prefix& prefix =
+            detail::timestamp_prefixes[static_cast<unsigned>(Style)];
+        if(detail::unlikely(prefix.second != second))
+            detail::update_timestamp_prefix(&prefix, second, Style);
+
+        char* p = pbuffer->reserve(size);
+        std::memcpy(p, prefix.date_time, 19);
+        p[19] = '.';
+        detail::write_timestamp_fraction<Digits>(p + 20, nanoseconds);
+        std::memcpy(p + 20 + Digits, prefix.zone, zone_size);
+        pbuffer->commit(size);
+    }
+};
+
+// Local time with millisecond precision.
+typedef basic_timestamp_field<> timestamp_field;
+
+}   // namespace reckless
+
+#endif  // RECKLESS_TIMESTAMP_FIELD_HPP
@@ -0,0 +1,121 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RECKLESS_TSC_TIMESTAMP_FIELD_HPP
+#define RECKLESS_TSC_TIMESTAMP_FIELD_HPP
+
+#include <reckless/timestamp_field.hpp>
+#include <reckless/detail/platform.hpp> // rdtsc, RECKLESS_TLS, likely
+
+#include <cstdint>  // uint64_t, int64_t
+
+namespace reckless {
+namespace detail {
+// True if the time stamp counter ticks at a constant rate regardless of
+// power state, and the operating system hasn't found it to be unreliable.
+// Only then can ticks be turned into wall-clock time with a linear mapping.
+// This is false until it has been initialized during static initialization.
+extern bool const tsc_is_reliable;
+
+// Nanoseconds since the epoch (UTC) from the most precise real-time clock
+// available. Used instead of the TSC when tsc_is_reliable is false.
+std::int64_t realtime_nanoseconds();
+
+// The mapping from TSC ticks to wall-clock time used on the thread that
+// converts them. realtime = realtime_base + (ticks - tsc_base)*
+// nanoseconds_per_tick. It's recalibrated once the counter passes
+// next_tsc.
+struct tsc_calibration {
+    std::uint64_t tsc_base;
+    std::int64_t realtime_base;
+    double nanoseconds_per_tick;
+    std::uint64_t next_tsc;
+};
+
+extern RECKLESS_TLS tsc_calibration tsc_calibration_state;
+
+void recalibrate_tsc(tsc_calibration* pcalibration);
+
+inline std::int64_t tsc_to_realtime_nanoseconds(std::uint64_t ticks)
+{
+    tsc_calibration* pcalibration = &tsc_calibration_state;
+    if(unlikely(ticks >= pcalibration->next_tsc))
+        recalibrate_tsc(pcalibration);
+    // Records may have been captured before the last recalibration, in which
+    // case the difference is negative.
+    auto delta = static_cast<std::int64_t>(ticks - pcalibration->tsc_base);
+    return pcalibration->realtime_base + static_cast<std::int64_t>(
+        static_cast<double>(delta)*pcalibration->nanoseconds_per_tick);
+}
+}   // namespace detail
+
+// A header field like basic_timestamp_field, but the producer only reads the
+// time stamp counter, which is cheaper than even the coarse real-time clock
+// and precise enough to order records from different threads. The output
+// worker converts the count to wall-clock time with a mapping that it
+// recalibrates against the system clock every second. Recalibration adjusts
+// the rate rather than stepping, so timestamps don't go backwards.
+//
+// If the TSC can't be trusted (see detail::tsc_is_reliable), the producer
+// reads the precise real-time clock instead.
+template <timestamp_style Style = timestamp_style::local, unsigned Digits = 9>
+class basic_tsc_timestamp_field {
+public:
+    basic_tsc_timestamp_field()
+    {
+        if(detail::likely(detail::tsc_is_reliable)) {
+            time_ = detail::rdtsc();
+            tsc_ = true;
+        } else {
+            time_ = static_cast<std::uint64_t>(detail::realtime_nanoseconds());
+            tsc_ = false;
+        }
+    }
+
+    bool format(output_buffer* pbuffer)
+    {
+        std::int64_t ns;
+        if(tsc_)
+            ns = detail::tsc_to_realtime_nanoseconds(time_);
+        else
+            ns = static_cast<std::int64_t>(time_);
+        std::int64_t seconds = ns/1000000000;
+        std::int64_t nanoseconds = ns%1000000000;
+        if(nanoseconds < 0) {
+            seconds -= 1;
+            nanoseconds += 1000000000;
+        }
+        basic_timestamp_field<Style, Digits> field(seconds,
+            static_cast<unsigned>(nanoseconds));
+        return field.format(pbuffer);
+    }
+
+private:
+    std::uint64_t time_;    // TSC ticks if tsc_, otherwise realtime_nanoseconds().
+    bool tsc_;
+};
+
+// Local time with nanosecond precision.
+typedef basic_tsc_timestamp_field<> tsc_timestamp_field;
+
+}   // namespace reckless
+
+#endif  // RECKLESS_TSC_TIMESTAMP_FIELD_HPP
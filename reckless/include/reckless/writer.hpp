@@ -29,6 +29,12 @@
 
 namespace reckless {
 
+// One piece of a gathered write, see writer::writev.
+struct write_segment {
+    void const* pbuffer;
+    std::size_t count;
+};
+
 // TODO this is a bit vague, rename to e.g. log_target or something?
 class writer {
 public:
@@ -42,6 +48,14 @@ public:
     virtual ~writer() = 0;
     virtual std::size_t write(void const* pbuffer, std::size_t count,
             std::error_code& ec) noexcept = 0;
+
+    // Write several buffers in sequence, as if they were one contiguous
+    // buffer. Returns the total number of bytes written, with the same error
+    // semantics as write(). The default implementation calls write() once
+    // for each segment; writers that can do this in one operation (such as
+    // with POSIX writev()) should override it.
+    virtual std::size_t writev(write_segment const* psegments,
+            std::size_t segment_count, std::error_code& ec) noexcept;
 };
 
 inline std::error_condition make_error_condition(writer::errc ec)
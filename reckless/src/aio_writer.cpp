@@ -0,0 +1,118 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/aio_writer.hpp>
+
+namespace reckless {
+
+aio_writer::aio_writer(writer* ptarget, std::size_t chunk_count,
+        std::size_t chunk_size) :
+    async_writer(chunk_count, chunk_size),
+    ptarget_(ptarget)
+{
+    submitted_.reserve(chunk_count);
+    completed_.reserve(chunk_count);
+    thread_ = std::thread(&aio_writer::helper_thread, this);
+}
+
+aio_writer::~aio_writer()
+{
+    drain();
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        shutdown_ = true;
+    }
+    submitted_cv_.notify_one();
+    thread_.join();
+}
+
+void aio_writer::submit(chunk* pchunk) noexcept
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        submitted_.push_back(pchunk);
+    }
+    submitted_cv_.notify_one();
+}
+
+detail::async_writer::chunk* aio_writer::complete(bool block) noexcept
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    if(block) {
+        completed_cv_.wait(lk, [this] { return !completed_.empty(); });
+    } else if(completed_.empty()) {
+        return nullptr;
+    }
+    chunk* pchunk = completed_.front();
+    completed_.erase(completed_.begin());
+    return pchunk;
+}
+
+void aio_writer::resume() noexcept
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    error_.clear();
+}
+
+void aio_writer::helper_thread()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    while(true) {
+        submitted_cv_.wait(lk, [this] {
+            return shutdown_ || !submitted_.empty();
+        });
+        if(submitted_.empty())
+            return;
+        chunk* pchunk = submitted_.front();
+        submitted_.erase(submitted_.begin());
+
+        // Once a write has failed we fail everything queued behind it
+        // without trying, until async_writer has collected the failed
+        // chunks and resubmits them in order. Otherwise later data could
+        // overtake the failed chunk.
+        if(error_) {
+            pchunk->error = error_;
+        } else {
+            lk.unlock();
+            std::error_code ec;
+            std::size_t written;
+            try {
+                written = ptarget_->write(pchunk->pdata + pchunk->written,
+                    pchunk->size - pchunk->written, ec);
+            } catch(...) {
+                // Same as in output_buffer::flush(), throwing is a fatal
+                // error for a writer.
+                ec.assign(writer::permanent_failure, writer::error_category());
+                written = 0;
+            }
+            lk.lock();
+            pchunk->written += written;
+            if(ec) {
+                pchunk->error = ec;
+                error_ = ec;
+            }
+        }
+        completed_.push_back(pchunk);
+        completed_cv_.notify_one();
+    }
+}
+
+}   // namespace reckless
@@ -0,0 +1,145 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/detail/async_writer.hpp>
+
+#include <algorithm>    // min, sort
+#include <cstring>      // memcpy
+#include <cassert>
+
+namespace reckless {
+namespace detail {
+
+async_writer::async_writer(std::size_t chunk_count, std::size_t chunk_size) :
+    chunk_size_(chunk_size),
+    storage_(new char[chunk_count*chunk_size]),
+    chunks_(chunk_count)
+{
+    assert(chunk_count != 0 && chunk_size != 0);
+    free_chunks_.reserve(chunk_count);
+    failed_chunks_.reserve(chunk_count);
+    for(std::size_t i=0; i!=chunk_count; ++i) {
+        chunks_[i].pdata = storage_.get() + i*chunk_size;
+        free_chunks_.push_back(&chunks_[chunk_count - i - 1]);
+    }
+}
+
+async_writer::~async_writer()
+{
+    assert(in_flight_ == 0);
+}
+
+void async_writer::resume() noexcept
+{
+}
+
+std::size_t async_writer::write(void const* pbuffer, std::size_t count,
+        std::error_code& ec) noexcept
+{
+    ec.clear();
+    while(chunk* pchunk = complete(false))
+        finish(pchunk);
+    if(!failed_chunks_.empty()) {
+        retry_failed(ec);
+        if(ec)
+            return 0;
+    }
+
+    char const* pinput = static_cast<char const*>(pbuffer);
+    std::size_t remaining = count;
+    while(remaining != 0) {
+        while(free_chunks_.empty()) {
+            finish(complete(true));
+            if(!failed_chunks_.empty()) {
+                // The data we have accepted so far is queued behind the
+                // failed chunk, so it will be retried along with it.
+                ec = failed_chunks_.front()->error;
+                return count - remaining;
+            }
+        }
+
+        chunk* pchunk = free_chunks_.back();
+        free_chunks_.pop_back();
+        std::size_t size = std::min(remaining, chunk_size_);
+        std::memcpy(pchunk->pdata, pinput, size);
+        pchunk->size = size;
+        pchunk->written = 0;
+        pchunk->offset = position_;
+        pchunk->error.clear();
+        position_ += size;
+        pinput += size;
+        remaining -= size;
+
+        ++in_flight_;
+        submit(pchunk);
+    }
+    return count;
+}
+
+void async_writer::drain() noexcept
+{
+    wait_in_flight();
+    if(!failed_chunks_.empty()) {
+        std::error_code ec;
+        retry_failed(ec);
+    }
+}
+
+void async_writer::finish(chunk* pchunk) noexcept
+{
+    assert(in_flight_ != 0);
+    --in_flight_;
+    if(pchunk->error)
+        failed_chunks_.push_back(pchunk);
+    else
+        free_chunks_.push_back(pchunk);
+}
+
+void async_writer::wait_in_flight() noexcept
+{
+    while(in_flight_ != 0)
+        finish(complete(true));
+}
+
+void async_writer::retry_failed(std::error_code& ec) noexcept
+{
+    // Everything that was submitted after a failed chunk may have failed
+    // too, so wait until we have all of them back before resubmitting
+    // anything. Otherwise we could end up retrying them out of order.
+    wait_in_flight();
+    std::sort(failed_chunks_.begin(), failed_chunks_.end(),
+        [](chunk const* pa, chunk const* pb) {
+            return pa->offset < pb->offset;
+        });
+    resume();
+    for(chunk* pchunk : failed_chunks_) {
+        pchunk->error.clear();
+        ++in_flight_;
+        submit(pchunk);
+    }
+    failed_chunks_.clear();
+    wait_in_flight();
+    if(!failed_chunks_.empty())
+        ec = failed_chunks_.front()->error;
+}
+
+}   // namespace detail
+}   // namespace reckless
@@ -26,9 +26,11 @@
 
 #include <vector>
 #include <algorithm>    // max, min
+#include <cstdio>       // snprintf
 #include <thread>       // sleep_for
 #include <sstream>      // ostringstream
 #include <chrono>       // hours
+#include <atomic>
 
 using reckless::detail::likely;
 
@@ -42,6 +44,133 @@ namespace {
 unsigned max_input_buffer_poll_period_ms = 1000u;
 unsigned input_buffer_poll_period_inverse_growth_factor = 4;
 
+// A pause instruction takes somewhere between ten and a hundred-something
+// cycles depending on the CPU, so this amounts to a few tens of
+// microseconds.
+unsigned const default_worker_spin_count = 1000u;
+
+// Passing a payload to the writer without copying it costs a writev() call
+// of its own, unless the output buffer was about to be flushed anyway. Below
+// a few tens of KiB the copy is cheaper than the system call.
+std::size_t const default_zero_copy_threshold = 64*1024;
+
+// Upper bound on the input frames that go into one job for the formatter
+// threads. The output worker can't start writing the output of a batch
+// until the first job is done.
+std::size_t const max_format_job_size = 16*1024;
+
+// Default size of the input buffer regions that a write_batch reserves. That
+// is 64 records at the default frame granularity.
+std::size_t const default_write_batch_capacity = 4*1024;
+
+// How often a thread that waits for room in the input buffer seals the
+// thread stages, which may be what keeps the worker from making room.
+unsigned const stage_seal_poll_period_ms = 1u;
+
+// Thrown by on_panic_flush_done() on a log_worker_pool thread, which has
+// other logs to take care of and can't just sleep forever.
+struct panic_flush_done {};
+
+// Performs one step of waiting for input according to a worker_wait_policy.
+// Construct a new instance each time the worker starts waiting for something.
+class input_wait {
+public:
+    input_wait(worker_wait_policy policy, unsigned spin_count,
+            detail::spsc_event* pevent,
+            unsigned max_wait_time_ms = max_input_buffer_poll_period_ms) :
+        policy_(policy),
+        remaining_spins_(policy == worker_wait_policy::backoff? 0 : spin_count),
+        max_wait_time_ms_(max_wait_time_ms),
+        pevent_(pevent)
+    {
+    }
+
+    // True until the spins are used up and the wait starts yielding or
+    // blocking.
+    bool spinning() const
+    {
+        return remaining_spins_ != 0;
+    }
+
+    void operator()()
+    {
+        if(remaining_spins_ != 0) {
+            --remaining_spins_;
+            detail::pause();
+            return;
+        }
+
+        switch(policy_) {
+        case worker_wait_policy::spin:
+            detail::pause();
+            break;
+        case worker_wait_policy::spin_then_yield:
+            std::this_thread::yield();
+            break;
+        case worker_wait_policy::backoff:
+        case worker_wait_policy::spin_then_block:
+            pevent_->wait(wait_time_ms_);
+            wait_time_ms_ += std::max(1u,
+                wait_time_ms_/input_buffer_poll_period_inverse_growth_factor);
+            wait_time_ms_ = std::min(wait_time_ms_, max_wait_time_ms_);
+            break;
+        }
+    }
+
+private:
+    worker_wait_policy policy_;
+    unsigned remaining_spins_;
+    unsigned max_wait_time_ms_;
+    unsigned wait_time_ms_ = 0;
+    detail::spsc_event* pevent_;
+};
+
+// Source of basic_log::serial_. Zero is never handed out, so that an
+// all-zero thread_input_buffer_cache never matches an open log.
+std::atomic<std::uint64_t> g_log_serial(0);
+
+// Keeps the per-thread input buffers that this thread has been given, so that
+// they can be handed back to their logs when the thread exits.
+class thread_input_buffer_registry {
+public:
+    ~thread_input_buffer_registry()
+    {
+        for(auto& registration : registrations_)
+            detail::abandon_thread_input_buffer(registration.pbuffer.get());
+    }
+
+    detail::thread_input_buffer* find(std::uint64_t log_serial)
+    {
+        // Take the opportunity to forget about buffers that belong to logs
+        // that have since been closed.
+        auto it = registrations_.begin();
+        while(it != registrations_.end()) {
+            if(detail::atomic_load_acquire(&it->pbuffer->closed))
+                it = registrations_.erase(it);
+            else if(it->log_serial == log_serial)
+                return it->pbuffer.get();
+            else
+                ++it;
+        }
+        return nullptr;
+    }
+
+    void add(std::uint64_t log_serial,
+        std::shared_ptr<detail::thread_input_buffer> const& pbuffer)
+    {
+        registrations_.push_back(registration{log_serial, pbuffer});
+    }
+
+private:
+    struct registration {
+        std::uint64_t log_serial;
+        std::shared_ptr<detail::thread_input_buffer> pbuffer;
+    };
+    std::vector<registration> registrations_;
+};
+
+thread_local thread_input_buffer_registry tls_input_buffer_registry;
+
 #ifdef RECKLESS_ENABLE_TRACE_LOG
 struct output_worker_start_event :
     public detail::timestamped_trace_event
@@ -149,6 +278,13 @@ struct format_frame_finish_event : public detail::timestamped_trace_event {
 
 }   // anonymous namespace
 
+namespace detail {
+RECKLESS_TLS thread_input_buffer_cache tls_input_buffer_cache = {0, nullptr};
+RECKLESS_TLS write_batch* tls_write_batch = nullptr;
+}
+
+RECKLESS_TLS input_full_policy const* scoped_input_full_policy::pcurrent_ = nullptr;
+
 char const* writer_error::what() const noexcept
 {
     return "writer error";
@@ -174,8 +310,18 @@ void basic_log::open(writer* pwriter)
 void basic_log::open(writer* pwriter,
     std::size_t input_buffer_capacity,
     std::size_t output_buffer_capacity)
+{
+    log_options options;
+    options.input_buffer_capacity = input_buffer_capacity;
+    options.output_buffer_capacity = output_buffer_capacity;
+    open(pwriter, options);
+}
+
+void basic_log::open(writer* pwriter, log_options const& options)
 {
     assert(!is_open());
+    std::size_t input_buffer_capacity = options.input_buffer_capacity;
+    std::size_t output_buffer_capacity = options.output_buffer_capacity;
 
     // We used to use the page size for input buffer capacity.
     // However, after introducing the new ring buffer for Windows
@@ -210,16 +356,134 @@ void basic_log::open(writer* pwriter,
     // The buffer currently has a fixed size and we set it based on an
     // assumption on how much space will be used if the entire input
     // queue is full of log entries. We assume an input frame will use
-    // up one cache line and that a log line will be 80 bytes in size.
+    // up one cache line, or half of one if frames are packed more tightly
+    // than that, and that a log line will be 80 bytes in size.
+    std::size_t frame_granularity = options.frame_granularity;
+    if(frame_granularity == 0)
+        frame_granularity = RECKLESS_CACHE_LINE_SIZE;
+    assert(detail::is_power_of_two(frame_granularity));
+    assert(frame_granularity >= detail::min_frame_granularity);
+    assert(frame_granularity <= RECKLESS_CACHE_LINE_SIZE);
     if(output_buffer_capacity == 0) {
-        auto assumed_count = (input_buffer_capacity+RECKLESS_CACHE_LINE_SIZE-1)/
-            RECKLESS_CACHE_LINE_SIZE;
+        std::size_t assumed_frame_size = std::max<std::size_t>(
+            frame_granularity, RECKLESS_CACHE_LINE_SIZE/2);
+        auto assumed_count = (input_buffer_capacity+assumed_frame_size-1)/
+            assumed_frame_size;
         output_buffer_capacity = assumed_count * 80;
     }
+    frame_granularity_ = frame_granularity;
+
+    // In per-thread mode the shared input buffer only carries the frames
+    // for flush, close and panic flush, but we keep its capacity anyway
+    // since it is also what we base the default output buffer size on.
+    thread_input_buffers_ =
+        options.input_queue == input_queue_mode::per_thread;
+    thread_input_buffer_capacity_ = options.thread_input_buffer_capacity;
+    if(thread_input_buffer_capacity_ == 0)
+        thread_input_buffer_capacity_ = input_buffer_capacity;
+
+    // Longer strings would make it hard to fit the frame in the buffer, so
+    // they are stored as usual.
+    inline_string_limit_ = 0;
+    if(options.inline_strings) {
+        inline_string_limit_ = (thread_input_buffers_?
+            thread_input_buffer_capacity_ : input_buffer_capacity)/4;
+    }
+    serial_ = ++g_log_serial;
+
+    input_full_policy_ = options.input_buffer_full;
+    worker_wait_ = options.worker_wait;
+    worker_spin_count_ = options.worker_spin_count;
+    if(worker_spin_count_ == 0)
+        worker_spin_count_ = default_worker_spin_count;
+
+    input_buffer_memory_flags_ = 0;
+    if(options.input_buffer_huge_pages)
+        input_buffer_memory_flags_ |= detail::ring_memory_huge_pages;
+    if(options.input_buffer_locked)
+        input_buffer_memory_flags_ |= detail::ring_memory_locked;
+    numa_node_ = -1;
+    if(options.worker_numa_local && !options.worker_cpus.empty())
+        numa_node_ = detail::numa_node_of_cpu(options.worker_cpus.front());
+    {
+        // The input buffer is prefaulted here. The output buffer isn't, but
+        // the worker faults it in from its own CPUs later on anyway.
+        detail::scoped_numa_preference numa(numa_node_);
+        input_buffer_.reserve(input_buffer_capacity, input_buffer_memory_flags_);
+        output_buffer::reset(pwriter, output_buffer_capacity);
+        if(options.formatter_threads != 0) {
+            formatter_pool_.reset(new detail::formatter_pool(
+                options.formatter_threads, output_buffer_capacity,
+                options.worker_cpus));
+        }
+    }
+    std::size_t zero_copy_threshold = options.zero_copy_threshold;
+    if(zero_copy_threshold == 0)
+        zero_copy_threshold = default_zero_copy_threshold;
+    output_buffer::zero_copy_threshold(zero_copy_threshold);
+
+    // Same limits as for a write_batch region, which also needs room for the
+    // filler frame at the start.
+    thread_staging_capacity_ = 0;
+    if(options.thread_staging_capacity != 0 && !thread_input_buffers_) {
+        stage_filler_size_ = (sizeof(detail::frame_header) + frame_granularity-1)
+            & ~(frame_granularity-1);
+        std::size_t capacity = std::min(options.thread_staging_capacity,
+            input_buffer_.capacity()/4);
+        capacity &= ~(frame_granularity-1);
+        thread_staging_capacity_ = std::max(capacity, 3*stage_filler_size_);
+    }
+    thread_staging_delay_ms_ = options.thread_staging_delay_ms;
+    pstalled_frame_ = nullptr;
+
+    if(options.worker_pool) {
+        // Once attached, the pool threads may start working on the log right
+        // away, so this has to come last.
+        worker_finished_ = false;
+        pworker_pool_ = options.worker_pool;
+        pool_registration_ = pworker_pool_->attach(this);
+        return;
+    }
 
-    input_buffer_.reserve(input_buffer_capacity);
-    output_buffer::reset(pwriter, output_buffer_capacity);
+    worker_cpus_ = options.worker_cpus;
+    worker_realtime_priority_ = options.worker_realtime_priority;
+    worker_nice_ = options.worker_nice;
+    worker_setup_error_.clear();
     output_thread_ = std::thread(std::mem_fn(&basic_log::output_worker), this);
+
+    // If the worker can't be set up the way that was asked for, it's better
+    // to fail now than to have it run on a core reserved for something else.
+    if(!worker_cpus_.empty() || worker_realtime_priority_ != 0
+        || worker_nice_ != 0)
+    {
+        worker_started_event_.wait();
+        if(worker_setup_error_) {
+            std::error_code error = worker_setup_error_;
+            std::error_code ignored;
+            close(ignored);
+            throw std::system_error(error,
+                "reckless: could not set up the output worker thread");
+        }
+    }
+}
+
+void basic_log::setup_output_worker()
+{
+    using namespace detail;
+    if(worker_cpus_.empty() && worker_realtime_priority_ == 0
+        && worker_nice_ == 0)
+    {
+        return;
+    }
+
+    int error = 0;
+    if(!worker_cpus_.empty())
+        error = set_thread_affinity(worker_cpus_.data(), worker_cpus_.size());
+    if(error == 0 && (worker_realtime_priority_ != 0 || worker_nice_ != 0))
+        error = set_thread_priority(worker_realtime_priority_, worker_nice_);
+    if(error != 0)
+        worker_setup_error_ = std::error_code(error, std::system_category());
+    worker_started_event_.signal();
 }
 
 void basic_log::close(std::error_code& ec) noexcept
@@ -227,15 +491,45 @@ void basic_log::close(std::error_code& ec) noexcept
     using namespace detail;
     assert(is_open());
 
+    publish_thread_batch();
+    if(thread_staging_capacity_ != 0)
+        seal_stages();
     frame_header* pframe = push_input_frame_blind(RECKLESS_CACHE_LINE_SIZE);
-    atomic_store_relaxed(&pframe->status, frame_status::shutdown_marker);
-    input_buffer_full_event_.signal();
-
-    // We're going to assume that join() will not throw here, since all the
-    // documented error conditions would be the result of a bug.
-    output_thread_.join();
+    set_frame_status(pframe, frame_status::shutdown_marker);
+    signal_input();
+
+    if(pworker_pool_) {
+        worker_done_event_.wait();
+        pworker_pool_->detach(pool_registration_);
+        pool_registration_.reset();
+        pworker_pool_ = nullptr;
+    } else {
+        // We're going to assume that join() will not throw here, since all
+        // the documented error conditions would be the result of a bug.
+        output_thread_.join();
+    }
     assert(input_buffer_.size() == 0);
 
+    if(thread_input_buffers_ || thread_staging_capacity_ != 0) {
+        // Threads that are still alive may keep a reference to their buffer
+        // for a while, but they will never write to it again. So we can
+        // release the memory right away. A thread that exits from now on
+        // must not seal its stage either, since the region is in our input
+        // buffer.
+        std::lock_guard<std::mutex> lk(thread_input_mutex_);
+        for(auto& pbuffer : thread_input_buffers_list_) {
+            pbuffer->buffer.reserve(0);
+            std::lock_guard<std::mutex> stage_lk(pbuffer->stage.mutex);
+            atomic_store_release(&pbuffer->closed, true);
+        }
+        thread_input_buffers_list_.clear();
+        worker_thread_input_buffers_.clear();
+        thread_input_buffers_ = false;
+        thread_staging_capacity_ = 0;
+    }
+    serial_ = 0;
+
+    formatter_pool_.reset();
     output_buffer::reset();
     input_buffer_.reserve(0);
 
@@ -275,8 +569,11 @@ void basic_log::flush(std::error_code& ec)
         }
     };
     detail::spsc_event event;
-    write<formatter>(&event, &ec);
-    input_buffer_full_event_.signal();
+    publish_thread_batch();
+    if(thread_staging_capacity_ != 0)
+        seal_stages();
+    write_frame<formatter, true>(&event, &ec);
+    signal_input();
     event.wait();
 }
 
@@ -291,6 +588,13 @@ void basic_log::flush()
 void basic_log::start_panic_flush()
 {
     using namespace detail;
+    // If we crashed in the middle of a batch, then the records in it would
+    // otherwise keep the worker from ever getting to the marker. The same
+    // goes for the stages of all threads, but if we can't get at one of them
+    // then the worker seals it once it has waited long enough.
+    publish_thread_batch();
+    if(thread_staging_capacity_ != 0)
+        seal_stages(true);
     frame_header* pframe = push_input_frame_blind(RECKLESS_CACHE_LINE_SIZE);
     // To reduce interference from other running threads that write to the log
     // during a panic flush, we set panic_flush_ = true. This stops the
@@ -320,8 +624,8 @@ void basic_log::start_panic_flush()
     atomic_store_relaxed(&panic_flush_, true);
     input_buffer_.deplete();
 
-    atomic_store_release(&pframe->status, frame_status::panic_shutdown_marker);
-    input_buffer_full_event_.signal();
+    set_frame_status(pframe, frame_status::panic_shutdown_marker);
+    signal_input();
 }
 
 void basic_log::await_panic_flush()
@@ -335,33 +639,388 @@ bool basic_log::await_panic_flush(unsigned int milliseconds)
 }
 
 detail::frame_header* basic_log::push_input_frame_slow_path(
-    detail::frame_header* pframe, bool error, std::size_t size)
+    detail::mpsc_ring_buffer* pbuffer, detail::frame_header* pframe,
+    std::uint64_t& position, bool error, std::size_t size, bool may_drop)
 {
     using namespace detail;
-    while(true) {
+    bool exclusive = pbuffer != &input_buffer_;
+    while(!pframe) {
         auto notify_count = input_buffer_empty_event_.notify_count();
-        pframe = static_cast<frame_header*>(input_buffer_.push(size));
+        if(exclusive) {
+            pframe = static_cast<frame_header*>(pbuffer->push_exclusive(size,
+                &position));
+        } else {
+            pframe = static_cast<frame_header*>(pbuffer->push(size,
+                &position));
+        }
         error = atomic_load_acquire(&error_flag_);
         if (pframe != nullptr || error)
             break;
 
         atomic_increment_fetch_relaxed(&input_buffer_full_count_);
-        input_buffer_full_event_.signal();
+        if(may_drop && drop_input_frame())
+            return nullptr;
+        // If this thread has a batch open, on this log or another one, then
+        // the worker that would make room for us may be waiting for it.
+        publish_thread_batch();
+        signal_input();
         RECKLESS_TRACE(input_buffer_full_wait_start_event);
-        input_buffer_empty_event_.wait(notify_count);
+        if(thread_staging_capacity_ == 0) {
+            input_buffer_empty_event_.wait(notify_count);
+        } else {
+            // The same goes for the stages of threads that have stopped
+            // writing, including any that were opened while we waited.
+            // Whoever holds a stage's mutex is about to seal it anyway.
+            seal_stages(true);
+            input_buffer_empty_event_.wait(notify_count,
+                stage_seal_poll_period_ms);
+        }
         RECKLESS_TRACE(input_buffer_full_wait_finish_event);
     }
+    if(pframe)
+        init_frame_header(pframe, pbuffer->lap_tag(position));
     if(!error) {
         return pframe;
     } else {
         if(pframe) {
-            pframe->frame_size = size;
-            atomic_store_release(&pframe->status, frame_status::failed_error_check);
+            pframe->frame_size = static_cast<std::uint32_t>(size);
+            set_frame_status(pframe, frame_status::failed_error_check);
         }
         throw writer_error(error_code_);
     }
 }
 
+detail::frame_header* basic_log::push_batch_frame_slow_path(
+    write_batch* pbatch, std::size_t size)
+{
+    using namespace detail;
+    if(pbatch->plog_ != this || thread_staging_capacity_ != 0) {
+        // The batch is for another log. Its records must not wait for
+        // whatever happens to this one, e.g. if both logs share a
+        // log_worker_pool thread and this log's input buffer is full.
+        // Or this log stages records anyway, in which case the batch never
+        // gets a region of its own.
+        pbatch->plog_->publish_batch(pbatch);
+        if(thread_staging_capacity_ != 0)
+            return push_staged_frame(size);
+        return push_input_frame(size, true);
+    }
+
+    // Either the region is full, or the log is in an error state and we are
+    // about to throw. In both cases the records in the region must be
+    // published first, since the worker can't get past them until they are.
+    publish_batch(pbatch);
+    std::size_t capacity = pbatch->capacity_;
+    if(size + pbatch->filler_size_ > capacity || atomic_load_acquire(&error_flag_))
+        return push_input_frame(size, true);
+
+    std::uint64_t position = 0;
+    auto pregion = static_cast<char*>(input_buffer_.push(capacity, &position));
+    if(pregion == nullptr) {
+        // The input buffer is too full for a whole region. Rather than wait
+        // for that much room, we push this one record as usual and try again
+        // with the next one.
+        return push_input_frame(size, true);
+    }
+    pbatch->pregion_ = pregion;
+    pbatch->region_position_ = position;
+    pbatch->next_position_ = position;
+    pbatch->end_position_ = position + capacity;
+    pbatch->fit_position_ = pbatch->end_position_ - pbatch->filler_size_;
+    return push_batch_frame(size);
+}
+
+void basic_log::publish_batch(write_batch* pbatch)
+{
+    using namespace detail;
+    if(pbatch->pregion_ == nullptr)
+        return;
+
+    write_region_filler(pbatch->pregion_, pbatch->region_position_,
+        pbatch->next_position_, pbatch->end_position_);
+
+    // Every frame after the first one is already published, but the worker
+    // won't get to them before it sees the proper lap tag on the first.
+    auto pfirst = static_cast<frame_header*>(static_cast<void*>(
+        pbatch->pregion_));
+    atomic_store_release(&pfirst->status_word,
+        (pfirst->status_word & frame_status_mask)
+        | input_buffer_.lap_tag(pbatch->region_position_));
+
+    pbatch->pregion_ = nullptr;
+    pbatch->region_position_ = 0;
+    pbatch->next_position_ = 0;
+    pbatch->end_position_ = 0;
+    pbatch->fit_position_ = 0;
+    // The output worker may have started waiting for the first frame with a
+    // long timeout. A pool thread doesn't wait for it but polls the log
+    // again when the pool is signaled.
+    signal_input();
+}
+
+void basic_log::publish_thread_batch()
+{
+    write_batch* pbatch = detail::tls_write_batch;
+    if(pbatch != nullptr)
+        pbatch->plog_->publish_batch(pbatch);
+}
+
+void basic_log::write_region_filler(char* pregion,
+    std::uint64_t region_position, std::uint64_t position,
+    std::uint64_t end_position)
+{
+    using namespace detail;
+    if(position == end_position)
+        return;
+    // The worker skips frames that failed the error check without looking
+    // at anything but the size.
+    auto pfiller = static_cast<frame_header*>(input_buffer_.wrap(
+        pregion + (position - region_position)));
+    pfiller->frame_size = static_cast<std::uint32_t>(end_position - position);
+    atomic_store_release(&pfiller->status_word,
+        input_buffer_.lap_tag(position)
+        | static_cast<std::uint64_t>(frame_status::failed_error_check));
+}
+
+detail::frame_header* basic_log::push_staged_frame_slow_path(
+    detail::thread_input_buffer* pbuffer, std::size_t size)
+{
+    using namespace detail;
+    // Either the region is full, or there is none, or the log is in an error
+    // state and we are about to throw. The weak compare-and-swap may also
+    // have failed for no reason, in which case we give up on the region a
+    // bit early.
+    thread_stage& stage = pbuffer->stage;
+    {
+        std::lock_guard<std::mutex> lk(stage.mutex);
+        seal_stage(&stage);
+    }
+    std::size_t capacity = thread_staging_capacity_;
+    if(size + 2*stage_filler_size_ > capacity
+            || atomic_load_acquire(&error_flag_))
+        return push_input_frame(size, true);
+
+    std::uint64_t position = 0;
+    auto pregion = static_cast<char*>(input_buffer_.push(capacity, &position));
+    if(pregion == nullptr) {
+        // Same as for a write_batch: rather than wait for room for a whole
+        // region, we push this one record as usual and try again with the
+        // next one.
+        return push_input_frame(size, true);
+    }
+    auto pgate = static_cast<frame_header*>(static_cast<void*>(pregion));
+    pgate->frame_size = static_cast<std::uint32_t>(stage_filler_size_);
+    atomic_store_relaxed(&pgate->status_word,
+        (~input_buffer_.lap_tag(position) & ~frame_status_mask)
+        | static_cast<std::uint64_t>(frame_status::failed_error_check));
+
+    {
+        std::lock_guard<std::mutex> lk(stage.mutex);
+        stage.pregion = pregion;
+        stage.region_position = position;
+        stage.end_position = position + capacity;
+        stage.fit_position = stage.end_position - stage_filler_size_;
+        atomic_store_relaxed(&stage.next_position,
+            position + stage_filler_size_);
+    }
+    return push_staged_frame(size);
+}
+
+void basic_log::seal_stage(detail::thread_stage* pstage)
+{
+    using namespace detail;
+    // Once stage_sealed is set, the owning thread can't allocate any more
+    // frames in the region, so what is past the position is ours to fill.
+    std::uint64_t position = atomic_load_relaxed(&pstage->next_position);
+    do {
+        if(position & stage_sealed)
+            return;
+    } while(!atomic_compare_exchange_weak_relaxed(&pstage->next_position,
+            &position, position | stage_sealed));
+
+    write_region_filler(pstage->pregion, pstage->region_position, position,
+        pstage->end_position);
+    // Frames that the thread is still constructing are waited for by the
+    // worker as usual.
+    auto pgate = static_cast<frame_header*>(static_cast<void*>(
+        pstage->pregion));
+    atomic_store_release(&pgate->status_word,
+        input_buffer_.lap_tag(pstage->region_position)
+        | static_cast<std::uint64_t>(frame_status::failed_error_check));
+    signal_input();
+}
+
+void basic_log::seal_stages(bool try_lock)
+{
+    using namespace detail;
+    std::unique_lock<std::mutex> lk(thread_input_mutex_, std::defer_lock);
+    if(try_lock) {
+        if(!lk.try_lock())
+            return;
+    } else {
+        lk.lock();
+    }
+
+    auto& list = thread_input_buffers_list_;
+    auto it = list.begin();
+    while(it != list.end()) {
+        auto& stage = (*it)->stage;
+        // A thread seals its stage before it lets go of it, see
+        // abandon_thread_input_buffer().
+        if(atomic_load_acquire(&(*it)->abandoned)) {
+            it = list.erase(it);
+            continue;
+        }
+        std::unique_lock<std::mutex> stage_lk(stage.mutex, std::defer_lock);
+        if(try_lock) {
+            if(stage_lk.try_lock())
+                seal_stage(&stage);
+        } else {
+            stage_lk.lock();
+            seal_stage(&stage);
+        }
+        ++it;
+    }
+}
+
+void basic_log::on_stalled_frame(void* pframe, std::uint64_t lap_tag)
+{
+    // The frame may be the start of a thread's stage. The thread has had
+    // the records in it to itself for long enough once we have waited
+    // thread_staging_delay_ms for it.
+    if(thread_staging_capacity_ == 0)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    if(pframe != pstalled_frame_ || lap_tag != stalled_lap_tag_) {
+        pstalled_frame_ = pframe;
+        stalled_lap_tag_ = lap_tag;
+        stalled_since_ = now;
+    } else if(now - stalled_since_
+            >= std::chrono::milliseconds(thread_staging_delay_ms_))
+    {
+        seal_stages(detail::atomic_load_relaxed(&panic_flush_));
+        stalled_since_ = now;
+    }
+}
+
+void detail::abandon_thread_input_buffer(thread_input_buffer* pbuffer)
+{
+    // Let the log have whatever we staged, unless it has been closed and its
+    // input buffer may already be gone.
+    {
+        std::lock_guard<std::mutex> lk(pbuffer->stage.mutex);
+        if(!atomic_load_acquire(&pbuffer->closed) && pbuffer->stage.plog)
+            pbuffer->stage.plog->seal_stage(&pbuffer->stage);
+    }
+    atomic_store_release(&pbuffer->abandoned, true);
+}
+
+// Called when the input buffer is full. Returns false if the policy is to
+// wait for room, otherwise counts the frame as dropped and returns true.
+bool basic_log::drop_input_frame()
+{
+    using namespace detail;
+    auto ppolicy = scoped_input_full_policy::current();
+    auto policy = ppolicy? *ppolicy : atomic_load_relaxed(&input_full_policy_);
+    if(policy == input_full_policy::block)
+        return false;
+
+    atomic_increment_fetch_relaxed(&input_buffer_drop_count_);
+    if(policy == input_full_policy::drop_and_report)
+        atomic_increment_fetch_relaxed(&input_buffer_reportable_drop_count_);
+    // The worker may be sleeping with a long timeout, and nobody else is
+    // going to wake it up while we keep dropping records.
+    signal_input();
+    return true;
+}
+
+// Called by the output worker after it has made room in the input buffer,
+// to report records that were dropped with
+// input_full_policy::drop_and_report.
+void basic_log::report_dropped_input_frames()
+{
+    using namespace detail;
+    unsigned dropped = atomic_load_relaxed(&input_buffer_reportable_drop_count_);
+    if(likely(dropped == input_buffer_reported_drop_count_))
+        return;
+    unsigned count = dropped - input_buffer_reported_drop_count_;
+    input_buffer_reported_drop_count_ = dropped;
+
+    try {
+        write_dropped_input_report(this, count);
+        output_buffer::frame_end();
+    } catch(flush_error const&) {
+        output_buffer::lost_frame();
+    } catch(...) {
+        output_buffer::revert_frame();
+    }
+}
+
+void basic_log::write_dropped_input_report(output_buffer* pbuffer,
+    unsigned count)
+{
+    char line[96];
+    int length = std::snprintf(line, sizeof(line),
+#if defined(_WIN32)
+        "reckless: %u log records were dropped because the input buffer was full\r\n",
+#else
+        "reckless: %u log records were dropped because the input buffer was full\n",
+#endif
+        count);
+    pbuffer->write(line, static_cast<std::size_t>(length));
+}
+
+detail::thread_input_buffer* basic_log::acquire_thread_input_buffer()
+{
+    using namespace detail;
+    thread_input_buffer* pbuffer = tls_input_buffer_registry.find(serial_);
+    if(!pbuffer) {
+        auto pnew_buffer = std::make_shared<thread_input_buffer>();
+        if(thread_staging_capacity_ != 0) {
+            // The stage lives in our own input buffer.
+            pnew_buffer->stage.plog = this;
+        } else {
+            scoped_numa_preference numa(numa_node_);
+            pnew_buffer->buffer.reserve(thread_input_buffer_capacity_,
+                input_buffer_memory_flags_);
+        }
+        {
+            std::lock_guard<std::mutex> lk(thread_input_mutex_);
+            thread_input_buffers_list_.push_back(pnew_buffer);
+            atomic_store_release(&thread_input_buffers_version_,
+                thread_input_buffers_version_ + 1);
+        }
+        tls_input_buffer_registry.add(serial_, pnew_buffer);
+        pbuffer = pnew_buffer.get();
+    }
+    tls_input_buffer_cache.log_serial = serial_;
+    tls_input_buffer_cache.pbuffer = pbuffer;
+    return pbuffer;
+}
+
+write_batch::write_batch(basic_log& log, std::size_t capacity) :
+    plog_(&log)
+{
+    assert(detail::tls_write_batch == nullptr);
+    std::size_t granularity = log.frame_granularity_;
+    filler_size_ = (sizeof(detail::frame_header) + granularity-1)
+        & ~(granularity-1);
+    if(capacity == 0)
+        capacity = default_write_batch_capacity;
+    // A region can hold up the worker for at most a quarter of the buffer,
+    // and we don't want to have to wait for room for it too often.
+    capacity = std::min(capacity, log.input_buffer_.capacity()/4);
+    capacity &= ~(granularity-1);
+    capacity_ = std::max(capacity, 2*filler_size_);
+    detail::tls_write_batch = this;
+}
+
+write_batch::~write_batch()
+{
+    publish();
+    detail::tls_write_batch = nullptr;
+}
+
 void basic_log::output_worker()
 {
     using namespace detail;
@@ -379,71 +1038,74 @@ void basic_log::output_worker()
 #endif
 
     set_thread_name("reckless output worker");
+    setup_output_worker();
 
     frame_status status = frame_status::uninitialized;
-    while(likely(status < frame_status::shutdown_marker)) {
-        auto batch_size = wait_for_input();
+    while(likely(status < frame_status::shutdown_marker))
+        status = process_input(wait_for_input());
+    finish_output();
+}
+
+detail::frame_status basic_log::process_input(std::size_t batch_size)
+{
+    using namespace detail;
+    // Anything that was written to a per-thread buffer before the frames in
+    // this batch were pushed is now visible to us. Process it first, so that
+    // flush() and close() account for all threads.
+    if(thread_input_buffers_)
+        process_thread_input();
+    if(batch_size == 0) {
+        report_dropped_input_frames();
+        return frame_status::uninitialized;
+    }
 
-        atomic_store_relaxed(&input_buffer_high_watermark_,
-            std::max(input_buffer_high_watermark_, batch_size));
-        RECKLESS_TRACE(process_batch_start_event, batch_size);
+    atomic_store_relaxed(&input_buffer_high_watermark_,
+        std::max(input_buffer_high_watermark_, batch_size));
+    RECKLESS_TRACE(process_batch_start_event, batch_size);
 
-        auto pbatch_start = static_cast<char*>(input_buffer_.front());
-        auto pbatch_end = pbatch_start + batch_size;
-        auto pframe = pbatch_start;
+    auto pbatch_start = static_cast<char*>(input_buffer_.front());
+    auto pbatch_end = pbatch_start + batch_size;
+    auto pframe = pbatch_start;
 
-        bool panic_flush = false;
-        do
-        {
-            while(pframe != pbatch_end &&
-                 likely(status < frame_status::shutdown_marker))
-            {
-                status = acquire_frame(pframe);
-
-                std::size_t frame_size;
-                if(likely(status == frame_status::initialized))
-                    frame_size = process_frame(pframe);
-                else if(status == frame_status::failed_error_check)
-                    frame_size = char_cast<frame_header*>(pframe)->frame_size;
-                else if(status == frame_status::failed_initialization)
-                    frame_size = skip_frame(pframe);
-                else if(status == frame_status::shutdown_marker)
-                    frame_size = RECKLESS_CACHE_LINE_SIZE;
-                else {
-                    assert(status == frame_status::panic_shutdown_marker);
-                    // We are in panic-flush mode and reached the shutdown marker. That
-                    // means we are done.
-                    on_panic_flush_done();  // never returns
-                }
-
-                clear_frame(pframe, frame_size);
-                pframe += frame_size;
-            }
-            assert(pframe == pbatch_end);
-
-            // Return memory to the input buffer to be used by other threads,
-            // but only if we are not in a panic-flush state.
-            // See start_panic_flush() for more information.
-            panic_flush = atomic_load_relaxed(&panic_flush_);
-            if(likely(!panic_flush)) {
-                input_buffer_.pop_release(batch_size);
-            } else {
-                // As a consequence of not returning memory to the input buffer,
-                // on the next batch iteration input_buffer_.front() is going
-                // to return exactly the same frame address that we already
-                // processed, meaning we will hang waiting for it to become
-                // initialized. So instead of continuing normally we just update
-                // the batch end to reflect the current size of the buffer
-                // (which is going to end up equal to the full capacity of the
-                // buffer), let pframe remain at its current position, and loop
-                // around until we reach the panic_shutdown_marker frame.
-                batch_size = input_buffer_.size();
-                pbatch_end = pbatch_start + batch_size;
+    frame_status status = frame_status::uninitialized;
+    bool panic_flush = false;
+    do
+    {
+        pframe = process_frames(&input_buffer_, pframe, pbatch_end, &status);
+
+        // Return memory to the input buffer to be used by other threads, but
+        // only if we are not in a panic-flush state.
+        // See start_panic_flush() for more information.
+        panic_flush = atomic_load_relaxed(&panic_flush_);
+        if(likely(!panic_flush)) {
+            if(unlikely(pframe != pbatch_end)) {
+                // A pool thread stopped at a frame that isn't ready; see
+                // acquire_frame(). The rest of the batch is left for later.
+                batch_size = pframe - pbatch_start;
+                input_stalled_ = true;
             }
-        } while(unlikely(panic_flush));
-        RECKLESS_TRACE(process_batch_finish_event);
-    }
+            input_buffer_.pop_release(batch_size);
+        } else {
+            // As a consequence of not returning memory to the input buffer,
+            // on the next batch iteration input_buffer_.front() is going to
+            // return exactly the same frame address that we already
+            // processed, meaning we will hang waiting for it to become
+            // initialized. So instead of continuing normally we just update
+            // the batch end to reflect the current size of the buffer (which
+            // is going to end up equal to the full capacity of the buffer),
+            // let pframe remain where processing stopped, and loop around
+            // until we reach the panic_shutdown_marker frame.
+            batch_size = input_buffer_.size();
+            pbatch_end = pbatch_start + batch_size;
+        }
+    } while(unlikely(panic_flush));
+    RECKLESS_TRACE(process_batch_finish_event);
+    report_dropped_input_frames();
+    return status;
+}
 
+void basic_log::finish_output()
+{
     if(output_buffer::has_complete_frame()) {
         // Can't do much here if there is a flush error here since we are
         // shutting down. The error code will be checked by close() when
@@ -455,10 +1117,51 @@ void basic_log::output_worker()
     }
 }
 
+bool basic_log::service_input()
+{
+    using namespace detail;
+    input_stalled_ = false;
+    if(worker_finished_)
+        return false;
+
+    auto batch_size = input_buffer_.size();
+    if(batch_size == 0 && !has_thread_input()) {
+        // Same as what wait_for_input() does before it starts waiting, except
+        // that the pool thread does the waiting.
+        input_buffer_empty_event_.notify_all();
+        report_dropped_input_frames();
+        if(output_buffer::has_complete_frame())
+            flush_output_buffer();
+        return false;
+    }
+
+    try {
+        if(process_input(batch_size) >= frame_status::shutdown_marker) {
+            finish_output();
+            worker_finished_ = true;
+            worker_done_event_.signal();
+        }
+    } catch(panic_flush_done const&) {
+        // Leave the log as it is, like the output worker would.
+        worker_finished_ = true;
+    }
+    if(unlikely(input_stalled_)) {
+        // The frame we stopped at may stay unpublished for a while, e.g. if
+        // it starts a write_batch region. Don't keep what came before it
+        // from the writer, or the threads that wait for room from making
+        // use of what we did process.
+        input_buffer_empty_event_.notify_all();
+        if(output_buffer::has_complete_frame())
+            flush_output_buffer();
+        return false;
+    }
+    return true;
+}
+
 std::size_t basic_log::wait_for_input()
 {
     auto size = input_buffer_.size();
-    if(likely(size != 0)) {
+    if(likely(size != 0 || has_thread_input())) {
         // It's not exactly *likely* that there is input in the buffer, but we
         // want this to be a "hot path" so that we perform our best when there
         // is a lot of load.
@@ -466,11 +1169,15 @@ std::size_t basic_log::wait_for_input()
     }
 
     RECKLESS_TRACE(wait_for_input_start_event);
+    // Let any threads that are waiting for the input buffer to drain know
+    // that it is now empty. The buffer can't fill up again without us leaving
+    // the loop below, so once is enough.
+    input_buffer_empty_event_.notify_all();
+
     // Poll the input buffer until something comes in.
-    unsigned wait_time_ms = 0;
+    input_wait wait(worker_wait_, worker_spin_count_,
+        &input_buffer_full_event_);
     while(true) {
-        input_buffer_empty_event_.notify_all();
-
         // The output buffer is flushed at least once before waiting for more
         // input. This makes sure that data gets sent to the writer immediately
         // whenever there's a pause in incoming log messages. If this flush
@@ -482,59 +1189,269 @@ std::size_t basic_log::wait_for_input()
             // The flush acts as a wait, so check the input buffer
             // again before waiting on the event.
             size = input_buffer_.size();
-            if(size != 0)
+            if(size != 0 || has_thread_input())
                 break;
         }
 
-        input_buffer_full_event_.wait(wait_time_ms);
+        wait();
         size = input_buffer_.size();
-        if(size != 0)
+        if(size != 0 || has_thread_input())
             break;
-
-        wait_time_ms += std::max(1u,
-            wait_time_ms/input_buffer_poll_period_inverse_growth_factor);
-        wait_time_ms = std::min(wait_time_ms, max_input_buffer_poll_period_ms);
     }
     RECKLESS_TRACE(wait_for_input_finish_event);
     return size;
 }
 
-detail::frame_status basic_log::acquire_frame(void* pframe)
+bool basic_log::has_thread_input()
+{
+    using namespace detail;
+    if(!thread_input_buffers_)
+        return false;
+
+    auto version = atomic_load_acquire(&thread_input_buffers_version_);
+    if(version != worker_thread_input_buffers_version_) {
+        std::lock_guard<std::mutex> lk(thread_input_mutex_);
+        worker_thread_input_buffers_ = thread_input_buffers_list_;
+        worker_thread_input_buffers_version_ = thread_input_buffers_version_;
+    }
+
+    for(auto& pbuffer : worker_thread_input_buffers_) {
+        if(pbuffer->buffer.size() != 0)
+            return true;
+    }
+    return false;
+}
+
+void basic_log::process_thread_input()
+{
+    using namespace detail;
+    // Make sure we know about every buffer that was registered before the
+    // current batch was pushed.
+    has_thread_input();
+
+    bool popped = false;
+    bool released = false;
+    for(auto& pbuffer : worker_thread_input_buffers_) {
+        // We only process what is in the buffer at this point, otherwise one
+        // busy thread could keep us from ever getting to the others.
+        auto& buffer = pbuffer->buffer;
+        auto abandoned = atomic_load_acquire(&pbuffer->abandoned);
+        auto batch_size = buffer.size();
+        if(batch_size != 0) {
+            atomic_store_relaxed(&input_buffer_high_watermark_,
+                std::max(input_buffer_high_watermark_, batch_size));
+            RECKLESS_TRACE(process_batch_start_event, batch_size);
+            auto pbatch_start = static_cast<char*>(buffer.front());
+            frame_status status = frame_status::uninitialized;
+            auto pstop = process_frames(&buffer, pbatch_start,
+                pbatch_start + batch_size, &status);
+            // See process_input().
+            if(unlikely(pstop != pbatch_start + batch_size)) {
+                batch_size = pstop - pbatch_start;
+                input_stalled_ = true;
+            }
+            if(batch_size != 0) {
+                buffer.pop_release(batch_size);
+                popped = true;
+            }
+            RECKLESS_TRACE(process_batch_finish_event);
+        } else if(abandoned) {
+            // The thread has exited and everything it wrote has been
+            // processed, so the buffer can go.
+            pbuffer.reset();
+            released = true;
+        }
+    }
+
+    // A thread may be waiting for room in its buffer. wait_for_input() only
+    // wakes it once every buffer is empty, which may never happen while
+    // other threads keep writing.
+    if(popped)
+        input_buffer_empty_event_.notify_all();
+
+    if(released) {
+        std::lock_guard<std::mutex> lk(thread_input_mutex_);
+        auto& list = thread_input_buffers_list_;
+        auto it = list.begin();
+        while(it != list.end()) {
+            if(atomic_load_relaxed(&(*it)->abandoned)
+                    && (*it)->buffer.size() == 0)
+                it = list.erase(it);
+            else
+                ++it;
+        }
+        worker_thread_input_buffers_ = list;
+        atomic_store_release(&thread_input_buffers_version_,
+            thread_input_buffers_version_ + 1);
+        worker_thread_input_buffers_version_ = thread_input_buffers_version_;
+    }
+}
+
+char* basic_log::process_frames(detail::mpsc_ring_buffer* pbuffer,
+    char* pbegin, char* pend, detail::frame_status* pstatus)
+{
+    using namespace detail;
+    if(formatter_pool_)
+        return process_frames_parallel(pbuffer, pbegin, pend, pstatus);
+
+    auto pnext_frame = pbegin;
+    auto status = *pstatus;
+    while(pnext_frame != pend && likely(status < frame_status::shutdown_marker))
+    {
+        // The batch may run past the end of the first mapping of the ring
+        // buffer, but the producer constructed the frame at its address in
+        // the first mapping. Objects such as std::string with the small
+        // string optimization keep pointers into themselves, so we have to
+        // use the same address or they won't recognize their own storage.
+        auto pframe = static_cast<char*>(pbuffer->wrap(pnext_frame));
+        auto lap_tag = pbuffer->lap_tag(pbuffer->position_of(pnext_frame));
+        status = acquire_frame(pframe, lap_tag);
+        if(unlikely(status == frame_status::uninitialized))
+            return pnext_frame;
+
+        if(unlikely(status == frame_status::panic_shutdown_marker)) {
+            // We are in panic-flush mode and reached the shutdown marker. That
+            // means we are done.
+            on_panic_flush_done();  // never returns
+        }
+        std::size_t frame_size = char_cast<frame_header*>(pframe)->frame_size;
+        // Frames that failed the error check or failed to initialize are
+        // just skipped.
+        if(likely(status == frame_status::initialized
+                || status == frame_status::initialized_on_worker))
+        {
+            process_frame(pframe);
+        }
+
+        // The frame is left as it is. Whoever ends up with this memory on
+        // the next lap writes a different lap tag.
+        pnext_frame += frame_size;
+    }
+    assert(pnext_frame == pend);
+    *pstatus = status;
+    return pnext_frame;
+}
+
+// Like process_frames, but runs of initialized frames are formatted by the
+// formatter threads. We commit their output in order, and deal with any
+// other frame ourselves once everything before it has been committed.
+char* basic_log::process_frames_parallel(detail::mpsc_ring_buffer* pbuffer,
+    char* pbegin, char* pend, detail::frame_status* pstatus)
+{
+    using namespace detail;
+    auto& pool = *formatter_pool_;
+    // Split the batch evenly between the formatter threads and ourselves,
+    // but keep the jobs small enough that we can start committing soon.
+    std::size_t job_size = std::min(max_format_job_size,
+        (static_cast<std::size_t>(pend - pbegin) + pool.thread_count())
+            / (pool.thread_count() + 1));
+
+    auto pnext_frame = pbegin;
+    auto status = *pstatus;
+    while(pnext_frame != pend && likely(status < frame_status::shutdown_marker))
+    {
+        auto pjob_begin = pnext_frame;
+        while(pnext_frame != pend
+            && static_cast<std::size_t>(pnext_frame - pjob_begin) < job_size)
+        {
+            auto pframe = static_cast<char*>(pbuffer->wrap(pnext_frame));
+            auto lap_tag = pbuffer->lap_tag(pbuffer->position_of(pnext_frame));
+            status = acquire_frame(pframe, lap_tag);
+            if(status != frame_status::initialized)
+                break;
+            pnext_frame += char_cast<frame_header*>(pframe)->frame_size;
+        }
+
+        if(pnext_frame != pjob_begin) {
+            format_job* pjob = pool.next_job();
+            if(!pjob) {
+                commit_format_job();
+                pjob = pool.next_job();
+            }
+            pjob->assign(pbuffer, pjob_begin, pnext_frame);
+            pool.submit();
+        }
+
+        if(unlikely(status == frame_status::uninitialized))
+            break;
+        if(status != frame_status::initialized) {
+            while(pool.oldest_job())
+                commit_format_job();
+            auto pframe = static_cast<char*>(pbuffer->wrap(pnext_frame));
+            if(unlikely(status == frame_status::panic_shutdown_marker))
+                on_panic_flush_done();  // never returns
+            if(status == frame_status::initialized_on_worker)
+                process_frame(pframe);
+            pnext_frame += char_cast<frame_header*>(pframe)->frame_size;
+        }
+    }
+    while(pool.oldest_job())
+        commit_format_job();
+    assert(pnext_frame == pend || status == frame_status::uninitialized);
+    *pstatus = status;
+    return pnext_frame;
+}
+
+detail::frame_status basic_log::acquire_frame(void* pframe,
+    std::uint64_t lap_tag)
 {
     using namespace detail;
     auto pheader = static_cast<frame_header*>(pframe);
-    auto status = atomic_load_acquire(&pheader->status);
+    auto status = load_frame_status(pheader, lap_tag);
     if(likely(status != frame_status::uninitialized))
         return status;
 
-    // Poll the frame status until it is no longer uninitialized. We don't need
-    // to be as sophisticated as in wait_for_input and try to flush the output
-    // buffer etc, since we know another thread is just in the process of
-    // putting data in the frame. If we have to wait more than a millisecond
-    // here then something has probably gone very wrong.
-    unsigned wait_time_ms = 0;
+    // Poll the frame status until it is no longer uninitialized. Usually
+    // another thread is just in the process of putting data in the frame,
+    // but it may also be the first frame of a write_batch region, which
+    // stays unpublished for as long as the thread keeps the batch open.
+    //
+    // A pool thread has other logs to take care of, so it only spins for a
+    // while before it gives up and leaves the frame for later; see
+    // service_input(). Except in a panic flush, which we see through to the
+    // end.
+    if(pworker_pool_ && !atomic_load_relaxed(&panic_flush_)) {
+        for(unsigned i=0; i!=worker_spin_count_; ++i) {
+            pause();
+            status = load_frame_status(pheader, lap_tag);
+            if(status != frame_status::uninitialized)
+                return status;
+        }
+        on_stalled_frame(pframe, lap_tag);
+        return frame_status::uninitialized;
+    }
+
+    // With thread staging we have to look in at least as often as the
+    // stages are to be sealed.
+    input_wait wait(worker_wait_, worker_spin_count_,
+        &input_buffer_full_event_, thread_staging_capacity_ == 0?
+            max_input_buffer_poll_period_ms
+            : std::max(1u, thread_staging_delay_ms_));
     while(true) {
-        input_buffer_full_event_.wait(wait_time_ms);
-        status = atomic_load_acquire(&pheader->status);
+        wait();
+        status = load_frame_status(pheader, lap_tag);
         if(status != frame_status::uninitialized)
             return status;
-
-        wait_time_ms += std::max(1u,
-            wait_time_ms/input_buffer_poll_period_inverse_growth_factor);
-        wait_time_ms = std::min(wait_time_ms, max_input_buffer_poll_period_ms);
+        // Once we're done spinning, let the output of the frames before
+        // this one go to the writer rather than hold it back until the
+        // frame is ready.
+        if(!wait.spinning()) {
+            if(output_buffer::has_complete_frame())
+                flush_output_buffer();
+            on_stalled_frame(pframe, lap_tag);
+        }
     }
 }
 
-std::size_t basic_log::process_frame(void* pframe)
+void basic_log::process_frame(void* pframe)
 {
     //RECKLESS_TRACE(process_frame_start_event);
     using namespace detail;
     auto pheader = static_cast<frame_header*>(pframe);
     auto pdispatch = pheader->pdispatch_function;
 
-    std::size_t frame_size;
     try {
-        frame_size = (*pdispatch)(invoke_formatter,
+        (*pdispatch)(invoke_formatter,
                 static_cast<output_buffer*>(this), pframe);
         output_buffer::frame_end();
     } catch(flush_error const&) {
@@ -543,42 +1460,59 @@ std::size_t basic_log::process_frame(void* pframe)
         // the flush failed. This means that we lose the frame.
         output_buffer::lost_frame();
         std::type_info const* pti;
-        frame_size = (*pdispatch)(get_typeid, &pti, nullptr);
+        (*pdispatch)(get_typeid, &pti, nullptr);
     } catch(...) {
         output_buffer::revert_frame();
-        std::type_info const* pti;
-        frame_size = (*pdispatch)(get_typeid, &pti, nullptr);
-        std::lock_guard<std::mutex> lk(callback_mutex_);
-        if(format_error_callback_) {
-            try {
-                format_error_callback_(this, std::current_exception(),
-                        *pti);
-            } catch(...) {
-            }
-        }
+        report_format_error(pframe, std::current_exception());
     }
 
     //RECKLESS_TRACE(process_frame_finish_event);
-    return frame_size;
 }
 
-std::size_t basic_log::skip_frame(void* pframe)
+// Copy the output of the oldest format job to the output buffer, one frame
+// at a time so that writer errors and format errors are dealt with just as
+// in process_frame().
+void basic_log::commit_format_job()
 {
     using namespace detail;
-    auto pdispatch = static_cast<frame_header*>(pframe)->pdispatch_function;
-    std::type_info const* pti;
-    return (*pdispatch)(get_typeid, &pti, nullptr);
+    format_job* pjob = formatter_pool_->wait_oldest_job();
+    char const* poutput = pjob->output();
+    std::size_t frame_begin = 0;
+    for(auto const& frame : pjob->frames()) {
+        if(unlikely(frame.lost)) {
+            output_buffer::lost_frame();
+        } else {
+            try {
+                output_buffer::write(poutput + frame_begin,
+                    frame.output_end - frame_begin);
+                output_buffer::frame_end();
+                if(unlikely(frame.error != nullptr))
+                    report_format_error(frame.pframe, frame.error);
+            } catch(flush_error const&) {
+                output_buffer::lost_frame();
+            } catch(...) {
+                output_buffer::revert_frame();
+                report_format_error(frame.pframe, std::current_exception());
+            }
+        }
+        frame_begin = frame.output_end;
+    }
+    formatter_pool_->retire();
 }
 
-void basic_log::clear_frame(void* pframe, std::size_t frame_size)
+void basic_log::report_format_error(void* pframe,
+    std::exception_ptr const& error)
 {
     using namespace detail;
-    auto pcframe = static_cast<char*>(pframe);
-    for(std::size_t offset=0; offset!=frame_size;
-            offset += RECKLESS_CACHE_LINE_SIZE)
-    {
-        auto pheader = char_cast<frame_header*>(pcframe + offset);
-        atomic_store_relaxed(&pheader->status, frame_status::uninitialized);
+    auto pdispatch = static_cast<frame_header*>(pframe)->pdispatch_function;
+    std::type_info const* pti;
+    (*pdispatch)(get_typeid, &pti, nullptr);
+    std::lock_guard<std::mutex> lk(callback_mutex_);
+    if(format_error_callback_) {
+        try {
+            format_error_callback_(this, error, *pti);
+        } catch(...) {
+        }
     }
 }
 
@@ -608,6 +1542,8 @@ void basic_log::on_panic_flush_done()
     }
 
     panic_flush_done_event_.signal();
+    if(pworker_pool_)
+        throw panic_flush_done();
     // Sleep and wait for death.
     while(true)
         std::this_thread::sleep_for(std::chrono::hours(1));
@@ -0,0 +1,71 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/binary_log.hpp>
+
+namespace reckless {
+namespace detail {
+
+std::uint32_t binary_format_table::define(output_buffer* pbuffer,
+    char const* pformat)
+{
+    if(ids_.empty()) {
+        char* p = pbuffer->reserve(binary_format::header_size);
+        std::memcpy(p, binary_format::magic, 8);
+        std::memcpy(p + 8, &binary_format::version, 4);
+        std::memcpy(p + 12, &binary_format::byte_order_mark, 4);
+        p[16] = static_cast<char>(sizeof(long double));
+        p[17] = 0;
+        p[18] = 0;
+        p[19] = 0;
+        pbuffer->commit(binary_format::header_size);
+    }
+
+    auto id = static_cast<std::uint32_t>(ids_.size());
+    auto length = static_cast<std::uint32_t>(std::strlen(pformat));
+    char* p = pbuffer->reserve(1 + 4 + 4);
+    p[0] = static_cast<char>(binary_format::record_type::format);
+    std::memcpy(p + 1, &id, 4);
+    std::memcpy(p + 5, &length, 4);
+    pbuffer->commit(1 + 4 + 4);
+    pbuffer->write(pformat, length);
+
+    // If this throws bad_alloc then we have written the format record but
+    // not remembered it. That's harmless, we'll just define it again next
+    // time.
+    ids_.emplace(pformat, id);
+    pending_ = pformat;
+    return id;
+}
+
+}   // namespace detail
+
+void binary_log::write_dropped_input_report(reckless::output_buffer* pbuffer,
+    unsigned count)
+{
+    // The format string is defined here so that it has one address, which
+    // is what the format table goes by.
+    binary_formatter::format(pbuffer, &format_table_, detail::binary_timestamp(),
+        "reckless: %u log records were dropped because the input buffer was full",
+        count);
+}
+
+}   // namespace reckless
@@ -21,9 +21,12 @@
  */
 #include <reckless/detail/fd_writer.hpp>
 
+#include <algorithm>    // min
+
 #if defined(__unix__)
 #include <errno.h>      // errno, EINTR
 #include <unistd.h>     // write
+#include <sys/uio.h>    // writev, iovec
 
 #elif defined(_WIN32)
 #define NOMINMAX
@@ -116,6 +119,11 @@ namespace {
 
 }
 
+std::error_category const& reckless::detail::fd_error_category()
+{
+    return get_error_category();
+}
+
 namespace reckless {
 namespace detail {
 
@@ -139,6 +147,52 @@ std::size_t fd_writer::write(void const* pbuffer, std::size_t count, std::error_
     return p - static_cast<char const*>(pbuffer);
 }
 
+std::size_t fd_writer::writev(write_segment const* psegments,
+        std::size_t segment_count, std::error_code& ec) noexcept
+{
+    // We convert the segments into iovecs a few at a time, so we don't need
+    // to allocate memory here.
+    std::size_t const max_iov = 16;
+    struct iovec iov[max_iov];
+    std::size_t total = 0;
+    ec.clear();
+    while(segment_count != 0) {
+        int iov_count = static_cast<int>(std::min(segment_count, max_iov));
+        for(int i=0; i!=iov_count; ++i) {
+            iov[i].iov_base = const_cast<void*>(psegments[i].pbuffer);
+            iov[i].iov_len = psegments[i].count;
+        }
+        psegments += iov_count;
+        segment_count -= iov_count;
+
+        struct iovec* piov = iov;
+        while(iov_count != 0) {
+            ssize_t written = ::writev(fd_, piov, iov_count);
+            if(written == -1) {
+                if(errno != EINTR) {
+                    ec.assign(errno, get_error_category());
+                    return total;
+                }
+                continue;
+            }
+            total += written;
+            // Skip past what was written. A partial write may leave us in
+            // the middle of a segment.
+            auto remaining = static_cast<std::size_t>(written);
+            while(iov_count != 0 && remaining >= piov->iov_len) {
+                remaining -= piov->iov_len;
+                ++piov;
+                --iov_count;
+            }
+            if(iov_count != 0) {
+                piov->iov_base = static_cast<char*>(piov->iov_base) + remaining;
+                piov->iov_len -= remaining;
+            }
+        }
+    }
+    return total;
+}
+
 #elif defined(_WIN32)
 std::size_t fd_writer::write(void const* pbuffer, std::size_t count, std::error_code& ec) noexcept
 {
@@ -0,0 +1,203 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/detail/formatter_pool.hpp>
+#include <reckless/basic_log.hpp>   // frame_header, mpsc_ring_buffer
+#include <reckless/detail/platform.hpp> // set_thread_name, set_thread_affinity
+
+#include <cassert>
+#include <new>      // bad_alloc
+
+namespace reckless {
+namespace detail {
+
+format_job::format_job(std::size_t output_capacity) :
+    output_buffer(this, output_capacity)
+{
+}
+
+void format_job::format()
+{
+    frames_.clear();
+    output_.clear();
+    auto pnext_frame = pbegin_;
+    while(pnext_frame != pend_) {
+        auto pframe = pinput_->wrap(pnext_frame);
+        auto pheader = static_cast<frame_header*>(pframe);
+        std::size_t frame_size = pheader->frame_size;
+        formatted_frame frame = {pframe, 0, nullptr, false};
+        try {
+            (*pheader->pdispatch_function)(invoke_formatter,
+                static_cast<output_buffer*>(this), pframe);
+            output_buffer::frame_end();
+        } catch(flush_error const&) {
+            // Only happens if we ran out of memory for output_.
+            output_buffer::revert_frame();
+            frame.lost = true;
+        } catch(...) {
+            output_buffer::revert_frame();
+            frame.error = std::current_exception();
+        }
+        frame.output_end = output_.size() + complete_frames_size();
+        frames_.push_back(std::move(frame));
+        pnext_frame += frame_size;
+    }
+
+    try {
+        output_buffer::flush();
+    } catch(flush_error const&) {
+        // Whatever didn't make it to output_ is lost, and has to go so that
+        // it doesn't end up in the next job.
+        for(auto& frame : frames_) {
+            if(frame.output_end > output_.size()) {
+                frame.output_end = output_.size();
+                frame.lost = true;
+            }
+        }
+        discard_ = true;
+        output_buffer::flush();
+        discard_ = false;
+    }
+}
+
+std::size_t format_job::write(void const* pbuffer, std::size_t count,
+        std::error_code& ec) noexcept
+{
+    if(!discard_) {
+        try {
+            auto p = static_cast<char const*>(pbuffer);
+            output_.insert(output_.end(), p, p + count);
+        } catch(std::bad_alloc const&) {
+            // The default temporary_error_policy is to throw flush_error,
+            // which is what we want.
+            ec = make_error_code(writer::temporary_failure);
+            return 0;
+        }
+    }
+    ec.clear();
+    return count;
+}
+
+formatter_pool::formatter_pool(unsigned thread_count,
+    std::size_t output_capacity, std::vector<unsigned> const& cpus)
+{
+    // Enough jobs for every thread, including the output worker, to have
+    // one in progress and one more waiting while the oldest is committed.
+    // Each job has an output buffer as large as the log's, so we don't want
+    // many more than that.
+    std::size_t job_count = 2*(thread_count + 1);
+    for(std::size_t i=0; i!=job_count; ++i)
+        jobs_.emplace_back(new format_job(output_capacity));
+
+    try {
+        for(unsigned i=0; i!=thread_count; ++i)
+            threads_.emplace_back(&formatter_pool::thread_main, this, cpus);
+    } catch(...) {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        job_submitted_.notify_all();
+        for(auto& thread : threads_)
+            thread.join();
+        throw;
+    }
+}
+
+formatter_pool::~formatter_pool()
+{
+    assert(submitted_ == retired_);
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        stop_ = true;
+    }
+    job_submitted_.notify_all();
+    for(auto& thread : threads_)
+        thread.join();
+}
+
+void formatter_pool::submit()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        jobs_[submitted_ % jobs_.size()]->done_ = false;
+        ++submitted_;
+    }
+    job_submitted_.notify_one();
+}
+
+format_job* formatter_pool::wait_oldest_job()
+{
+    format_job* pjob = oldest_job();
+    assert(pjob);
+    std::unique_lock<std::mutex> lk(mutex_);
+    while(!pjob->done_) {
+        // Rather than wait for a formatter thread to get around to it, we
+        // take the next unclaimed job ourselves. Sooner or later that is the
+        // one we're waiting for.
+        format_job* pother = claim_job();
+        if(pother)
+            run_job(lk, pother);
+        else
+            job_done_.wait(lk);
+    }
+    return pjob;
+}
+
+void formatter_pool::thread_main(std::vector<unsigned> const& cpus)
+{
+    set_thread_name("reckless formatter");
+    // The output worker has already reported any problem with these CPUs
+    // from open().
+    if(!cpus.empty())
+        set_thread_affinity(cpus.data(), cpus.size());
+
+    std::unique_lock<std::mutex> lk(mutex_);
+    while(true) {
+        format_job* pjob = claim_job();
+        if(pjob)
+            run_job(lk, pjob);
+        else if(stop_)
+            return;
+        else
+            job_submitted_.wait(lk);
+    }
+}
+
+format_job* formatter_pool::claim_job()
+{
+    if(claimed_ == submitted_)
+        return nullptr;
+    return jobs_[claimed_++ % jobs_.size()].get();
+}
+
+void formatter_pool::run_job(std::unique_lock<std::mutex>& lk,
+    format_job* pjob)
+{
+    lk.unlock();
+    pjob->format();
+    lk.lock();
+    pjob->done_ = true;
+    job_done_.notify_all();
+}
+
+}   // namespace detail
+}   // namespace reckless
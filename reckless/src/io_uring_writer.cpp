@@ -0,0 +1,268 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#if defined(__linux__)
+#include <reckless/io_uring_writer.hpp>
+#include <reckless/detail/fd_writer.hpp>    // fd_error_category
+
+#include <system_error>
+#include <algorithm>    // max
+#include <cstring>      // memset
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>   // mmap
+#include <sys/stat.h>   // open
+#include <sys/syscall.h>
+#include <fcntl.h>      // open
+#include <sched.h>      // sched_yield
+#include <errno.h>
+#include <unistd.h>     // lseek, close, syscall
+
+// We talk to io_uring through the raw system calls rather than liburing, to
+// avoid adding a dependency for what amounts to a single opcode.
+namespace {
+int io_uring_setup(unsigned entries, io_uring_params* pparams)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, pparams));
+}
+
+int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+        unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+        min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int ring_fd, unsigned opcode, void* parg,
+        unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode,
+        parg, nr_args));
+}
+
+// io_uring itself arrived in Linux 5.1 but IORING_OP_WRITE only in 5.6, so
+// a ring that we could set up may still be unable to do the one thing we
+// need. Kernels older than 5.6 don't know IORING_REGISTER_PROBE either and
+// fail it with EINVAL, which also tells us what we need to know.
+bool supports_write(int ring_fd)
+{
+    // The kernel wants the probe zeroed and caps the op count at what it
+    // knows about.
+    unsigned const max_ops = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe)
+        + max_ops*sizeof(io_uring_probe_op));
+    auto pprobe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if(-1 == io_uring_register(ring_fd, IORING_REGISTER_PROBE, pprobe,
+            max_ops))
+        return false;
+    return pprobe->last_op >= IORING_OP_WRITE
+        && (pprobe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+}
+
+void* map_ring(int ring_fd, std::size_t size, off_t offset)
+{
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+    if(p == MAP_FAILED)
+        throw std::system_error(errno, std::system_category());
+    return p;
+}
+
+template <typename T>
+T* ring_field(void* pring, unsigned offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(pring) + offset);
+}
+}   // anonymous namespace
+
+namespace reckless {
+
+io_uring_writer::io_uring_writer(char const* path, std::size_t chunk_count,
+        std::size_t chunk_size) :
+    async_writer(chunk_count, chunk_size)
+{
+    failed_submissions_.reserve(chunk_count);
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = io_uring_setup(static_cast<unsigned>(chunk_count), &params);
+    if(ring_fd_ == -1)
+        throw std::system_error(errno, std::system_category());
+
+    try {
+        if(!supports_write(ring_fd_))
+            throw std::system_error(ENOSYS, std::system_category());
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+            psq_ring_ = map_ring(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+            pcq_ring_ = psq_ring_;
+        } else {
+            psq_ring_ = map_ring(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+            pcq_ring_ = map_ring(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+        }
+        sqes_size_ = params.sq_entries*sizeof(io_uring_sqe);
+        psqes_ = static_cast<io_uring_sqe*>(
+            map_ring(ring_fd_, sqes_size_, IORING_OFF_SQES));
+
+        psq_tail_ = ring_field<unsigned>(psq_ring_, params.sq_off.tail);
+        psq_mask_ = ring_field<unsigned>(psq_ring_, params.sq_off.ring_mask);
+        psq_array_ = ring_field<unsigned>(psq_ring_, params.sq_off.array);
+        pcq_head_ = ring_field<unsigned>(pcq_ring_, params.cq_off.head);
+        pcq_tail_ = ring_field<unsigned>(pcq_ring_, params.cq_off.tail);
+        pcq_mask_ = ring_field<unsigned>(pcq_ring_, params.cq_off.ring_mask);
+        pcqes_ = ring_field<io_uring_cqe>(pcq_ring_, params.cq_off.cqes);
+
+        auto full_access =
+            S_IRUSR | S_IWUSR |
+            S_IRGRP | S_IWGRP |
+            S_IROTH | S_IWOTH;
+        fd_ = open(path, O_WRONLY | O_CREAT, full_access);
+        if(fd_ == -1)
+            throw std::system_error(errno, std::system_category());
+        off_t end = lseek(fd_, 0, SEEK_END);
+        if(end == -1)
+            throw std::system_error(errno, std::system_category());
+        file_offset_ = static_cast<std::uint64_t>(end);
+    } catch(...) {
+        close_ring();
+        throw;
+    }
+}
+
+io_uring_writer::~io_uring_writer()
+{
+    drain();
+    close_ring();
+}
+
+void io_uring_writer::close_ring() noexcept
+{
+    if(psqes_)
+        munmap(psqes_, sqes_size_);
+    if(pcq_ring_ && pcq_ring_ != psq_ring_)
+        munmap(pcq_ring_, cq_ring_size_);
+    if(psq_ring_)
+        munmap(psq_ring_, sq_ring_size_);
+    close(ring_fd_);
+    if(fd_ != -1) {
+        while(-1 == close(fd_)) {
+            if(errno != EINTR)
+                break;
+        }
+    }
+}
+
+void io_uring_writer::submit(chunk* pchunk) noexcept
+{
+    // We are the only thread touching the submission queue, and without
+    // SQPOLL the kernel only reads it during io_uring_enter(), so there is
+    // no need to check for space: async_writer never has more chunks in
+    // flight than we asked for entries.
+    unsigned tail = *psq_tail_;
+    unsigned index = tail & *psq_mask_;
+    io_uring_sqe* psqe = &psqes_[index];
+    std::memset(psqe, 0, sizeof(*psqe));
+    psqe->opcode = IORING_OP_WRITE;
+    psqe->fd = fd_;
+    psqe->addr = reinterpret_cast<std::uint64_t>(pchunk->pdata + pchunk->written);
+    psqe->len = static_cast<unsigned>(pchunk->size - pchunk->written);
+    psqe->off = file_offset_ + pchunk->offset + pchunk->written;
+    psqe->user_data = reinterpret_cast<std::uint64_t>(pchunk);
+    psq_array_[index] = index;
+    __atomic_store_n(psq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    while(-1 == io_uring_enter(ring_fd_, 1, 0, 0)) {
+        if(errno != EINTR) {
+            // The kernel hasn't looked at the entry, so we can take it back.
+            __atomic_store_n(psq_tail_, tail, __ATOMIC_RELEASE);
+            pchunk->error.assign(errno, detail::fd_error_category());
+            failed_submissions_.push_back(pchunk);
+            return;
+        }
+    }
+}
+
+detail::async_writer::chunk* io_uring_writer::complete(bool block) noexcept
+{
+    if(!failed_submissions_.empty()) {
+        chunk* pchunk = failed_submissions_.back();
+        failed_submissions_.pop_back();
+        return pchunk;
+    }
+
+    while(true) {
+        unsigned head = *pcq_head_;
+        if(head == __atomic_load_n(pcq_tail_, __ATOMIC_ACQUIRE)) {
+            if(!block)
+                return nullptr;
+            if(-1 == io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS)
+                    && errno != EINTR)
+            {
+                // Shouldn't happen with a valid ring, but if it does we
+                // can't wait so we'll have to spin.
+                sched_yield();
+            }
+            continue;
+        }
+
+        io_uring_cqe const* pcqe = &pcqes_[head & *pcq_mask_];
+        chunk* pchunk = reinterpret_cast<chunk*>(pcqe->user_data);
+        int result = pcqe->res;
+        __atomic_store_n(pcq_head_, head + 1, __ATOMIC_RELEASE);
+
+        if(result < 0) {
+            if(result != -EINTR && result != -EAGAIN) {
+                pchunk->error.assign(-result, detail::fd_error_category());
+                return pchunk;
+            }
+        } else {
+            pchunk->written += static_cast<std::size_t>(result);
+            if(pchunk->written == pchunk->size)
+                return pchunk;
+            if(result == 0) {
+                // The kernel made no progress and had no error to report.
+                // Trying again would most likely get us the same result
+                // forever.
+                pchunk->error.assign(EIO, detail::fd_error_category());
+                return pchunk;
+            }
+        }
+
+        // Interrupted, or a short write e.g. because a signal interrupted
+        // it. Carry on with the rest. If we can't even resubmit then there
+        // is no completion coming for the chunk, so hand it back now
+        // instead of waiting for one.
+        submit(pchunk);
+        if(!failed_submissions_.empty()) {
+            pchunk = failed_submissions_.back();
+            failed_submissions_.pop_back();
+            return pchunk;
+        }
+    }
+}
+
+}   // namespace reckless
+
+#endif  // __linux__
@@ -44,15 +44,22 @@ int sys_futex(void *addr1, int op, int val1, struct timespec const *timeout,
 
 void lockless_cv::notify_all()
 {
-    atomic_fetch_add_release(&notify_count_, 1);
-    sys_futex(&notify_count_, FUTEX_WAKE_PRIVATE, 0x7fffffff,
-        nullptr, nullptr, 0);
+    // Waiters register themselves before the kernel compares notify_count_
+    // to the expected value. So if we see no waiters here, then any thread
+    // that is about to wait will see the new count and return immediately.
+    atomic_fetch_add_seq_cst(&notify_count_, 1);
+    if(atomic_load_seq_cst(&waiters_) != 0) {
+        sys_futex(&notify_count_, FUTEX_WAKE_PRIVATE, 0x7fffffff,
+            nullptr, nullptr, 0);
+    }
 }
 
 void lockless_cv::wait(unsigned expected_notify_count)
 {
+    atomic_fetch_add_seq_cst(&waiters_, 1);
     sys_futex(&notify_count_, FUTEX_WAIT_PRIVATE, expected_notify_count,
         nullptr, 0, 0);
+    atomic_fetch_add_relaxed(&waiters_, -1);
 }
 
 void lockless_cv::wait(unsigned expected_notify_count, unsigned milliseconds)
@@ -61,8 +68,10 @@ void lockless_cv::wait(unsigned expected_notify_count, unsigned milliseconds)
     timeout.tv_sec = milliseconds/1000;
     timeout.tv_nsec = static_cast<long>(milliseconds%1000)*1000000;
 
+    atomic_fetch_add_seq_cst(&waiters_, 1);
     sys_futex(&notify_count_, FUTEX_WAIT_PRIVATE,
         expected_notify_count, &timeout, 0, 0);
+    atomic_fetch_add_relaxed(&waiters_, -1);
 }
 
 }   // namespace detail
@@ -77,18 +86,24 @@ namespace detail {
 
 void lockless_cv::notify_all()
 {
-    atomic_fetch_add_release(&notify_count_, 1);
-    WakeByAddressAll(&notify_count_);
+    // See the Linux version for why this is safe.
+    atomic_fetch_add_seq_cst(&notify_count_, 1);
+    if(atomic_load_seq_cst(&waiters_) != 0)
+        WakeByAddressAll(&notify_count_);
 }
 
 void lockless_cv::wait(unsigned expected_notify_count)
 {
+    atomic_fetch_add_seq_cst(&waiters_, 1);
     WaitOnAddress(&notify_count_, &expected_notify_count, sizeof(unsigned), INFINITE);
+    atomic_fetch_add_relaxed(&waiters_, -1);
 }
 
 void lockless_cv::wait(unsigned expected_notify_count, unsigned milliseconds)
 {
+    atomic_fetch_add_seq_cst(&waiters_, 1);
     WaitOnAddress(&notify_count_, &expected_notify_count, sizeof(unsigned), milliseconds);
+    atomic_fetch_add_relaxed(&waiters_, -1);
 }
 
 }   // namespace detail
@@ -0,0 +1,147 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/log_worker_pool.hpp>
+#include <reckless/basic_log.hpp>
+#include <reckless/detail/platform.hpp> // set_thread_name
+
+#include <algorithm>    // max, min, find
+#include <cassert>
+
+namespace reckless {
+
+namespace {
+// Same back off as the output worker of a log uses with
+// worker_wait_policy::backoff.
+unsigned const max_poll_period_ms = 1000u;
+unsigned const poll_period_inverse_growth_factor = 4;
+// How long we wait at most while a log has a frame that isn't ready yet.
+// Publishing a write_batch signals the pool, but a thread that is merely
+// slow to finish a frame doesn't.
+unsigned const max_stalled_poll_period_ms = 1u;
+}   // anonymous namespace
+
+log_worker_pool::log_worker_pool(unsigned thread_count)
+{
+    assert(thread_count != 0);
+    try {
+        for(unsigned i=0; i!=thread_count; ++i)
+            threads_.emplace_back(&log_worker_pool::thread_main, this, i);
+    } catch(...) {
+        detail::atomic_store_release(&stop_, true);
+        input_event_.notify_all();
+        for(auto& thread : threads_)
+            thread.join();
+        throw;
+    }
+}
+
+log_worker_pool::~log_worker_pool()
+{
+    // Every log must have been closed first.
+    assert(logs_.empty());
+    detail::atomic_store_release(&stop_, true);
+    input_event_.notify_all();
+    for(auto& thread : threads_)
+        thread.join();
+}
+
+std::shared_ptr<detail::pooled_log> log_worker_pool::attach(basic_log* plog)
+{
+    auto pentry = std::make_shared<detail::pooled_log>(plog);
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        logs_.push_back(pentry);
+        detail::atomic_store_release(&logs_version_, logs_version_ + 1);
+    }
+    input_event_.notify_all();
+    return pentry;
+}
+
+void log_worker_pool::detach(std::shared_ptr<detail::pooled_log> const& pentry)
+{
+    // The log has already processed its shutdown marker, so whoever is
+    // working on it now is about to let go.
+    while(pentry->busy.exchange(true, std::memory_order_acquire))
+        std::this_thread::yield();
+    pentry->plog = nullptr;
+    pentry->busy.store(false, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = std::find(logs_.begin(), logs_.end(), pentry);
+    assert(it != logs_.end());
+    logs_.erase(it);
+    detail::atomic_store_release(&logs_version_, logs_version_ + 1);
+}
+
+void log_worker_pool::thread_main(unsigned index)
+{
+    using namespace detail;
+    set_thread_name("reckless pool worker");
+
+    std::vector<std::shared_ptr<pooled_log>> logs;
+    unsigned logs_version = 0;
+    // Each thread starts its rounds at a different log, and the starting
+    // point moves on by one every round, so that no log is always last.
+    std::size_t next = index;
+    unsigned wait_time_ms = 0;
+    while(true) {
+        auto notify_count = input_event_.notify_count();
+        if(atomic_load_acquire(&stop_))
+            return;
+        if(atomic_load_acquire(&logs_version_) != logs_version) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            logs = logs_;
+            logs_version = logs_version_;
+        }
+
+        bool found_input = false;
+        bool stalled = false;
+        for(std::size_t i=0; i!=logs.size(); ++i) {
+            auto& pentry = logs[(next + i) % logs.size()];
+            // If another pool thread is working on the log then it will
+            // look for more input when it is done.
+            if(pentry->busy.exchange(true, std::memory_order_acquire))
+                continue;
+            if(pentry->plog) {
+                if(pentry->plog->service_input())
+                    found_input = true;
+                else if(pentry->plog->input_stalled_)
+                    stalled = true;
+            }
+            pentry->busy.store(false, std::memory_order_release);
+        }
+        ++next;
+
+        if(found_input) {
+            wait_time_ms = 0;
+        } else {
+            input_event_.wait(notify_count, stalled?
+                std::min(wait_time_ms, max_stalled_poll_period_ms)
+                : wait_time_ms);
+            wait_time_ms += std::max(1u,
+                wait_time_ms/poll_period_inverse_growth_factor);
+            wait_time_ms = std::min(wait_time_ms, max_poll_period_ms);
+        }
+    }
+}
+
+}   // namespace reckless
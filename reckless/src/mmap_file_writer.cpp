@@ -0,0 +1,195 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#if defined(__unix__)
+#include <reckless/mmap_file_writer.hpp>
+#include <reckless/detail/fd_writer.hpp>    // fd_error_category
+#include <reckless/detail/platform.hpp>     // get_page_size
+
+#include <system_error>
+#include <algorithm>    // min
+#include <cstring>      // memcpy
+
+#include <sys/mman.h>   // mmap, msync, madvise
+#include <sys/stat.h>   // open, fstat
+#include <fcntl.h>      // open, fallocate, posix_fallocate
+#include <errno.h>
+#include <unistd.h>     // ftruncate, close
+
+namespace {
+int allocate(int fd, std::uint64_t offset, std::uint64_t length)
+{
+#if defined(__linux__)
+    // fallocate() is not supported by all file systems, but
+    // posix_fallocate() falls back to writing zeroes so it always works.
+    if(0 == fallocate(fd, 0, static_cast<off_t>(offset),
+            static_cast<off_t>(length)))
+        return 0;
+    if(errno != EOPNOTSUPP)
+        return errno;
+#endif
+    return posix_fallocate(fd, static_cast<off_t>(offset),
+        static_cast<off_t>(length));
+}
+}   // anonymous namespace
+
+namespace reckless {
+
+mmap_file_writer::mmap_file_writer(char const* path, std::size_t extent_size,
+        mmap_sync_policy sync, mmap_advice advice) :
+    sync_(sync),
+    advice_(advice)
+{
+    // Windows have to start at a page boundary, so the extent size needs to
+    // be a multiple of the page size.
+    std::size_t page_size = detail::get_page_size();
+    extent_size_ = std::max(page_size,
+        (extent_size + page_size - 1)/page_size*page_size);
+
+    auto full_access =
+        S_IRUSR | S_IWUSR |
+        S_IRGRP | S_IWGRP |
+        S_IROTH | S_IWOTH;
+    // The mapping needs read access to the file even if we only write to it.
+    fd_ = open(path, O_RDWR | O_CREAT, full_access);
+    if(fd_ == -1)
+        throw std::system_error(errno, std::system_category());
+    struct stat st;
+    if(-1 == fstat(fd_, &st)) {
+        int error = errno;
+        close(fd_);
+        throw std::system_error(error, std::system_category());
+    }
+    size_ = static_cast<std::uint64_t>(st.st_size);
+    allocated_ = size_;
+}
+
+mmap_file_writer::~mmap_file_writer()
+{
+    release_window();
+    // Give back whatever part of the last extent we didn't use.
+    while(-1 == ftruncate(fd_, static_cast<off_t>(size_))) {
+        if(errno != EINTR)
+            break;
+    }
+    while(-1 == close(fd_)) {
+        if(errno != EINTR)
+            break;
+    }
+}
+
+std::size_t mmap_file_writer::write(void const* pbuffer, std::size_t count,
+        std::error_code& ec) noexcept
+{
+    char const* pinput = static_cast<char const*>(pbuffer);
+    std::size_t remaining = count;
+    ec.clear();
+    while(remaining != 0) {
+        std::size_t window_position = static_cast<std::size_t>(
+            size_ - window_offset_);
+        if(!pwindow_ || window_position == window_size_) {
+            if(!next_window(ec))
+                return count - remaining;
+            window_position = static_cast<std::size_t>(size_ - window_offset_);
+        }
+        std::size_t n = std::min(remaining, window_size_ - window_position);
+        std::memcpy(pwindow_ + window_position, pinput, n);
+        pinput += n;
+        remaining -= n;
+        size_ += n;
+    }
+    return count;
+}
+
+bool mmap_file_writer::next_window(std::error_code& ec) noexcept
+{
+    release_window();
+
+    // Start the window at the page that contains the end of the data, and
+    // make sure the whole window is backed by allocated disk space.
+    std::size_t page_size = detail::get_page_size();
+    std::uint64_t offset = size_/page_size*page_size;
+    std::uint64_t window_end = offset + extent_size_;
+    if(allocated_ < window_end) {
+        int error = allocate(fd_, allocated_, window_end - allocated_);
+        if(error != 0) {
+            ec.assign(error, detail::fd_error_category());
+            return false;
+        }
+        allocated_ = window_end;
+    }
+
+    void* p = mmap(nullptr, extent_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd_, static_cast<off_t>(offset));
+    if(p == MAP_FAILED) {
+        ec.assign(errno, detail::fd_error_category());
+        return false;
+    }
+    switch(advice_) {
+    case mmap_advice::normal:
+        break;
+    case mmap_advice::sequential:
+        madvise(p, extent_size_, MADV_SEQUENTIAL);
+        break;
+    case mmap_advice::populate:
+#if defined(MADV_POPULATE_WRITE)
+        // Taking all the page faults at once is a lot cheaper than taking
+        // them one at a time as we copy data. MADV_POPULATE_WRITE needs
+        // Linux 5.14; if it fails we just take the faults as usual.
+        if(0 == madvise(p, extent_size_, MADV_POPULATE_WRITE))
+            break;
+#endif
+        madvise(p, extent_size_, MADV_WILLNEED);
+        break;
+    }
+
+    pwindow_ = static_cast<char*>(p);
+    window_offset_ = offset;
+    window_size_ = extent_size_;
+    return true;
+}
+
+void mmap_file_writer::release_window() noexcept
+{
+    if(!pwindow_)
+        return;
+    // Only the part of the window that we actually wrote to needs to be
+    // synced.
+    std::size_t page_size = detail::get_page_size();
+    std::size_t used = static_cast<std::size_t>(size_ - window_offset_);
+    std::size_t used_pages = (used + page_size - 1)/page_size*page_size;
+    switch(sync_) {
+    case mmap_sync_policy::none:
+        break;
+    case mmap_sync_policy::async:
+        msync(pwindow_, used_pages, MS_ASYNC);
+        break;
+    case mmap_sync_policy::sync:
+        msync(pwindow_, used_pages, MS_SYNC);
+        break;
+    }
+    munmap(pwindow_, window_size_);
+    pwindow_ = nullptr;
+}
+
+}   // namespace reckless
+
+#endif  // __unix__
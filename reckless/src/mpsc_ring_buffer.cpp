@@ -21,17 +21,33 @@
  */
 #include <reckless/detail/mpsc_ring_buffer.hpp>
 #include <new>    // bad_alloc
+#include <chrono>   // steady_clock
+#include <cstdint>  // uint64_t, uintptr_t
 
 #if defined(__linux__)
-#include <sys/mman.h>   // mmap
+#include <sys/mman.h>   // mmap, mlock
 #include <sys/ipc.h>    // shmget/shmat
 #include <sys/shm.h>    // shmget/shmat
 #include <sys/stat.h>   // S_IRUSR/S_IWUSR
+#include <sys/syscall.h>    // SYS_memfd_create
+#include <unistd.h>     // syscall, ftruncate, close
 #include <reckless/detail/utility.hpp>  // get_page_size
 
+#include <cstdio>       // fopen, fgets, sscanf
 #include <errno.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+#ifndef SHM_HUGETLB
+#define SHM_HUGETLB 04000
+#endif
 #elif defined(_WIN32)
 #include <Windows.h>
+#include <cstring>      // memset
 #endif
 
 namespace {
@@ -73,44 +89,165 @@ namespace {
         n_segments = round_nearest_power_of_2(n_segments);
         return n_segments*granularity;
     }
-}   // anonymous namespace
 
-namespace reckless {
-namespace detail {
+#if defined(__linux__)
+    // The default huge page size, which is what MFD_HUGETLB and SHM_HUGETLB
+    // give us.
+    std::size_t read_huge_page_size()
+    {
+        std::size_t size = 2*1024*1024;
+        std::FILE* file = std::fopen("/proc/meminfo", "r");
+        if(!file)
+            return size;
+        char line[256];
+        while(std::fgets(line, sizeof(line), file)) {
+            unsigned long kib;
+            if(std::sscanf(line, "Hugepagesize: %lu kB", &kib) == 1) {
+                size = static_cast<std::size_t>(kib)*1024;
+                break;
+            }
+        }
+        std::fclose(file);
+        return size;
+    }
 
-void mpsc_ring_buffer::init(std::size_t capacity)
-{
-    if(capacity == 0) {
-        rewind();
-        pbuffer_start_ = nullptr;
-        capacity_ = 0;
-        return;
+    std::size_t huge_page_size()
+    {
+        static std::size_t const size = read_huge_page_size();
+        return size;
     }
 
-    capacity = round_capacity(capacity);
+    // Reserve size bytes of address space, aligned to alignment (which must
+    // be a multiple of the page size), for the two views to be mapped over.
+    char* reserve_address_range(std::size_t size, std::size_t alignment)
+    {
+        std::size_t padded_size = size + alignment - reckless::detail::get_page_size();
+        void* p = mmap(nullptr, padded_size, PROT_NONE,
+                MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+        if(p == MAP_FAILED)
+            return nullptr;
+        auto start = reinterpret_cast<std::uintptr_t>(p);
+        auto aligned_start = (start + alignment - 1) & ~(alignment - 1);
+        auto end = start + padded_size;
+        auto aligned_end = aligned_start + size;
+        if(aligned_start != start)
+            munmap(p, aligned_start - start);
+        if(aligned_end != end)
+            munmap(reinterpret_cast<void*>(aligned_end), end - aligned_end);
+        return reinterpret_cast<char*>(aligned_start);
+    }
 
-#if defined(__linux__)
-    int shm = shmget(IPC_PRIVATE, capacity, IPC_CREAT | S_IRUSR | S_IWUSR);
-    if(shm == -1)
-        throw std::bad_alloc();
+    // Map both views of a memfd over a reserved range. Since we map with
+    // MAP_FIXED over our own reservation, nobody can take the addresses in
+    // between like with shmat. Returns nullptr if memfd_create isn't
+    // available, or if there aren't enough huge pages.
+    char* map_memfd(std::size_t capacity, bool huge_pages, bool prefault)
+    {
+#if defined(SYS_memfd_create)
+        unsigned memfd_flags = MFD_CLOEXEC | (huge_pages? MFD_HUGETLB : 0);
+        int fd = static_cast<int>(syscall(SYS_memfd_create, "reckless",
+            memfd_flags));
+        if(fd == -1)
+            return nullptr;
 
-    void* pbase = nullptr;
-    while(!pbase) {
-        pbase = mmap(nullptr, 2*capacity, PROT_NONE,
-                MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-        if(MAP_FAILED == pbase)
-            throw std::bad_alloc();
-        munmap(pbase, 2*capacity);
-        pbase = shmat(shm, pbase, 0);
+        char* pbase = nullptr;
+        if(ftruncate(fd, static_cast<off_t>(capacity)) == 0) {
+            pbase = reserve_address_range(2*capacity, huge_pages?
+                huge_page_size() : reckless::detail::get_page_size());
+        }
+        if(pbase) {
+            int flags = MAP_SHARED | MAP_FIXED | (prefault? MAP_POPULATE : 0);
+            if(MAP_FAILED == mmap(pbase, capacity, PROT_READ | PROT_WRITE,
+                    flags, fd, 0)
+                || MAP_FAILED == mmap(pbase + capacity, capacity,
+                    PROT_READ | PROT_WRITE, flags, fd, 0))
+            {
+                munmap(pbase, 2*capacity);
+                pbase = nullptr;
+            }
+        }
+        close(fd);
+        return pbase;
+#else
+        (void)capacity;
+        (void)huge_pages;
+        (void)prefault;
+        return nullptr;
+#endif
+    }
+
+    // The same with a SysV shared memory segment, for kernels older than
+    // 3.17. SHM_REMAP lets us attach over the reservation. There is no
+    // MAP_POPULATE for shmat, so the caller has to touch the pages instead.
+    char* map_sysv(std::size_t capacity, bool huge_pages)
+    {
+        int shm = shmget(IPC_PRIVATE, capacity, IPC_CREAT | S_IRUSR | S_IWUSR
+            | (huge_pages? SHM_HUGETLB : 0));
+        if(shm == -1)
+            return nullptr;
+
+        char* pbase = reserve_address_range(2*capacity, huge_pages?
+            huge_page_size() : reckless::detail::get_page_size());
         if(pbase) {
-            if((void*)-1 == shmat(shm, static_cast<char*>(pbase) + capacity, 0))
+            if((void*)-1 == shmat(shm, pbase, SHM_REMAP)
+                || (void*)-1 == shmat(shm, pbase + capacity, SHM_REMAP))
             {
-                shmdt(pbase);
+                munmap(pbase, 2*capacity);
                 pbase = nullptr;
             }
         }
+        shmctl(shm, IPC_RMID, nullptr);
+        return pbase;
+    }
+#endif
+}   // anonymous namespace
+
+namespace reckless {
+namespace detail {
+
+std::size_t round_ring_capacity(std::size_t capacity)
+{
+    return round_capacity(capacity);
+}
+
+char* map_ring_memory(std::size_t capacity, unsigned flags,
+    unsigned* pactual_flags)
+{
+    unsigned actual_flags = 0;
+#if defined(__linux__)
+    bool prefault = (flags & ring_memory_prefault) != 0;
+    char* pbase = nullptr;
+    bool populated = false;
+    if((flags & ring_memory_huge_pages) && capacity % huge_page_size() == 0) {
+        pbase = map_memfd(capacity, true, prefault);
+        populated = pbase != nullptr;
+        if(!pbase)
+            pbase = map_sysv(capacity, true);
+        if(pbase)
+            actual_flags |= ring_memory_huge_pages;
+    }
+    if(!pbase) {
+        pbase = map_memfd(capacity, false, prefault);
+        populated = pbase != nullptr;
+    }
+    if(!pbase)
+        pbase = map_sysv(capacity, false);
+    if(!pbase)
+        throw std::bad_alloc();
+
+    if(prefault) {
+        if(!populated) {
+            std::size_t page_size = (actual_flags & ring_memory_huge_pages)?
+                huge_page_size() : get_page_size();
+            for(std::size_t offset=0; offset < 2*capacity; offset += page_size)
+                *static_cast<char volatile*>(pbase + offset) = 0;
+        }
+        actual_flags |= ring_memory_prefault;
     }
-    shmctl(shm, IPC_RMID, nullptr);
+    // Locking one view is enough to keep the pages in RAM, and the limit
+    // counts every view that we lock.
+    if((flags & ring_memory_locked) && mlock(pbase, capacity) == 0)
+        actual_flags |= ring_memory_locked;
 
 #elif defined(_WIN32)
     HANDLE mapping = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr,
@@ -139,26 +276,62 @@ void mpsc_ring_buffer::init(std::size_t capacity)
         }
     }
     CloseHandle(mapping);
+
+    if(flags & ring_memory_prefault) {
+        std::memset(pbase, 0, capacity);
+        actual_flags |= ring_memory_prefault;
+    }
+    if((flags & ring_memory_locked) && VirtualLock(pbase, capacity))
+        actual_flags |= ring_memory_locked;
+#endif
+    if(pactual_flags)
+        *pactual_flags = actual_flags;
+    return static_cast<char*>(pbase);
+}
+
+void unmap_ring_memory(char* pbase, std::size_t capacity)
+{
+#if defined(__linux__)
+    // munmap also detaches SysV segments.
+    munmap(pbase, 2*capacity);
+
+#elif defined(_WIN32)
+    UnmapViewOfFile(pbase + capacity);
+    UnmapViewOfFile(pbase);
 #endif
+}
+
+void mpsc_ring_buffer::init(std::size_t capacity, unsigned memory_flags)
+{
+    if(capacity == 0) {
+        rewind();
+        pbuffer_start_ = nullptr;
+        capacity_ = 0;
+        lap_tag_offset_ = 0;
+        memory_flags_ = 0;
+        return;
+    }
+
+    capacity = round_capacity(capacity);
+    // The memory is zero-filled by the OS already. Faulting it in here saves
+    // producers from taking the page faults on their first lap.
+    char* pbase = map_ring_memory(capacity,
+        memory_flags | ring_memory_prefault, &memory_flags_);
 
     rewind();
-    std::memset(pbase, 0, capacity);
-    pbuffer_start_ = static_cast<char*>(pbase);
+    pbuffer_start_ = pbase;
     capacity_ = capacity;
+    // Doesn't need to be unpredictable, just different every time.
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    lap_tag_offset_ = (static_cast<std::uint64_t>(now)*0xff51afd7ed558ccd
+        ^ reinterpret_cast<std::uintptr_t>(pbase)) & ~std::uint64_t(7);
 }
 
 void mpsc_ring_buffer::destroy()
 {
     if(!pbuffer_start_)
         return;
-#if defined(__linux__)
-    shmdt(pbuffer_start_ + capacity_);
-    shmdt(pbuffer_start_);
-
-#elif defined(_WIN32)
-    UnmapViewOfFile(pbuffer_start_ + capacity_);
-    UnmapViewOfFile(pbuffer_start_);
-#endif
+    unmap_ring_memory(pbuffer_start_, capacity_);
 }
 
 }   // namespace detail
@@ -27,8 +27,20 @@
 #include <algorithm>    // max, min
 #include <type_traits>  // is_unsigned
 #include <cassert>
-#include <cstring>      // memset
-#include <cmath>        // lrint, llrint, frexp
+#include <cstring>      // memset, memcpy
+#include <limits>       // numeric_limits
+
+#if defined(_MSC_VER)
+#include <intrin.h>     // _umul128, _BitScanForward, _byteswap_uint64
+#endif
+
+// SSE2 is part of the x86-64 baseline so on that architecture we can always
+// use it without checking cpuid. On other architectures integers are
+// converted with plain C++ only.
+#if defined(__x86_64__) || defined(_M_X64)
+#define RECKLESS_NTOA_SIMD
+#include <emmintrin.h>
+#endif
 
 namespace reckless {
 namespace detail {
@@ -391,11 +403,190 @@ log10(Uint64 x)
     }
 }
 
+// Integer conversion
+// ==================
+// itoa_generic_base10/16 render the digits right-aligned into a digit_string
+// on the stack and then copy them into place once the layout is known. That
+// way the digit count falls out of the conversion instead of having to be
+// computed up front with log10().
+//
+// On x86-64 the digits are produced with SIMD instructions. For decimal we
+// split the value into groups of eight digits and then divide each group by
+// 10000, 1000, 100 and 10 in parallel with multiply-high by fixed-point
+// reciprocals, so that every 16-bit lane ends up holding one digit. For hex
+// we just spread the nibbles out to one per byte. A 16-digit chunk is done as
+// two groups in separate registers. (An AVX2 version that did both groups in
+// one register was slower, since the setup and the extra lane permutation
+// cost more than the second set of multiplications.)
+unsigned const DIGIT_STRING_SIZE = 32;
+typedef char digit_string[DIGIT_STRING_SIZE];
+
+// Conversion functions return the number of digits, which end at the end of
+// the digit_string. Zero has no digits, same as for
+// utoa_generic_base10_preallocated.
 template <typename Unsigned>
-typename std::enable_if<std::is_unsigned<Unsigned>::value, Unsigned>::type
-log16(Unsigned v)
+unsigned utoa_base10_scalar(digit_string& str, Unsigned value)
+{
+    return DIGIT_STRING_SIZE
+        - utoa_generic_base10_preallocated(str, DIGIT_STRING_SIZE, value);
+}
+
+template <bool Uppercase, typename Unsigned>
+unsigned utoa_base16_scalar(digit_string& str, Unsigned value)
 {
-    return log2(v)/4;
+    return DIGIT_STRING_SIZE
+        - utoa_generic_base16_preallocated<Uppercase>(str, DIGIT_STRING_SIZE, value);
+}
+
+#if defined(RECKLESS_NTOA_SIMD)
+std::uint64_t const TEN_TO_THE_8 = 100000000;
+std::uint64_t const TEN_TO_THE_16 = 10000000000000000;
+
+// For v != 0.
+inline unsigned count_trailing_zeroes(unsigned v)
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctz(v));
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return static_cast<unsigned>(index);
+#else
+    static_assert(false, "count_trailing_zeroes() is not implemented for this compiler");
+#endif
+}
+
+inline std::uint64_t byteswap(std::uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_bswap64(v);
+#elif defined(_MSC_VER)
+    return _byteswap_uint64(v);
+#else
+    static_assert(false, "byteswap() is not implemented for this compiler");
+#endif
+}
+
+// Given the 16 characters that were stored at the end of the digit_string,
+// figure out how many remain when leading zeroes are dropped.
+inline unsigned significant_digits(__m128i chars, char zero)
+{
+    unsigned nonzero = ~static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(chars, _mm_set1_epi8(zero)))) & 0xffff;
+    if(nonzero == 0)
+        return 0;
+    return 16 - count_trailing_zeroes(nonzero);
+}
+
+// When value >= 10^16 there are up to four more digits in front of the
+// 16-digit chunk, which we do the old way. Here every digit is significant.
+inline unsigned prepend_top_digits(digit_string& str, std::uint64_t top)
+{
+    return DIGIT_STRING_SIZE - utoa_generic_base10_preallocated(str,
+        DIGIT_STRING_SIZE - 16, static_cast<std::uint32_t>(top));
+}
+
+short const RECIPROCAL_1000 = 8389;     // 2^23/1000, rounded up
+short const RECIPROCAL_100 = 5243;      // 2^19/100, rounded up
+short const RECIPROCAL_10 = 13108;      // 2^17/10, rounded up
+short const RECIPROCAL_1 = -32768;      // 2^15, i.e. 0x8000 unsigned
+short const SHIFT_1000 = 1 << 7;        // Multiply-high by 2^(16-k) is >> k.
+short const SHIFT_100 = 1 << 11;
+short const SHIFT_10 = 1 << 13;
+short const SHIFT_1 = -32768;           // 1 << 15
+
+// Returns the eight digits of value < 10^8, from most to least significant,
+// as 16-bit integers.
+inline __m128i eight_digits_sse2(std::uint32_t value)
+{
+    // abcd = abcdefgh / 10000, efgh = abcdefgh % 10000. The division is
+    // multiplication by 2^45/10000 rounded up, which is exact for this range.
+    __m128i abcdefgh = _mm_cvtsi32_si128(static_cast<int>(value));
+    __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh,
+        _mm_set1_epi32(static_cast<int>(0xd1b71759))), 45);
+    __m128i efgh = _mm_sub_epi32(abcdefgh,
+        _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+    // [abcd*4, efgh*4, 0, ...], then broadcast each half of that to four
+    // lanes. The factor four buys two bits of precision in the multiply-high
+    // below.
+    __m128i v = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+    v = _mm_unpacklo_epi16(v, v);
+    v = _mm_unpacklo_epi32(v, v);
+    // Divide by 1000, 100, 10 and 1 to get [a, ab, abc, abcd, e, ef, efg,
+    // efgh].
+    v = _mm_mulhi_epu16(v, _mm_setr_epi16(
+        RECIPROCAL_1000, RECIPROCAL_100, RECIPROCAL_10, RECIPROCAL_1,
+        RECIPROCAL_1000, RECIPROCAL_100, RECIPROCAL_10, RECIPROCAL_1));
+    v = _mm_mulhi_epu16(v, _mm_setr_epi16(
+        SHIFT_1000, SHIFT_100, SHIFT_10, SHIFT_1,
+        SHIFT_1000, SHIFT_100, SHIFT_10, SHIFT_1));
+    // Subtract ten times the lane to the left, e.g. abc - ab*10 = c.
+    __m128i tens = _mm_slli_epi64(_mm_mullo_epi16(v, _mm_set1_epi16(10)), 16);
+    return _mm_sub_epi16(v, tens);
+}
+
+inline unsigned utoa_base10_sse2(digit_string& str, std::uint64_t value)
+{
+    // Up to four digits are quicker to just look up.
+    if(value < 10000)
+        return utoa_base10_scalar(str, value);
+    std::uint64_t top = 0;
+    if(value >= TEN_TO_THE_16) {
+        top = value / TEN_TO_THE_16;
+        value %= TEN_TO_THE_16;
+    }
+    __m128i high = _mm_setzero_si128();
+    if(value >= TEN_TO_THE_8)
+        high = eight_digits_sse2(static_cast<std::uint32_t>(value / TEN_TO_THE_8));
+    __m128i low = eight_digits_sse2(static_cast<std::uint32_t>(value % TEN_TO_THE_8));
+    __m128i chars = _mm_add_epi8(_mm_packus_epi16(high, low), _mm_set1_epi8('0'));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(str + DIGIT_STRING_SIZE - 16), chars);
+    if(top != 0)
+        return prepend_top_digits(str, top);
+    return significant_digits(chars, '0');
+}
+
+template <bool Uppercase>
+unsigned utoa_base16_sse2(digit_string& str, std::uint64_t value)
+{
+    // Byte-swap so that the most significant nibbles come first, then
+    // interleave the high and low nibble of each byte.
+    __m128i bytes = _mm_cvtsi64_si128(static_cast<long long>(byteswap(value)));
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i nibbles = _mm_unpacklo_epi8(
+        _mm_and_si128(_mm_srli_epi16(bytes, 4), mask),
+        _mm_and_si128(bytes, mask));
+    // Without pshufb we get from 10-15 to the letters by adding an offset
+    // to the lanes that are above 9.
+    char const letter_offset = (Uppercase? 'A' : 'a') - '0' - 10;
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+        _mm_set1_epi8(letter_offset));
+    __m128i chars = _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+        letters);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(str + DIGIT_STRING_SIZE - 16), chars);
+    return significant_digits(chars, '0');
+}
+
+#endif  // RECKLESS_NTOA_SIMD
+
+template <typename Unsigned>
+unsigned utoa_base10(digit_string& str, Unsigned value)
+{
+#if defined(RECKLESS_NTOA_SIMD)
+    return utoa_base10_sse2(str, value);
+#else
+    return utoa_base10_scalar(str, value);
+#endif
+}
+
+template <bool Uppercase, typename Unsigned>
+unsigned utoa_base16(digit_string& str, Unsigned value)
+{
+#if defined(RECKLESS_NTOA_SIMD)
+    return utoa_base16_sse2<Uppercase>(str, value);
+#else
+    return utoa_base16_scalar<Uppercase>(str, value);
+#endif
 }
 
 template <typename Unsigned>
@@ -419,7 +610,15 @@ void itoa_generic_base10(output_buffer* pbuffer, bool negative, Unsigned value,
     //                  [---precision---]
     // [--------------size--------------]
     // depending on if it's left-justified or not.
-    unsigned digits = value? log10(value) + 1 : 0;
+    // Up to four digits it's cheaper to compute the digit count up front and
+    // write the digits in place than to go through digit_str.
+    digit_string digit_str;
+    bool const small = value < 10000;
+    unsigned digits;
+    if(small)
+        digits = value? log10(value) + 1 : 0;
+    else
+        digits = utoa_base10(digit_str, value);
     unsigned precision = (cs.precision == UNSPECIFIED_PRECISION? 1 : cs.precision);
     unsigned zeroes = precision>digits? precision - digits : 0;
     unsigned content_size = !!sign + zeroes + digits;
@@ -438,7 +637,12 @@ void itoa_generic_base10(output_buffer* pbuffer, bool negative, Unsigned value,
         pos -= padding;
         std::memset(str+pos, ' ', padding);
     }
-    pos = utoa_generic_base10_preallocated(str, pos, value);
+    if(small) {
+        pos = utoa_generic_base10_preallocated(str, pos, value);
+    } else {
+        pos -= digits;
+        std::memcpy(str + pos, digit_str + DIGIT_STRING_SIZE - digits, digits);
+    }
     pos -= zeroes;
     std::memset(str+pos, '0', zeroes);
     if(sign)
@@ -475,13 +679,15 @@ template <typename Unsigned>
 void itoa_generic_base16(output_buffer* pbuffer, bool negative, Unsigned value, conversion_specification const& cs)
 {
     char sign = negative? '-' : cs.plus_sign;
-    unsigned digits = 0;
+    digit_string digit_str;
+    unsigned digits;
+    if(cs.uppercase)
+        digits = utoa_base16<true>(digit_str, value);
+    else
+        digits = utoa_base16<false>(digit_str, value);
     unsigned prefix = 0;
-    if(value != 0) {
-        digits = static_cast<unsigned>(log16(value) + 1);
-        if(cs.alternative_form)
-            prefix = 2;
-    }
+    if(value != 0 && cs.alternative_form)
+        prefix = 2;
     unsigned precision = (cs.precision == UNSPECIFIED_PRECISION? 1 : cs.precision);
     unsigned zeroes = precision>digits? precision - digits : 0;
     unsigned content_size = !!sign + prefix + zeroes + digits;
@@ -500,11 +706,8 @@ void itoa_generic_base16(output_buffer* pbuffer, bool negative, Unsigned value,
         std::memset(str + pos, ' ', padding);
     }
 
-    if(cs.uppercase)
-        pos = utoa_generic_base16_preallocated<true>(str, pos, value);
-    else
-        pos = utoa_generic_base16_preallocated<false>(str, pos, value);
-
+    pos -= digits;
+    std::memcpy(str + pos, digit_str + DIGIT_STRING_SIZE - digits, digits);
     pos -= zeroes;
     std::memset(str + pos, '0', zeroes);
     if(prefix) {
@@ -542,431 +745,1444 @@ itoa_generic_base16(output_buffer* pbuffer, Integer value, conversion_specificat
     itoa_generic_base16(pbuffer, false, value, cs);
 }
 
-#if defined(__GNUC__)
-template <typename Float>
-Float fxtract(Float v, Float* exp)
+// Floating-point conversion
+// =========================
+// Everything below works on the exact binary value of the double,
+// significand*2^exponent, using only integer arithmetic. There are two kinds
+// of conversions:
+//
+// * Shortest round-trip digits, used by %g when no precision is given. This
+//   is the Schubfach algorithm by Raffaello Giulietti (the same family as Ryu
+//   and Dragonbox): with a table of 128-bit approximations of powers of ten we
+//   can find the shortest decimal that still reads back as the same double,
+//   and among those the one closest to the exact value.
+//
+// * Correctly rounded digits for a given precision, used by %f, %e and %g
+//   with an explicit precision. These must come out exactly like printf,
+//   which rounds the exact binary value (half to even on ties). Rounding the
+//   shortest digits would be wrong: 2.675 is really 2.67499999999999982...,
+//   so %.2f must give 2.67 although the shortest representation is 2.675.
+//   For the typical case (at most 18 digits and a reasonable magnitude) a
+//   64x64->128-bit multiplication or a 64-bit division is enough. Otherwise
+//   we fall back to generating the exact decimal expansion with a small
+//   bignum.
+//
+// The digits from either kind then go through the same code for layout,
+// which deals with sign, padding, decimal point and exponent.
+
+struct uint128 {
+    std::uint64_t high;
+    std::uint64_t low;
+};
+
+inline uint128 multiply_64x64(std::uint64_t a, std::uint64_t b)
 {
-    Float significand;
-    asm("fxtract" : "=t"(significand), "=u"(*exp) : "0"(v));
-    return significand;
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = static_cast<unsigned __int128>(a)*b;
+    return {static_cast<std::uint64_t>(product >> 64),
+        static_cast<std::uint64_t>(product)};
+#elif defined(_MSC_VER) && defined(_M_X64)
+    std::uint64_t high;
+    std::uint64_t low = _umul128(a, b, &high);
+    return {high, low};
+#else
+    std::uint64_t a0 = a & 0xffffffff, a1 = a >> 32;
+    std::uint64_t b0 = b & 0xffffffff, b1 = b >> 32;
+    std::uint64_t p00 = a0*b0;
+    std::uint64_t p01 = a0*b1;
+    std::uint64_t p10 = a1*b0;
+    std::uint64_t p11 = a1*b1;
+    std::uint64_t middle = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+    return {p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32),
+        (middle << 32) | (p00 & 0xffffffff)};
+#endif
 }
-#elif defined(_MSC_VER)
 
-double fxtract(long double v, long double* exp)
-{
-    // So here's what you might think we can do.
-    //  long double significand;
-    //  long double exp;
-    //  __asm {
-    //      fld [v]
-    //      fxtract
-    //      fstp [exp]
-    //      fstp [significand]
-    //  }
-    //
-    // But MSVC does not support inline asm on x64, and don't have fxtract as
-    // an intrinsic, so we're kinda screwed. Additionally, they decided they
-    // don't need no 80-bit long double any longer, so we're even more screwed.
-    // I'm not sure how they expect anyone to be able to do this kind of stuff
-    // with the same quality and speed as e.g. gcc, but... their call. Instead
-    // we'll just extract the bits from the in-memory representation.
-
-    int iexp;
-    auto significand = std::frexp(v, &iexp);
-    *exp = iexp - 1;
-    return static_cast<double>(2*significand);
-
-    //std::uint16_t const* pv = reinterpret_cast<std::uint16_t const*>(&v);
-    //// Highest 16 bits is seeeeeee eeeemmmm. We want the e part which is the
-    //// exponent.
-    //unsigned exponent = pv[3];
-    //exponent = (exponent >> 4) & 0x7ff;
-    //*exp = static_cast<int>(exponent) - 1023;
+// For 0 < shift < 128.
+inline uint128 shift_right(uint128 v, unsigned shift)
+{
+    if(shift >= 64)
+        return {0, v.high >> (shift - 64)};
+    else
+        return {v.high >> shift, (v.high << (64 - shift)) | (v.low >> shift)};
 }
 
-#else
-static_assert(false, "fxtract is not implemented for this compiler")
-#endif
-
-template <typename Float>
-inline std::uint_fast64_t u64_rint(Float value)
+// Keep the lowest bits of v. For 0 < bits < 128.
+inline uint128 low_bits(uint128 v, unsigned bits)
 {
-    if(std::is_convertible<std::uint64_t, long>::value)
-        return static_cast<std::uint_fast64_t>(std::lrint(value));
+    if(bits >= 64)
+        return {v.high & ((std::uint64_t(1) << (bits - 64)) - 1), v.low};
     else
-        return static_cast<std::uint_fast64_t>(std::llrint(value));
+        return {0, v.low & ((std::uint64_t(1) << bits) - 1)};
 }
 
-struct decimal18
+// For 0 <= bit < 128.
+inline uint128 power_of_two(unsigned bit)
 {
-    bool sign;
-    std::uint64_t mantissa;
-    int exponent;
-};
+    if(bit >= 64)
+        return {std::uint64_t(1) << (bit - 64), 0};
+    else
+        return {0, std::uint64_t(1) << bit};
+}
 
-decimal18 binary64_to_decimal18(double v)
+inline bool operator<(uint128 a, uint128 b)
 {
-    if(v == 0)
-        return {std::signbit(v), 0, 0};
+    return a.high < b.high || (a.high == b.high && a.low < b.low);
+}
 
-    long double e2;
-    long double m2 = fxtract(static_cast<long double>(v), &e2);
+inline bool operator==(uint128 a, uint128 b)
+{
+    return a.high == b.high && a.low == b.low;
+}
 
-    // We have
-    //   v = m2 * 2^e2  [1 <= m2 < 2] (1)
-    // and want a new representation
-    //   v = m10 * 10^e10  [1 <= m10 < 10].
-    //
-    // (1) can be rewritten as
-    //   m2 * 10^(C*e2)  [C = log(2)/log(10)] =
-    //   m2 * 10^(e10i + e10f)  [e10i = trunc(C*e2), e10f=frac(C*e2)] =
-    //   m2 * 10^e10i * 10^e10f.
-    //
-    // If m2 * 10^e10f turns out to be in the range [1, 10) then this gives us
-    // a value for m10 (and consequently for e10=C*e2i). But assuming e2f is a
-    // positive fraction, we have
-    //   0 <= e2f < 1
-    //   1 <= 10^e2f < 10.
-    //   1 <= m2 * 10^e2f < 20.
-    //
-    // We can adjust for m2 * 10^e2f >= 10 by dividing m2 by 10 and increasing
-    // e10 by one. Hence, with D = e2*log(2)/log(10) we have
-    //   m10 = m2 * 10^(frac(D))
-    //   e10 = trunc(D).
-    // when m2*10^(frac(D)) < 10, or
-    //   m10 = m2 * 10^(frac(D)) / 10
-    //   e10 = trunc(D) + 1.
-    // when m2*10^(frac(D)) >= 10, i.e. normalization requires at most a shift
-    // to the right by 1 digit.
-    //
-    // If e2f is a negative fraction we get
-    //   -1 < e2f <= 0
-    //   0.1 <= 10^e2f <= 1.
-    //   0.1 <= m2 * 10^e2f < 2.
-    // Note that this is the range obtained for a positive exponent except
-    // divided by 10. If we multiply this by 10 and subtract 1 from the
-    // exponent then we get the same situation as above, i.e.
-    //   1 <= 10 * m2 * 10^e2f < 20.
-
-    long double d = e2;
-    d *=  0.30102999566398119521L;
-    long double e10i;
-    long double e10f = std::modf(d, &e10i);
-    long double m10;
-    if(e2 < 0) {
-        e10f += 1;
-        e10i -= 1;
-    }
-
-    m10 = m2*powl(10, e10f + 16);
-    std::uint64_t mantissa = static_cast<std::uint64_t>(std::llrint(std::abs(m10)));
-    if(mantissa < 100000000000000000u)
-        mantissa *= 10;
+// True if v << shift does not fit in 64 bits.
+inline bool shift_left_overflows(std::uint64_t v, unsigned shift)
+{
+    if(shift == 0)
+        return false;
+    else if(shift >= 64)
+        return v != 0;
     else
-        e10i += 1.0L;
-    // TODO rounding of m10 might cause it to overflow, right?. We need to
-    // adjust again in that case. But try to reproduce this scenario first so
-    // we know it's needed.
+        return (v >> (64 - shift)) != 0;
+}
 
-    return {std::signbit(v), mantissa, static_cast<int>(e10i)};
+// These are exact for the range of exponents that a double can have. They
+// rely on >> rounding negative numbers towards minus infinity, which is what
+// every compiler we care about does.
+inline int floor_log2_pow10(int e)
+{
+    return (e * 1741647) >> 19;
 }
 
-std::uint64_t rounded_divide(bool sign, std::uint64_t value, std::uint64_t divisor)
+inline int floor_log10_pow2(int e)
 {
-    if(!sign) {
-        // +divisor/2 to turn truncation into rounding.
-        return (value + divisor/2) / divisor;
-    } else {
-        // This is the same rounding as above but we must pretend that the
-        // value is negative and reproduce the corresponding behavior.
-        // Adding divisor-1 turns the flooring behavior of integer division
-        // into a ceiling behavior.
-        return (value + (divisor-1) - divisor/2) / divisor;
-    }
+    return (e * 1262611) >> 22;
 }
-std::uint64_t rounded_rshift(bool sign, std::uint64_t value, unsigned digits)
+
+inline int floor_log10_three_quarters_pow2(int e)
 {
-    return rounded_divide(sign, value, detail::power_lut[digits]);
+    return (e * 1262611 - 524031) >> 22;
 }
 
-unsigned count_trailing_zeroes(decimal18 const& dv, unsigned truncated_digits)
+// The value of a finite double is significand*2^exponent.
+struct binary64 {
+    bool sign;
+    std::uint64_t significand;
+    int exponent;
+    // Raw fields from the IEEE 754 representation, for the shortest
+    // conversion.
+    std::uint64_t ieee_fraction;
+    unsigned ieee_exponent;
+};
+
+binary64 decompose(double value)
 {
-    std::uint64_t mantissa = rounded_rshift(dv.sign, dv.mantissa, truncated_digits);
-    unsigned low = 0;
-    unsigned high = 18u-truncated_digits;
-    // Find the lowest x such that mantissa % 10^x != 0.
-    // Then the number of trailing zeroes is x-1.
-    while(low < high) {
-        unsigned pos = (low + high)/2;
-        if(mantissa % detail::power_lut[pos] == 0)
-            low = pos + 1;
-        else
-            high = pos;
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    binary64 b;
+    b.sign = (bits >> 63) != 0;
+    b.ieee_fraction = bits & ((std::uint64_t(1) << 52) - 1);
+    b.ieee_exponent = static_cast<unsigned>((bits >> 52) & 0x7ff);
+    if(b.ieee_exponent != 0) {
+        b.significand = b.ieee_fraction | (std::uint64_t(1) << 52);
+        b.exponent = static_cast<int>(b.ieee_exponent) - 1075;
+    } else {
+        b.significand = b.ieee_fraction;
+        b.exponent = -1074;
     }
-
-    return low-1;
+    return b;
 }
 
-unsigned count_trailing_zeroes_after_dot(decimal18 const& dv)
+// A decimal number with its significant digits in a character buffer:
+// d0.d1d2...*10^exponent. A count of zero means the value is zero. Digits
+// beyond count are zero, so trailing zeroes may or may not be included.
+struct decimal_digits {
+    char* digits;
+    unsigned count;
+    int exponent;
+};
+
+// The exact decimal expansion of a double never has more than 767
+// significant digits. The bignum path may overshoot by up to 9 digits.
+std::size_t const DIGIT_BUFFER_SIZE = 800;
+
+// Write value to the buffer, most significant digit first. Returns the number
+// of digits.
+unsigned write_digits(char* str, std::uint64_t value)
 {
-    // We need to get rid of the least significant digit because a double can't
-    // always represent a zero digit at that position.
-    // (e.g. 123.456 becomes 123.456000000000003).
-    std::uint64_t mantissa = rounded_divide(dv.sign, dv.mantissa, 10);
-    unsigned digits_before_dot = unsigned_cast(std::max(0, dv.exponent+1));
-    if(digits_before_dot>17) {
-        // All significant digits are in front of the dots. No trailing zeroes
+    if(value == 0)
         return 0;
-    }
-    unsigned max_trailing_zeroes = unsigned_cast(17 - digits_before_dot);
-    unsigned low = 0;
-    unsigned high = max_trailing_zeroes+1;
-    // Find the lowest x such that mantissa % 10^x != 0.
-    // Then the number of trailing zeroes is x-1.
-    while(low < high) {
-        unsigned pos = (low + high)/2;
-        if(mantissa % detail::power_lut[pos] == 0)
-            low = pos + 1;
-        else
-            high = pos;
-    }
-
-    // +1 because we always treat the least significant digit (that we stripped
-    // at function entry) as if it were zero.
-    return low-1 + 1;
+    unsigned count = log10(value) + 1;
+    utoa_generic_base10_preallocated(str, count, value);
+    return count;
 }
 
-void write_special_category(output_buffer* pbuffer, double value, conversion_specification const& cs, char const* category)
+void strip_trailing_zeroes(decimal_digits* pd)
 {
-    char sign = std::signbit(value)? '-' : cs.plus_sign;
-    unsigned content_size = 3 + (sign? 1 : 0);
-    unsigned size = std::max(content_size, cs.minimum_field_width);
-    unsigned padding = size - content_size;
-    char* str = pbuffer->reserve(size);
-    unsigned pos = 0;
-    if(cs.left_justify) {
-        if(sign)
-            str[pos++] = sign;
-        memcpy(str+pos, category, 3);
-        pos += 3;
-        std::memset(str+pos, ' ', padding);
-    } else {
-        std::memset(str, ' ', padding);
-        pos += padding;
-        if(sign)
-            str[pos++] = sign;
-        memcpy(str+pos, category, 3);
-    }
-    pbuffer->commit(size);
+    while(pd->count != 0 && pd->digits[pd->count-1] == '0')
+        --pd->count;
 }
 
-void write_nan(output_buffer* pbuffer, double value, conversion_specification const& cs)
+// Shortest round-trip conversion
+// ------------------------------
+// pow10_table[k - POW10_TABLE_MIN] holds floor(10^k*2^(127-floor(log2(10^k))))
+// + 1, i.e. a 128-bit approximation of 10^k that is slightly too large and
+// normalized so that the top bit is set. Generated with exact integer
+// arithmetic.
+int const POW10_TABLE_MIN = -292;
+int const POW10_TABLE_MAX = 324;
+
+uint128 const pow10_table[POW10_TABLE_MAX - POW10_TABLE_MIN + 1] = {
+    {0xFF77B1FCBEBCDC4F, 0x25E8E89C13BB0F7B},  // -292
+    {0x9FAACF3DF73609B1, 0x77B191618C54E9AD},  // -291
+    {0xC795830D75038C1D, 0xD59DF5B9EF6A2418},  // -290
+    {0xF97AE3D0D2446F25, 0x4B0573286B44AD1E},  // -289
+    {0x9BECCE62836AC577, 0x4EE367F9430AEC33},  // -288
+    {0xC2E801FB244576D5, 0x229C41F793CDA740},  // -287
+    {0xF3A20279ED56D48A, 0x6B43527578C11110},  // -286
+    {0x9845418C345644D6, 0x830A13896B78AAAA},  // -285
+    {0xBE5691EF416BD60C, 0x23CC986BC656D554},  // -284
+    {0xEDEC366B11C6CB8F, 0x2CBFBE86B7EC8AA9},  // -283
+    {0x94B3A202EB1C3F39, 0x7BF7D71432F3D6AA},  // -282
+    {0xB9E08A83A5E34F07, 0xDAF5CCD93FB0CC54},  // -281
+    {0xE858AD248F5C22C9, 0xD1B3400F8F9CFF69},  // -280
+    {0x91376C36D99995BE, 0x23100809B9C21FA2},  // -279
+    {0xB58547448FFFFB2D, 0xABD40A0C2832A78B},  // -278
+    {0xE2E69915B3FFF9F9, 0x16C90C8F323F516D},  // -277
+    {0x8DD01FAD907FFC3B, 0xAE3DA7D97F6792E4},  // -276
+    {0xB1442798F49FFB4A, 0x99CD11CFDF41779D},  // -275
+    {0xDD95317F31C7FA1D, 0x40405643D711D584},  // -274
+    {0x8A7D3EEF7F1CFC52, 0x482835EA666B2573},  // -273
+    {0xAD1C8EAB5EE43B66, 0xDA3243650005EED0},  // -272
+    {0xD863B256369D4A40, 0x90BED43E40076A83},  // -271
+    {0x873E4F75E2224E68, 0x5A7744A6E804A292},  // -270
+    {0xA90DE3535AAAE202, 0x711515D0A205CB37},  // -269
+    {0xD3515C2831559A83, 0x0D5A5B44CA873E04},  // -268
+    {0x8412D9991ED58091, 0xE858790AFE9486C3},  // -267
+    {0xA5178FFF668AE0B6, 0x626E974DBE39A873},  // -266
+    {0xCE5D73FF402D98E3, 0xFB0A3D212DC81290},  // -265
+    {0x80FA687F881C7F8E, 0x7CE66634BC9D0B9A},  // -264
+    {0xA139029F6A239F72, 0x1C1FFFC1EBC44E81},  // -263
+    {0xC987434744AC874E, 0xA327FFB266B56221},  // -262
+    {0xFBE9141915D7A922, 0x4BF1FF9F0062BAA9},  // -261
+    {0x9D71AC8FADA6C9B5, 0x6F773FC3603DB4AA},  // -260
+    {0xC4CE17B399107C22, 0xCB550FB4384D21D4},  // -259
+    {0xF6019DA07F549B2B, 0x7E2A53A146606A49},  // -258
+    {0x99C102844F94E0FB, 0x2EDA7444CBFC426E},  // -257
+    {0xC0314325637A1939, 0xFA911155FEFB5309},  // -256
+    {0xF03D93EEBC589F88, 0x793555AB7EBA27CB},  // -255
+    {0x96267C7535B763B5, 0x4BC1558B2F3458DF},  // -254
+    {0xBBB01B9283253CA2, 0x9EB1AAEDFB016F17},  // -253
+    {0xEA9C227723EE8BCB, 0x465E15A979C1CADD},  // -252
+    {0x92A1958A7675175F, 0x0BFACD89EC191ECA},  // -251
+    {0xB749FAED14125D36, 0xCEF980EC671F667C},  // -250
+    {0xE51C79A85916F484, 0x82B7E12780E7401B},  // -249
+    {0x8F31CC0937AE58D2, 0xD1B2ECB8B0908811},  // -248
+    {0xB2FE3F0B8599EF07, 0x861FA7E6DCB4AA16},  // -247
+    {0xDFBDCECE67006AC9, 0x67A791E093E1D49B},  // -246
+    {0x8BD6A141006042BD, 0xE0C8BB2C5C6D24E1},  // -245
+    {0xAECC49914078536D, 0x58FAE9F773886E19},  // -244
+    {0xDA7F5BF590966848, 0xAF39A475506A899F},  // -243
+    {0x888F99797A5E012D, 0x6D8406C952429604},  // -242
+    {0xAAB37FD7D8F58178, 0xC8E5087BA6D33B84},  // -241
+    {0xD5605FCDCF32E1D6, 0xFB1E4A9A90880A65},  // -240
+    {0x855C3BE0A17FCD26, 0x5CF2EEA09A550680},  // -239
+    {0xA6B34AD8C9DFC06F, 0xF42FAA48C0EA481F},  // -238
+    {0xD0601D8EFC57B08B, 0xF13B94DAF124DA27},  // -237
+    {0x823C12795DB6CE57, 0x76C53D08D6B70859},  // -236
+    {0xA2CB1717B52481ED, 0x54768C4B0C64CA6F},  // -235
+    {0xCB7DDCDDA26DA268, 0xA9942F5DCF7DFD0A},  // -234
+    {0xFE5D54150B090B02, 0xD3F93B35435D7C4D},  // -233
+    {0x9EFA548D26E5A6E1, 0xC47BC5014A1A6DB0},  // -232
+    {0xC6B8E9B0709F109A, 0x359AB6419CA1091C},  // -231
+    {0xF867241C8CC6D4C0, 0xC30163D203C94B63},  // -230
+    {0x9B407691D7FC44F8, 0x79E0DE63425DCF1E},  // -229
+    {0xC21094364DFB5636, 0x985915FC12F542E5},  // -228
+    {0xF294B943E17A2BC4, 0x3E6F5B7B17B2939E},  // -227
+    {0x979CF3CA6CEC5B5A, 0xA705992CEECF9C43},  // -226
+    {0xBD8430BD08277231, 0x50C6FF782A838354},  // -225
+    {0xECE53CEC4A314EBD, 0xA4F8BF5635246429},  // -224
+    {0x940F4613AE5ED136, 0x871B7795E136BE9A},  // -223
+    {0xB913179899F68584, 0x28E2557B59846E40},  // -222
+    {0xE757DD7EC07426E5, 0x331AEADA2FE589D0},  // -221
+    {0x9096EA6F3848984F, 0x3FF0D2C85DEF7622},  // -220
+    {0xB4BCA50B065ABE63, 0x0FED077A756B53AA},  // -219
+    {0xE1EBCE4DC7F16DFB, 0xD3E8495912C62895},  // -218
+    {0x8D3360F09CF6E4BD, 0x64712DD7ABBBD95D},  // -217
+    {0xB080392CC4349DEC, 0xBD8D794D96AACFB4},  // -216
+    {0xDCA04777F541C567, 0xECF0D7A0FC5583A1},  // -215
+    {0x89E42CAAF9491B60, 0xF41686C49DB57245},  // -214
+    {0xAC5D37D5B79B6239, 0x311C2875C522CED6},  // -213
+    {0xD77485CB25823AC7, 0x7D633293366B828C},  // -212
+    {0x86A8D39EF77164BC, 0xAE5DFF9C02033198},  // -211
+    {0xA8530886B54DBDEB, 0xD9F57F830283FDFD},  // -210
+    {0xD267CAA862A12D66, 0xD072DF63C324FD7C},  // -209
+    {0x8380DEA93DA4BC60, 0x4247CB9E59F71E6E},  // -208
+    {0xA46116538D0DEB78, 0x52D9BE85F074E609},  // -207
+    {0xCD795BE870516656, 0x67902E276C921F8C},  // -206
+    {0x806BD9714632DFF6, 0x00BA1CD8A3DB53B7},  // -205
+    {0xA086CFCD97BF97F3, 0x80E8A40ECCD228A5},  // -204
+    {0xC8A883C0FDAF7DF0, 0x6122CD128006B2CE},  // -203
+    {0xFAD2A4B13D1B5D6C, 0x796B805720085F82},  // -202
+    {0x9CC3A6EEC6311A63, 0xCBE3303674053BB1},  // -201
+    {0xC3F490AA77BD60FC, 0xBEDBFC4411068A9D},  // -200
+    {0xF4F1B4D515ACB93B, 0xEE92FB5515482D45},  // -199
+    {0x991711052D8BF3C5, 0x751BDD152D4D1C4B},  // -198
+    {0xBF5CD54678EEF0B6, 0xD262D45A78A0635E},  // -197
+    {0xEF340A98172AACE4, 0x86FB897116C87C35},  // -196
+    {0x9580869F0E7AAC0E, 0xD45D35E6AE3D4DA1},  // -195
+    {0xBAE0A846D2195712, 0x8974836059CCA10A},  // -194
+    {0xE998D258869FACD7, 0x2BD1A438703FC94C},  // -193
+    {0x91FF83775423CC06, 0x7B6306A34627DDD0},  // -192
+    {0xB67F6455292CBF08, 0x1A3BC84C17B1D543},  // -191
+    {0xE41F3D6A7377EECA, 0x20CABA5F1D9E4A94},  // -190
+    {0x8E938662882AF53E, 0x547EB47B7282EE9D},  // -189
+    {0xB23867FB2A35B28D, 0xE99E619A4F23AA44},  // -188
+    {0xDEC681F9F4C31F31, 0x6405FA00E2EC94D5},  // -187
+    {0x8B3C113C38F9F37E, 0xDE83BC408DD3DD05},  // -186
+    {0xAE0B158B4738705E, 0x9624AB50B148D446},  // -185
+    {0xD98DDAEE19068C76, 0x3BADD624DD9B0958},  // -184
+    {0x87F8A8D4CFA417C9, 0xE54CA5D70A80E5D7},  // -183
+    {0xA9F6D30A038D1DBC, 0x5E9FCF4CCD211F4D},  // -182
+    {0xD47487CC8470652B, 0x7647C32000696720},  // -181
+    {0x84C8D4DFD2C63F3B, 0x29ECD9F40041E074},  // -180
+    {0xA5FB0A17C777CF09, 0xF468107100525891},  // -179
+    {0xCF79CC9DB955C2CC, 0x7182148D4066EEB5},  // -178
+    {0x81AC1FE293D599BF, 0xC6F14CD848405531},  // -177
+    {0xA21727DB38CB002F, 0xB8ADA00E5A506A7D},  // -176
+    {0xCA9CF1D206FDC03B, 0xA6D90811F0E4851D},  // -175
+    {0xFD442E4688BD304A, 0x908F4A166D1DA664},  // -174
+    {0x9E4A9CEC15763E2E, 0x9A598E4E043287FF},  // -173
+    {0xC5DD44271AD3CDBA, 0x40EFF1E1853F29FE},  // -172
+    {0xF7549530E188C128, 0xD12BEE59E68EF47D},  // -171
+    {0x9A94DD3E8CF578B9, 0x82BB74F8301958CF},  // -170
+    {0xC13A148E3032D6E7, 0xE36A52363C1FAF02},  // -169
+    {0xF18899B1BC3F8CA1, 0xDC44E6C3CB279AC2},  // -168
+    {0x96F5600F15A7B7E5, 0x29AB103A5EF8C0BA},  // -167
+    {0xBCB2B812DB11A5DE, 0x7415D448F6B6F0E8},  // -166
+    {0xEBDF661791D60F56, 0x111B495B3464AD22},  // -165
+    {0x936B9FCEBB25C995, 0xCAB10DD900BEEC35},  // -164
+    {0xB84687C269EF3BFB, 0x3D5D514F40EEA743},  // -163
+    {0xE65829B3046B0AFA, 0x0CB4A5A3112A5113},  // -162
+    {0x8FF71A0FE2C2E6DC, 0x47F0E785EABA72AC},  // -161
+    {0xB3F4E093DB73A093, 0x59ED216765690F57},  // -160
+    {0xE0F218B8D25088B8, 0x306869C13EC3532D},  // -159
+    {0x8C974F7383725573, 0x1E414218C73A13FC},  // -158
+    {0xAFBD2350644EEACF, 0xE5D1929EF90898FB},  // -157
+    {0xDBAC6C247D62A583, 0xDF45F746B74ABF3A},  // -156
+    {0x894BC396CE5DA772, 0x6B8BBA8C328EB784},  // -155
+    {0xAB9EB47C81F5114F, 0x066EA92F3F326565},  // -154
+    {0xD686619BA27255A2, 0xC80A537B0EFEFEBE},  // -153
+    {0x8613FD0145877585, 0xBD06742CE95F5F37},  // -152
+    {0xA798FC4196E952E7, 0x2C48113823B73705},  // -151
+    {0xD17F3B51FCA3A7A0, 0xF75A15862CA504C6},  // -150
+    {0x82EF85133DE648C4, 0x9A984D73DBE722FC},  // -149
+    {0xA3AB66580D5FDAF5, 0xC13E60D0D2E0EBBB},  // -148
+    {0xCC963FEE10B7D1B3, 0x318DF905079926A9},  // -147
+    {0xFFBBCFE994E5C61F, 0xFDF17746497F7053},  // -146
+    {0x9FD561F1FD0F9BD3, 0xFEB6EA8BEDEFA634},  // -145
+    {0xC7CABA6E7C5382C8, 0xFE64A52EE96B8FC1},  // -144
+    {0xF9BD690A1B68637B, 0x3DFDCE7AA3C673B1},  // -143
+    {0x9C1661A651213E2D, 0x06BEA10CA65C084F},  // -142
+    {0xC31BFA0FE5698DB8, 0x486E494FCFF30A63},  // -141
+    {0xF3E2F893DEC3F126, 0x5A89DBA3C3EFCCFB},  // -140
+    {0x986DDB5C6B3A76B7, 0xF89629465A75E01D},  // -139
+    {0xBE89523386091465, 0xF6BBB397F1135824},  // -138
+    {0xEE2BA6C0678B597F, 0x746AA07DED582E2D},  // -137
+    {0x94DB483840B717EF, 0xA8C2A44EB4571CDD},  // -136
+    {0xBA121A4650E4DDEB, 0x92F34D62616CE414},  // -135
+    {0xE896A0D7E51E1566, 0x77B020BAF9C81D18},  // -134
+    {0x915E2486EF32CD60, 0x0ACE1474DC1D122F},  // -133
+    {0xB5B5ADA8AAFF80B8, 0x0D819992132456BB},  // -132
+    {0xE3231912D5BF60E6, 0x10E1FFF697ED6C6A},  // -131
+    {0x8DF5EFABC5979C8F, 0xCA8D3FFA1EF463C2},  // -130
+    {0xB1736B96B6FD83B3, 0xBD308FF8A6B17CB3},  // -129
+    {0xDDD0467C64BCE4A0, 0xAC7CB3F6D05DDBDF},  // -128
+    {0x8AA22C0DBEF60EE4, 0x6BCDF07A423AA96C},  // -127
+    {0xAD4AB7112EB3929D, 0x86C16C98D2C953C7},  // -126
+    {0xD89D64D57A607744, 0xE871C7BF077BA8B8},  // -125
+    {0x87625F056C7C4A8B, 0x11471CD764AD4973},  // -124
+    {0xA93AF6C6C79B5D2D, 0xD598E40D3DD89BD0},  // -123
+    {0xD389B47879823479, 0x4AFF1D108D4EC2C4},  // -122
+    {0x843610CB4BF160CB, 0xCEDF722A585139BB},  // -121
+    {0xA54394FE1EEDB8FE, 0xC2974EB4EE658829},  // -120
+    {0xCE947A3DA6A9273E, 0x733D226229FEEA33},  // -119
+    {0x811CCC668829B887, 0x0806357D5A3F5260},  // -118
+    {0xA163FF802A3426A8, 0xCA07C2DCB0CF26F8},  // -117
+    {0xC9BCFF6034C13052, 0xFC89B393DD02F0B6},  // -116
+    {0xFC2C3F3841F17C67, 0xBBAC2078D443ACE3},  // -115
+    {0x9D9BA7832936EDC0, 0xD54B944B84AA4C0E},  // -114
+    {0xC5029163F384A931, 0x0A9E795E65D4DF12},  // -113
+    {0xF64335BCF065D37D, 0x4D4617B5FF4A16D6},  // -112
+    {0x99EA0196163FA42E, 0x504BCED1BF8E4E46},  // -111
+    {0xC06481FB9BCF8D39, 0xE45EC2862F71E1D7},  // -110
+    {0xF07DA27A82C37088, 0x5D767327BB4E5A4D},  // -109
+    {0x964E858C91BA2655, 0x3A6A07F8D510F870},  // -108
+    {0xBBE226EFB628AFEA, 0x890489F70A55368C},  // -107
+    {0xEADAB0ABA3B2DBE5, 0x2B45AC74CCEA842F},  // -106
+    {0x92C8AE6B464FC96F, 0x3B0B8BC90012929E},  // -105
+    {0xB77ADA0617E3BBCB, 0x09CE6EBB40173745},  // -104
+    {0xE55990879DDCAABD, 0xCC420A6A101D0516},  // -103
+    {0x8F57FA54C2A9EAB6, 0x9FA946824A12232E},  // -102
+    {0xB32DF8E9F3546564, 0x47939822DC96ABFA},  // -101
+    {0xDFF9772470297EBD, 0x59787E2B93BC56F8},  // -100
+    {0x8BFBEA76C619EF36, 0x57EB4EDB3C55B65B},  // -99
+    {0xAEFAE51477A06B03, 0xEDE622920B6B23F2},  // -98
+    {0xDAB99E59958885C4, 0xE95FAB368E45ECEE},  // -97
+    {0x88B402F7FD75539B, 0x11DBCB0218EBB415},  // -96
+    {0xAAE103B5FCD2A881, 0xD652BDC29F26A11A},  // -95
+    {0xD59944A37C0752A2, 0x4BE76D3346F04960},  // -94
+    {0x857FCAE62D8493A5, 0x6F70A4400C562DDC},  // -93
+    {0xA6DFBD9FB8E5B88E, 0xCB4CCD500F6BB953},  // -92
+    {0xD097AD07A71F26B2, 0x7E2000A41346A7A8},  // -91
+    {0x825ECC24C873782F, 0x8ED400668C0C28C9},  // -90
+    {0xA2F67F2DFA90563B, 0x728900802F0F32FB},  // -89
+    {0xCBB41EF979346BCA, 0x4F2B40A03AD2FFBA},  // -88
+    {0xFEA126B7D78186BC, 0xE2F610C84987BFA9},  // -87
+    {0x9F24B832E6B0F436, 0x0DD9CA7D2DF4D7CA},  // -86
+    {0xC6EDE63FA05D3143, 0x91503D1C79720DBC},  // -85
+    {0xF8A95FCF88747D94, 0x75A44C6397CE912B},  // -84
+    {0x9B69DBE1B548CE7C, 0xC986AFBE3EE11ABB},  // -83
+    {0xC24452DA229B021B, 0xFBE85BADCE996169},  // -82
+    {0xF2D56790AB41C2A2, 0xFAE27299423FB9C4},  // -81
+    {0x97C560BA6B0919A5, 0xDCCD879FC967D41B},  // -80
+    {0xBDB6B8E905CB600F, 0x5400E987BBC1C921},  // -79
+    {0xED246723473E3813, 0x290123E9AAB23B69},  // -78
+    {0x9436C0760C86E30B, 0xF9A0B6720AAF6522},  // -77
+    {0xB94470938FA89BCE, 0xF808E40E8D5B3E6A},  // -76
+    {0xE7958CB87392C2C2, 0xB60B1D1230B20E05},  // -75
+    {0x90BD77F3483BB9B9, 0xB1C6F22B5E6F48C3},  // -74
+    {0xB4ECD5F01A4AA828, 0x1E38AEB6360B1AF4},  // -73
+    {0xE2280B6C20DD5232, 0x25C6DA63C38DE1B1},  // -72
+    {0x8D590723948A535F, 0x579C487E5A38AD0F},  // -71
+    {0xB0AF48EC79ACE837, 0x2D835A9DF0C6D852},  // -70
+    {0xDCDB1B2798182244, 0xF8E431456CF88E66},  // -69
+    {0x8A08F0F8BF0F156B, 0x1B8E9ECB641B5900},  // -68
+    {0xAC8B2D36EED2DAC5, 0xE272467E3D222F40},  // -67
+    {0xD7ADF884AA879177, 0x5B0ED81DCC6ABB10},  // -66
+    {0x86CCBB52EA94BAEA, 0x98E947129FC2B4EA},  // -65
+    {0xA87FEA27A539E9A5, 0x3F2398D747B36225},  // -64
+    {0xD29FE4B18E88640E, 0x8EEC7F0D19A03AAE},  // -63
+    {0x83A3EEEEF9153E89, 0x1953CF68300424AD},  // -62
+    {0xA48CEAAAB75A8E2B, 0x5FA8C3423C052DD8},  // -61
+    {0xCDB02555653131B6, 0x3792F412CB06794E},  // -60
+    {0x808E17555F3EBF11, 0xE2BBD88BBEE40BD1},  // -59
+    {0xA0B19D2AB70E6ED6, 0x5B6ACEAEAE9D0EC5},  // -58
+    {0xC8DE047564D20A8B, 0xF245825A5A445276},  // -57
+    {0xFB158592BE068D2E, 0xEED6E2F0F0D56713},  // -56
+    {0x9CED737BB6C4183D, 0x55464DD69685606C},  // -55
+    {0xC428D05AA4751E4C, 0xAA97E14C3C26B887},  // -54
+    {0xF53304714D9265DF, 0xD53DD99F4B3066A9},  // -53
+    {0x993FE2C6D07B7FAB, 0xE546A8038EFE402A},  // -52
+    {0xBF8FDB78849A5F96, 0xDE98520472BDD034},  // -51
+    {0xEF73D256A5C0F77C, 0x963E66858F6D4441},  // -50
+    {0x95A8637627989AAD, 0xDDE7001379A44AA9},  // -49
+    {0xBB127C53B17EC159, 0x5560C018580D5D53},  // -48
+    {0xE9D71B689DDE71AF, 0xAAB8F01E6E10B4A7},  // -47
+    {0x9226712162AB070D, 0xCAB3961304CA70E9},  // -46
+    {0xB6B00D69BB55C8D1, 0x3D607B97C5FD0D23},  // -45
+    {0xE45C10C42A2B3B05, 0x8CB89A7DB77C506B},  // -44
+    {0x8EB98A7A9A5B04E3, 0x77F3608E92ADB243},  // -43
+    {0xB267ED1940F1C61C, 0x55F038B237591ED4},  // -42
+    {0xDF01E85F912E37A3, 0x6B6C46DEC52F6689},  // -41
+    {0x8B61313BBABCE2C6, 0x2323AC4B3B3DA016},  // -40
+    {0xAE397D8AA96C1B77, 0xABEC975E0A0D081B},  // -39
+    {0xD9C7DCED53C72255, 0x96E7BD358C904A22},  // -38
+    {0x881CEA14545C7575, 0x7E50D64177DA2E55},  // -37
+    {0xAA242499697392D2, 0xDDE50BD1D5D0B9EA},  // -36
+    {0xD4AD2DBFC3D07787, 0x955E4EC64B44E865},  // -35
+    {0x84EC3C97DA624AB4, 0xBD5AF13BEF0B113F},  // -34
+    {0xA6274BBDD0FADD61, 0xECB1AD8AEACDD58F},  // -33
+    {0xCFB11EAD453994BA, 0x67DE18EDA5814AF3},  // -32
+    {0x81CEB32C4B43FCF4, 0x80EACF948770CED8},  // -31
+    {0xA2425FF75E14FC31, 0xA1258379A94D028E},  // -30
+    {0xCAD2F7F5359A3B3E, 0x096EE45813A04331},  // -29
+    {0xFD87B5F28300CA0D, 0x8BCA9D6E188853FD},  // -28
+    {0x9E74D1B791E07E48, 0x775EA264CF55347E},  // -27
+    {0xC612062576589DDA, 0x95364AFE032A819E},  // -26
+    {0xF79687AED3EEC551, 0x3A83DDBD83F52205},  // -25
+    {0x9ABE14CD44753B52, 0xC4926A9672793543},  // -24
+    {0xC16D9A0095928A27, 0x75B7053C0F178294},  // -23
+    {0xF1C90080BAF72CB1, 0x5324C68B12DD6339},  // -22
+    {0x971DA05074DA7BEE, 0xD3F6FC16EBCA5E04},  // -21
+    {0xBCE5086492111AEA, 0x88F4BB1CA6BCF585},  // -20
+    {0xEC1E4A7DB69561A5, 0x2B31E9E3D06C32E6},  // -19
+    {0x9392EE8E921D5D07, 0x3AFF322E62439FD0},  // -18
+    {0xB877AA3236A4B449, 0x09BEFEB9FAD487C3},  // -17
+    {0xE69594BEC44DE15B, 0x4C2EBE687989A9B4},  // -16
+    {0x901D7CF73AB0ACD9, 0x0F9D37014BF60A11},  // -15
+    {0xB424DC35095CD80F, 0x538484C19EF38C95},  // -14
+    {0xE12E13424BB40E13, 0x2865A5F206B06FBA},  // -13
+    {0x8CBCCC096F5088CB, 0xF93F87B7442E45D4},  // -12
+    {0xAFEBFF0BCB24AAFE, 0xF78F69A51539D749},  // -11
+    {0xDBE6FECEBDEDD5BE, 0xB573440E5A884D1C},  // -10
+    {0x89705F4136B4A597, 0x31680A88F8953031},  // -9
+    {0xABCC77118461CEFC, 0xFDC20D2B36BA7C3E},  // -8
+    {0xD6BF94D5E57A42BC, 0x3D32907604691B4D},  // -7
+    {0x8637BD05AF6C69B5, 0xA63F9A49C2C1B110},  // -6
+    {0xA7C5AC471B478423, 0x0FCF80DC33721D54},  // -5
+    {0xD1B71758E219652B, 0xD3C36113404EA4A9},  // -4
+    {0x83126E978D4FDF3B, 0x645A1CAC083126EA},  // -3
+    {0xA3D70A3D70A3D70A, 0x3D70A3D70A3D70A4},  // -2
+    {0xCCCCCCCCCCCCCCCC, 0xCCCCCCCCCCCCCCCD},  // -1
+    {0x8000000000000000, 0x0000000000000001},  // 0
+    {0xA000000000000000, 0x0000000000000001},  // 1
+    {0xC800000000000000, 0x0000000000000001},  // 2
+    {0xFA00000000000000, 0x0000000000000001},  // 3
+    {0x9C40000000000000, 0x0000000000000001},  // 4
+    {0xC350000000000000, 0x0000000000000001},  // 5
+    {0xF424000000000000, 0x0000000000000001},  // 6
+    {0x9896800000000000, 0x0000000000000001},  // 7
+    {0xBEBC200000000000, 0x0000000000000001},  // 8
+    {0xEE6B280000000000, 0x0000000000000001},  // 9
+    {0x9502F90000000000, 0x0000000000000001},  // 10
+    {0xBA43B74000000000, 0x0000000000000001},  // 11
+    {0xE8D4A51000000000, 0x0000000000000001},  // 12
+    {0x9184E72A00000000, 0x0000000000000001},  // 13
+    {0xB5E620F480000000, 0x0000000000000001},  // 14
+    {0xE35FA931A0000000, 0x0000000000000001},  // 15
+    {0x8E1BC9BF04000000, 0x0000000000000001},  // 16
+    {0xB1A2BC2EC5000000, 0x0000000000000001},  // 17
+    {0xDE0B6B3A76400000, 0x0000000000000001},  // 18
+    {0x8AC7230489E80000, 0x0000000000000001},  // 19
+    {0xAD78EBC5AC620000, 0x0000000000000001},  // 20
+    {0xD8D726B7177A8000, 0x0000000000000001},  // 21
+    {0x878678326EAC9000, 0x0000000000000001},  // 22
+    {0xA968163F0A57B400, 0x0000000000000001},  // 23
+    {0xD3C21BCECCEDA100, 0x0000000000000001},  // 24
+    {0x84595161401484A0, 0x0000000000000001},  // 25
+    {0xA56FA5B99019A5C8, 0x0000000000000001},  // 26
+    {0xCECB8F27F4200F3A, 0x0000000000000001},  // 27
+    {0x813F3978F8940984, 0x4000000000000001},  // 28
+    {0xA18F07D736B90BE5, 0x5000000000000001},  // 29
+    {0xC9F2C9CD04674EDE, 0xA400000000000001},  // 30
+    {0xFC6F7C4045812296, 0x4D00000000000001},  // 31
+    {0x9DC5ADA82B70B59D, 0xF020000000000001},  // 32
+    {0xC5371912364CE305, 0x6C28000000000001},  // 33
+    {0xF684DF56C3E01BC6, 0xC732000000000001},  // 34
+    {0x9A130B963A6C115C, 0x3C7F400000000001},  // 35
+    {0xC097CE7BC90715B3, 0x4B9F100000000001},  // 36
+    {0xF0BDC21ABB48DB20, 0x1E86D40000000001},  // 37
+    {0x96769950B50D88F4, 0x1314448000000001},  // 38
+    {0xBC143FA4E250EB31, 0x17D955A000000001},  // 39
+    {0xEB194F8E1AE525FD, 0x5DCFAB0800000001},  // 40
+    {0x92EFD1B8D0CF37BE, 0x5AA1CAE500000001},  // 41
+    {0xB7ABC627050305AD, 0xF14A3D9E40000001},  // 42
+    {0xE596B7B0C643C719, 0x6D9CCD05D0000001},  // 43
+    {0x8F7E32CE7BEA5C6F, 0xE4820023A2000001},  // 44
+    {0xB35DBF821AE4F38B, 0xDDA2802C8A800001},  // 45
+    {0xE0352F62A19E306E, 0xD50B2037AD200001},  // 46
+    {0x8C213D9DA502DE45, 0x4526F422CC340001},  // 47
+    {0xAF298D050E4395D6, 0x9670B12B7F410001},  // 48
+    {0xDAF3F04651D47B4C, 0x3C0CDD765F114001},  // 49
+    {0x88D8762BF324CD0F, 0xA5880A69FB6AC801},  // 50
+    {0xAB0E93B6EFEE0053, 0x8EEA0D047A457A01},  // 51
+    {0xD5D238A4ABE98068, 0x72A4904598D6D881},  // 52
+    {0x85A36366EB71F041, 0x47A6DA2B7F864751},  // 53
+    {0xA70C3C40A64E6C51, 0x999090B65F67D925},  // 54
+    {0xD0CF4B50CFE20765, 0xFFF4B4E3F741CF6E},  // 55
+    {0x82818F1281ED449F, 0xBFF8F10E7A8921A5},  // 56
+    {0xA321F2D7226895C7, 0xAFF72D52192B6A0E},  // 57
+    {0xCBEA6F8CEB02BB39, 0x9BF4F8A69F764491},  // 58
+    {0xFEE50B7025C36A08, 0x02F236D04753D5B5},  // 59
+    {0x9F4F2726179A2245, 0x01D762422C946591},  // 60
+    {0xC722F0EF9D80AAD6, 0x424D3AD2B7B97EF6},  // 61
+    {0xF8EBAD2B84E0D58B, 0xD2E0898765A7DEB3},  // 62
+    {0x9B934C3B330C8577, 0x63CC55F49F88EB30},  // 63
+    {0xC2781F49FFCFA6D5, 0x3CBF6B71C76B25FC},  // 64
+    {0xF316271C7FC3908A, 0x8BEF464E3945EF7B},  // 65
+    {0x97EDD871CFDA3A56, 0x97758BF0E3CBB5AD},  // 66
+    {0xBDE94E8E43D0C8EC, 0x3D52EEED1CBEA318},  // 67
+    {0xED63A231D4C4FB27, 0x4CA7AAA863EE4BDE},  // 68
+    {0x945E455F24FB1CF8, 0x8FE8CAA93E74EF6B},  // 69
+    {0xB975D6B6EE39E436, 0xB3E2FD538E122B45},  // 70
+    {0xE7D34C64A9C85D44, 0x60DBBCA87196B617},  // 71
+    {0x90E40FBEEA1D3A4A, 0xBC8955E946FE31CE},  // 72
+    {0xB51D13AEA4A488DD, 0x6BABAB6398BDBE42},  // 73
+    {0xE264589A4DCDAB14, 0xC696963C7EED2DD2},  // 74
+    {0x8D7EB76070A08AEC, 0xFC1E1DE5CF543CA3},  // 75
+    {0xB0DE65388CC8ADA8, 0x3B25A55F43294BCC},  // 76
+    {0xDD15FE86AFFAD912, 0x49EF0EB713F39EBF},  // 77
+    {0x8A2DBF142DFCC7AB, 0x6E3569326C784338},  // 78
+    {0xACB92ED9397BF996, 0x49C2C37F07965405},  // 79
+    {0xD7E77A8F87DAF7FB, 0xDC33745EC97BE907},  // 80
+    {0x86F0AC99B4E8DAFD, 0x69A028BB3DED71A4},  // 81
+    {0xA8ACD7C0222311BC, 0xC40832EA0D68CE0D},  // 82
+    {0xD2D80DB02AABD62B, 0xF50A3FA490C30191},  // 83
+    {0x83C7088E1AAB65DB, 0x792667C6DA79E0FB},  // 84
+    {0xA4B8CAB1A1563F52, 0x577001B891185939},  // 85
+    {0xCDE6FD5E09ABCF26, 0xED4C0226B55E6F87},  // 86
+    {0x80B05E5AC60B6178, 0x544F8158315B05B5},  // 87
+    {0xA0DC75F1778E39D6, 0x696361AE3DB1C722},  // 88
+    {0xC913936DD571C84C, 0x03BC3A19CD1E38EA},  // 89
+    {0xFB5878494ACE3A5F, 0x04AB48A04065C724},  // 90
+    {0x9D174B2DCEC0E47B, 0x62EB0D64283F9C77},  // 91
+    {0xC45D1DF942711D9A, 0x3BA5D0BD324F8395},  // 92
+    {0xF5746577930D6500, 0xCA8F44EC7EE3647A},  // 93
+    {0x9968BF6ABBE85F20, 0x7E998B13CF4E1ECC},  // 94
+    {0xBFC2EF456AE276E8, 0x9E3FEDD8C321A67F},  // 95
+    {0xEFB3AB16C59B14A2, 0xC5CFE94EF3EA101F},  // 96
+    {0x95D04AEE3B80ECE5, 0xBBA1F1D158724A13},  // 97
+    {0xBB445DA9CA61281F, 0x2A8A6E45AE8EDC98},  // 98
+    {0xEA1575143CF97226, 0xF52D09D71A3293BE},  // 99
+    {0x924D692CA61BE758, 0x593C2626705F9C57},  // 100
+    {0xB6E0C377CFA2E12E, 0x6F8B2FB00C77836D},  // 101
+    {0xE498F455C38B997A, 0x0B6DFB9C0F956448},  // 102
+    {0x8EDF98B59A373FEC, 0x4724BD4189BD5EAD},  // 103
+    {0xB2977EE300C50FE7, 0x58EDEC91EC2CB658},  // 104
+    {0xDF3D5E9BC0F653E1, 0x2F2967B66737E3EE},  // 105
+    {0x8B865B215899F46C, 0xBD79E0D20082EE75},  // 106
+    {0xAE67F1E9AEC07187, 0xECD8590680A3AA12},  // 107
+    {0xDA01EE641A708DE9, 0xE80E6F4820CC9496},  // 108
+    {0x884134FE908658B2, 0x3109058D147FDCDE},  // 109
+    {0xAA51823E34A7EEDE, 0xBD4B46F0599FD416},  // 110
+    {0xD4E5E2CDC1D1EA96, 0x6C9E18AC7007C91B},  // 111
+    {0x850FADC09923329E, 0x03E2CF6BC604DDB1},  // 112
+    {0xA6539930BF6BFF45, 0x84DB8346B786151D},  // 113
+    {0xCFE87F7CEF46FF16, 0xE612641865679A64},  // 114
+    {0x81F14FAE158C5F6E, 0x4FCB7E8F3F60C07F},  // 115
+    {0xA26DA3999AEF7749, 0xE3BE5E330F38F09E},  // 116
+    {0xCB090C8001AB551C, 0x5CADF5BFD3072CC6},  // 117
+    {0xFDCB4FA002162A63, 0x73D9732FC7C8F7F7},  // 118
+    {0x9E9F11C4014DDA7E, 0x2867E7FDDCDD9AFB},  // 119
+    {0xC646D63501A1511D, 0xB281E1FD541501B9},  // 120
+    {0xF7D88BC24209A565, 0x1F225A7CA91A4227},  // 121
+    {0x9AE757596946075F, 0x3375788DE9B06959},  // 122
+    {0xC1A12D2FC3978937, 0x0052D6B1641C83AF},  // 123
+    {0xF209787BB47D6B84, 0xC0678C5DBD23A49B},  // 124
+    {0x9745EB4D50CE6332, 0xF840B7BA963646E1},  // 125
+    {0xBD176620A501FBFF, 0xB650E5A93BC3D899},  // 126
+    {0xEC5D3FA8CE427AFF, 0xA3E51F138AB4CEBF},  // 127
+    {0x93BA47C980E98CDF, 0xC66F336C36B10138},  // 128
+    {0xB8A8D9BBE123F017, 0xB80B0047445D4185},  // 129
+    {0xE6D3102AD96CEC1D, 0xA60DC059157491E6},  // 130
+    {0x9043EA1AC7E41392, 0x87C89837AD68DB30},  // 131
+    {0xB454E4A179DD1877, 0x29BABE4598C311FC},  // 132
+    {0xE16A1DC9D8545E94, 0xF4296DD6FEF3D67B},  // 133
+    {0x8CE2529E2734BB1D, 0x1899E4A65F58660D},  // 134
+    {0xB01AE745B101E9E4, 0x5EC05DCFF72E7F90},  // 135
+    {0xDC21A1171D42645D, 0x76707543F4FA1F74},  // 136
+    {0x899504AE72497EBA, 0x6A06494A791C53A9},  // 137
+    {0xABFA45DA0EDBDE69, 0x0487DB9D17636893},  // 138
+    {0xD6F8D7509292D603, 0x45A9D2845D3C42B7},  // 139
+    {0x865B86925B9BC5C2, 0x0B8A2392BA45A9B3},  // 140
+    {0xA7F26836F282B732, 0x8E6CAC7768D7141F},  // 141
+    {0xD1EF0244AF2364FF, 0x3207D795430CD927},  // 142
+    {0x8335616AED761F1F, 0x7F44E6BD49E807B9},  // 143
+    {0xA402B9C5A8D3A6E7, 0x5F16206C9C6209A7},  // 144
+    {0xCD036837130890A1, 0x36DBA887C37A8C10},  // 145
+    {0x802221226BE55A64, 0xC2494954DA2C978A},  // 146
+    {0xA02AA96B06DEB0FD, 0xF2DB9BAA10B7BD6D},  // 147
+    {0xC83553C5C8965D3D, 0x6F92829494E5ACC8},  // 148
+    {0xFA42A8B73ABBF48C, 0xCB772339BA1F17FA},  // 149
+    {0x9C69A97284B578D7, 0xFF2A760414536EFC},  // 150
+    {0xC38413CF25E2D70D, 0xFEF5138519684ABB},  // 151
+    {0xF46518C2EF5B8CD1, 0x7EB258665FC25D6A},  // 152
+    {0x98BF2F79D5993802, 0xEF2F773FFBD97A62},  // 153
+    {0xBEEEFB584AFF8603, 0xAAFB550FFACFD8FB},  // 154
+    {0xEEAABA2E5DBF6784, 0x95BA2A53F983CF39},  // 155
+    {0x952AB45CFA97A0B2, 0xDD945A747BF26184},  // 156
+    {0xBA756174393D88DF, 0x94F971119AEEF9E5},  // 157
+    {0xE912B9D1478CEB17, 0x7A37CD5601AAB85E},  // 158
+    {0x91ABB422CCB812EE, 0xAC62E055C10AB33B},  // 159
+    {0xB616A12B7FE617AA, 0x577B986B314D600A},  // 160
+    {0xE39C49765FDF9D94, 0xED5A7E85FDA0B80C},  // 161
+    {0x8E41ADE9FBEBC27D, 0x14588F13BE847308},  // 162
+    {0xB1D219647AE6B31C, 0x596EB2D8AE258FC9},  // 163
+    {0xDE469FBD99A05FE3, 0x6FCA5F8ED9AEF3BC},  // 164
+    {0x8AEC23D680043BEE, 0x25DE7BB9480D5855},  // 165
+    {0xADA72CCC20054AE9, 0xAF561AA79A10AE6B},  // 166
+    {0xD910F7FF28069DA4, 0x1B2BA1518094DA05},  // 167
+    {0x87AA9AFF79042286, 0x90FB44D2F05D0843},  // 168
+    {0xA99541BF57452B28, 0x353A1607AC744A54},  // 169
+    {0xD3FA922F2D1675F2, 0x42889B8997915CE9},  // 170
+    {0x847C9B5D7C2E09B7, 0x69956135FEBADA12},  // 171
+    {0xA59BC234DB398C25, 0x43FAB9837E699096},  // 172
+    {0xCF02B2C21207EF2E, 0x94F967E45E03F4BC},  // 173
+    {0x8161AFB94B44F57D, 0x1D1BE0EEBAC278F6},  // 174
+    {0xA1BA1BA79E1632DC, 0x6462D92A69731733},  // 175
+    {0xCA28A291859BBF93, 0x7D7B8F7503CFDCFF},  // 176
+    {0xFCB2CB35E702AF78, 0x5CDA735244C3D43F},  // 177
+    {0x9DEFBF01B061ADAB, 0x3A0888136AFA64A8},  // 178
+    {0xC56BAEC21C7A1916, 0x088AAA1845B8FDD1},  // 179
+    {0xF6C69A72A3989F5B, 0x8AAD549E57273D46},  // 180
+    {0x9A3C2087A63F6399, 0x36AC54E2F678864C},  // 181
+    {0xC0CB28A98FCF3C7F, 0x84576A1BB416A7DE},  // 182
+    {0xF0FDF2D3F3C30B9F, 0x656D44A2A11C51D6},  // 183
+    {0x969EB7C47859E743, 0x9F644AE5A4B1B326},  // 184
+    {0xBC4665B596706114, 0x873D5D9F0DDE1FEF},  // 185
+    {0xEB57FF22FC0C7959, 0xA90CB506D155A7EB},  // 186
+    {0x9316FF75DD87CBD8, 0x09A7F12442D588F3},  // 187
+    {0xB7DCBF5354E9BECE, 0x0C11ED6D538AEB30},  // 188
+    {0xE5D3EF282A242E81, 0x8F1668C8A86DA5FB},  // 189
+    {0x8FA475791A569D10, 0xF96E017D694487BD},  // 190
+    {0xB38D92D760EC4455, 0x37C981DCC395A9AD},  // 191
+    {0xE070F78D3927556A, 0x85BBE253F47B1418},  // 192
+    {0x8C469AB843B89562, 0x93956D7478CCEC8F},  // 193
+    {0xAF58416654A6BABB, 0x387AC8D1970027B3},  // 194
+    {0xDB2E51BFE9D0696A, 0x06997B05FCC0319F},  // 195
+    {0x88FCF317F22241E2, 0x441FECE3BDF81F04},  // 196
+    {0xAB3C2FDDEEAAD25A, 0xD527E81CAD7626C4},  // 197
+    {0xD60B3BD56A5586F1, 0x8A71E223D8D3B075},  // 198
+    {0x85C7056562757456, 0xF6872D5667844E4A},  // 199
+    {0xA738C6BEBB12D16C, 0xB428F8AC016561DC},  // 200
+    {0xD106F86E69D785C7, 0xE13336D701BEBA53},  // 201
+    {0x82A45B450226B39C, 0xECC0024661173474},  // 202
+    {0xA34D721642B06084, 0x27F002D7F95D0191},  // 203
+    {0xCC20CE9BD35C78A5, 0x31EC038DF7B441F5},  // 204
+    {0xFF290242C83396CE, 0x7E67047175A15272},  // 205
+    {0x9F79A169BD203E41, 0x0F0062C6E984D387},  // 206
+    {0xC75809C42C684DD1, 0x52C07B78A3E60869},  // 207
+    {0xF92E0C3537826145, 0xA7709A56CCDF8A83},  // 208
+    {0x9BBCC7A142B17CCB, 0x88A66076400BB692},  // 209
+    {0xC2ABF989935DDBFE, 0x6ACFF893D00EA436},  // 210
+    {0xF356F7EBF83552FE, 0x0583F6B8C4124D44},  // 211
+    {0x98165AF37B2153DE, 0xC3727A337A8B704B},  // 212
+    {0xBE1BF1B059E9A8D6, 0x744F18C0592E4C5D},  // 213
+    {0xEDA2EE1C7064130C, 0x1162DEF06F79DF74},  // 214
+    {0x9485D4D1C63E8BE7, 0x8ADDCB5645AC2BA9},  // 215
+    {0xB9A74A0637CE2EE1, 0x6D953E2BD7173693},  // 216
+    {0xE8111C87C5C1BA99, 0xC8FA8DB6CCDD0438},  // 217
+    {0x910AB1D4DB9914A0, 0x1D9C9892400A22A3},  // 218
+    {0xB54D5E4A127F59C8, 0x2503BEB6D00CAB4C},  // 219
+    {0xE2A0B5DC971F303A, 0x2E44AE64840FD61E},  // 220
+    {0x8DA471A9DE737E24, 0x5CEAECFED289E5D3},  // 221
+    {0xB10D8E1456105DAD, 0x7425A83E872C5F48},  // 222
+    {0xDD50F1996B947518, 0xD12F124E28F7771A},  // 223
+    {0x8A5296FFE33CC92F, 0x82BD6B70D99AAA70},  // 224
+    {0xACE73CBFDC0BFB7B, 0x636CC64D1001550C},  // 225
+    {0xD8210BEFD30EFA5A, 0x3C47F7E05401AA4F},  // 226
+    {0x8714A775E3E95C78, 0x65ACFAEC34810A72},  // 227
+    {0xA8D9D1535CE3B396, 0x7F1839A741A14D0E},  // 228
+    {0xD31045A8341CA07C, 0x1EDE48111209A051},  // 229
+    {0x83EA2B892091E44D, 0x934AED0AAB460433},  // 230
+    {0xA4E4B66B68B65D60, 0xF81DA84D56178540},  // 231
+    {0xCE1DE40642E3F4B9, 0x36251260AB9D668F},  // 232
+    {0x80D2AE83E9CE78F3, 0xC1D72B7C6B42601A},  // 233
+    {0xA1075A24E4421730, 0xB24CF65B8612F820},  // 234
+    {0xC94930AE1D529CFC, 0xDEE033F26797B628},  // 235
+    {0xFB9B7CD9A4A7443C, 0x169840EF017DA3B2},  // 236
+    {0x9D412E0806E88AA5, 0x8E1F289560EE864F},  // 237
+    {0xC491798A08A2AD4E, 0xF1A6F2BAB92A27E3},  // 238
+    {0xF5B5D7EC8ACB58A2, 0xAE10AF696774B1DC},  // 239
+    {0x9991A6F3D6BF1765, 0xACCA6DA1E0A8EF2A},  // 240
+    {0xBFF610B0CC6EDD3F, 0x17FD090A58D32AF4},  // 241
+    {0xEFF394DCFF8A948E, 0xDDFC4B4CEF07F5B1},  // 242
+    {0x95F83D0A1FB69CD9, 0x4ABDAF101564F98F},  // 243
+    {0xBB764C4CA7A4440F, 0x9D6D1AD41ABE37F2},  // 244
+    {0xEA53DF5FD18D5513, 0x84C86189216DC5EE},  // 245
+    {0x92746B9BE2F8552C, 0x32FD3CF5B4E49BB5},  // 246
+    {0xB7118682DBB66A77, 0x3FBC8C33221DC2A2},  // 247
+    {0xE4D5E82392A40515, 0x0FABAF3FEAA5334B},  // 248
+    {0x8F05B1163BA6832D, 0x29CB4D87F2A7400F},  // 249
+    {0xB2C71D5BCA9023F8, 0x743E20E9EF511013},  // 250
+    {0xDF78E4B2BD342CF6, 0x914DA9246B255417},  // 251
+    {0x8BAB8EEFB6409C1A, 0x1AD089B6C2F7548F},  // 252
+    {0xAE9672ABA3D0C320, 0xA184AC2473B529B2},  // 253
+    {0xDA3C0F568CC4F3E8, 0xC9E5D72D90A2741F},  // 254
+    {0x8865899617FB1871, 0x7E2FA67C7A658893},  // 255
+    {0xAA7EEBFB9DF9DE8D, 0xDDBB901B98FEEAB8},  // 256
+    {0xD51EA6FA85785631, 0x552A74227F3EA566},  // 257
+    {0x8533285C936B35DE, 0xD53A88958F872760},  // 258
+    {0xA67FF273B8460356, 0x8A892ABAF368F138},  // 259
+    {0xD01FEF10A657842C, 0x2D2B7569B0432D86},  // 260
+    {0x8213F56A67F6B29B, 0x9C3B29620E29FC74},  // 261
+    {0xA298F2C501F45F42, 0x8349F3BA91B47B90},  // 262
+    {0xCB3F2F7642717713, 0x241C70A936219A74},  // 263
+    {0xFE0EFB53D30DD4D7, 0xED238CD383AA0111},  // 264
+    {0x9EC95D1463E8A506, 0xF4363804324A40AB},  // 265
+    {0xC67BB4597CE2CE48, 0xB143C6053EDCD0D6},  // 266
+    {0xF81AA16FDC1B81DA, 0xDD94B7868E94050B},  // 267
+    {0x9B10A4E5E9913128, 0xCA7CF2B4191C8327},  // 268
+    {0xC1D4CE1F63F57D72, 0xFD1C2F611F63A3F1},  // 269
+    {0xF24A01A73CF2DCCF, 0xBC633B39673C8CED},  // 270
+    {0x976E41088617CA01, 0xD5BE0503E085D814},  // 271
+    {0xBD49D14AA79DBC82, 0x4B2D8644D8A74E19},  // 272
+    {0xEC9C459D51852BA2, 0xDDF8E7D60ED1219F},  // 273
+    {0x93E1AB8252F33B45, 0xCABB90E5C942B504},  // 274
+    {0xB8DA1662E7B00A17, 0x3D6A751F3B936244},  // 275
+    {0xE7109BFBA19C0C9D, 0x0CC512670A783AD5},  // 276
+    {0x906A617D450187E2, 0x27FB2B80668B24C6},  // 277
+    {0xB484F9DC9641E9DA, 0xB1F9F660802DEDF7},  // 278
+    {0xE1A63853BBD26451, 0x5E7873F8A0396974},  // 279
+    {0x8D07E33455637EB2, 0xDB0B487B6423E1E9},  // 280
+    {0xB049DC016ABC5E5F, 0x91CE1A9A3D2CDA63},  // 281
+    {0xDC5C5301C56B75F7, 0x7641A140CC7810FC},  // 282
+    {0x89B9B3E11B6329BA, 0xA9E904C87FCB0A9E},  // 283
+    {0xAC2820D9623BF429, 0x546345FA9FBDCD45},  // 284
+    {0xD732290FBACAF133, 0xA97C177947AD4096},  // 285
+    {0x867F59A9D4BED6C0, 0x49ED8EABCCCC485E},  // 286
+    {0xA81F301449EE8C70, 0x5C68F256BFFF5A75},  // 287
+    {0xD226FC195C6A2F8C, 0x73832EEC6FFF3112},  // 288
+    {0x83585D8FD9C25DB7, 0xC831FD53C5FF7EAC},  // 289
+    {0xA42E74F3D032F525, 0xBA3E7CA8B77F5E56},  // 290
+    {0xCD3A1230C43FB26F, 0x28CE1BD2E55F35EC},  // 291
+    {0x80444B5E7AA7CF85, 0x7980D163CF5B81B4},  // 292
+    {0xA0555E361951C366, 0xD7E105BCC3326220},  // 293
+    {0xC86AB5C39FA63440, 0x8DD9472BF3FEFAA8},  // 294
+    {0xFA856334878FC150, 0xB14F98F6F0FEB952},  // 295
+    {0x9C935E00D4B9D8D2, 0x6ED1BF9A569F33D4},  // 296
+    {0xC3B8358109E84F07, 0x0A862F80EC4700C9},  // 297
+    {0xF4A642E14C6262C8, 0xCD27BB612758C0FB},  // 298
+    {0x98E7E9CCCFBD7DBD, 0x8038D51CB897789D},  // 299
+    {0xBF21E44003ACDD2C, 0xE0470A63E6BD56C4},  // 300
+    {0xEEEA5D5004981478, 0x1858CCFCE06CAC75},  // 301
+    {0x95527A5202DF0CCB, 0x0F37801E0C43EBC9},  // 302
+    {0xBAA718E68396CFFD, 0xD30560258F54E6BB},  // 303
+    {0xE950DF20247C83FD, 0x47C6B82EF32A206A},  // 304
+    {0x91D28B7416CDD27E, 0x4CDC331D57FA5442},  // 305
+    {0xB6472E511C81471D, 0xE0133FE4ADF8E953},  // 306
+    {0xE3D8F9E563A198E5, 0x58180FDDD97723A7},  // 307
+    {0x8E679C2F5E44FF8F, 0x570F09EAA7EA7649},  // 308
+    {0xB201833B35D63F73, 0x2CD2CC6551E513DB},  // 309
+    {0xDE81E40A034BCF4F, 0xF8077F7EA65E58D2},  // 310
+    {0x8B112E86420F6191, 0xFB04AFAF27FAF783},  // 311
+    {0xADD57A27D29339F6, 0x79C5DB9AF1F9B564},  // 312
+    {0xD94AD8B1C7380874, 0x18375281AE7822BD},  // 313
+    {0x87CEC76F1C830548, 0x8F2293910D0B15B6},  // 314
+    {0xA9C2794AE3A3C69A, 0xB2EB3875504DDB23},  // 315
+    {0xD433179D9C8CB841, 0x5FA60692A46151EC},  // 316
+    {0x849FEEC281D7F328, 0xDBC7C41BA6BCD334},  // 317
+    {0xA5C7EA73224DEFF3, 0x12B9B522906C0801},  // 318
+    {0xCF39E50FEAE16BEF, 0xD768226B34870A01},  // 319
+    {0x81842F29F2CCE375, 0xE6A1158300D46641},  // 320
+    {0xA1E53AF46F801C53, 0x60495AE3C1097FD1},  // 321
+    {0xCA5E89B18B602368, 0x385BB19CB14BDFC5},  // 322
+    {0xFCF62C1DEE382C42, 0x46729E03DD9ED7B6},  // 323
+    {0x9E19DB92B4E31BA9, 0x6C07A2C26A8346D2}   // 324
+};
+
+// Compute the top 64 bits of the 192-bit product g*cp, rounded to odd: if
+// any of the discarded bits are set then the lowest bit of the result is
+// set. (The lowest 64 bits of the product are too small to matter.)
+inline std::uint64_t round_to_odd(uint128 g, std::uint64_t cp)
 {
-    return write_special_category(pbuffer, value, cs, "nan");
+    uint128 x = multiply_64x64(g.low, cp);
+    uint128 y = multiply_64x64(g.high, cp);
+    std::uint64_t y0 = y.low + x.high;
+    std::uint64_t y1 = y.high + (y0 < x.high);
+    return y1 | (y0 > 1);
 }
 
-void write_inf(output_buffer* pbuffer, double value, conversion_specification const& cs)
+// Returns the shortest digits, and their exponent such that the value is
+// digits*10^exponent. The digits may have trailing zeroes. The value must be
+// finite and nonzero.
+void binary64_to_shortest_decimal(binary64 const& b, std::uint64_t* pdigits,
+    int* pexponent)
 {
-    return write_special_category(pbuffer, value, cs, "inf");
+    std::uint64_t c = b.significand;
+    int q = b.exponent;
+
+    // Small integers are their own shortest representation.
+    if(b.ieee_exponent != 0 && q <= 0 && -q < 53) {
+        std::uint64_t mask = (std::uint64_t(1) << -q) - 1;
+        if((c & mask) == 0) {
+            *pdigits = c >> -q;
+            *pexponent = 0;
+            return;
+        }
+    }
+
+    // For the tiniest subnormals there are too few significant bits for the
+    // algorithm to work. We scale them by ten and compensate in the
+    // exponent.
+    int dk = 0;
+    if(b.ieee_exponent == 0 && c < 3) {
+        c *= 10;
+        dk = -1;
+    }
+
+    // The value is c*2^q, and any number in the open (or closed, if c is
+    // even) interval between the halfway points to the neighboring doubles
+    // will read back as the same value. We work with everything multiplied by
+    // four to have the halfway points as integers. If the value is a power
+    // of two then the lower neighbor is closer, since the exponent changes.
+    bool even = (c & 1) == 0;
+    bool lower_is_closer = b.ieee_fraction == 0 && b.ieee_exponent > 1;
+    std::uint64_t cb = c << 2;
+    std::uint64_t cbl = lower_is_closer? cb - 1 : cb - 2;
+    std::uint64_t cbr = cb + 2;
+    int k = lower_is_closer? floor_log10_three_quarters_pow2(q)
+        : floor_log10_pow2(q);
+    int h = q + floor_log2_pow10(-k) + 1;
+    uint128 g = pow10_table[-k - POW10_TABLE_MIN];
+
+    // Scale the value and the interval by 10^-k.
+    std::uint64_t vb = round_to_odd(g, cb << h);
+    std::uint64_t vbl = round_to_odd(g, cbl << h);
+    std::uint64_t vbr = round_to_odd(g, cbr << h);
+    std::uint64_t lower = vbl + !even;
+    std::uint64_t upper = vbr - !even;
+
+    // Now s is the value rounded down to an integer, at most 17 digits. If
+    // exactly one of the two numbers with one digit less that surround the
+    // value is inside the interval then that is our answer.
+    std::uint64_t s = vb >> 2;
+    if(s >= 10) {
+        std::uint64_t sp10 = (s/10)*10;
+        std::uint64_t tp10 = sp10 + 10;
+        bool sp_inside = lower <= (sp10 << 2);
+        bool tp_inside = (tp10 << 2) <= upper;
+        if(sp_inside != tp_inside) {
+            *pdigits = sp_inside? sp10 : tp10;
+            *pexponent = k + dk;
+            return;
+        }
+    }
+
+    // Otherwise it is s or s+1, whichever is inside the interval or, if both
+    // are, whichever is closest to the value.
+    std::uint64_t t = s + 1;
+    bool s_inside = lower <= (s << 2);
+    bool t_inside = (t << 2) <= upper;
+    if(s_inside != t_inside) {
+        *pdigits = s_inside? s : t;
+    } else {
+        std::uint64_t mid = (s << 2) + 2;
+        bool round_up = vb > mid || (vb == mid && (s & 1) != 0);
+        *pdigits = round_up? t : s;
+    }
+    *pexponent = k + dk;
 }
 
-void ftoa_base10_f_normal(output_buffer* pbuffer, decimal18 dv, unsigned precision, conversion_specification const& cs)
+// Correctly rounded conversion
+// ----------------------------
+// Computes floor(significand*2^exponent/10^position) and whether rounding it
+// half to even should add one, using at most 128-bit arithmetic. Returns
+// false if that isn't enough for these arguments, or if the result doesn't
+// fit in 64 bits.
+bool scale_and_round(std::uint64_t significand, int exponent, int position,
+    std::uint64_t* presult, bool* pround_up)
 {
-    // [sign] [digits_before_dot] [zeroes_before_dot] [dot] [zeroes_after_dot] [digits_after_dot] [suffix_zeroes]
-    char sign = dv.sign? '-' : cs.plus_sign;
-    unsigned digits_before_dot;
-    unsigned zeroes_before_dot;
-    unsigned zeroes_after_dot;
-    unsigned digits_after_dot;
+    if(position <= 0) {
+        unsigned scale = unsigned_cast(-position);
+        if(scale > 18)
+            return false;
+        uint128 n = multiply_64x64(significand, detail::power_lut[scale]);
+        if(exponent >= 0) {
+            unsigned shift = unsigned_cast(exponent);
+            if(n.high != 0 || shift_left_overflows(n.low, shift))
+                return false;
+            *presult = n.low << shift;
+            *pround_up = false;
+            return true;
+        }
 
-    if(dv.exponent>=17) {
-        // All digits from the mantissa are on the left-hand side of the dot.
-        digits_before_dot = 18;
-        zeroes_before_dot = unsigned_cast(dv.exponent)+1 - 18;
-        zeroes_after_dot = precision;
-        digits_after_dot = 0;
-    } else if(dv.exponent < 0) {
-        // All digits from the mantissa are on the right-hand side of the dot.
-        // We set zeroes_before_dot=1 to generate a zero on the left-hand side,
-        // since this is what people expect and it's what stdio does.
-        digits_before_dot = 0;
-        zeroes_before_dot = 1;
-        zeroes_after_dot = std::min(unsigned_cast(-dv.exponent)-1, precision);
-        digits_after_dot = std::min(18u, precision - zeroes_after_dot);
+        unsigned shift = unsigned_cast(-exponent);
+        if(shift >= 128) {
+            // n < 2^117, so this is less than one half.
+            *presult = 0;
+            *pround_up = false;
+            return true;
+        }
+        uint128 q = shift_right(n, shift);
+        if(q.high != 0)
+            return false;
+        uint128 remainder = low_bits(n, shift);
+        uint128 half = power_of_two(shift - 1);
+        *presult = q.low;
+        *pround_up = half < remainder
+            || (remainder == half && (q.low & 1) != 0);
+        return true;
     } else {
-        // There are digits from the mantissa both on the left- and right-hand
-        // sides of the dot.
-        if(dv.mantissa == 0) {
-            // Special case for +-0: utoa_generic_base10_preallocated does not
-            // output any digits for a zero value, so we need to fake it in by
-            // using zeroes_before_dot instead.
-            digits_before_dot = 0;
-            zeroes_before_dot = 1;
-            zeroes_after_dot = 0;
-            digits_after_dot = 0;
+        if(position > 18)
+            return false;
+        std::uint64_t numerator = significand;
+        std::uint64_t divisor = detail::power_lut[position];
+        if(exponent >= 0) {
+            unsigned shift = unsigned_cast(exponent);
+            if(shift_left_overflows(numerator, shift))
+                return false;
+            numerator <<= shift;
         } else {
-            digits_before_dot = unsigned_cast(dv.exponent+1);
-            zeroes_before_dot = 0;
-            zeroes_after_dot = 0;
-            digits_after_dot = std::min(18 - digits_before_dot, precision);
+            unsigned shift = unsigned_cast(-exponent);
+            if(shift_left_overflows(divisor, shift)) {
+                // The divisor is at least 2^64 and the numerator less than
+                // 2^53, so this is less than one half.
+                *presult = 0;
+                *pround_up = false;
+                return true;
+            }
+            divisor <<= shift;
         }
+        std::uint64_t q = numerator / divisor;
+        std::uint64_t remainder = numerator % divisor;
+        *presult = q;
+        *pround_up = remainder > divisor - remainder
+            || (remainder == divisor - remainder && (q & 1) != 0);
+        return true;
     }
-    unsigned suffix_zeroes = precision - (zeroes_after_dot + digits_after_dot);
-
-    bool dot = cs.alternative_form
-        || (zeroes_after_dot + digits_after_dot + suffix_zeroes != 0);
-
-    // Reduce the mantissa part to the requested number of digits.
-    auto mantissa_digits = digits_before_dot + digits_after_dot;
-    std::uint64_t mantissa = rounded_rshift(dv.sign, dv.mantissa, 18-mantissa_digits);
-    auto order = detail::power_lut[mantissa_digits];
-    bool carry = mantissa >= order;
-    if(carry) {
-        // When reducing the mantissa, rounding caused it to overflow. For
-        // example, when formatting 0.095 with precision=2, we have
-        // zeroes_before_dot=1, zeroes_after_dot=1, mantissa_digits=1 and
-        // suffix_zeroes=0. When trying to reduce the mantissa to 1 digit we
-        // end up not with 9, but with 10 due to rounding. In this case we need
-        // to make room for an extra digit from the mantissa, which we'll take
-        // from zeroes_after_dot or by increasing digits_before_dot.
-        //
-        // Logically this can only happen if there are actual digits from the
-        // mantissa on the right-hand side of the dot. If all the digits are on
-        // the left-hand side then no reduction will take place, because only
-        // the number of fractional digits are user-controllable. So, if
-        // zeroes_before_dot is nonzero then that's only to generate a filler
-        // zero (see if clause above where dv.exponent < 0). If the overflow
-        // now produces a digit on the left-hand side of the dot then we must
-        // cancel out that zero by setting zeroes_before_dot=0.
-        if(zeroes_after_dot) {
-            --zeroes_after_dot;
-            ++digits_after_dot;
-        } else {
-            ++digits_before_dot;
-            zeroes_before_dot = 0;
+}
+
+// Same as scale_and_round(), but for any magnitude. We multiply by the
+// approximation of 10^-position from pow10_table, which is slightly too large.
+// The error is less than the significand in the lowest bits of the 181-bit
+// product, so it can only affect the result when the part below the integer
+// is within that distance from zero or one half. In that case we return false
+// since we can't tell which side we are on; this happens when the exact
+// result is an integer or a tie, i.e. rarely outside the cases that
+// scale_and_round() already takes care of.
+bool scale_and_round_approximately(std::uint64_t significand, int exponent,
+    int position, std::uint64_t* presult, bool* pround_up)
+{
+    int k = -position;
+    if(k < POW10_TABLE_MIN || k > POW10_TABLE_MAX)
+        return false;
+    // Shifting the product right by this many bits gives us the result.
+    int shift = 127 - exponent - floor_log2_pow10(k);
+    if(shift < 117) {
+        // The error could reach above the 64 bits below the integer, or the
+        // result might not fit in 64 bits.
+        return false;
+    } else if(shift >= 192) {
+        // The product has at most 181 bits, so this is less than one half.
+        *presult = 0;
+        *pround_up = false;
+        return true;
+    }
+
+    uint128 g = pow10_table[k - POW10_TABLE_MIN];
+    uint128 low = multiply_64x64(g.low, significand);
+    uint128 high = multiply_64x64(g.high, significand);
+    std::uint64_t p0 = low.low;
+    std::uint64_t p1 = high.low + low.high;
+    std::uint64_t p2 = high.high + (p1 < low.high);
+
+    // Split into the integer part and the 64 bits right below it.
+    unsigned s = static_cast<unsigned>(shift);
+    std::uint64_t integer;
+    std::uint64_t fraction;
+    if(s >= 128) {
+        integer = p2 >> (s - 128);
+        fraction = s == 128? p1 : (p2 << (192 - s)) | (p1 >> (s - 128));
+    } else {
+        integer = (p2 << (128 - s)) | (p1 >> (s - 64));
+        fraction = (p1 << (128 - s)) | (p0 >> (s - 64));
+    }
+
+    std::uint64_t const half = std::uint64_t(1) << 63;
+    if(fraction == 0 || fraction == half)
+        return false;
+    *presult = integer;
+    *pround_up = fraction > half;
+    return true;
+}
+
+// A fixed-size unsigned integer, large enough to hold any double shifted to
+// an integer plus 30 bits of headroom.
+class bignum {
+public:
+    explicit bignum(std::uint64_t v) :
+        size_(0)
+    {
+        while(v != 0) {
+            limbs_[size_++] = static_cast<std::uint32_t>(v);
+            v >>= 32;
         }
-        ++mantissa_digits;
     }
 
-    unsigned content_size = !!sign + digits_before_dot + zeroes_before_dot
-        + dot + zeroes_after_dot + digits_after_dot + suffix_zeroes;
-    unsigned size = std::max(cs.minimum_field_width, content_size);
-    unsigned padding = size - content_size;
-    unsigned pad_zeroes = 0;
-    if(cs.pad_with_zeroes && !cs.left_justify) {
-        pad_zeroes = padding;
-        padding = 0;
+    bool is_zero() const
+    {
+        return size_ == 0;
     }
 
-    char* str = pbuffer->reserve(size);
-    unsigned pos = size;
-    if(cs.left_justify) {
-        pos -= padding;
-        std::memset(str+pos, ' ', padding);
+    void shift_left(unsigned shift)
+    {
+        if(size_ == 0)
+            return;
+        unsigned limb_shift = shift/32;
+        unsigned bit_shift = shift%32;
+        assert(size_ + limb_shift + 1 <= MAX_LIMBS);
+        limbs_[size_ + limb_shift] = 0;
+        for(unsigned i=size_; i!=0; --i) {
+            std::uint64_t v = static_cast<std::uint64_t>(limbs_[i-1]) << bit_shift;
+            limbs_[i + limb_shift] |= static_cast<std::uint32_t>(v >> 32);
+            limbs_[i - 1 + limb_shift] = static_cast<std::uint32_t>(v);
+        }
+        for(unsigned i=0; i!=limb_shift; ++i)
+            limbs_[i] = 0;
+        size_ += limb_shift + 1;
+        trim();
     }
 
-    if(dot) {
-        pos -= suffix_zeroes;
-        std::memset(str+pos, '0', suffix_zeroes);
-        mantissa = utoa_generic_base10_preallocated(str, pos, mantissa,
-                digits_after_dot);
-        pos -= digits_after_dot;
+    void multiply(std::uint32_t factor)
+    {
+        std::uint64_t carry = 0;
+        for(unsigned i=0; i!=size_; ++i) {
+            std::uint64_t v = static_cast<std::uint64_t>(limbs_[i])*factor + carry;
+            limbs_[i] = static_cast<std::uint32_t>(v);
+            carry = v >> 32;
+        }
+        if(carry != 0) {
+            assert(size_ != MAX_LIMBS);
+            limbs_[size_++] = static_cast<std::uint32_t>(carry);
+        }
+    }
 
-        pos -= zeroes_after_dot;
-        std::memset(str+pos, '0', zeroes_after_dot);
-        str[--pos] = '.';
+    // Returns the remainder.
+    std::uint32_t divide(std::uint32_t divisor)
+    {
+        std::uint64_t remainder = 0;
+        for(unsigned i=size_; i!=0; --i) {
+            std::uint64_t v = (remainder << 32) | limbs_[i-1];
+            limbs_[i-1] = static_cast<std::uint32_t>(v / divisor);
+            remainder = v % divisor;
+        }
+        trim();
+        return static_cast<std::uint32_t>(remainder);
     }
 
-    pos -= zeroes_before_dot;
-    std::memset(str+pos, '0', zeroes_before_dot);
-    pos = utoa_generic_base10_preallocated(str, pos, mantissa);
-    pos -= pad_zeroes;
-    std::memset(str+pos, '0', pad_zeroes);
-    if(sign)
-        str[--pos] = sign;
+    // Remove and return the bits from position bit and up. They must fit in
+    // 32 bits.
+    std::uint32_t split(unsigned bit)
+    {
+        unsigned limb = bit/32;
+        unsigned bit_shift = bit%32;
+        if(limb >= size_)
+            return 0;
+        std::uint64_t v = limbs_[limb];
+        if(limb + 1 < size_)
+            v |= static_cast<std::uint64_t>(limbs_[limb + 1]) << 32;
+        std::uint32_t high = static_cast<std::uint32_t>(v >> bit_shift);
+        limbs_[limb] &= (std::uint32_t(1) << bit_shift) - 1;
+        size_ = limb + 1;
+        trim();
+        return high;
+    }
 
-    if(!cs.left_justify) {
-        pos -= padding;
-        std::memset(str+pos, ' ', padding);
+private:
+    void trim()
+    {
+        while(size_ != 0 && limbs_[size_-1] == 0)
+            --size_;
+    }
+
+    // 2^1024 needs 33 limbs, and a fraction of 1074 bits multiplied by 10^9
+    // needs 35.
+    static unsigned const MAX_LIMBS = 36;
+    std::uint32_t limbs_[MAX_LIMBS];
+    unsigned size_;
+};
+
+// Append a 9-digit chunk to the digits, skipping leading zeroes if there are
+// no digits yet.
+void append_chunk(decimal_digits* pd, std::uint32_t chunk, int position)
+{
+    if(pd->count == 0) {
+        if(chunk == 0)
+            return;
+        unsigned count = write_digits(pd->digits, chunk);
+        pd->count = count;
+        pd->exponent = position + static_cast<int>(count) - 1;
+    } else {
+        utoa_generic_base10_preallocated(pd->digits + pd->count, 9,
+            static_cast<std::uint64_t>(chunk), 9);
+        pd->count += 9;
     }
-    pbuffer->commit(size);
-    assert(pos == 0);
 }
 
-void ftoa_base10_e_normal(output_buffer* pbuffer, decimal18 dv,
-        unsigned precision, conversion_specification const& cs)
+// Generate the exact decimal digits of significand*2^exponent, until we
+// either have more than max_digits digits or have passed the digit at
+// min_position (the digit for 10^min_position). Returns true if there are
+// nonzero digits beyond the ones that were generated.
+bool generate_exact_digits(std::uint64_t significand, int exponent,
+    unsigned max_digits, int min_position, decimal_digits* pd)
 {
-    // We have either
-    // [sign] [digit] [dot] [digits_after_dot] [e] [exponent sign] [exponent_digits]
-    // or
-    // [padding] [sign] [zero_padding] [digit] [dot] [digits_after_dot] [e] [exponent sign] [exponent_digits]
-    // depending on if it's left-justified or not.
+    pd->count = 0;
+    pd->exponent = 0;
+
+    if(exponent >= 0) {
+        // It's an integer. Divide it into 9-digit chunks, least significant
+        // first, then append them starting from the most significant. There
+        // are at most 309 digits so we don't bother stopping early.
+        bignum n(significand);
+        n.shift_left(unsigned_cast(exponent));
+        std::uint32_t chunks[35];
+        unsigned chunk_count = 0;
+        while(!n.is_zero())
+            chunks[chunk_count++] = n.divide(1000000000);
+        for(unsigned i=chunk_count; i!=0; --i)
+            append_chunk(pd, chunks[i-1], 9*static_cast<int>(i-1));
+        return false;
+    }
+
+    unsigned shift = unsigned_cast(-exponent);
+    std::uint64_t integer_part = shift < 64? significand >> shift : 0;
+    pd->count = write_digits(pd->digits, integer_part);
+    pd->exponent = static_cast<int>(pd->count) - 1;
+
+    // The fraction is a fixed-point number with shift fractional bits.
+    // Multiplying by 10^9 moves the next nine digits to the integer part.
+    bignum fraction(shift < 64?
+        significand & ((std::uint64_t(1) << shift) - 1) : significand);
+    int position = -1;
+    while(!fraction.is_zero() && pd->count <= max_digits
+        && position >= min_position)
+    {
+        fraction.multiply(1000000000);
+        append_chunk(pd, fraction.split(shift), position - 8);
+        position -= 9;
+    }
+    return !fraction.is_zero();
+}
+
+// Round the digits to keep significant digits, half to even. If sticky is
+// set then there are nonzero digits beyond the ones in the buffer; in that
+// case there must be more than keep digits in the buffer. Rounding up may
+// leave trailing zeroes out.
+void round_digits(decimal_digits* pd, int keep, bool sticky)
+{
+    if(keep < 0) {
+        pd->count = 0;
+        return;
+    }
+    unsigned kept = unsigned_cast(keep);
+    if(kept >= pd->count) {
+        assert(!sticky);
+        return;
+    }
 
-    char exponent_sign;
-    unsigned exponent;
-    if(dv.exponent < 0) {
-        exponent_sign = '-';
-        exponent = unsigned_cast(-dv.exponent);
+    char* digits = pd->digits;
+    char first_dropped = digits[kept];
+    bool round_up;
+    if(first_dropped != '5') {
+        round_up = first_dropped > '5';
     } else {
-        exponent_sign = '+';
-        exponent = unsigned_cast(dv.exponent);
-    }
-    unsigned digits_after_dot = precision;
-    int dot = digits_after_dot!=0 || cs.alternative_form;
-
-    int exponent_digits;
-    // Apparently stdio never prints less than two digits for the exponent,
-    // so we'll do the same to stay consistent. Maximum value of the exponent
-    // in a double is 308 so we won't get more than 3 digits.
-    if(exponent < 100)
-        exponent_digits = 2;
-    else
-        exponent_digits = 3;
+        round_up = sticky;
+        for(unsigned i=kept+1; i!=pd->count && !round_up; ++i)
+            round_up = digits[i] != '0';
+        // It's a tie. Round to even.
+        if(!round_up && kept != 0)
+            round_up = ((digits[kept-1] - '0') & 1) != 0;
+    }
+
+    pd->count = kept;
+    if(!round_up)
+        return;
+    while(pd->count != 0 && digits[pd->count-1] == '9')
+        --pd->count;
+    if(pd->count == 0) {
+        // All nines (or nothing) became a one in the next position.
+        digits[0] = '1';
+        pd->count = 1;
+        pd->exponent += 1;
+    } else {
+        ++digits[pd->count-1];
+    }
+}
 
-    char sign = dv.sign? '-' : cs.plus_sign;
-    unsigned content_size = !!sign + 1 + dot + digits_after_dot + 1 + 1 + exponent_digits;
-    unsigned size = std::max(cs.minimum_field_width, content_size);
-    unsigned padding = size - content_size;
-    unsigned pad_zeroes = 0;
-    if(cs.pad_with_zeroes && !cs.left_justify) {
-        pad_zeroes = padding;
-        padding = 0;
+bool scale(binary64 const& b, int position, std::uint64_t* presult,
+    bool* pround_up)
+{
+    return scale_and_round(b.significand, b.exponent, position, presult,
+            pround_up)
+        || scale_and_round_approximately(b.significand, b.exponent, position,
+            presult, pround_up);
+}
+
+// Round to a multiple of 10^-precision, as for %f.
+void round_to_precision(binary64 const& b, unsigned precision,
+    decimal_digits* pd)
+{
+    // There are never more than 1074 digits after the decimal point, so
+    // rounding any further out makes no difference.
+    int capped_precision = static_cast<int>(std::min(precision, 1100u));
+    std::uint64_t v;
+    bool round_up;
+    if(scale(b, -capped_precision, &v, &round_up)
+        && v != std::numeric_limits<std::uint64_t>::max())
+    {
+        v += round_up;
+        pd->count = write_digits(pd->digits, v);
+        pd->exponent = static_cast<int>(pd->count) - 1 - capped_precision;
+        return;
+    }
+
+    bool sticky = generate_exact_digits(b.significand, b.exponent,
+        std::numeric_limits<unsigned>::max(), -capped_precision - 1, pd);
+    // If there are no digits then everything down to the first digit after
+    // the rounding position was zero, so it rounds to zero.
+    if(pd->count != 0)
+        round_digits(pd, pd->exponent + 1 + capped_precision, sticky);
+}
+
+// Round to significant_digits significant digits, as for %e. The value must
+// not be zero.
+void round_to_significant_digits(binary64 const& b,
+    unsigned significant_digits, decimal_digits* pd)
+{
+    assert(significant_digits != 0);
+    if(significant_digits <= 17) {
+        // The value is between 2^e2 and 2^(e2+1), so its decimal exponent is
+        // either this estimate or one more.
+        int e2 = b.exponent + static_cast<int>(log2(b.significand));
+        int exponent = floor_log10_pow2(e2);
+        int position = exponent - static_cast<int>(significant_digits) + 1;
+        std::uint64_t limit = detail::power_lut[significant_digits];
+        std::uint64_t v;
+        bool round_up;
+        bool ok = scale(b, position, &v, &round_up);
+        if(ok && v >= limit) {
+            ++exponent;
+            ++position;
+            ok = scale(b, position, &v, &round_up);
+        }
+        if(ok) {
+            v += round_up;
+            if(v == limit) {
+                v /= 10;
+                ++exponent;
+            }
+            pd->count = write_digits(pd->digits, v);
+            pd->exponent = exponent;
+            return;
+        }
     }
 
-    // Get rid of digits we don't want in the mantissa.
-    std::uint64_t mantissa = rounded_rshift(dv.sign, dv.mantissa,
-            18-(digits_after_dot+1));
+    unsigned max_digits = std::min(significant_digits, 1100u);
+    bool sticky = generate_exact_digits(b.significand, b.exponent, max_digits,
+        std::numeric_limits<int>::min(), pd);
+    round_digits(pd, static_cast<int>(max_digits), sticky);
+}
 
+// Layout
+// ------
+// Reserve room for a number that takes content_size characters, including
+// the sign. Writes padding and sign and returns where the rest of the number
+// should go. Finish with pbuffer->commit(*psize).
+char* begin_number(output_buffer* pbuffer, char sign, unsigned content_size,
+    conversion_specification const& cs, unsigned* psize)
+{
+    unsigned size = std::max(cs.minimum_field_width, content_size);
+    unsigned padding = size - content_size;
     char* str = pbuffer->reserve(size);
-
-    unsigned pos = size;
+    *psize = size;
     if(cs.left_justify) {
-        pos -= padding;
-        std::memset(str+pos, ' ', padding);
+        std::memset(str + content_size, ' ', padding);
+        padding = 0;
+    } else if(!cs.pad_with_zeroes) {
+        std::memset(str, ' ', padding);
+        str += padding;
+        padding = 0;
     }
+    if(sign)
+        *str++ = sign;
+    // If there is any padding left then it goes between the sign and the
+    // digits.
+    std::memset(str, '0', padding);
+    return str + padding;
+}
 
-    utoa_generic_base10_preallocated(str, pos, exponent, exponent_digits);
-    pos -= exponent_digits;
-    str[--pos] = exponent_sign;
-    str[--pos] = 'e';
+void write_special_category(output_buffer* pbuffer, bool negative,
+    conversion_specification const& cs, char const* category)
+{
+    char sign = negative? '-' : cs.plus_sign;
+    unsigned content_size = 3 + (sign? 1 : 0);
+    // Zero padding makes no sense here; stdio pads with spaces.
+    conversion_specification space_padded = cs;
+    space_padded.pad_with_zeroes = false;
+    unsigned size;
+    char* str = begin_number(pbuffer, sign, content_size, space_padded, &size);
+    std::memcpy(str, category, 3);
+    pbuffer->commit(size);
+}
 
-    mantissa = utoa_generic_base10_preallocated(str, pos, mantissa, digits_after_dot);
-    pos -= digits_after_dot;
+void write_special(output_buffer* pbuffer, binary64 const& b,
+    conversion_specification const& cs)
+{
+    char const* category;
+    if(b.ieee_fraction != 0)
+        category = cs.uppercase? "NAN" : "nan";
+    else
+        category = cs.uppercase? "INF" : "inf";
+    write_special_category(pbuffer, b.sign, cs, category);
+}
 
+// [sign] [integer_digits] [integer_zeroes] [dot] [fraction_zeroes]
+// [fraction_digits] [suffix_zeroes]
+// The digits must not go beyond the precision.
+void write_fixed(output_buffer* pbuffer, bool negative,
+    decimal_digits const& d, unsigned precision,
+    conversion_specification const& cs)
+{
+    char sign = negative? '-' : cs.plus_sign;
+    unsigned integer_digits;
+    unsigned integer_zeroes;
+    unsigned fraction_zeroes;
+    unsigned fraction_digits;
+    if(d.count == 0 || d.exponent < 0) {
+        // We always have a zero in front of the dot, since that's what
+        // people expect and it's what stdio does.
+        integer_digits = 0;
+        integer_zeroes = 1;
+        fraction_zeroes = d.count == 0? precision
+            : std::min(unsigned_cast(-d.exponent) - 1, precision);
+        fraction_digits = d.count;
+    } else {
+        unsigned integer_length = unsigned_cast(d.exponent) + 1;
+        integer_digits = std::min(d.count, integer_length);
+        integer_zeroes = integer_length - integer_digits;
+        fraction_zeroes = 0;
+        fraction_digits = d.count - integer_digits;
+    }
+    assert(fraction_zeroes + fraction_digits <= precision);
+    unsigned suffix_zeroes = precision - fraction_zeroes - fraction_digits;
+    bool dot = precision != 0 || cs.alternative_form;
+
+    unsigned content_size = !!sign + integer_digits + integer_zeroes + dot
+        + precision;
+    unsigned size;
+    char* str = begin_number(pbuffer, sign, content_size, cs, &size);
+    std::memcpy(str, d.digits, integer_digits);
+    str += integer_digits;
+    std::memset(str, '0', integer_zeroes);
+    str += integer_zeroes;
     if(dot)
-        str[--pos] = '.';
-
-    str[--pos] = '0' + static_cast<char>(mantissa);
-
-    pos -= pad_zeroes;
-    std::memset(str+pos, '0', pad_zeroes);
-    if(sign)
-        str[0] = sign;
+        *str++ = '.';
+    std::memset(str, '0', fraction_zeroes);
+    str += fraction_zeroes;
+    std::memcpy(str, d.digits + integer_digits, fraction_digits);
+    str += fraction_digits;
+    std::memset(str, '0', suffix_zeroes);
+    pbuffer->commit(size);
+}
 
-    if(!cs.left_justify) {
-        pos -= padding;
-        std::memset(str+pos, ' ', padding);
-    }
+// [sign] [digit] [dot] [fraction_digits] [suffix_zeroes] [e] [exponent_sign]
+// [exponent_digits]
+void write_exponential(output_buffer* pbuffer, bool negative,
+    decimal_digits const& d, unsigned precision,
+    conversion_specification const& cs)
+{
+    char sign = negative? '-' : cs.plus_sign;
+    int exponent = d.count == 0? 0 : d.exponent;
+    char exponent_sign = exponent < 0? '-' : '+';
+    unsigned absolute_exponent = unsigned_cast(exponent < 0? -exponent : exponent);
+    // stdio never prints less than two digits for the exponent, so we'll do
+    // the same to stay consistent. The largest exponent of a double is 308.
+    unsigned exponent_digits = absolute_exponent < 100? 2 : 3;
+    unsigned fraction_digits = d.count > 1? d.count - 1 : 0;
+    assert(fraction_digits <= precision);
+    unsigned suffix_zeroes = precision - fraction_digits;
+    bool dot = precision != 0 || cs.alternative_form;
+
+    unsigned content_size = !!sign + 1 + dot + precision + 2 + exponent_digits;
+    unsigned size;
+    char* str = begin_number(pbuffer, sign, content_size, cs, &size);
+    *str++ = d.count == 0? '0' : d.digits[0];
+    if(dot)
+        *str++ = '.';
+    std::memcpy(str, d.digits + 1, fraction_digits);
+    str += fraction_digits;
+    std::memset(str, '0', suffix_zeroes);
+    str += suffix_zeroes;
+    *str++ = cs.uppercase? 'E' : 'e';
+    *str++ = exponent_sign;
+    if(exponent_digits == 3) {
+        *str++ = static_cast<char>('0' + absolute_exponent/100);
+        absolute_exponent %= 100;
+    }
+    str[0] = detail::decimal_digits[2*absolute_exponent];
+    str[1] = detail::decimal_digits[2*absolute_exponent + 1];
     pbuffer->commit(size);
 }
 
@@ -1034,19 +2250,30 @@ void itoa_base16(output_buffer* pbuffer, unsigned long long value, conversion_sp
 
 void ftoa_base10_f(output_buffer* pbuffer, double value, conversion_specification const& cs)
 {
-    // TODO measure if these prefetches help
-    //prefetch_digits();
-    //prefetch_power_lut();
-    auto category = std::fpclassify(value);
-    if(category == FP_NAN) {
-        return write_nan(pbuffer, value, cs);
-    } else if(category == FP_INFINITE) {
-        return write_inf(pbuffer, value, cs);
-    } else {
-        decimal18 dv = binary64_to_decimal18(value);
-        int p = cs.precision == UNSPECIFIED_PRECISION? 6 : cs.precision;
-        return ftoa_base10_f_normal(pbuffer, dv, p, cs);
-    }
+    binary64 b = decompose(value);
+    if(b.ieee_exponent == 0x7ff)
+        return write_special(pbuffer, b, cs);
+
+    unsigned precision = cs.precision == UNSPECIFIED_PRECISION? 6 : cs.precision;
+    char buffer[DIGIT_BUFFER_SIZE];
+    decimal_digits d = {buffer, 0, 0};
+    if(b.significand != 0)
+        round_to_precision(b, precision, &d);
+    write_fixed(pbuffer, b.sign, d, precision, cs);
+}
+
+void ftoa_base10_e(output_buffer* pbuffer, double value, conversion_specification const& cs)
+{
+    binary64 b = decompose(value);
+    if(b.ieee_exponent == 0x7ff)
+        return write_special(pbuffer, b, cs);
+
+    unsigned precision = cs.precision == UNSPECIFIED_PRECISION? 6 : cs.precision;
+    char buffer[DIGIT_BUFFER_SIZE];
+    decimal_digits d = {buffer, 0, 0};
+    if(b.significand != 0)
+        round_to_significant_digits(b, precision + 1, &d);
+    write_exponential(pbuffer, b.sign, d, precision, cs);
 }
 
 void ftoa_base10_g(output_buffer* pbuffer, double value, conversion_specification const& cs)
@@ -1061,52 +2288,49 @@ void ftoa_base10_g(output_buffer* pbuffer, double value, conversion_specificatio
     // alternative mode is requested. Alternative mode also means that the period
     // stays, no matter if there are any fractional decimals remaining or
     // not.
-    //prefetch_digits();
-    //prefetch_power_lut();
-    auto category = std::fpclassify(value);
-    if(category == FP_NAN) {
-        return write_nan(pbuffer, value, cs);
-    } else if(category == FP_INFINITE) {
-        return write_inf(pbuffer, value, cs);
-    } else {
-        int const minimum_exponent = -4;
-        decimal18 dv = binary64_to_decimal18(value);
-
-        int p;
-        if(cs.precision == UNSPECIFIED_PRECISION)
-            p = 6;
-        else if(cs.precision == 0)
-            p = 1;
-        else {
-            p = cs.precision;
-            if(!cs.alternative_form) {
-                // We are supposed to remove trailing zeroes, so we can't ever
-                // get more than 18 digits because the rest will be zero
-                // anyway, as this is the number of digits in the mantissa.
-                p = std::min(p, 18);
-            }
-        }
-        unsigned truncated_digits = 18 - p;
-
-        if(p > dv.exponent && dv.exponent >= minimum_exponent) {
-            unsigned trailing_zeroes = 0;
-            if(!cs.alternative_form) {
-                trailing_zeroes = count_trailing_zeroes_after_dot(dv);
-                if(trailing_zeroes > truncated_digits)
-                    trailing_zeroes -= truncated_digits;
-                else
-                    trailing_zeroes = 0;
-            }
-            p = p - 1 - dv.exponent - trailing_zeroes;
-            p = std::max(0, p);
-            return ftoa_base10_f_normal(pbuffer, dv, p, cs);
-        } else {
-            unsigned trailing_zeroes = 0;
-            if(!cs.alternative_form)
-                trailing_zeroes = count_trailing_zeroes(dv, truncated_digits);
-            p = p - 1 - trailing_zeroes;
-            return ftoa_base10_e_normal(pbuffer, dv, p, cs);
+    //
+    // Unlike stdio we don't default to a precision of 6 when there is none.
+    // Instead we use the shortest digits that read back as the same double,
+    // and make the choice between %f and %e notation as if the precision was
+    // 17, which is enough for any double.
+    binary64 b = decompose(value);
+    if(b.ieee_exponent == 0x7ff)
+        return write_special(pbuffer, b, cs);
+
+    char buffer[DIGIT_BUFFER_SIZE];
+    decimal_digits d = {buffer, 0, 0};
+    unsigned p;
+    bool pad = false;
+    if(cs.precision == UNSPECIFIED_PRECISION) {
+        p = 17;
+        if(b.significand != 0) {
+            std::uint64_t digits;
+            int exponent;
+            binary64_to_shortest_decimal(b, &digits, &exponent);
+            d.count = write_digits(buffer, digits);
+            d.exponent = exponent + static_cast<int>(d.count) - 1;
         }
+        strip_trailing_zeroes(&d);
+    } else {
+        p = cs.precision == 0? 1 : cs.precision;
+        if(b.significand != 0)
+            round_to_significant_digits(b, p, &d);
+        if(cs.alternative_form)
+            pad = true;
+        else
+            strip_trailing_zeroes(&d);
+    }
+
+    int exponent = d.count == 0? 0 : d.exponent;
+    unsigned count = d.count == 0? 1 : d.count;
+    if(exponent >= -4 && exponent < static_cast<int>(p)) {
+        int precision = pad? static_cast<int>(p) - 1 - exponent
+            : static_cast<int>(count) - 1 - exponent;
+        write_fixed(pbuffer, b.sign, d, unsigned_cast(std::max(0, precision)),
+            cs);
+    } else {
+        unsigned precision = pad? p - 1 : count - 1;
+        write_exponential(pbuffer, b.sign, d, precision, cs);
     }
 }
 
@@ -1116,6 +2340,9 @@ void ftoa_base10_g(output_buffer* pbuffer, double value, conversion_specificatio
 #include "unit_test.hpp"
 
 #include <string>
+#include <cmath>    // isfinite, nextafter, nan
+#include <cstdio>   // sprintf
+#include <cstdlib>  // strtod
 #include <sstream>  // istringstream, ostringstream
 #include <iomanip>  // iomanip
 #include <random>
@@ -1126,7 +2353,14 @@ namespace detail {
 class whitebox_output_buffer : public output_buffer {
 public:
     using output_buffer::output_buffer;
-    using output_buffer::flush;
+
+    // output_buffer::flush() only writes complete frames, and there are no
+    // frames here.
+    void flush()
+    {
+        frame_end();
+        output_buffer::flush();
+    }
 };
 
 class log10_suite {
@@ -1166,6 +2400,87 @@ unit_test::suite<log10_suite> log10_tests = {
     TESTCASE(log10_suite::uint64),
 };
 
+// The SIMD conversions must agree with the scalar ones everywhere, including
+// where the number of digits changes and where the 8- and 16-digit chunks
+// are split.
+class simd_suite {
+public:
+    void base10()
+    {
+        std::uint64_t v = 1;
+        for(unsigned i=0; i!=20; ++i) {
+            test_base10(v-1);
+            test_base10(v);
+            test_base10(v+1);
+            v *= 10;
+        }
+        test_base10(~std::uint64_t(0));
+        test_base10(std::numeric_limits<std::uint32_t>::max());
+        for(std::uint32_t i=0; i!=100000; ++i)
+            test_base10(i);
+
+        std::mt19937_64 rng;
+        for(unsigned i=0; i!=1000000; ++i)
+            test_base10(rng() >> (rng() % 64));
+    }
+
+    void base16()
+    {
+        for(unsigned i=0; i!=64; ++i) {
+            std::uint64_t v = std::uint64_t(1) << i;
+            test_base16(v-1);
+            test_base16(v);
+        }
+        test_base16(~std::uint64_t(0));
+        test_base16(0x0123456789abcdef);
+        test_base16(0xfedcba9876543210);
+
+        std::mt19937_64 rng;
+        for(unsigned i=0; i!=1000000; ++i)
+            test_base16(rng() >> (rng() % 64));
+    }
+
+private:
+    static std::string digits(digit_string const& str, unsigned count)
+    {
+        return std::string(str + DIGIT_STRING_SIZE - count, count);
+    }
+
+    void test_base10(std::uint64_t value)
+    {
+        digit_string str;
+        std::string expected = digits(str, utoa_base10_scalar(str, value));
+        std::string expected32;
+        if(value <= std::numeric_limits<std::uint32_t>::max()) {
+            auto value32 = static_cast<std::uint32_t>(value);
+            expected32 = digits(str, utoa_base10_scalar(str, value32));
+            TEST(expected32 == expected);
+        }
+        TEST(digits(str, utoa_base10(str, value)) == expected);
+#if defined(RECKLESS_NTOA_SIMD)
+        TEST(digits(str, utoa_base10_sse2(str, value)) == expected);
+#endif
+    }
+
+    void test_base16(std::uint64_t value)
+    {
+        digit_string str;
+        std::string lower = digits(str, utoa_base16_scalar<false>(str, value));
+        std::string upper = digits(str, utoa_base16_scalar<true>(str, value));
+        TEST(digits(str, utoa_base16<false>(str, value)) == lower);
+        TEST(digits(str, utoa_base16<true>(str, value)) == upper);
+#if defined(RECKLESS_NTOA_SIMD)
+        TEST(digits(str, utoa_base16_sse2<false>(str, value)) == lower);
+        TEST(digits(str, utoa_base16_sse2<true>(str, value)) == upper);
+#endif
+    }
+};
+
+unit_test::suite<simd_suite> simd_tests = {
+    TESTCASE(simd_suite::base10),
+    TESTCASE(simd_suite::base16),
+};
+
 class string_writer : public writer {
 public:
     std::size_t write(void const* pbuffer, std::size_t count, std::error_code& ec) noexcept override
@@ -1618,28 +2933,35 @@ public:
         TEST(convert(1.5, 2) == "1.50");
         TEST(convert(1.234567890, 4) == "1.2346");
         TEST(convert(1.2345678901234567, 16) == "1.2345678901234567");
-        TEST(convert(1.2345678901234567, 17) == "1.23456789012345670");
-        TEST(convert(1.2345678901234567, 25) == "1.2345678901234567000000000");
-        TEST(convert(1.7976931348623157e308, 3) == "179769313486231563000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000.000");
+        TEST(convert(1.2345678901234567, 17) == "1.23456789012345669");
+        TEST(convert(1.2345678901234567, 25) == "1.2345678901234566904321355");
+        TEST(convert(1.7976931348623157e308, 3) == "179769313486231570814527423731704356798070567525844996598917476803157260780028538760589558632766878171540458953514382464234321326889464182768467546703537516986049910576551282076245490090389328944075868508455133942304583236903222948165808559332123348274797826204144723168738177180919299881250404026184124858368.000");
         TEST(convert(1234.5678, 0) == "1235");
         TEST(convert(1234.5678, 1) == "1234.6");
 
         TEST(convert(0.3, 1) == "0.3");
         TEST(convert(0.3, 2) == "0.30");
-        TEST(convert(0.3, 20) == "0.29999999999999999000");
+        TEST(convert(0.3, 20) == "0.29999999999999998890");
 
         TEST(convert(1.2345e20, 5) == "123450000000000000000.00000");
         TEST(convert(1.2345e20, 0) == "123450000000000000000");
         TEST(convert(1.2345e2, 5) == "123.45000");
         TEST(convert(1.2345e-20, 5) == "0.00000");
-        TEST(convert(0.5, 0) == "1");
+        // Ties are rounded to even, like stdio does.
+        TEST(convert(0.5, 0) == "0");
+        TEST(convert(1.5, 0) == "2");
+        TEST(convert(2.5, 0) == "2");
         TEST(convert(0.05, 1) == "0.1");
         TEST(convert(9.9, 0) == "10");
         TEST(convert(0, 0) == "0");
-        TEST(convert(1.23456789012345670, 20) == "1.23456789012345670000");
-        TEST(convert(0.123456789012345670, 20) == "0.12345678901234566300");
+        TEST(convert(1.23456789012345670, 20) == "1.23456789012345669043");
+        TEST(convert(0.123456789012345670, 20) == "0.12345678901234566349");
 
         TEST(convert(0.000123, 6) == "0.000123");
+        // 2.675 is really 2.67499999999999982236431605997495353221893310546875.
+        TEST(convert(2.675, 2) == "2.67");
+        TEST(convert(1e-320, 3) == "0.000");
+        TEST(convert(-1e-320, 3) == "-0.000");
     }
 
     void padding()
@@ -1698,6 +3020,83 @@ unit_test::suite<ftoa_base10_f> ftoa_base10_precision_tests = {
     TESTCASE(ftoa_base10_f::padding),
 };
 
+class ftoa_base10_e
+{
+public:
+    ftoa_base10_e() :
+        output_buffer_(&writer_, 1024)
+    {
+    }
+
+    void normal()
+    {
+        TEST(convert(1.5, 2) == "1.50e+00");
+        TEST(convert(1234.5678, 0) == "1e+03");
+        TEST(convert(1234.5678, 3) == "1.235e+03");
+        TEST(convert(9.9999, 2) == "1.00e+01");
+        TEST(convert(0.3, 20) == "2.99999999999999988898e-01");
+        TEST(convert(0.0, 3) == "0.000e+00");
+        TEST(convert(-0.0, 0) == "-0e+00");
+        TEST(convert(1e100, 1) == "1.0e+100");
+        TEST(convert(1.7976931348623157e308, 5) == "1.79769e+308");
+        TEST(convert(4.9406564584124654e-324, 30) ==
+            "4.940656458412465441765687928682e-324");
+        // 2.5e-5 is really 2.50000000000000011...e-5, but 0.125 and 0.375
+        // are exact ties.
+        TEST(convert(2.5e-5, 0) == "3e-05");
+        TEST(convert(0.125, 1) == "1.2e-01");
+        TEST(convert(0.375, 1) == "3.8e-01");
+    }
+
+    void flags()
+    {
+        conversion_specification cs;
+        cs.minimum_field_width = 12;
+        cs.precision = 2;
+        cs.left_justify = false;
+        cs.alternative_form = false;
+        cs.pad_with_zeroes = true;
+        cs.plus_sign = '+';
+        cs.uppercase = true;
+
+        TEST(convert(12345.0, cs) == "+0001.23E+04");
+        TEST(convert(-12345.0, cs) == "-0001.23E+04");
+        cs.pad_with_zeroes = false;
+        TEST(convert(12345.0, cs) == "   +1.23E+04");
+        cs.left_justify = true;
+        cs.plus_sign = ' ';
+        TEST(convert(12345.0, cs) == " 1.23E+04   ");
+        cs.precision = 0;
+        cs.alternative_form = true;
+        TEST(convert(12345.0, cs) == " 1.E+04     ");
+        TEST(convert(std::numeric_limits<double>::infinity(), cs) == " INF        ");
+    }
+
+private:
+    std::string convert(double number, conversion_specification const& cs)
+    {
+        writer_.reset();
+        reckless::ftoa_base10_e(&output_buffer_, number, cs);
+        output_buffer_.flush();
+        return writer_.str();
+    }
+
+    std::string convert(double number, unsigned precision)
+    {
+        conversion_specification cs;
+        cs.precision = precision;
+        return convert(number, cs);
+    }
+
+    string_writer writer_;
+    whitebox_output_buffer output_buffer_;
+};
+
+unit_test::suite<ftoa_base10_e> ftoa_base10_e_tests = {
+    TESTCASE(ftoa_base10_e::normal),
+    TESTCASE(ftoa_base10_e::flags),
+};
+
 #define TEST_FTOA(number) test_conversion_quality(number, __FILE__, __LINE__)
 
 class ftoa_base10_g
@@ -1733,8 +3132,7 @@ public:
         TEST_FTOA(0.123456);
         TEST_FTOA(0.00000123456);
         TEST_FTOA(0.00000000000000000123456);
-        // TODO below test works but doesn't give perfect output. Can we fix?
-        //TEST_FTOA(0.0000000000000000012345678901234567890);
+        TEST_FTOA(0.0000000000000000012345678901234567890);
         TEST_FTOA(-0.0);
         TEST_FTOA(-0.1);
     }
@@ -1866,6 +3264,50 @@ public:
         for(std::size_t i=0; i!=superfluous_counts.size(); ++i)
             std::cout << "    " << i << ": " << superfluous_counts[i] <<
                 " (" << 100*static_cast<double>(superfluous_counts[i])/total << "%)\n";
+        TEST(perfect == total);
+    }
+
+    void shortest()
+    {
+        TEST(convert_shortest(0.0) == "0");
+        TEST(convert_shortest(-0.0) == "-0");
+        TEST(convert_shortest(0.1) == "0.1");
+        TEST(convert_shortest(0.3) == "0.3");
+        TEST(convert_shortest(2.675) == "2.675");
+        TEST(convert_shortest(123.456) == "123.456");
+        TEST(convert_shortest(-123.456) == "-123.456");
+        TEST(convert_shortest(100) == "100");
+        TEST(convert_shortest(0.0001) == "0.0001");
+        TEST(convert_shortest(0.00001) == "1e-05");
+        TEST(convert_shortest(1e16) == "10000000000000000");
+        TEST(convert_shortest(1e17) == "1e+17");
+        TEST(convert_shortest(1e23) == "1e+23");
+        TEST(convert_shortest(1.7976931348623157e308) == "1.7976931348623157e+308");
+        TEST(convert_shortest(4.9406564584124654e-324) == "5e-324");
+        TEST(convert_shortest(2.2250738585072014e-308) == "2.2250738585072014e-308");
+
+        // The result must read back as the same value, and it must not be
+        // possible with fewer digits. If there is any shorter decimal that
+        // reads back the same then the correctly rounded one (which is what
+        // printf gives us) does too.
+        std::mt19937_64 rng;
+        for(int i=0; i!=1000000; ++i) {
+            std::uint64_t bits = rng();
+            double v;
+            std::memcpy(&v, &bits, sizeof(v));
+            if(!std::isfinite(v))
+                continue;
+            std::string const str = convert_shortest(v);
+            TEST(std::strtod(str.c_str(), nullptr) == v);
+            std::string mantissa = normalize_for_comparison(
+                str[0] == '-'? str.substr(1) : str).first;
+            mantissa.erase(mantissa.find_last_not_of('0') + 1);
+            if(mantissa.size() > 1) {
+                char buf[32];
+                std::sprintf(buf, "%.*g", static_cast<int>(mantissa.size() - 1), v);
+                TEST(std::strtod(buf, nullptr) != v);
+            }
+        }
     }
 
 private:
@@ -1965,6 +3407,12 @@ private:
         return str;
     }
 
+    std::string convert_shortest(double number)
+    {
+        conversion_specification cs;
+        return convert(number, cs);
+    }
+
     void test_conversion_quality(double number, char const* file, int line)
     {
         if(get_conversion_quality(number) != PERFECT_QUALITY)
@@ -1987,6 +3435,7 @@ unit_test::suite<ftoa_base10_g> ftoa_base10_tests = {
     TESTCASE(ftoa_base10_g::special),
     TESTCASE(ftoa_base10_g::scientific),
     TESTCASE(ftoa_base10_g::padding),
+    TESTCASE(ftoa_base10_g::shortest),
     TESTCASE(ftoa_base10_g::random)
 };
 
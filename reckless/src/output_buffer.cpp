@@ -22,9 +22,9 @@
 #include <reckless/output_buffer.hpp>
 #include <reckless/writer.hpp>
 #include <reckless/detail/platform.hpp> // atomic_store_release
+#include <reckless/detail/mpsc_ring_buffer.hpp> // map_ring_memory
 #include <performance_log/trace_log.hpp>
 
-#include <cstdlib>      // malloc, free
 #include <cassert>
 #include <algorithm>    // max, min
 
@@ -70,6 +70,7 @@ char const* flush_error::what() const noexcept
 }
 
 using detail::likely;
+using detail::unlikely;
 
 output_buffer::output_buffer()
 {
@@ -82,8 +83,9 @@ output_buffer::output_buffer(writer* pwriter, std::size_t max_capacity)
 
 void output_buffer::reset() noexcept
 {
-    std::free(pbuffer_);
+    release();
     pwriter_ = nullptr;
+    pring_ = nullptr;
     pbuffer_ = nullptr;
     pcommit_end_ = nullptr;
     pbuffer_end_ = nullptr;
@@ -93,50 +95,157 @@ void output_buffer::reset() noexcept
 void output_buffer::reset(writer* pwriter, std::size_t max_capacity)
 {
     using namespace detail;
-    auto pbuffer = static_cast<char*>(std::malloc(max_capacity));
-    if(!pbuffer)
-        throw std::bad_alloc();
-    std::free(pbuffer_);
-    pbuffer_ = pbuffer;
+    auto capacity = round_ring_capacity(std::max(max_capacity,
+        static_cast<std::size_t>(1)));
+    char* pring = map_ring_memory(capacity);
+    release();
+    pring_ = pring;
+    pbuffer_ = pring;
 
     pwriter_ = pwriter;
     pframe_end_ = pbuffer_;
     pcommit_end_ = pbuffer_;
-    pbuffer_end_ = pbuffer_ + max_capacity;
+    pbuffer_end_ = pbuffer_ + capacity;
 }
 
 output_buffer::~output_buffer()
 {
-    std::free(pbuffer_);
+    release();
 }
 
-// FIXME I think this code is wrong. Review and check it against the invariants
-// regarding error state etc.
-void output_buffer::write(void const* buf, std::size_t count)
+void output_buffer::release() noexcept
 {
-    // TODO this could be smarter by writing from the client-provided
-    // buffer instead of copying the data.
-    auto const buffer_size = pbuffer_end_ - pbuffer_;
+    if(pring_)
+        detail::unmap_ring_memory(pring_, pbuffer_end_ - pbuffer_);
+}
 
+// The buffer memory is mapped twice in a row, so instead of moving unwritten
+// data to the front of the buffer after a partial write we can just slide
+// the window [pbuffer_, pbuffer_end_) forward past the data that was written.
+// Whatever remains stays contiguous. Once the window has moved entirely into
+// the second mapping we move it back by the capacity, which refers to the
+// same memory.
+void output_buffer::discard(std::size_t count)
+{
+    std::size_t capacity = pbuffer_end_ - pbuffer_;
+    pbuffer_ += count;
+    pbuffer_end_ += count;
+    if(pframe_end_ < pbuffer_)
+        pframe_end_ = pbuffer_;
+    if(pbuffer_ >= pring_ + capacity) {
+        pbuffer_ -= capacity;
+        pframe_end_ -= capacity;
+        pcommit_end_ -= capacity;
+        pbuffer_end_ -= capacity;
+    }
+}
+
+void output_buffer::write_slow_path(void const* buf, std::size_t count)
+{
     char const* pinput = static_cast<char const*>(buf);
-    auto remaining_input = count;
-    auto available_buffer = static_cast<std::size_t>(pbuffer_end_ - pcommit_end_);
-    while(true) {
-        if(likely(remaining_input <= available_buffer))
-            break;
-        std::memcpy(pcommit_end_, pinput, available_buffer);
-        pinput += available_buffer;
-        remaining_input -= available_buffer;
-        available_buffer = buffer_size;
-        pcommit_end_ = pbuffer_end_;
-        RECKLESS_TRACE(output_buffer_full_event);
+    // The payload can only bypass the buffer if it is the first output of
+    // the current frame. Otherwise the part of the frame that was committed
+    // before it would have to be written too, and flush() must never write
+    // a partial frame.
+    if(count >= zero_copy_threshold_ && pcommit_end_ == pframe_end_) {
+        // If there are lost frames waiting to be reported then we let
+        // flush() sort things out first, so the writer error callback gets
+        // to put its notice in the output before this frame does.
+        if(unlikely(lost_input_frames_ != 0))
+            flush();
+        write_external(pinput, count);
+        return;
+    }
+
+    // Copy the data, flushing complete frames whenever the buffer runs full.
+    // The entire frame has to fit in the buffer for that to work, since
+    // flush() never writes a partial frame.
+    std::size_t frame_size = (pcommit_end_ - pframe_end_) + count;
+    std::size_t buffer_size = pbuffer_end_ - pbuffer_;
+    if(likely(frame_size <= buffer_size)) {
+    } else {
+        throw excessive_output_by_frame();
+    }
 
+    std::size_t available = pbuffer_end_ - pcommit_end_;
+    if(count > available) {
+        RECKLESS_TRACE(output_buffer_full_event);
         increment_output_buffer_full_count();
         flush();
     }
+    std::memcpy(pcommit_end_, pinput, count);
+    pcommit_end_ += count;
+}
+
+// Write the complete frames in the buffer followed by the caller's data in a
+// single writev(), without copying the caller's data first. The current frame
+// must not have any output in the buffer yet. The payload becomes the start
+// of the frame's output in the file, so if the formatter fails after this
+// point the record will be truncated rather than missing entirely.
+void output_buffer::write_external(char const* pinput, std::size_t count)
+{
+    using namespace reckless::detail;
+    assert(pcommit_end_ == pframe_end_);
+    RECKLESS_TRACE(flush_output_buffer_start_event);
+
+    unsigned block_time_ms = 0;
+    while(true) {
+        std::size_t complete = pframe_end_ - pbuffer_;
+        atomic_store_relaxed(&output_buffer_high_watermark_,
+            std::max(output_buffer_high_watermark_, complete));
+
+        write_segment segments[2] = {{pbuffer_, complete}, {pinput, count}};
+        std::error_code error;
+        std::size_t written;
+        try {
+            written = pwriter_->writev(segments, 2, error);
+        } catch(...) {
+            // See flush().
+            error.assign(writer::permanent_failure, writer::error_category());
+            written = 0;
+        }
+
+        if(likely(!error)) {
+            assert(written == complete + count);
+            pbuffer_end_ -= pbuffer_ - pring_;
+            pbuffer_ = pring_;
+            pframe_end_ = pring_;
+            pcommit_end_ = pring_;
+            error_code_.clear();
+            atomic_store_release(&error_flag_, false);
+            RECKLESS_TRACE(flush_output_buffer_finish_event);
+            return;
+        }
 
-    std::memcpy(pcommit_end_, pinput, remaining_input);
-    pcommit_end_ += remaining_input;
+        assert(written <= complete + count);
+        if(written <= complete) {
+            // None of the payload was written, so the frame can still be
+            // reverted if the error policy says so. Otherwise we try again.
+            discard(written);
+            handle_flush_error(error, &block_time_ms);
+            continue;
+        }
+
+        // Some of the payload made it to the writer. Reverting the frame is
+        // no longer possible, so the best we can do is to treat the rest of
+        // the payload as complete output and have flush() push it out before
+        // anything else.
+        discard(complete);
+        pinput += written - complete;
+        count -= written - complete;
+        while(true) {
+            std::size_t n = std::min(count,
+                static_cast<std::size_t>(pbuffer_end_ - pcommit_end_));
+            std::memcpy(pcommit_end_, pinput, n);
+            pcommit_end_ += n;
+            pinput += n;
+            count -= n;
+            frame_end();
+            flush();
+            if(count == 0)
+                return;
+        }
+    }
 }
 
 void output_buffer::flush()
@@ -191,17 +300,20 @@ void output_buffer::flush()
         else
             assert(written <= remaining);   // A failing writer may write no data, some data, or all data (but no more than that).
 
-        // Discard the data that was written, preserve data that remains. We could
-        // avoid this copy by using a circular buffer, but in practice it should be
-        // rare to have any data remaining in the buffer. It only happens if the
-        // buffer fills up entirely (forcing us to flush in the middle of a frame)
-        // or if there is an error in the writer.
-        // TODO On the other hand when the buffer does fill up, that's when we are under
-        // the highest load. Shouldn't we perform as efficiently as possible then?
-        std::size_t remaining_data = (pcommit_end_ - pbuffer_) - written;
-        std::memmove(pbuffer_, pbuffer_+written, remaining_data);
-        pframe_end_ -= written;
-        pcommit_end_ -= written;
+        // Discard the data that was written, preserve data that remains.
+        // There is usually nothing left, but when the buffer fills up in the
+        // middle of a frame, or the writer fails, there is. That tends to
+        // happen under the highest load, so we don't want to spend time
+        // moving the remaining data around; discard() only moves pointers.
+        if(likely(pcommit_end_ - pbuffer_ == static_cast<std::ptrdiff_t>(written))) {
+            pbuffer_end_ -= pbuffer_ - pring_;
+            pbuffer_ = pring_;
+            pframe_end_ = pring_;
+            pcommit_end_ = pring_;
+        } else {
+            discard(written);
+        }
+        remaining -= written;
 
         if(likely(!error)) {
             error_code_.clear();
@@ -245,58 +357,67 @@ void output_buffer::flush()
                 remaining = pframe_end_ - pbuffer_; // Update byte-remaining count.
             }
         } else {
-            error_policy ep;
-            if(error == writer::temporary_failure)
-                ep = temporary_error_policy_.load(std::memory_order_relaxed);
-            else
-                ep = permanent_error_policy_.load(std::memory_order_relaxed);
-
-            switch(ep) {
-            case error_policy::ignore:
-                throw flush_error(error);
-            case error_policy::notify_on_recovery:
-                // We will notify the client about this once the writer
-                // starts working again.
-                if(!initial_error_)
-                    initial_error_ = error;
-                throw flush_error(error);
-            case error_policy::block:
-                // To give the client the appearance of blocking, we need to
-                // poll the writer, i.e. check periodically whether writing is
-                // now working, until it starts working again. We don't remove
-                // anything from the input queue while this happens, hence any
-                // client threads that are writing log events will start
-                // blocking once the input queue fills up. We use
-                // shared_input_queue_full_event_ for an exponentially
-                // increasing wait time between polls. That way we can check
-                // the panic-flush flag early, which will be set in case the
-                // program crashes.
-                //
-                // If the program crashes while the writer is failing (not an
-                // unlikely scenario since circumstances are already ominous),
-                // then we have a dilemma. We could keep on blocking, but then
-                // we are withholding a crashing program from generating a core
-                // dump until the writer starts working. Or we could just throw
-                // the input queue away and pretend we're done with the panic
-                // flush, so the program can die in peace. But then we will
-                // lose log data that might be vital to determining the cause
-                // of the crash. I've chosen the latter option, because I think
-                // it's not likely that the log data will ever make it past the
-                // writer anyway, even if we do keep on blocking.
-                shared_input_queue_full_event_.wait(block_time_ms);
-                if(atomic_load_relaxed(&panic_flush_))
-                    throw flush_error(error);
-                block_time_ms += std::max(1u, block_time_ms/4);
-                block_time_ms = std::min(block_time_ms, 1000u);
-                break;
-            case error_policy::fail_immediately:
-                if(!error_flag_) {
-                    error_code_ = error;
-                    atomic_store_release(&error_flag_, true);
-                }
-                throw flush_error(error);
-            }
+            handle_flush_error(error, &block_time_ms);
+        }
+    }
+}
+
+// Apply the error policy for a failed write. Returns if the write should be
+// tried again, otherwise throws flush_error.
+void output_buffer::handle_flush_error(std::error_code const& error,
+    unsigned* pblock_time_ms)
+{
+    using namespace reckless::detail;
+    error_policy ep;
+    if(error == writer::temporary_failure)
+        ep = temporary_error_policy_.load(std::memory_order_relaxed);
+    else
+        ep = permanent_error_policy_.load(std::memory_order_relaxed);
+
+    switch(ep) {
+    case error_policy::ignore:
+        throw flush_error(error);
+    case error_policy::notify_on_recovery:
+        // We will notify the client about this once the writer
+        // starts working again.
+        if(!initial_error_)
+            initial_error_ = error;
+        throw flush_error(error);
+    case error_policy::block:
+        // To give the client the appearance of blocking, we need to
+        // poll the writer, i.e. check periodically whether writing is
+        // now working, until it starts working again. We don't remove
+        // anything from the input queue while this happens, hence any
+        // client threads that are writing log events will start
+        // blocking once the input queue fills up. We use
+        // shared_input_queue_full_event_ for an exponentially
+        // increasing wait time between polls. That way we can check
+        // the panic-flush flag early, which will be set in case the
+        // program crashes.
+        //
+        // If the program crashes while the writer is failing (not an
+        // unlikely scenario since circumstances are already ominous),
+        // then we have a dilemma. We could keep on blocking, but then
+        // we are withholding a crashing program from generating a core
+        // dump until the writer starts working. Or we could just throw
+        // the input queue away and pretend we're done with the panic
+        // flush, so the program can die in peace. But then we will
+        // lose log data that might be vital to determining the cause
+        // of the crash. I've chosen the latter option, because I think
+        // it's not likely that the log data will ever make it past the
+        // writer anyway, even if we do keep on blocking.
+        shared_input_queue_full_event_.wait(*pblock_time_ms);
+        if(atomic_load_relaxed(&panic_flush_))
+            throw flush_error(error);
+        *pblock_time_ms += std::max(1u, *pblock_time_ms/4);
+        *pblock_time_ms = std::min(*pblock_time_ms, 1000u);
+        return;
+    case error_policy::fail_immediately:
+        if(!error_flag_) {
+            error_code_ = error;
+            atomic_store_release(&error_flag_, true);
         }
+        throw flush_error(error);
     }
 }
 
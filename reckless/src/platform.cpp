@@ -23,13 +23,27 @@
 
 #if defined(__unix__)
 #include <pthread.h>    // pthread_setname_np, pthread_self
+#include <sched.h>      // sched_param, SCHED_FIFO
 #endif
 #if defined(__linux__)
-#include <unistd.h> // sysconf
+#include <unistd.h> // sysconf, syscall
+#include <sys/syscall.h>    // SYS_gettid, SYS_get_mempolicy, SYS_set_mempolicy
+#include <sys/resource.h>   // setpriority
+#include <dirent.h>     // opendir, readdir
+#include <cerrno>
+#include <cstdio>       // snprintf
+#include <cstdlib>      // atoi
+#include <cstring>      // strncmp, memset
 #endif
 #if defined(_WIN32)
 #include <Windows.h>    // GetSystemInfo
 #endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>      // __get_cpuid_max, __cpuid_count
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>     // __cpuid, __cpuidex
+#endif
 
 namespace reckless {
 namespace detail {
@@ -48,6 +62,29 @@ unsigned get_page_size()
 #endif
 }
 
+bool cpuid(std::uint32_t leaf, std::uint32_t subleaf, std::uint32_t registers[4])
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if(__get_cpuid_max(leaf & 0x80000000, nullptr) < leaf)
+        return false;
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2],
+        registers[3]);
+    return true;
+#elif defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, static_cast<int>(leaf & 0x80000000));
+    if(static_cast<std::uint32_t>(r[0]) < leaf)
+        return false;
+    __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for(int i=0; i!=4; ++i)
+        registers[i] = static_cast<std::uint32_t>(r[i]);
+    return true;
+#else
+    (void)leaf; (void)subleaf; (void)registers;
+    return false;
+#endif
+}
+
 void set_thread_name(char const* name)
 {
 #if defined(__unix__)
@@ -85,5 +122,140 @@ void set_thread_name(char const* name)
 
 unsigned const page_size = get_page_size();
 
+int set_thread_affinity(unsigned const* cpus, std::size_t count)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(std::size_t i=0; i!=count; ++i) {
+        if(cpus[i] >= CPU_SETSIZE)
+            return EINVAL;
+        CPU_SET(cpus[i], &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for(std::size_t i=0; i!=count; ++i) {
+        if(cpus[i] >= 8*sizeof(mask))
+            return ERROR_INVALID_PARAMETER;
+        mask |= static_cast<DWORD_PTR>(1) << cpus[i];
+    }
+    if(!SetThreadAffinityMask(GetCurrentThread(), mask))
+        return static_cast<int>(GetLastError());
+    return 0;
+#else
+    static_assert(false, "set_thread_affinity() is not implemented for this OS");
+#endif
+}
+
+int set_thread_priority(int realtime_priority, int nice)
+{
+#if defined(__linux__)
+    if(realtime_priority != 0) {
+        sched_param param = {};
+        param.sched_priority = realtime_priority;
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+    // Linux applies the nice value to a single thread if we give it the
+    // thread ID rather than the process ID.
+    auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    if(setpriority(PRIO_PROCESS, tid, nice) != 0)
+        return errno;
+    return 0;
+#elif defined(_WIN32)
+    int priority;
+    if(realtime_priority != 0)
+        priority = THREAD_PRIORITY_TIME_CRITICAL;
+    else if(nice <= -10)
+        priority = THREAD_PRIORITY_HIGHEST;
+    else if(nice < 0)
+        priority = THREAD_PRIORITY_ABOVE_NORMAL;
+    else if(nice == 0)
+        priority = THREAD_PRIORITY_NORMAL;
+    else if(nice < 10)
+        priority = THREAD_PRIORITY_BELOW_NORMAL;
+    else
+        priority = THREAD_PRIORITY_LOWEST;
+    if(!SetThreadPriority(GetCurrentThread(), priority))
+        return static_cast<int>(GetLastError());
+    return 0;
+#else
+    static_assert(false, "set_thread_priority() is not implemented for this OS");
+#endif
+}
+
+int numa_node_of_cpu(unsigned cpu)
+{
+#if defined(__linux__)
+    // The CPU's directory in sysfs has a link named after its node.
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
+    DIR* dir = opendir(path);
+    if(!dir)
+        return -1;
+    int node = -1;
+    while(dirent* entry = readdir(dir)) {
+        if(std::strncmp(entry->d_name, "node", 4) == 0
+            && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        {
+            node = std::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+#elif defined(_WIN32)
+    if(cpu > 0xff)
+        return -1;
+    UCHAR node;
+    if(!GetNumaProcessorNode(static_cast<UCHAR>(cpu), &node) || node == 0xff)
+        return -1;
+    return node;
+#else
+    static_assert(false, "numa_node_of_cpu() is not implemented for this OS");
+#endif
+}
+
+#if defined(__linux__)
+namespace {
+// From linux/mempolicy.h, which we don't want to depend on.
+int const MPOL_DEFAULT = 0;
+int const MPOL_PREFERRED = 1;
+}
+#endif
+
+scoped_numa_preference::scoped_numa_preference(int node) :
+    active_(false),
+    previous_mode_(0)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy) && defined(SYS_get_mempolicy)
+    std::size_t const bits = 8*sizeof(unsigned long);
+    if(node < 0 || static_cast<std::size_t>(node) >= max_nodes)
+        return;
+    std::memset(previous_nodes_, 0, sizeof(previous_nodes_));
+    if(syscall(SYS_get_mempolicy, &previous_mode_, previous_nodes_,
+            max_nodes, nullptr, 0) != 0)
+        return;
+    unsigned long nodes[max_nodes/bits] = {};
+    nodes[node/bits] = 1ul << (node % bits);
+    active_ = syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodes,
+        max_nodes) == 0;
+#else
+    (void)node;
+#endif
+}
+
+scoped_numa_preference::~scoped_numa_preference()
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy) && defined(SYS_get_mempolicy)
+    if(!active_)
+        return;
+    if(previous_mode_ == MPOL_DEFAULT)
+        syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+    else
+        syscall(SYS_set_mempolicy, previous_mode_, previous_nodes_, max_nodes);
+#endif
+}
+
 }   // detail
 }   // reckless
@@ -0,0 +1,300 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#if defined(__unix__)
+#include <reckless/rotating_file_writer.hpp>
+
+#include <cerrno>
+#include <ctime>        // gmtime_r, strftime
+
+#include <fcntl.h>      // open
+#include <spawn.h>      // posix_spawnp
+#include <sys/stat.h>   // fstat, stat
+#include <sys/wait.h>   // waitpid
+#include <unistd.h>     // close, unlink
+
+extern char** environ;
+
+namespace {
+int open_file(char const* path, int flags)
+{
+    auto full_access =
+        S_IRUSR | S_IWUSR |
+        S_IRGRP | S_IWGRP |
+        S_IROTH | S_IWOTH;
+    return open(path, O_WRONLY | O_CREAT | O_APPEND | flags, full_access);
+}
+
+int open_active_file(char const* path)
+{
+    int fd = open_file(path, 0);
+    if(fd == -1)
+        throw std::system_error(errno, std::system_category());
+    return fd;
+}
+
+void close_file(int fd)
+{
+    while(-1 == close(fd)) {
+        if(errno != EINTR)
+            break;
+    }
+}
+
+bool file_exists(std::string const& path)
+{
+    struct stat st;
+    return 0 == stat(path.c_str(), &st);
+}
+
+std::string archive_path(std::string const& path,
+        std::chrono::system_clock::time_point time)
+{
+    std::time_t t = std::chrono::system_clock::to_time_t(time);
+    std::tm tm;
+    gmtime_r(&t, &tm);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", &tm);
+    std::string result = path + '.' + timestamp;
+    std::string candidate = result;
+    for(unsigned i=1; file_exists(candidate); ++i)
+        candidate = result + '.' + std::to_string(i);
+    return candidate;
+}
+
+std::error_code run_command(std::string const& command, std::string const& path)
+{
+    char* argv[] = {
+        const_cast<char*>(command.c_str()),
+        const_cast<char*>(path.c_str()),
+        nullptr
+    };
+    pid_t pid;
+    int error = posix_spawnp(&pid, command.c_str(), nullptr, nullptr, argv,
+        environ);
+    if(error != 0)
+        return std::error_code(error, std::system_category());
+    int status;
+    while(-1 == waitpid(pid, &status, 0)) {
+        if(errno != EINTR)
+            return std::error_code(errno, std::system_category());
+    }
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return std::make_error_code(std::errc::io_error);
+    return std::error_code();
+}
+}   // anonymous namespace
+
+namespace reckless {
+
+rotating_file_writer::rotating_file_writer(char const* path,
+        rotation_policy const& policy) :
+    fd_writer(open_active_file(path)),
+    path_(path),
+    next_path_(path_ + ".next"),
+    policy_(policy)
+{
+    struct stat st;
+    if(0 == fstat(fd_, &st))
+        size_ = static_cast<std::uint64_t>(st.st_size);
+    if(policy_.interval.count() != 0)
+        update_next_rotation_time(std::chrono::system_clock::now());
+
+    // The next file is opened with O_EXCL so we never truncate a file that
+    // is still in use, e.g. if renaming failed during the last rotation.
+    // Anything left over from a previous run that was not shut down properly
+    // has to go, though.
+    unlink(next_path_.c_str());
+    retired_files_.reserve(1);
+    thread_ = std::thread(&rotating_file_writer::background_thread, this);
+}
+
+rotating_file_writer::~rotating_file_writer()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        shutdown_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    close_file(fd_);
+}
+
+void rotating_file_writer::rotation_callback(rotation_callback_t callback)
+{
+    std::lock_guard<std::mutex> lk(callback_mutex_);
+    rotation_callback_ = std::move(callback);
+}
+
+std::size_t rotating_file_writer::write(void const* pbuffer, std::size_t count,
+        std::error_code& ec) noexcept
+{
+    rotate_if_due(count);
+    std::size_t written = fd_writer::write(pbuffer, count, ec);
+    size_ += written;
+    return written;
+}
+
+std::size_t rotating_file_writer::writev(write_segment const* psegments,
+        std::size_t segment_count, std::error_code& ec) noexcept
+{
+    std::size_t count = 0;
+    for(std::size_t i=0; i!=segment_count; ++i)
+        count += psegments[i].count;
+    rotate_if_due(count);
+    std::size_t written = fd_writer::writev(psegments, segment_count, ec);
+    size_ += written;
+    return written;
+}
+
+// Rotates before writing count more bytes, if the policy says so.
+void rotating_file_writer::rotate_if_due(std::size_t count) noexcept
+{
+    if(policy_.interval.count() != 0) {
+        auto now = std::chrono::system_clock::now();
+        if(now >= next_rotation_time_) {
+            // No point in rotating out an empty file.
+            if(size_ == 0)
+                update_next_rotation_time(now);
+            else
+                rotate(now);
+        }
+    }
+    if(policy_.max_size != 0 && size_ != 0 && size_ + count > policy_.max_size)
+        rotate(std::chrono::system_clock::now());
+}
+
+void rotating_file_writer::rotate(std::chrono::system_clock::time_point now) noexcept
+{
+    // We don't want to wait for the background thread, so if it is busy or
+    // hasn't got the next file ready yet then we'll try again on the next
+    // write.
+    std::unique_lock<std::mutex> lk(mutex_, std::try_to_lock);
+    if(!lk.owns_lock() || next_fd_ == -1)
+        return;
+    retired_files_.push_back(retired_file{fd_, now});
+    fd_ = next_fd_;
+    next_fd_ = -1;
+    lk.unlock();
+    cv_.notify_one();
+
+    size_ = 0;
+    if(policy_.interval.count() != 0)
+        update_next_rotation_time(now);
+}
+
+void rotating_file_writer::update_next_rotation_time(
+    std::chrono::system_clock::time_point now)
+{
+    using namespace std::chrono;
+    auto interval = policy_.interval.count();
+    auto seconds = duration_cast<std::chrono::seconds>(
+        now.time_since_epoch()).count();
+    next_rotation_time_ = system_clock::time_point(
+        std::chrono::seconds((seconds/interval + 1)*interval));
+}
+
+void rotating_file_writer::background_thread()
+{
+    unsigned retry_delay_ms = 0;
+    std::unique_lock<std::mutex> lk(mutex_);
+    while(true) {
+        if(!retired_files_.empty()) {
+            retired_file file = retired_files_.front();
+            retired_files_.clear();
+            lk.unlock();
+            retire(file);
+            lk.lock();
+        } else if(shutdown_) {
+            break;
+        } else if(next_fd_ == -1) {
+            lk.unlock();
+            int fd = open_file(next_path_.c_str(), O_EXCL);
+            std::error_code ec;
+            if(fd == -1)
+                ec.assign(errno, std::system_category());
+            lk.lock();
+            if(fd != -1) {
+                next_fd_ = fd;
+                retry_delay_ms = 0;
+            } else {
+                lk.unlock();
+                notify(next_path_.c_str(), ec);
+                lk.lock();
+                // Back off, but don't stay away for too long; until we
+                // succeed there will be no rotation.
+                retry_delay_ms = std::min(std::max(2*retry_delay_ms, 10u),
+                    10000u);
+                cv_.wait_for(lk, std::chrono::milliseconds(retry_delay_ms),
+                    [this] { return shutdown_; });
+            }
+        } else {
+            cv_.wait(lk);
+        }
+    }
+
+    if(next_fd_ != -1) {
+        close_file(next_fd_);
+        unlink(next_path_.c_str());
+        next_fd_ = -1;
+    }
+}
+
+void rotating_file_writer::retire(retired_file const& file)
+{
+    close_file(file.fd);
+    std::string archive = archive_path(path_, file.time);
+    if(-1 == rename(path_.c_str(), archive.c_str())) {
+        // If we can't move the old file out of the way then we leave the new
+        // one where it is, rather than overwrite the old one. This blocks
+        // further rotation, since path.next can't be created while it
+        // exists, but no data is lost.
+        notify(path_.c_str(), std::error_code(errno, std::system_category()));
+        return;
+    }
+    if(-1 == rename(next_path_.c_str(), path_.c_str()))
+        notify(next_path_.c_str(), std::error_code(errno, std::system_category()));
+
+    std::error_code ec;
+    if(!policy_.compress_command.empty())
+        ec = run_command(policy_.compress_command, archive);
+    notify(archive.c_str(), ec);
+}
+
+void rotating_file_writer::notify(char const* path, std::error_code ec)
+{
+    rotation_callback_t callback;
+    {
+        std::lock_guard<std::mutex> lk(callback_mutex_);
+        callback = rotation_callback_;
+    }
+    if(callback) {
+        try {
+            callback(this, path, ec);
+        } catch(...) {
+            // It's an error for the callback to throw an exception.
+        }
+    }
+}
+
+}   // namespace reckless
+
+#endif  // __unix__
@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 #include <reckless/template_formatter.hpp>
+#include <reckless/basic_log.hpp>   // captured_string
 #include <reckless/ntoa.hpp>
 
 #include <cstdio>
@@ -129,10 +130,18 @@ namespace {
         conversion_specification cs;
         pformat = parse_conversion_specification(&cs, pformat);
         char f = *pformat;
-        if(f != 'f')
+        if(f == 'f' || f == 'F') {
+            cs.uppercase = f == 'F';
+            ftoa_base10_f(pbuffer, static_cast<double>(v), cs);
+        } else if(f == 'e' || f == 'E') {
+            cs.uppercase = f == 'E';
+            ftoa_base10_e(pbuffer, static_cast<double>(v), cs);
+        } else if(f == 'g' || f == 'G') {
+            cs.uppercase = f == 'G';
+            ftoa_base10_g(pbuffer, static_cast<double>(v), cs);
+        } else {
             return nullptr;
-        
-        ftoa_base10_f(pbuffer, static_cast<double>(v), cs);
+        }
         return pformat + 1;
     }
 
@@ -230,10 +239,7 @@ char const* format(output_buffer* pbuffer, char const* pformat, char const* v)
 {
     char c = *pformat;
     if(c =='s') {
-        auto len = std::strlen(v);
-        char* p = pbuffer->reserve(len);
-        std::memcpy(p, v, len);
-        pbuffer->commit(len);
+        pbuffer->write(v, std::strlen(v));
     } else if(c == 'p') {
         conversion_specification cs;
         cs.minimum_field_width = 0;
@@ -252,13 +258,21 @@ char const* format(output_buffer* pbuffer, char const* pformat, char const* v)
 }
 
 char const* format(output_buffer* pbuffer, char const* pformat, std::string const& v)
+{
+    return format_string(pbuffer, pformat, v.data(), v.size());
+}
+
+char const* format(output_buffer* pbuffer, char const* pformat, captured_string const& v)
+{
+    return format_string(pbuffer, pformat, v.data(), v.size());
+}
+
+char const* format_string(output_buffer* pbuffer, char const* pformat,
+    char const* s, std::size_t size)
 {
     if(*pformat != 's')
         return nullptr;
-    auto len = v.size();
-    char* p = pbuffer->reserve(len);
-    std::memcpy(p, v.data(), len);
-    pbuffer->commit(len);
+    pbuffer->write(s, size);
     return pformat + 1;
 }
 
@@ -0,0 +1,161 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/timestamp_field.hpp>
+
+#include <limits>   // numeric_limits
+#if defined(__unix__)
+#include <time.h>   // localtime_r, gmtime_r
+#endif
+
+namespace reckless {
+namespace detail {
+
+#if defined(_WIN32)
+// Windows.h can't be included here since it declares GetSystemTimeAsFileTime
+// differently from timestamp_field.hpp.
+extern "C" {
+    int __stdcall FileTimeToLocalFileTime(void const* lpFileTime, void* lpLocalFileTime);
+    int __stdcall FileTimeToSystemTime(void const* lpFileTime, void* lpSystemTime);
+}
+#endif
+
+namespace {
+std::int64_t const NO_SECOND = std::numeric_limits<std::int64_t>::min();
+
+void write_digit_pair(char* ptarget, unsigned digits)
+{
+    ptarget[0] = decimal_digits[2*digits];
+    ptarget[1] = decimal_digits[2*digits+1];
+}
+
+struct calendar_time {
+    unsigned year;
+    unsigned month;
+    unsigned day;
+    unsigned hour;
+    unsigned minute;
+    unsigned second;
+    long utc_offset;    // Seconds east of UTC.
+};
+
+calendar_time to_calendar_time(std::int64_t second, bool utc)
+{
+    calendar_time ct;
+#if defined(__unix__)
+    time_t t = static_cast<time_t>(second);
+    struct tm tm;
+    if(utc)
+        gmtime_r(&t, &tm);
+    else
+        localtime_r(&t, &tm);
+    ct.year = static_cast<unsigned>(tm.tm_year + 1900);
+    ct.month = static_cast<unsigned>(tm.tm_mon + 1);
+    ct.day = static_cast<unsigned>(tm.tm_mday);
+    ct.hour = static_cast<unsigned>(tm.tm_hour);
+    ct.minute = static_cast<unsigned>(tm.tm_min);
+    ct.second = static_cast<unsigned>(tm.tm_sec);
+    ct.utc_offset = tm.tm_gmtoff;
+#elif defined(_WIN32)
+#pragma pack(push, 8)
+    struct SYSTEMTIME {
+        unsigned short wYear;
+        unsigned short wMonth;
+        unsigned short wDayOfWeek;
+        unsigned short wDay;
+        unsigned short wHour;
+        unsigned short wMinute;
+        unsigned short wSecond;
+        unsigned short wMilliseconds;
+    };
+#pragma pack(pop)
+    // FILETIME counts 100-nanosecond intervals since 1601-01-01.
+    std::int64_t const EPOCH_DIFFERENCE = 11644473600;
+    std::uint64_t ft = static_cast<std::uint64_t>(
+        (second + EPOCH_DIFFERENCE)*10000000);
+    std::uint64_t ft_local = ft;
+    if(!utc)
+        FileTimeToLocalFileTime(&ft, &ft_local);
+    SYSTEMTIME st;
+    FileTimeToSystemTime(&ft_local, &st);
+    ct.year = st.wYear;
+    ct.month = st.wMonth;
+    ct.day = st.wDay;
+    ct.hour = st.wHour;
+    ct.minute = st.wMinute;
+    ct.second = st.wSecond;
+    ct.utc_offset = static_cast<long>(
+        (static_cast<std::int64_t>(ft_local) - static_cast<std::int64_t>(ft))
+        / 10000000);
+#else
+    static_assert(false, "to_calendar_time() is not implemented for this OS");
+#endif
+    return ct;
+}
+}   // anonymous namespace
+
+RECKLESS_TLS timestamp_prefix timestamp_prefixes[4] = {
+    {NO_SECOND, {}, {}},
+    {NO_SECOND, {}, {}},
+    {NO_SECOND, {}, {}},
+    {NO_SECOND, {}, {}}
+};
+
+void update_timestamp_prefix(timestamp_prefix* pprefix, std::int64_t second,
+    timestamp_style style)
+{
+    bool utc = style == timestamp_style::utc
+        || style == timestamp_style::iso8601_utc;
+    bool iso8601 = style == timestamp_style::iso8601_local
+        || style == timestamp_style::iso8601_utc;
+    calendar_time ct = to_calendar_time(second, utc);
+
+    char* p = pprefix->date_time;
+    write_digit_pair(p, ct.year/100);
+    write_digit_pair(p + 2, ct.year%100);
+    p[4] = '-';
+    write_digit_pair(p + 5, ct.month);
+    p[7] = '-';
+    write_digit_pair(p + 8, ct.day);
+    p[10] = iso8601? 'T' : ' ';
+    write_digit_pair(p + 11, ct.hour);
+    p[13] = ':';
+    write_digit_pair(p + 14, ct.minute);
+    p[16] = ':';
+    write_digit_pair(p + 17, ct.second);
+
+    if(style == timestamp_style::iso8601_utc) {
+        pprefix->zone[0] = 'Z';
+    } else if(style == timestamp_style::iso8601_local) {
+        long offset = ct.utc_offset;
+        pprefix->zone[0] = offset < 0? '-' : '+';
+        if(offset < 0)
+            offset = -offset;
+        unsigned minutes = static_cast<unsigned>(offset/60);
+        write_digit_pair(pprefix->zone + 1, minutes/60);
+        pprefix->zone[3] = ':';
+        write_digit_pair(pprefix->zone + 4, minutes%60);
+    }
+    pprefix->second = second;
+}
+
+}   // namespace detail
+}   // namespace reckless
@@ -0,0 +1,212 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/tsc_timestamp_field.hpp>
+
+#include <chrono>   // milliseconds
+#include <thread>   // this_thread::sleep_for
+#if defined(__unix__)
+#include <time.h>   // clock_gettime
+#endif
+#if defined(__linux__)
+#include <cstdio>   // fopen, fgets
+#include <cstring>  // strstr
+#endif
+
+namespace reckless {
+namespace detail {
+
+#if defined(_WIN32)
+// Windows.h can't be included here since it declares GetSystemTimeAsFileTime
+// differently from timestamp_field.hpp.
+extern "C" {
+    void __stdcall GetSystemTimePreciseAsFileTime(void* lpSystemTimeAsFileTime);
+    int __stdcall QueryPerformanceCounter(void* lpPerformanceCount);
+    int __stdcall QueryPerformanceFrequency(void* lpFrequency);
+}
+#endif
+
+namespace {
+// How long the first calibration on a thread measures the tick rate for, at
+// least. After that every recalibration measures from the same starting
+// point, so the estimate keeps getting better.
+std::int64_t const MIN_CALIBRATION_NANOSECONDS = 10*1000*1000;
+std::int64_t const RECALIBRATION_INTERVAL_NANOSECONDS = 1000*1000*1000;
+// Largest difference between the mapping and the real-time clock that a
+// recalibration corrects gradually rather than at once.
+std::int64_t const MAX_SLEW_NANOSECONDS = 100*1000*1000;
+
+bool detect_reliable_tsc()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    // Invariant TSC: constant rate in all ACPI P-, C- and T-states.
+    std::uint32_t r[4];
+    if(!cpuid(0x80000007, 0, r) || (r[3] & (1u << 8)) == 0)
+        return false;
+#if defined(__linux__)
+    // The kernel checks the TSC against other clocks at boot and while
+    // running, and takes it off this list if it's found to be unstable
+    // (e.g. not synchronized between sockets).
+    std::FILE* file = std::fopen(
+        "/sys/devices/system/clocksource/clocksource0/available_clocksource",
+        "r");
+    if(file) {
+        char line[256];
+        bool found = std::fgets(line, sizeof(line), file) != nullptr
+            && std::strstr(line, "tsc") != nullptr;
+        std::fclose(file);
+        if(!found)
+            return false;
+    }
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Nanoseconds from a clock that is never stepped, although it may be slewed
+// to keep up with the real-time clock. Its rate is what we calibrate the TSC
+// against.
+std::int64_t monotonic_nanoseconds()
+{
+#if defined(__unix__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+#elif defined(_WIN32)
+    std::int64_t count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return static_cast<std::int64_t>(
+        static_cast<double>(count)*1e9/static_cast<double>(frequency));
+#else
+    static_assert(false, "monotonic_nanoseconds() is not implemented for this OS");
+#endif
+}
+
+struct clock_sample {
+    std::uint64_t tsc;
+    std::int64_t monotonic;
+    std::int64_t realtime;
+};
+
+// Read the TSC and both clocks as close together as we can manage. An
+// interrupt in the middle would throw the result off by microseconds, so
+// take the quickest of a few tries.
+clock_sample sample_clocks()
+{
+    clock_sample best = {};
+    std::uint64_t best_duration = ~std::uint64_t(0);
+    for(unsigned i=0; i!=5; ++i) {
+        std::uint64_t before = rdtsc();
+        std::int64_t monotonic = monotonic_nanoseconds();
+        std::int64_t realtime = realtime_nanoseconds();
+        std::uint64_t after = rdtsc();
+        if(after - before < best_duration) {
+            best_duration = after - before;
+            best.tsc = before + (after - before)/2;
+            best.monotonic = monotonic;
+            best.realtime = realtime;
+        }
+    }
+    return best;
+}
+
+clock_sample const& first_sample()
+{
+    static clock_sample const sample = sample_clocks();
+    return sample;
+}
+}   // anonymous namespace
+
+bool const tsc_is_reliable = detect_reliable_tsc();
+
+// The first sample is what every calibration measures the tick rate from.
+// Take it during static initialization so that it's usually far enough in
+// the past by the time the first record is formatted.
+static clock_sample const& g_first_sample = first_sample();
+
+RECKLESS_TLS tsc_calibration tsc_calibration_state = {0, 0, 0.0, 0};
+
+std::int64_t realtime_nanoseconds()
+{
+#if defined(__unix__)
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+#elif defined(_WIN32)
+    // FILETIME counts 100-nanosecond intervals since 1601-01-01.
+    std::uint64_t ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    return (static_cast<std::int64_t>(ft) - 116444736000000000)*100;
+#else
+    static_assert(false, "realtime_nanoseconds() is not implemented for this OS");
+#endif
+}
+
+void recalibrate_tsc(tsc_calibration* pcalibration)
+{
+    clock_sample const& start = first_sample();
+    clock_sample now = sample_clocks();
+    std::int64_t elapsed = now.monotonic - start.monotonic;
+    if(elapsed < MIN_CALIBRATION_NANOSECONDS) {
+        // Only happens if a record is formatted right after startup. The
+        // output worker can afford to wait here once rather than use a poor
+        // estimate for the next second.
+        std::this_thread::sleep_for(std::chrono::nanoseconds(
+            MIN_CALIBRATION_NANOSECONDS - elapsed));
+        now = sample_clocks();
+        elapsed = now.monotonic - start.monotonic;
+    }
+    double nanoseconds_per_tick = static_cast<double>(elapsed)
+        / static_cast<double>(now.tsc - start.tsc);
+    auto interval_ticks = static_cast<std::uint64_t>(
+        RECALIBRATION_INTERVAL_NANOSECONDS/nanoseconds_per_tick);
+
+    // Moving the mapping straight to the clock would make timestamps jump,
+    // backwards if the previous mapping ran ahead. Instead we start from
+    // where the previous mapping is now and adjust the rate so that we meet
+    // the clock at the next recalibration. Only if the clock itself was set
+    // (or this is the first calibration) do we follow it right away.
+    std::int64_t realtime_base = now.realtime;
+    if(pcalibration->next_tsc != 0) {
+        auto delta = static_cast<std::int64_t>(now.tsc - pcalibration->tsc_base);
+        std::int64_t current = pcalibration->realtime_base
+            + static_cast<std::int64_t>(static_cast<double>(delta)
+                *pcalibration->nanoseconds_per_tick);
+        std::int64_t offset = now.realtime - current;
+        if(offset < MAX_SLEW_NANOSECONDS && offset > -MAX_SLEW_NANOSECONDS) {
+            realtime_base = current;
+            nanoseconds_per_tick *= static_cast<double>(
+                RECALIBRATION_INTERVAL_NANOSECONDS + offset)
+                / static_cast<double>(RECALIBRATION_INTERVAL_NANOSECONDS);
+        }
+    }
+
+    pcalibration->tsc_base = now.tsc;
+    pcalibration->realtime_base = realtime_base;
+    pcalibration->nanoseconds_per_tick = nanoseconds_per_tick;
+    pcalibration->next_tsc = now.tsc + interval_ticks;
+}
+
+}   // namespace detail
+}   // namespace reckless
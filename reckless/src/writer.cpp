@@ -37,6 +37,20 @@ writer::~writer()
 {
 }
 
+std::size_t writer::writev(write_segment const* psegments,
+        std::size_t segment_count, std::error_code& ec) noexcept
+{
+    std::size_t total = 0;
+    ec.clear();
+    for(std::size_t i=0; i!=segment_count; ++i) {
+        auto written = write(psegments[i].pbuffer, psegments[i].count, ec);
+        total += written;
+        if(ec)
+            break;
+    }
+    return total;
+}
+
 std::error_category const& writer::error_category()
 {
     static error_category_t ec;
@@ -0,0 +1,130 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include <reckless/aio_writer.hpp>
+#if defined(__linux__)
+#include <reckless/io_uring_writer.hpp>
+#endif
+
+#include "memory_writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <cstdio>   // remove
+
+// A memory writer that fails with a temporary error, after writing part of
+// the data, for as long as fail is set.
+class flaky_writer : public memory_writer<std::string> {
+public:
+    std::size_t write(void const* data, std::size_t size,
+            std::error_code& ec) noexcept override
+    {
+        if(!fail.load())
+            return memory_writer<std::string>::write(data, size, ec);
+        std::size_t written = size/2;
+        memory_writer<std::string>::write(data, written, ec);
+        ec.assign(temporary_failure, error_category());
+        return written;
+    }
+    std::atomic<bool> fail{false};
+};
+
+std::string expected_output(unsigned count)
+{
+    std::string s;
+    for(unsigned i=0; i!=count; ++i)
+        s += "record " + std::to_string(i) + '\n';
+    return s;
+}
+
+template <class Log>
+void write_records(Log& log, unsigned begin, unsigned end)
+{
+    for(unsigned i=begin; i!=end; ++i)
+        log.write("record %d", i);
+}
+
+// Records must come out complete and in order even when the target fails
+// for a while and the failed chunks have to be retried.
+bool check_aio_writer()
+{
+    unsigned const record_count = 100000;
+    flaky_writer target;
+    {
+        reckless::aio_writer writer(&target, 3, 4096);
+        reckless::policy_log<> log(&writer);
+        log.temporary_error_policy(reckless::error_policy::block);
+        write_records(log, 0, record_count/3);
+        target.fail = true;
+        std::thread recover([&target]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            target.fail = false;
+        });
+        write_records(log, record_count/3, record_count);
+        recover.join();
+    }
+    bool correct = target.container == expected_output(record_count);
+    std::cout << "aio_writer: " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct;
+}
+
+#if defined(__linux__)
+bool check_io_uring_writer()
+{
+    unsigned const record_count = 100000;
+    char const* path = "async_writer_test.log";
+    std::remove(path);
+    try {
+        reckless::io_uring_writer writer(path, 3, 4096);
+        reckless::policy_log<> log(&writer);
+        write_records(log, 0, record_count);
+    } catch(std::system_error const& e) {
+        std::cout << "io_uring_writer: not available (" << e.what() << ")"
+            << std::endl;
+        return true;
+    }
+    std::ifstream ifs(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << ifs.rdbuf();
+    ifs.close();
+    std::remove(path);
+    bool correct = contents.str() == expected_output(record_count);
+    std::cout << "io_uring_writer: " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct;
+}
+#endif
+
+int main()
+{
+    bool success = check_aio_writer();
+#if defined(__linux__)
+    success = check_io_uring_writer() && success;
+#endif
+    return success? 0 : 1;
+}
@@ -0,0 +1,308 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/binary_log.hpp>
+#include "memory_writer.hpp"
+#include "unreliable_writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>  // out_of_range
+#include <string>
+#include <thread>
+
+namespace bf = reckless::binary_format;
+
+class reader {
+public:
+    explicit reader(std::string const& data) : data_(data) {}
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        if(pos_ + sizeof(value) > data_.size())
+            throw std::out_of_range("read past end");
+        std::memcpy(&value, data_.data() + pos_, sizeof(value));
+        pos_ += sizeof(value);
+        return value;
+    }
+
+    std::string get_string(std::size_t length)
+    {
+        if(pos_ + length > data_.size())
+            throw std::out_of_range("read past end");
+        std::string s = data_.substr(pos_, length);
+        pos_ += length;
+        return s;
+    }
+
+    bool at_end() const
+    {
+        return pos_ == data_.size();
+    }
+
+private:
+    std::string const& data_;
+    std::size_t pos_ = 0;
+};
+
+bool check_header(reader& r)
+{
+    return r.get_string(8) == std::string(bf::magic, 8)
+        && r.get<std::uint32_t>() == bf::version
+        && r.get<std::uint32_t>() == bf::byte_order_mark
+        && r.get<std::uint8_t>() == sizeof(long double)
+        && (r.get_string(3), true);
+}
+
+bool check_format(reader& r, std::uint32_t id, char const* format)
+{
+    return r.get<bf::record_type>() == bf::record_type::format
+        && r.get<std::uint32_t>() == id
+        && r.get<std::uint32_t>() == std::strlen(format)
+        && r.get_string(std::strlen(format)) == format;
+}
+
+bool check_entry(reader& r, std::uint32_t id, unsigned arg_count)
+{
+    return r.get<bf::record_type>() == bf::record_type::entry
+        && r.get<std::uint32_t>() == id
+        && r.get<std::int64_t>() > 0
+        && r.get<std::uint8_t>() == arg_count;
+}
+
+template <typename T>
+bool check_arg(reader& r, bf::arg_type type, T value)
+{
+    return r.get<bf::arg_type>() == type && r.get<T>() == value;
+}
+
+bool check_string_arg(reader& r, char const* value)
+{
+    return r.get<bf::arg_type>() == bf::arg_type::string
+        && r.get<std::uint32_t>() == std::strlen(value)
+        && r.get_string(std::strlen(value)) == value;
+}
+
+// Log a few records and check that they are encoded the way the file format
+// says. Each format string should only be written once per session, and a
+// new session should start with a new header.
+bool check_encoding()
+{
+    char const* first = "Hello %s %d %f";
+    char const* second = "%p %u %d";
+    memory_writer<std::string> writer;
+    reckless::binary_log log(&writer);
+    log.write(first, "World", -1, 1.5);
+    log.write(second, &writer, 2u, true);
+    log.write(first, std::string("again"), 'x', 2.5f);
+    log.close();
+    log.open(&writer);
+    log.write(second);
+    log.close();
+
+    bool correct;
+    try {
+        reader r(writer.container);
+        correct = check_header(r)
+            && check_format(r, 0, first)
+            && check_entry(r, 0, 3)
+            && check_string_arg(r, "World")
+            && check_arg(r, bf::arg_type::int32, std::int32_t(-1))
+            && check_arg(r, bf::arg_type::double_, 1.5)
+
+            && check_format(r, 1, second)
+            && check_entry(r, 1, 3)
+            && check_arg(r, bf::arg_type::pointer, static_cast<std::uint64_t>(
+                reinterpret_cast<std::uintptr_t>(&writer)))
+            && check_arg(r, bf::arg_type::uint32, std::uint32_t(2))
+            && check_arg(r, bf::arg_type::int32, std::int32_t(1))
+
+            && check_entry(r, 0, 3)
+            && check_string_arg(r, "again")
+            && check_arg(r, bf::arg_type::char_, 'x')
+            && check_arg(r, bf::arg_type::float_, 2.5f)
+
+            && check_header(r)
+            && check_format(r, 0, second)
+            && check_entry(r, 0, 0)
+            && r.at_end();
+    } catch(std::out_of_range const&) {
+        correct = false;
+    }
+
+    std::cout << "encoding: " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct;
+}
+
+bool check_string_entry(reader& r, std::uint32_t id, std::string const& s)
+{
+    return check_entry(r, id, 1) && check_string_arg(r, s.c_str());
+}
+
+// A record whose output is thrown away, because the formatter failed or
+// because the writer failed and the record did not fit in the output buffer,
+// must not take the header or a format definition with it.
+bool check_lost_frames()
+{
+    char const* too_long = "%s too long";
+    char const* first = "%s first";
+    char const* second = "%s second";
+    std::string const s(1000, 'x');
+
+    unreliable_writer writer;
+    std::ostringstream output;
+    auto pcout_buffer = std::cout.rdbuf(output.rdbuf());
+
+    reckless::log_options options;
+    options.output_buffer_capacity = 4096;
+    reckless::binary_log log(&writer, options);
+    log.temporary_error_policy(reckless::error_policy::ignore);
+
+    // This is the first record, but it does not fit in the output buffer
+    // and is reverted.
+    log.write(too_long, std::string(10000, 'x'));
+
+    // Fill the output buffer while the writer is failing, so that the next
+    // record that defines a format string gets lost.
+    writer.error_code.assign(static_cast<int>(std::errc::no_space_on_device),
+        get_error_category());
+    for(int i=0; i!=3; ++i)
+        log.write(first, s);
+    log.write(second, s);
+    std::error_code error;
+    log.flush(error);
+    writer.error_code.clear();
+
+    log.write(second, s);
+    log.write(first, s);
+    log.close();
+    std::cout.rdbuf(pcout_buffer);
+
+    bool correct;
+    try {
+        std::string data = output.str();
+        reader r(data);
+        correct = error
+            && check_header(r)
+            && check_format(r, 0, first)
+            && check_string_entry(r, 0, s)
+            && check_string_entry(r, 0, s)
+            && check_string_entry(r, 0, s)
+            && check_format(r, 1, second)
+            && check_string_entry(r, 1, s)
+            && check_string_entry(r, 0, s)
+            && r.at_end();
+    } catch(std::out_of_range const&) {
+        correct = false;
+    }
+
+    std::cout << "lost frames: " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct;
+}
+
+// A writer that doesn't return until it is opened, like a stalled disk.
+class gated_writer : public memory_writer<std::string> {
+public:
+    std::size_t write(void const* data, std::size_t size, std::error_code& ec) noexcept override
+    {
+        while(!open.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return memory_writer<std::string>::write(data, size, ec);
+    }
+    std::atomic<bool> open{false};
+};
+
+// With input_full_policy::drop_and_report the report of dropped records
+// must be an entry like any other, so that the rest of the file can still
+// be read.
+bool check_dropped_report()
+{
+    unsigned const record_count = 100000;
+    char const* record = "%u";
+    gated_writer writer;
+    reckless::log_options options;
+    options.input_buffer_capacity = 4096;
+    options.input_buffer_full = reckless::input_full_policy::drop_and_report;
+    reckless::binary_log log(&writer, options);
+    for(unsigned i=0; i!=record_count; ++i)
+        log.write(record, i);
+    unsigned dropped = log.input_buffer_drop_count();
+    writer.open = true;
+    log.close();
+
+    bool correct = dropped != 0;
+    unsigned written = 0;
+    unsigned reported = 0;
+    try {
+        reader r(writer.container);
+        correct = check_header(r) && correct;
+        std::map<std::uint32_t, std::string> formats;
+        unsigned next = 0;
+        while(correct && !r.at_end()) {
+            auto type = r.get<bf::record_type>();
+            auto id = r.get<std::uint32_t>();
+            if(type == bf::record_type::format) {
+                formats[id] = r.get_string(r.get<std::uint32_t>());
+            } else if(type == bf::record_type::entry) {
+                r.get<std::int64_t>();
+                correct = r.get<std::uint8_t>() == 1
+                    && r.get<bf::arg_type>() == bf::arg_type::uint32;
+                auto n = r.get<std::uint32_t>();
+                if(formats[id] == record) {
+                    correct = correct && n >= next;
+                    next = n + 1;
+                    ++written;
+                } else {
+                    correct = correct && formats[id].compare(0, 10,
+                        "reckless: ") == 0;
+                    reported += n;
+                }
+            } else {
+                correct = false;
+            }
+        }
+    } catch(std::out_of_range const&) {
+        correct = false;
+    }
+    correct = correct && written + dropped == record_count
+        && reported == dropped;
+
+    std::cout << "dropped report: " << dropped << " dropped, " << reported
+        << " reported, " << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+int main()
+{
+    bool success = check_encoding();
+    success = check_lost_frames() && success;
+    success = check_dropped_report() && success;
+    return success? 0 : 1;
+}
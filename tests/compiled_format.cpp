@@ -0,0 +1,82 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include "memory_writer.hpp"
+
+#include <iostream>
+#include <string>
+
+struct Coordinate {
+    int x;
+    int y;
+};
+
+char const* format(reckless::output_buffer* pbuffer, char const* fmt,
+    Coordinate const& c)
+{
+    if(*fmt != 'd')
+        return nullptr;
+    reckless::template_formatter::format(pbuffer, "(%d, %d)", c.x, c.y);
+    return fmt+1;
+}
+
+// Everything written with RECKLESS_FMT should come out exactly as when the
+// same format string is parsed at run time.
+int main()
+{
+    memory_writer<std::string> runtime_writer;
+    memory_writer<std::string> compiled_writer;
+    reckless::policy_log<> runtime_log(&runtime_writer);
+    reckless::policy_log<> compiled_log(&compiled_writer);
+
+#define WRITE_BOTH(fmt, ...) \
+    runtime_log.write(fmt, __VA_ARGS__); \
+    compiled_log.write(RECKLESS_FMT(fmt), __VA_ARGS__)
+
+    WRITE_BOTH("%d|%5d|%-5d|%05d|%+d|% d|%.3d", 1, 2, 3, 4, 5, 6, 7);
+    WRITE_BOTH("%x|%X|%#x|%8x|%-#8X|", 255, 255u, 255l, 255ul, 255ll);
+    WRITE_BOTH("%d %d %d %d", static_cast<short>(-1),
+        static_cast<unsigned short>(2), true, -3ll);
+    WRITE_BOTH("%s %d %x", 'a', 'b', static_cast<unsigned char>('c'));
+    WRITE_BOTH("%f|%.2f|%10.3f|%-10.1f|%+f", 1.5, 2.345f, 3.14159, -1.0,
+        static_cast<long double>(2.5));
+    WRITE_BOTH("%e|%.3E|%g|%.3g|%#.3G|%F", 1.5, 2.345, 0.1, 1234567.0, 1e-10,
+        3.0);
+    WRITE_BOTH("%s %s %p", "string", std::string("std::string"),
+        static_cast<void const*>(&runtime_writer));
+    WRITE_BOTH("100%% %d%%", 5);
+    WRITE_BOTH("%d and %x", Coordinate{1, 2}, Coordinate{3, 4});
+    WRITE_BOTH("%s", "no literal text");
+    runtime_log.write("no conversions");
+    compiled_log.write(RECKLESS_FMT("no conversions"));
+    runtime_log.write("");
+    compiled_log.write(RECKLESS_FMT(""));
+
+    runtime_log.close();
+    compiled_log.close();
+
+    bool correct = runtime_writer.container == compiled_writer.container;
+    std::cout << compiled_writer.container;
+    std::cout << "compiled_format: " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct? 0 : 1;
+}
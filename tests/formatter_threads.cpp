@@ -0,0 +1,146 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include "ordered_writer.hpp"
+
+#include <cstdio>   // sscanf, sprintf
+#include <exception>    // rethrow_exception
+#include <iostream>
+#include <stdexcept>    // runtime_error
+#include <string>
+
+// Besides the order, checks that a format error is reported right where the
+// record would have been.
+class checking_writer : public ordered_writer {
+public:
+    using ordered_writer::ordered_writer;
+
+protected:
+    bool parse(std::string const& line, unsigned* pthread,
+        unsigned* pi) override
+    {
+        if(line.compare(0, 6, "error ") == 0) {
+            // The failing formatter wrote the thread and index before it
+            // threw, but that must have been reverted.
+            return 2 == std::sscanf(line.c_str() + 6, "%u %u", pthread, pi)
+                && *pi % 100 == 0;
+        }
+        double half;
+        return 3 == std::sscanf(line.c_str(), "%u %u %lf", pthread, pi, &half)
+            && half == *pi/2.0 && *pi % 100 != 0;
+    }
+};
+
+struct record_number {
+    unsigned thread;
+    unsigned i;
+};
+
+class record_error : public std::runtime_error {
+public:
+    record_error(record_number n) :
+        runtime_error("record error"),
+        number(n)
+    {
+    }
+    record_number number;
+};
+
+char const* format(reckless::output_buffer* poutput, char const* fmt,
+    record_number n)
+{
+    if(*fmt != 's')
+        return nullptr;
+    char buf[32];
+    poutput->write(buf, std::sprintf(buf, "%u %u", n.thread, n.i));
+    if(n.i % 100 == 0)
+        throw record_error(n);
+    return fmt+1;
+}
+
+void format_error(reckless::output_buffer* poutput,
+    std::exception_ptr const& pexception, std::type_info const&)
+{
+    try {
+        std::rethrow_exception(pexception);
+    } catch(record_error const& e) {
+        char buf[32];
+        poutput->write(buf, std::sprintf(buf, "error %u %u\n",
+            e.number.thread, e.number.i));
+    }
+}
+
+unsigned const THREAD_COUNT = 4;
+unsigned const RECORDS_PER_THREAD = 20000;
+
+bool run(char const* name, reckless::input_queue_mode mode, unsigned fail_after)
+{
+    checking_writer writer(THREAD_COUNT, fail_after);
+    reckless::log_options options;
+    options.input_queue = mode;
+    options.formatter_threads = 3;
+    reckless::policy_log<> log(&writer, options);
+    log.format_error_callback(format_error);
+    log.permanent_error_policy(reckless::error_policy::fail_immediately);
+
+    bool flushed = true;
+    run_threads(THREAD_COUNT, [&](unsigned thread) {
+        try {
+            for(unsigned i=0; i!=RECORDS_PER_THREAD; ++i) {
+                log.write("%s %f", record_number{thread, i}, i/2.0);
+                if(thread == 0 && i % 1000 == 999) {
+                    log.flush();
+                    if(writer.written(0) != i + 1)
+                        flushed = false;
+                }
+            }
+        } catch(reckless::writer_error const&) {
+        }
+    });
+    std::error_code error;
+    log.close(error);
+
+    bool complete;
+    if(fail_after == ~0u) {
+        complete = !error && writer.lines() == THREAD_COUNT*RECORDS_PER_THREAD;
+    } else {
+        complete = error && writer.lines() >= fail_after
+            && writer.lines() < THREAD_COUNT*RECORDS_PER_THREAD;
+        flushed = true;
+    }
+    bool correct = writer.ordered() && flushed && complete;
+    std::cout << "formatter_threads " << name << ": "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+// Format records on several threads and check that they come out exactly as
+// if the output worker had formatted them itself.
+int main()
+{
+    bool correct = run("shared", reckless::input_queue_mode::shared, ~0u);
+    correct = run("per_thread", reckless::input_queue_mode::per_thread, ~0u)
+        && correct;
+    correct = run("writer error", reckless::input_queue_mode::shared, 12345)
+        && correct;
+    return correct? 0 : 1;
+}
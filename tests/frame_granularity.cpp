@@ -0,0 +1,130 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+
+#include "memory_writer.hpp"
+
+#include <cstdint>
+#include <cstdio>   // sscanf
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Remembers whether it was properly aligned where the output worker found it.
+template <std::size_t Alignment>
+struct alignas(Alignment) aligned {
+    unsigned value;
+};
+
+template <std::size_t Alignment>
+char const* format(reckless::output_buffer* poutput, char const* fmt,
+    aligned<Alignment> const& v)
+{
+    if(*fmt != 'd')
+        return nullptr;
+    bool ok = reinterpret_cast<std::uintptr_t>(&v) % Alignment == 0;
+    reckless::template_formatter::format(poutput, ok? "%d" : "misaligned",
+        v.value);
+    return fmt+1;
+}
+
+// Write records of different sizes and alignments from a few threads and
+// check that every record comes out, in order for each thread.
+bool test(reckless::input_queue_mode mode, std::size_t granularity)
+{
+    unsigned const thread_count = 4;
+    unsigned const records_per_thread = 20000;
+
+    memory_writer<std::string> writer;
+    reckless::log_options options;
+    options.input_queue = mode;
+    options.input_buffer_capacity = 4096;
+    options.frame_granularity = granularity;
+    reckless::policy_log<> log(&writer, options);
+
+    std::vector<std::thread> threads;
+    for(unsigned thread=0; thread!=thread_count; ++thread) {
+        threads.emplace_back([&log, thread]() {
+            std::string padding(thread, '.');
+            for(unsigned i=0; i!=records_per_thread; ++i) {
+                switch(i % 5) {
+                case 0:
+                    log.write("%d %d", thread, i);
+                    break;
+                case 1:
+                    // Small enough for the small-string optimization.
+                    log.write("%d %d%s", thread, i, padding);
+                    break;
+                case 2:
+                    log.write("%d %d", static_cast<char>(thread), i);
+                    break;
+                case 3:
+                    log.write("%d %d", thread, aligned<32>{i});
+                    break;
+                case 4:
+                    log.write("%d %d", thread, aligned<128>{i});
+                    break;
+                }
+            }
+        });
+    }
+    for(auto& thread : threads)
+        thread.join();
+    log.close();
+
+    std::vector<unsigned> next(thread_count, 0);
+    std::istringstream istr(writer.container);
+    std::string line;
+    bool correct = true;
+    while(std::getline(istr, line)) {
+        unsigned thread, i;
+        if(2 != std::sscanf(line.c_str(), "%u %u", &thread, &i)
+                || thread >= thread_count || next[thread] != i)
+        {
+            correct = false;
+            break;
+        }
+        ++next[thread];
+    }
+    for(auto count : next)
+        correct = correct && count == records_per_thread;
+
+    std::cout << "frame_granularity "
+        << (mode == reckless::input_queue_mode::shared? "shared " : "per_thread ")
+        << granularity << ": " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct;
+}
+
+int main()
+{
+    bool correct = true;
+    for(auto mode : {reckless::input_queue_mode::shared,
+            reckless::input_queue_mode::per_thread})
+    {
+        for(std::size_t granularity : {8, 16, 32, 0})
+            correct = test(mode, granularity) && correct;
+    }
+    return correct? 0 : 1;
+}
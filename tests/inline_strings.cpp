@@ -0,0 +1,105 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+
+#include "memory_writer.hpp"
+#include "eol.hpp"
+
+#include <cstdlib>  // malloc, free
+#include <cstring>  // strcpy
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>  // move
+
+// Count allocations made by this thread, so that the output worker's
+// don't get in the way.
+thread_local unsigned g_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    ++g_allocations;
+    if(void* p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// With inline_strings, strings are copied into the input frame: writing
+// them doesn't allocate, and a char array can be reused as soon as write()
+// returns. Strings that are too long for the input buffer are stored as
+// std::string.
+int main()
+{
+    memory_writer<std::string> writer;
+    reckless::log_options options;
+    options.input_buffer_capacity = 64*1024;
+    options.inline_strings = true;
+    reckless::policy_log<> log(&writer, options);
+
+    std::string const long_string(100, 'x');
+    std::string const too_long(32*1024, 'y');
+    std::string const empty;
+    std::string temporary("moved string that is long enough");
+    char buffer[16];
+
+    unsigned allocations = g_allocations;
+    log.write("%s|%s|%d", long_string, empty, 1);
+    std::strcpy(buffer, "first");
+    log.write("%s", buffer);
+    std::strcpy(buffer, "second");
+    log.write("%s %s", buffer, std::move(temporary));
+    // Fills the array completely, with no terminator.
+    std::memset(buffer, 'z', sizeof(buffer));
+    log.write("%s", buffer);
+    log.write("%s %d", "literal", 2);
+#if RECKLESS_HAS_STRING_VIEW
+    log.write("%s", std::string_view(long_string.data(), 10));
+#endif
+    allocations = g_allocations - allocations;
+
+    log.write("%s", too_long);
+    log.close();
+
+    std::string expected = eol(long_string + "||1\n"
+        "first\n"
+        "second moved string that is long enough\n"
+        + std::string(sizeof(buffer), 'z') + "\n"
+        "literal 2\n"
+#if RECKLESS_HAS_STRING_VIEW
+        + long_string.substr(0, 10) + "\n"
+#endif
+        + too_long + "\n");
+    bool correct = allocations == 0 && writer.container == expected;
+    std::cout << "inline_strings: " << allocations << " allocations, "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct? 0 : 1;
+}
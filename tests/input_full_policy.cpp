@@ -0,0 +1,114 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+
+#include "memory_writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>   // sscanf
+#include <iostream>
+#include <memory>   // unique_ptr
+#include <sstream>
+#include <string>
+#include <thread>
+
+// A writer that doesn't return until it is opened, like a stalled disk.
+class gated_writer : public memory_writer<std::string> {
+public:
+    std::size_t write(void const* data, std::size_t size, std::error_code& ec) noexcept override
+    {
+        while(!open.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return memory_writer<std::string>::write(data, size, ec);
+    }
+    std::atomic<bool> open{false};
+};
+
+unsigned const RECORD_COUNT = 100000;
+
+// Write far more records than fit in the buffers while the writer is
+// stalled. None of the calls may block. Every record must either be written
+// or counted as dropped, and with drop_and_report the worker must say how
+// many were dropped.
+bool test(char const* name, reckless::input_full_policy log_policy,
+    reckless::input_full_policy const* pthread_policy)
+{
+    gated_writer writer;
+    reckless::log_options options;
+    options.input_buffer_capacity = 4096;
+    options.input_buffer_full = log_policy;
+    reckless::policy_log<> log(&writer, options);
+
+    {
+        std::unique_ptr<reckless::scoped_input_full_policy> pscope;
+        if(pthread_policy)
+            pscope.reset(new reckless::scoped_input_full_policy(*pthread_policy));
+        for(unsigned i=0; i!=RECORD_COUNT; ++i)
+            log.write("%d", i);
+    }
+    unsigned dropped = log.input_buffer_drop_count();
+    writer.open = true;
+    log.close();
+
+    bool report = (pthread_policy? *pthread_policy : log_policy)
+        == reckless::input_full_policy::drop_and_report;
+    std::istringstream lines(writer.container);
+    std::string line;
+    unsigned written = 0;
+    unsigned reported = 0;
+    bool ordered = true;
+    unsigned next = 0;
+    while(std::getline(lines, line)) {
+        unsigned n;
+        if(std::sscanf(line.c_str(),
+                "reckless: %u log records were dropped", &n) == 1)
+        {
+            reported += n;
+        } else if(std::sscanf(line.c_str(), "%u", &n) == 1 && n >= next) {
+            next = n + 1;
+            ++written;
+        } else {
+            ordered = false;
+        }
+    }
+
+    bool correct = ordered && dropped != 0 && written + dropped == RECORD_COUNT
+        && reported == (report? dropped : 0);
+    std::cout << "input_full_policy " << name << ": " << dropped
+        << " dropped, " << reported << " reported, "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+int main()
+{
+    using reckless::input_full_policy;
+    input_full_policy const drop = input_full_policy::drop;
+    input_full_policy const drop_and_report = input_full_policy::drop_and_report;
+    bool correct = test("drop", drop, nullptr);
+    correct = test("drop_and_report", drop_and_report, nullptr) && correct;
+    correct = test("scoped drop", input_full_policy::block, &drop) && correct;
+    correct = test("scoped drop_and_report", input_full_policy::block,
+        &drop_and_report) && correct;
+    return correct? 0 : 1;
+}
@@ -0,0 +1,67 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include <reckless/mmap_file_writer.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdio>   // remove
+
+std::string read_file(char const* path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << ifs.rdbuf();
+    return contents.str();
+}
+
+// Write enough to span many small extents, then reopen the file and append
+// to it. The file should contain exactly what was written, without any of
+// the preallocated space left at the end.
+int main()
+{
+    char const* path = "mmap_file_writer_test.log";
+    std::remove(path);
+
+    std::string expected;
+    for(unsigned round=0; round!=2; ++round) {
+        reckless::mmap_file_writer writer(path, 4096,
+            reckless::mmap_sync_policy::async,
+            reckless::mmap_advice::sequential);
+        reckless::policy_log<> log(&writer);
+        for(unsigned i=0; i!=20000; ++i) {
+            std::string s(i%100, static_cast<char>('a' + i%26));
+            log.write("%d %d %s", round, i, s);
+            expected += std::to_string(round) + ' ' + std::to_string(i) + ' '
+                + s + '\n';
+        }
+        log.close();
+    }
+
+    bool correct = read_file(path) == expected;
+    std::remove(path);
+    std::cout << "mmap_file_writer: " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct? 0 : 1;
+}
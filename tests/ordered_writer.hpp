@@ -0,0 +1,120 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TESTS_ORDERED_WRITER_HPP
+#define TESTS_ORDERED_WRITER_HPP
+#include <reckless/writer.hpp>
+
+#include <cstdio>   // sscanf
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checks every line as it is written. Each line starts with the number of
+// the thread that wrote the record and the number of the record within that
+// thread, and the records from each thread must come in order. If
+// fail_after is given, the writer fails permanently once it has seen that
+// many lines.
+class ordered_writer : public reckless::writer {
+public:
+    explicit ordered_writer(unsigned thread_count,
+            unsigned fail_after = ~0u) :
+        next_(thread_count, 0),
+        fail_after_(fail_after)
+    {
+    }
+
+    std::size_t write(void const* data, std::size_t size,
+        std::error_code& ec) noexcept override
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if(lines_ >= fail_after_) {
+            ec = make_error_code(reckless::writer::permanent_failure);
+            return 0;
+        }
+        pending_.append(static_cast<char const*>(data), size);
+        std::size_t pos;
+        while((pos = pending_.find('\n')) != std::string::npos) {
+            unsigned thread, i;
+            if(!parse(pending_.substr(0, pos), &thread, &i)
+                    || thread >= next_.size() || next_[thread] != i)
+                ordered_ = false;
+            else
+                ++next_[thread];
+            ++lines_;
+            pending_.erase(0, pos + 1);
+        }
+        ec.clear();
+        return size;
+    }
+
+    // Number of records from the thread that have been written.
+    unsigned written(unsigned thread)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return next_[thread];
+    }
+
+    unsigned lines()
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return lines_;
+    }
+
+    // True if every line so far was in order and no partial line was
+    // written.
+    bool ordered()
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return ordered_ && pending_.empty();
+    }
+
+protected:
+    // Get the thread and record number from a line. Return false if the
+    // line is not what the test wrote.
+    virtual bool parse(std::string const& line, unsigned* pthread,
+        unsigned* pi)
+    {
+        return 2 == std::sscanf(line.c_str(), "%u %u", pthread, pi);
+    }
+
+private:
+    std::mutex mutex_;
+    std::string pending_;
+    std::vector<unsigned> next_;
+    unsigned lines_ = 0;
+    unsigned fail_after_;
+    bool ordered_ = true;
+};
+
+// Call f(thread) on each of thread_count threads and wait for them all.
+template <class Function>
+void run_threads(unsigned thread_count, Function f)
+{
+    std::vector<std::thread> threads;
+    for(unsigned thread=0; thread!=thread_count; ++thread)
+        threads.emplace_back(f, thread);
+    for(auto& thread : threads)
+        thread.join();
+}
+
+#endif  // TESTS_ORDERED_WRITER_HPP
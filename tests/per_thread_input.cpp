@@ -0,0 +1,80 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+
+#include "memory_writer.hpp"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <sstream>
+#include <iostream>
+#include <cstdio>   // sscanf
+
+// Write from several threads using per-thread input buffers and check that
+// nothing is lost, that each thread's records come out in order, and that
+// flush() sees records from all threads.
+int main()
+{
+    unsigned const thread_count = 8;
+    unsigned const records_per_thread = 10000;
+
+    memory_writer<std::string> writer;
+    reckless::log_options options;
+    options.input_queue = reckless::input_queue_mode::per_thread;
+    options.thread_input_buffer_capacity = 4096;
+    reckless::policy_log<> log(&writer, options);
+
+    std::vector<std::thread> threads;
+    for(unsigned thread=0; thread!=thread_count; ++thread) {
+        threads.emplace_back([&log, thread]() {
+            for(unsigned i=0; i!=records_per_thread; ++i)
+                log.write("%d %d", thread, i);
+        });
+    }
+    for(auto& thread : threads)
+        thread.join();
+    log.flush();
+
+    std::vector<unsigned> next(thread_count, 0);
+    std::istringstream istr(writer.container);
+    std::string line;
+    bool ordered = true;
+    while(std::getline(istr, line)) {
+        unsigned thread, i;
+        if(2 != std::sscanf(line.c_str(), "%u %u", &thread, &i)
+                || thread >= thread_count || next[thread] != i)
+        {
+            ordered = false;
+            break;
+        }
+        ++next[thread];
+    }
+
+    bool complete = true;
+    for(auto count : next)
+        complete = complete && count == records_per_thread;
+
+    std::cout << "ordered: " << ordered << std::endl;
+    std::cout << "complete: " << complete << std::endl;
+    return ordered && complete? 0 : 1;
+}
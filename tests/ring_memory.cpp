@@ -0,0 +1,120 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>   // also mpsc_ring_buffer
+
+#include "memory_writer.hpp"
+
+#include <cstdint>
+#include <cstring>  // memcpy
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Huge pages and locking are best effort, so whatever the system allows, the
+// buffer must behave the same: zero-filled, with both views referring to
+// the same memory, and records written across the wraparound point must come
+// back intact.
+bool test_ring(unsigned flags)
+{
+    using namespace reckless::detail;
+    std::size_t const capacity = 4*1024*1024;
+    mpsc_ring_buffer buffer(capacity, flags);
+    bool ok = (buffer.memory_flags() & ring_memory_prefault) != 0;
+
+    char* pfront = static_cast<char*>(buffer.front());
+    for(std::size_t i=0; i < capacity; i += 4096) {
+        if(pfront[i] != 0)
+            ok = false;
+    }
+    pfront[capacity + 1] = 'x';
+    if(pfront[1] != 'x')
+        ok = false;
+    pfront[1] = 0;
+
+    // Odd-sized records so that they straddle the end of the first view.
+    std::size_t const record_size = 4099;
+    std::uint64_t written = 0;
+    std::uint64_t read = 0;
+    for(unsigned round=0; round!=8000; ++round) {
+        while(void* p = buffer.push(record_size)) {
+            for(std::size_t i=0; i < record_size; i += sizeof(written))
+                std::memcpy(static_cast<char*>(p) + i, &written, sizeof(written));
+            ++written;
+        }
+        char* p = static_cast<char*>(buffer.front());
+        std::uint64_t value;
+        std::memcpy(&value, p + record_size - record_size % sizeof(value)
+            - sizeof(value), sizeof(value));
+        if(value != read)
+            ok = false;
+        buffer.pop_release(record_size);
+        ++read;
+    }
+
+    std::cout << "ring_memory: flags " << flags << ", got "
+        << buffer.memory_flags() << ", " << (ok? "correct" : "INCORRECT")
+        << std::endl;
+    return ok;
+}
+
+bool test_log(bool per_thread)
+{
+    memory_writer<std::string> writer;
+    reckless::log_options options;
+    options.input_buffer_capacity = 2*1024*1024;
+    options.input_buffer_huge_pages = true;
+    options.input_buffer_locked = true;
+    if(per_thread)
+        options.input_queue = reckless::input_queue_mode::per_thread;
+    unsigned const count = 100000;
+    {
+        reckless::policy_log<> log(&writer, options);
+        for(unsigned i=0; i!=count; ++i)
+            log.write("%d", i);
+    }
+
+    std::istringstream lines(writer.container);
+    unsigned expected = 0;
+    unsigned value;
+    bool ok = true;
+    while(lines >> value) {
+        if(value != expected++)
+            ok = false;
+    }
+    ok = ok && expected == count;
+    std::cout << "ring_memory: log, " << (per_thread? "per-thread" : "shared")
+        << " input, " << (ok? "correct" : "INCORRECT") << std::endl;
+    return ok;
+}
+
+int main()
+{
+    using namespace reckless::detail;
+    bool ok = true;
+    ok = test_ring(0) && ok;
+    ok = test_ring(ring_memory_huge_pages) && ok;
+    ok = test_ring(ring_memory_locked) && ok;
+    ok = test_ring(ring_memory_huge_pages | ring_memory_locked) && ok;
+    ok = test_log(false) && ok;
+    ok = test_log(true) && ok;
+    return ok? 0 : 1;
+}
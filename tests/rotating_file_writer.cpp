@@ -0,0 +1,110 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include <reckless/rotating_file_writer.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>  // uint64_t
+#include <cstdio>   // remove
+
+std::string read_file(char const* path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << ifs.rdbuf();
+    return contents.str();
+}
+
+// Write enough to cause plenty of size-based rotations. Putting the
+// rotated-out files back together in the order they were reported, followed
+// by the current file, should give exactly what was written.
+//
+// Records of at least the zero-copy threshold (64 KiB by default) reach the
+// writer through writev() instead of write(), and must be counted towards
+// max_size all the same. There are few of those records, so we give the
+// background thread a chance to open the next file between them; until it
+// has, rotation is put off.
+bool check(char const* name, std::uint64_t max_size, unsigned record_count,
+    std::size_t min_record_size, bool pause)
+{
+    char const* path = "rotating_file_writer_test.log";
+    std::remove(path);
+
+    std::mutex mutex;
+    std::vector<std::string> archives;
+    bool error = false;
+
+    std::string expected;
+    {
+        reckless::rotation_policy policy;
+        policy.max_size = max_size;
+        reckless::rotating_file_writer writer(path, policy);
+        writer.rotation_callback([&](reckless::rotating_file_writer*,
+                char const* archive, std::error_code ec)
+            {
+                std::lock_guard<std::mutex> lk(mutex);
+                if(ec)
+                    error = true;
+                else
+                    archives.push_back(archive);
+            });
+        reckless::policy_log<> log(&writer);
+        for(unsigned i=0; i!=record_count; ++i) {
+            std::string s(min_record_size + i%100,
+                static_cast<char>('a' + i%26));
+            log.write("%s %d", s, i);
+            expected += s + ' ' + std::to_string(i) + '\n';
+            if(pause) {
+                log.flush();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+        log.close();
+    }
+
+    std::string actual;
+    for(auto const& archive : archives)
+        actual += read_file(archive.c_str());
+    actual += read_file(path);
+
+    bool correct = !error && archives.size() > 1 && actual == expected;
+    for(auto const& archive : archives)
+        std::remove(archive.c_str());
+    std::remove(path);
+    std::cout << name << ": " << archives.size()
+        << " rotations, " << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+int main()
+{
+    bool success = check("small records", 64*1024, 50000, 0, false);
+    success = check("zero-copy records", 256*1024, 40, 80*1024, true) && success;
+    return success? 0 : 1;
+}
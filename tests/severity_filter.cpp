@@ -0,0 +1,85 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+// Compile out debug calls, so that we can check that the compile-time and
+// run-time filters work together.
+#define RECKLESS_MINIMUM_SEVERITY 1
+#include <reckless/severity_log.hpp>
+#include "memory_writer.hpp"
+
+#include <iostream>
+#include <string>
+
+typedef reckless::severity_log<reckless::no_indent, ' ',
+    reckless::severity_field> log_t;
+
+unsigned g_evaluations = 0;
+
+int evaluate(int value)
+{
+    ++g_evaluations;
+    return value;
+}
+
+int main()
+{
+    using reckless::severity_level;
+    memory_writer<std::string> writer;
+    log_t log(&writer);
+
+    bool correct = !log.enabled(severity_level::debug)
+        && log.enabled(severity_level::info)
+        && log.threshold() == severity_level::debug;
+
+    // Debug is compiled out regardless of the threshold.
+    log.debug("debug %d", 1);
+    RECKLESS_LOG_DEBUG(log, "debug %d", evaluate(2));
+    log.info("info %d", 3);
+    RECKLESS_LOG_INFO(log, "info %d", evaluate(4));
+
+    log.threshold(severity_level::warn);
+    correct = correct && log.threshold() == severity_level::warn
+        && !log.enabled(severity_level::info)
+        && log.enabled(severity_level::error);
+    log.info("info %d", 5);
+    RECKLESS_LOG_INFO(log, "info %d", evaluate(6));
+    log.warn(RECKLESS_FMT("warn %d"), 7);
+    RECKLESS_LOG_ERROR(log, RECKLESS_FMT("error %d"), evaluate(8));
+
+    log.threshold(severity_level::none);
+    RECKLESS_LOG_ERROR(log, "error %d", evaluate(9));
+
+    log.threshold(severity_level::debug);
+    log.info("info %d", 10);
+    log.close();
+
+    std::string const expected =
+        "I info 3\n"
+        "I info 4\n"
+        "W warn 7\n"
+        "E error 8\n"
+        "I info 10\n";
+    correct = correct && g_evaluations == 2 && writer.container == expected;
+    std::cout << writer.container;
+    std::cout << "severity_filter: " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct? 0 : 1;
+}
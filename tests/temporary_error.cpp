@@ -80,14 +80,17 @@ void recovered_error_with_registered_callback()
 
 void lost_frames_with_registered_callback()
 {
-    reckless::policy_log<> log(&writer, 0, 1024);
+    // The output buffer capacity is rounded up to whole pages (64 KiB on
+    // Windows), so use a size that is not rounded on any platform.
+    std::size_t const output_buffer_capacity = 64*1024;
+    reckless::policy_log<> log(&writer, 0, output_buffer_capacity);
     log.temporary_error_policy(reckless::error_policy::notify_on_recovery);
     log.writer_error_callback(&writer_error_callback);
     std::cout << "Simulating disk full" << std::endl;
     writer.error_code.assign(static_cast<int>(std::errc::no_space_on_device),
             get_error_category());
     char const msg[] = "Temporary failed write";
-    for(std::size_t count=0; count!=1024/sizeof(msg) + 1; ++count)
+    for(std::size_t count=0; count!=output_buffer_capacity/sizeof(msg) + 1; ++count)
         log.write(msg);
     std::this_thread::sleep_for(std::chrono::seconds(2));
     std::cout << "Simulating disk no longer full" << std::endl;
@@ -0,0 +1,103 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include <reckless/writer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+class null_writer : public reckless::writer {
+public:
+    std::size_t write(void const*, std::size_t count, std::error_code& ec) noexcept override
+    {
+        ec.clear();
+        return count;
+    }
+};
+
+// A record from the busy thread. Formatting it waits until the thread has
+// written its next record, so that the output worker always finds more input
+// when it is done with a pass over the buffers.
+struct busy_record {
+    unsigned i;
+    std::atomic<unsigned>* pstarted;
+    std::atomic<unsigned>* pwritten;
+    std::atomic<bool>* pstop;
+};
+
+char const* format(reckless::output_buffer* poutput, char const* fmt,
+    busy_record const& record)
+{
+    if(*fmt != 's')
+        return nullptr;
+    record.pstarted->store(record.i + 1);
+    while(record.pwritten->load() < record.i + 2 && !record.pstop->load())
+        std::this_thread::yield();
+    poutput->write("busy", 4);
+    return fmt+1;
+}
+
+// One thread writes far more than fits in its per-thread input buffer, while
+// another thread keeps the output worker from ever running out of input. The
+// thread with the full buffer has to be woken up when room is made in it,
+// not only when the worker has nothing left to do.
+int main()
+{
+    unsigned const records = 20000;
+    auto const time_limit = std::chrono::seconds(10);
+
+    null_writer writer;
+    reckless::log_options options;
+    options.input_queue = reckless::input_queue_mode::per_thread;
+    options.thread_input_buffer_capacity = 4096;
+    reckless::policy_log<> log(&writer, options);
+
+    std::atomic<unsigned> started(0);
+    std::atomic<unsigned> written(0);
+    std::atomic<bool> stop(false);
+    auto start = std::chrono::steady_clock::now();
+    std::thread busy_thread([&]() {
+        // Give up after the time limit, so that the test ends even if the
+        // other thread is never woken up.
+        for(unsigned i=0; !stop.load(); ++i) {
+            log.write("%s", busy_record{i, &started, &written, &stop});
+            written.store(i + 1);
+            while(started.load() < i + 1 && !stop.load())
+                std::this_thread::yield();
+            if(std::chrono::steady_clock::now() - start > time_limit)
+                stop = true;
+        }
+    });
+
+    for(unsigned i=0; i!=records; ++i)
+        log.write("%d", i);
+    bool finished = std::chrono::steady_clock::now() - start < time_limit;
+    stop = true;
+    busy_thread.join();
+    log.close();
+
+    std::cout << "thread_buffer_full: " << (finished? "correct" : "INCORRECT")
+        << std::endl;
+    return finished? 0 : 1;
+}
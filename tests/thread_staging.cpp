@@ -0,0 +1,177 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include <reckless/log_worker_pool.hpp>
+#include "ordered_writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+unsigned const THREAD_COUNT = 8;
+unsigned const RECORDS_PER_THREAD = 20000;
+// Long enough that nothing is published by the time bound during a test.
+unsigned const NEVER_MS = 60*60*1000;
+
+template <class Predicate>
+bool wait_until(Predicate predicate)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(!predicate()) {
+        if(std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Threads write with staging, now and then with a record that is too long
+// for a region or inside a write_batch. Then they stay around without
+// writing while another thread flushes, which has to see everything they
+// staged. With a small input buffer the regions keep wrapping around the
+// end of it, and some threads can't get a region of their own.
+bool run(char const* name, std::size_t input_buffer_capacity,
+    unsigned fail_after)
+{
+    ordered_writer writer(THREAD_COUNT, fail_after);
+    reckless::log_options options;
+    options.inline_strings = true;
+    options.input_buffer_capacity = input_buffer_capacity;
+    options.thread_staging_capacity = 1024;
+    options.thread_staging_delay_ms = NEVER_MS;
+    reckless::policy_log<> log(&writer, options);
+    log.permanent_error_policy(reckless::error_policy::fail_immediately);
+
+    std::string long_string(2000, 'x');
+    std::atomic<unsigned> idle(0);
+    std::atomic<bool> flushed(false);
+    bool flush_complete = true;
+    run_threads(THREAD_COUNT + 1, [&](unsigned thread) {
+        if(thread == THREAD_COUNT) {
+            wait_until([&] { return idle == THREAD_COUNT; });
+            try {
+                log.flush();
+            } catch(reckless::writer_error const&) {
+            }
+            flush_complete = writer.lines() == THREAD_COUNT*RECORDS_PER_THREAD;
+            flushed = true;
+            return;
+        }
+        try {
+            for(unsigned i=0; i!=RECORDS_PER_THREAD; ++i) {
+                if(i % 37 == 0) {
+                    log.write("%d %d %s", thread, i, long_string);
+                } else if(i % 101 == 0) {
+                    reckless::write_batch batch(log);
+                    log.write("%d %d", thread, i);
+                } else {
+                    log.write("%d %d", thread, i);
+                }
+            }
+        } catch(reckless::writer_error const&) {
+        }
+        ++idle;
+        wait_until([&] { return flushed.load(); });
+    });
+    std::error_code error;
+    log.close(error);
+
+    bool complete;
+    if(fail_after == ~0u) {
+        complete = !error && flush_complete
+            && writer.lines() == THREAD_COUNT*RECORDS_PER_THREAD;
+    } else {
+        // Every thread must have noticed the error instead of hanging.
+        complete = error && writer.lines() >= fail_after
+            && writer.lines() < THREAD_COUNT*RECORDS_PER_THREAD;
+    }
+    bool correct = writer.ordered() && complete;
+    std::cout << "thread_staging " << name << ": "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+// A staged record stays with its thread until something publishes it: here
+// a flush() from another thread, the time bound, or the thread exiting.
+bool run_published(char const* name, unsigned delay_ms, bool flush,
+    bool exit, reckless::log_worker_pool* ppool)
+{
+    ordered_writer writer(1);
+    reckless::log_options options;
+    options.thread_staging_capacity = 4096;
+    options.thread_staging_delay_ms = delay_ms;
+    options.worker_pool = ppool;
+    reckless::policy_log<> log(&writer, options);
+
+    std::atomic<bool> written(false);
+    std::atomic<bool> done(false);
+    bool held = true;
+    bool published = false;
+    run_threads(2, [&](unsigned thread) {
+        if(thread == 0) {
+            log.write("%d %d", 0, 0);
+            written = true;
+            if(!exit)
+                wait_until([&] { return done.load(); });
+        } else {
+            wait_until([&] { return written.load(); });
+            if(delay_ms == NEVER_MS && !exit) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                held = writer.lines() == 0;
+            }
+            if(flush)
+                log.flush();
+            published = wait_until([&] { return writer.lines() == 1; });
+            done = true;
+        }
+    });
+    log.close();
+
+    bool correct = held && published && writer.lines() == 1
+        && writer.ordered();
+    std::cout << "thread_staging " << name << ": "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+int main()
+{
+    bool correct = run("ordering", 0, ~0u);
+    correct = run("wrapping", 8192, ~0u) && correct;
+    correct = run("writer error", 0, 12345) && correct;
+    correct = run_published("flush", NEVER_MS, true, false, nullptr)
+        && correct;
+    correct = run_published("time bound", 1, false, false, nullptr)
+        && correct;
+    correct = run_published("thread exit", NEVER_MS, false, true, nullptr)
+        && correct;
+    {
+        reckless::log_worker_pool pool(1);
+        correct = run_published("pool flush", NEVER_MS, true, false, &pool)
+            && correct;
+        correct = run_published("pool time bound", 1, false, false, &pool)
+            && correct;
+    }
+    return correct? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/timestamp_field.hpp>
+#include "memory_writer.hpp"
+
+#include <cstdint>
+#include <cstdio>   // snprintf
+#include <cstdlib>  // setenv
+#include <iostream>
+#include <random>
+#include <string>
+#include <time.h>   // tzset, localtime_r, gmtime_r, strftime
+
+class test_buffer : public reckless::output_buffer {
+public:
+    test_buffer(reckless::writer* pwriter) :
+        output_buffer(pwriter, 1024)
+    {
+    }
+
+    void flush()
+    {
+        frame_end();
+        output_buffer::flush();
+    }
+};
+
+memory_writer<std::string> g_writer;
+test_buffer g_buffer(&g_writer);
+
+template <class Field>
+std::string format(std::int64_t seconds, unsigned nanoseconds)
+{
+    g_writer.container.clear();
+    Field field(seconds, nanoseconds);
+    field.format(&g_buffer);
+    g_buffer.flush();
+    return g_writer.container;
+}
+
+// The slow and obvious way of getting the same result.
+std::string expected(std::int64_t seconds, unsigned nanoseconds, bool utc,
+    bool iso8601, unsigned digits)
+{
+    time_t t = static_cast<time_t>(seconds);
+    struct tm tm;
+    if(utc)
+        gmtime_r(&t, &tm);
+    else
+        localtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), iso8601? "%Y-%m-%dT%H:%M:%S" : "%Y-%m-%d %H:%M:%S",
+        &tm);
+    std::string s = buf;
+    std::snprintf(buf, sizeof(buf), ".%09u", nanoseconds);
+    s += std::string(buf, 1 + digits);
+    if(iso8601 && utc) {
+        s += 'Z';
+    } else if(iso8601) {
+        long offset = tm.tm_gmtoff/60;
+        std::snprintf(buf, sizeof(buf), "%c%02ld:%02ld", offset < 0? '-' : '+',
+            std::labs(offset)/60, std::labs(offset)%60);
+        s += buf;
+    }
+    return s;
+}
+
+unsigned g_failures = 0;
+
+void check(std::string const& actual, std::string const& expected)
+{
+    if(actual != expected) {
+        if(++g_failures <= 10)
+            std::cout << "got " << actual << ", expected " << expected
+                << std::endl;
+    }
+}
+
+void test(std::int64_t seconds, unsigned nanoseconds)
+{
+    using namespace reckless;
+    check(format<timestamp_field>(seconds, nanoseconds),
+        expected(seconds, nanoseconds, false, false, 3));
+    check(format<basic_timestamp_field<timestamp_style::local, 6>>(seconds, nanoseconds),
+        expected(seconds, nanoseconds, false, false, 6));
+    check(format<basic_timestamp_field<timestamp_style::utc, 9>>(seconds, nanoseconds),
+        expected(seconds, nanoseconds, true, false, 9));
+    check(format<basic_timestamp_field<timestamp_style::iso8601_local, 3>>(seconds, nanoseconds),
+        expected(seconds, nanoseconds, false, true, 3));
+    check(format<basic_timestamp_field<timestamp_style::iso8601_utc, 6>>(seconds, nanoseconds),
+        expected(seconds, nanoseconds, true, true, 6));
+    check(format<basic_timestamp_field<timestamp_style::iso8601_local, 1>>(seconds, nanoseconds),
+        expected(seconds, nanoseconds, false, true, 1));
+}
+
+// Timestamps must be right whether they come from the per-second cache or
+// not, including across daylight saving time changes, and for time zones
+// that are behind UTC or not a whole number of hours from it.
+int main()
+{
+    char const* zones[] = {
+        "CET-1CEST,M3.5.0,M10.5.0/3",
+        "EST5EDT,M3.2.0,M11.1.0",
+        "IST-5:30",
+        "UTC0"
+    };
+    std::mt19937_64 rng;
+    for(char const* zone : zones) {
+        setenv("TZ", zone, 1);
+        tzset();
+        test(0, 0);
+
+        // Every second around the 2020 DST changes in Europe and the US, a
+        // few records per second.
+        std::int64_t const changes[] = {1585443600, 1603587600, 1583650800,
+            1604210400};
+        for(std::int64_t change : changes) {
+            for(std::int64_t s = change - 5; s != change + 5; ++s) {
+                test(s, 0);
+                test(s, 999999999);
+                test(s, static_cast<unsigned>(rng() % 1000000000));
+            }
+        }
+        // Anywhere between 1970 and 2100.
+        for(unsigned i=0; i!=100000; ++i) {
+            test(static_cast<std::int64_t>(rng() % 4102444800),
+                static_cast<unsigned>(rng() % 1000000000));
+        }
+    }
+
+    bool correct = g_failures == 0;
+    std::cout << "timestamp_field: " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include <reckless/tsc_timestamp_field.hpp>
+#include "memory_writer.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>   // sscanf
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <time.h>   // timegm
+
+typedef reckless::basic_tsc_timestamp_field<
+    reckless::timestamp_style::iso8601_utc, 9> field;
+
+// Each record carries the real time just before it was written, which its
+// timestamp must be close to. Records are written from a few threads over a
+// few seconds, so that the worker has to recalibrate along the way.
+bool check_accuracy()
+{
+    std::int64_t const TOLERANCE = 100*1000;
+    memory_writer<std::string> writer;
+    {
+        reckless::policy_log<reckless::no_indent, ' ', field> log(&writer);
+        std::vector<std::thread> threads;
+        for(unsigned t=0; t!=4; ++t) {
+            threads.emplace_back([&log]
+            {
+                for(unsigned i=0; i!=250; ++i) {
+                    // write() captures the field right after this.
+                    long long before = reckless::detail::realtime_nanoseconds();
+                    log.write("%d", before);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+        log.close();
+    }
+
+    std::istringstream lines(writer.container);
+    std::string line;
+    unsigned count = 0;
+    unsigned failures = 0;
+    std::int64_t max_error = 0;
+    while(std::getline(lines, line)) {
+        struct tm tm = {};
+        unsigned nanoseconds;
+        long long before;
+        if(std::sscanf(line.c_str(), "%d-%d-%dT%d:%d:%d.%uZ %lld",
+                &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min,
+                &tm.tm_sec, &nanoseconds, &before) != 8) {
+            ++failures;
+            continue;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        std::int64_t timestamp = static_cast<std::int64_t>(timegm(&tm))
+            *1000000000 + nanoseconds;
+        std::int64_t error = timestamp - before;
+        if(error < 0)
+            error = -error;
+        if(error > max_error)
+            max_error = error;
+        if(error > TOLERANCE)
+            ++failures;
+        ++count;
+    }
+
+    bool correct = count == 1000 && failures == 0;
+    std::cout << "accuracy: " << count << " records, "
+        << (reckless::detail::tsc_is_reliable? "TSC" : "no TSC")
+        << ", max error " << max_error << " ns, "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+// If the mapping has drifted ahead of the real-time clock then a
+// recalibration must not make the next timestamp earlier than the last one.
+// It should still catch up with the clock by the recalibration after that.
+bool check_recalibration()
+{
+    using namespace reckless::detail;
+    if(!tsc_is_reliable) {
+        std::cout << "recalibration: skipped, no TSC" << std::endl;
+        return true;
+    }
+    std::int64_t const AHEAD = 50*1000;
+    tsc_calibration* pcalibration = &tsc_calibration_state;
+    tsc_to_realtime_nanoseconds(rdtsc());
+    pcalibration->realtime_base += AHEAD;
+
+    std::int64_t before = tsc_to_realtime_nanoseconds(rdtsc());
+    pcalibration->next_tsc = rdtsc();
+    std::int64_t after = tsc_to_realtime_nanoseconds(rdtsc());
+    bool monotonic = after >= before;
+
+    pcalibration->next_tsc = rdtsc() + static_cast<std::uint64_t>(
+        1e9/pcalibration->nanoseconds_per_tick);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    std::int64_t error = tsc_to_realtime_nanoseconds(rdtsc())
+        - realtime_nanoseconds();
+    if(error < 0)
+        error = -error;
+
+    bool correct = monotonic && error < AHEAD/2;
+    std::cout << "recalibration: step " << after - before << " ns, error "
+        << error << " ns, " << (correct? "correct" : "INCORRECT")
+        << std::endl;
+    return correct;
+}
+
+int main()
+{
+    bool success = check_accuracy();
+    success = check_recalibration() && success;
+    return success? 0 : 1;
+}
@@ -0,0 +1,103 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include "memory_writer.hpp"
+
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#include <pthread.h>    // pthread_getaffinity_np
+#include <sched.h>      // sched_getcpu
+#include <sys/resource.h>   // getpriority
+#include <sys/syscall.h>    // SYS_gettid
+#include <unistd.h>     // syscall
+
+// Formatted on the output worker, so it can tell us how the worker runs.
+struct worker_state {
+};
+
+char const* format(reckless::output_buffer* pbuffer, char const* fmt,
+    worker_state)
+{
+    if(*fmt != 's')
+        return nullptr;
+    auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    reckless::template_formatter::format(pbuffer, "cpu %d nice %d",
+        sched_getcpu(), getpriority(PRIO_PROCESS, tid));
+    return fmt + 1;
+}
+
+bool test_placement()
+{
+    memory_writer<std::string> writer;
+    reckless::log_options options;
+    options.worker_cpus = {0};
+    options.worker_nice = 5;
+    options.worker_numa_local = true;
+    bool ok;
+    {
+        reckless::policy_log<> log(&writer, options);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        ok = pthread_getaffinity_np(log.worker_thread().native_handle(),
+            sizeof(set), &set) == 0;
+        ok = ok && CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set);
+        log.write("%s", worker_state());
+    }
+    ok = ok && writer.container == "cpu 0 nice 5\n";
+    std::cout << "worker_placement: " << (ok? "correct" : "INCORRECT")
+        << std::endl;
+    return ok;
+}
+
+// A CPU that can't exist must make open() fail, rather than leave the
+// worker running somewhere it shouldn't.
+bool test_invalid_cpu()
+{
+    memory_writer<std::string> writer;
+    reckless::log_options options;
+    options.worker_cpus = {1000000};
+    reckless::policy_log<> log;
+    bool ok = false;
+    try {
+        log.open(&writer, options);
+    } catch(std::system_error const&) {
+        ok = true;
+    }
+    // The log was closed again, so it can be opened without the bad setting.
+    options.worker_cpus.clear();
+    log.open(&writer, options);
+    log.write("%d", 1);
+    log.close();
+    ok = ok && writer.container == "1\n";
+    std::cout << "worker_placement: invalid CPU, "
+        << (ok? "correct" : "INCORRECT") << std::endl;
+    return ok;
+}
+
+int main()
+{
+    bool ok = test_placement();
+    ok = test_invalid_cpu() && ok;
+    return ok? 0 : 1;
+}
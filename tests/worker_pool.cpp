@@ -0,0 +1,206 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include <reckless/log_worker_pool.hpp>
+#include "ordered_writer.hpp"
+
+#include <condition_variable>
+#include <iostream>
+#include <memory>   // unique_ptr
+#include <mutex>
+#include <vector>
+
+// A writer that can be made to block, like one writing to a stalled network
+// share.
+class blocking_writer : public ordered_writer {
+public:
+    using ordered_writer::ordered_writer;
+
+    std::size_t write(void const* data, std::size_t size,
+        std::error_code& ec) noexcept override
+    {
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            entered_ = true;
+            cv_.notify_all();
+            cv_.wait(lk, [this] { return !held_; });
+        }
+        return ordered_writer::write(data, size, ec);
+    }
+
+    void hold()
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        held_ = true;
+        entered_ = false;
+    }
+
+    // Wait until a pool thread is stuck in write().
+    void wait_entered()
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        cv_.wait(lk, [this] { return entered_; });
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        held_ = false;
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool held_ = false;
+    bool entered_ = false;
+};
+
+unsigned const LOG_COUNT = 8;
+unsigned const THREAD_COUNT = 4;
+unsigned const RECORDS_PER_THREAD = 40000;
+
+bool run(unsigned pool_threads)
+{
+    reckless::log_worker_pool pool(pool_threads);
+    std::vector<std::unique_ptr<ordered_writer>> writers;
+    std::vector<std::unique_ptr<reckless::policy_log<>>> logs;
+    for(unsigned l=0; l!=LOG_COUNT; ++l) {
+        writers.emplace_back(new ordered_writer(THREAD_COUNT));
+        reckless::log_options options;
+        options.worker_pool = &pool;
+        // Small buffers so that writers have to wait for the pool every so
+        // often.
+        options.input_buffer_capacity = 64*1024;
+        if(l % 2 == 1)
+            options.input_queue = reckless::input_queue_mode::per_thread;
+        logs.emplace_back(new reckless::policy_log<>(writers.back().get(),
+            options));
+    }
+
+    // Thread 0 writes almost everything to log 0, to check that it doesn't
+    // keep the pool from getting to the other logs. Every thread flushes now
+    // and then, after which everything it wrote must have been written.
+    bool flushed = true;
+    run_threads(THREAD_COUNT, [&](unsigned thread) {
+        std::vector<unsigned> written(LOG_COUNT, 0);
+        for(unsigned i=0; i!=RECORDS_PER_THREAD; ++i) {
+            unsigned l = (thread == 0 && i % 16 != 0)? 0 : i % LOG_COUNT;
+            logs[l]->write("%d %d", thread, written[l]++);
+            if(i % 997 == 0) {
+                logs[l]->flush();
+                if(writers[l]->written(thread) != written[l])
+                    flushed = false;
+            }
+        }
+    });
+
+    bool complete = true;
+    unsigned total = 0;
+    for(unsigned l=0; l!=LOG_COUNT; ++l) {
+        logs[l]->close();
+        for(unsigned thread=0; thread!=THREAD_COUNT; ++thread)
+            total += writers[l]->written(thread);
+        if(!writers[l]->ordered())
+            complete = false;
+    }
+    if(total != THREAD_COUNT*RECORDS_PER_THREAD)
+        complete = false;
+
+    // A closed log can be opened on the pool again.
+    ordered_writer writer(1);
+    reckless::log_options options;
+    options.worker_pool = &pool;
+    logs[0]->open(&writer, options);
+    logs[0]->write("%d %d", 0u, 0u);
+    logs[0]->close();
+    bool reopened = writer.written(0) == 1;
+
+    bool correct = flushed && complete && reopened;
+    std::cout << "worker_pool " << pool_threads << " threads: "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+// A log whose writer blocks holds on to one pool thread, but the other pool
+// threads must keep serving the remaining logs, flushes included.
+bool run_blocked()
+{
+    unsigned const OTHER_LOGS = 3;
+    reckless::log_worker_pool pool(2);
+    reckless::log_options options;
+    options.worker_pool = &pool;
+
+    blocking_writer blocked_writer(1);
+    reckless::policy_log<> blocked_log(&blocked_writer, options);
+    std::vector<std::unique_ptr<ordered_writer>> writers;
+    std::vector<std::unique_ptr<reckless::policy_log<>>> logs;
+    for(unsigned l=0; l!=OTHER_LOGS; ++l) {
+        writers.emplace_back(new ordered_writer(1));
+        logs.emplace_back(new reckless::policy_log<>(writers.back().get(),
+            options));
+    }
+
+    blocked_writer.hold();
+    blocked_log.write("%d %d", 0, 0);
+    blocked_writer.wait_entered();
+
+    bool flushed = true;
+    run_threads(OTHER_LOGS, [&](unsigned l) {
+        for(unsigned i=0; i!=RECORDS_PER_THREAD; ++i) {
+            logs[l]->write("%d %d", 0, i);
+            if(i % 997 == 0) {
+                logs[l]->flush();
+                if(writers[l]->written(0) != i + 1)
+                    flushed = false;
+            }
+        }
+        logs[l]->close();
+    });
+    bool blocked = blocked_writer.written(0) == 0;
+
+    blocked_writer.release();
+    blocked_log.close();
+    bool complete = blocked_writer.written(0) == 1
+        && blocked_writer.ordered();
+    for(unsigned l=0; l!=OTHER_LOGS; ++l) {
+        if(writers[l]->written(0) != RECORDS_PER_THREAD
+                || !writers[l]->ordered())
+            complete = false;
+    }
+
+    bool correct = flushed && blocked && complete;
+    std::cout << "worker_pool blocked log: "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+// Open several logs on a few pool threads and check that each of them gets
+// its records written in order, and that flush() and close() work as with a
+// worker thread of their own.
+int main()
+{
+    bool correct = run(1);
+    correct = run(3) && correct;
+    correct = run_blocked() && correct;
+    return correct? 0 : 1;
+}
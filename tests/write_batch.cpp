@@ -0,0 +1,207 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+#include <reckless/log_worker_pool.hpp>
+#include "ordered_writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+unsigned const THREAD_COUNT = 4;
+unsigned const RECORDS_PER_THREAD = 50000;
+
+// Threads write bursts of records in batches of different sizes, with single
+// records in between. Some of the records have a string that is too long
+// for the batch, and the last thread reserves more than the input buffer
+// can hold. With a small input buffer the regions keep wrapping around the
+// end of it.
+bool run(char const* name, std::size_t input_buffer_capacity,
+    unsigned fail_after)
+{
+    ordered_writer writer(THREAD_COUNT, fail_after);
+    reckless::log_options options;
+    options.inline_strings = true;
+    options.input_buffer_capacity = input_buffer_capacity;
+    reckless::policy_log<> log(&writer, options);
+    log.permanent_error_policy(reckless::error_policy::fail_immediately);
+
+    std::string long_string(400, 'x');
+    std::size_t const batch_capacity[THREAD_COUNT] = {0, 256, 4096,
+        1024*1024*1024};
+
+    bool flushed = true;
+    run_threads(THREAD_COUNT, [&](unsigned thread) {
+        unsigned i = 0;
+        try {
+            while(i != RECORDS_PER_THREAD) {
+                reckless::write_batch batch(log, batch_capacity[thread]);
+                unsigned burst = i % 200;
+                for(unsigned j=0; j!=burst && i!=RECORDS_PER_THREAD; ++j) {
+                    if(i % 37 == 0)
+                        log.write("%d %d %s", thread, i, long_string);
+                    else
+                        log.write("%d %d", thread, i);
+                    ++i;
+                    // A flush inside the batch has to see the records in
+                    // it.
+                    if(i % 1009 == 0) {
+                        log.flush();
+                        if(writer.written(thread) != i)
+                            flushed = false;
+                    }
+                }
+                batch.publish();
+                if(i != RECORDS_PER_THREAD)
+                    log.write("%d %d", thread, i++);
+            }
+        } catch(reckless::writer_error const&) {
+        }
+    });
+    std::error_code error;
+    log.close(error);
+
+    bool complete;
+    if(fail_after == ~0u) {
+        complete = !error && writer.lines() == THREAD_COUNT*RECORDS_PER_THREAD;
+    } else {
+        // Every thread must have noticed the error instead of hanging.
+        complete = error && writer.lines() >= fail_after
+            && writer.lines() < THREAD_COUNT*RECORDS_PER_THREAD;
+        flushed = true;
+    }
+    bool correct = writer.ordered() && flushed && complete;
+    std::cout << "write_batch " << name << ": "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+// A thread with a batch open on one log writes a lot to another log on the
+// same single pool thread. Unless the batch is published first, the pool
+// thread waits for it while the writing thread waits for the pool thread
+// to make room.
+bool run_crossing()
+{
+    unsigned const COUNT = 100000;
+    reckless::log_worker_pool pool(1);
+    reckless::log_options options;
+    options.worker_pool = &pool;
+    ordered_writer writer1(1);
+    ordered_writer writer2(1);
+    reckless::policy_log<> log1(&writer1, options);
+    reckless::policy_log<> log2(&writer2, options);
+    {
+        reckless::write_batch batch(log1);
+        log1.write("%d %d", 0, 0);
+        for(unsigned i=0; i!=COUNT; ++i)
+            log2.write("%d %d", 0, i);
+        log2.flush();
+    }
+    log1.close();
+    log2.close();
+
+    bool correct = writer1.lines() == 1 && writer1.ordered()
+        && writer2.lines() == COUNT && writer2.ordered();
+    std::cout << "write_batch crossing logs: "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+template <class Predicate>
+bool wait_until(Predicate predicate)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(!predicate()) {
+        if(std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// A batch that stays open holds back the records after it, but not the
+// output of those before it. On a worker pool it doesn't hold back other
+// logs either, even if the thread with the batch doesn't touch them.
+bool run_stalled(char const* name, reckless::log_worker_pool* ppool)
+{
+    unsigned const COUNT = 100000;
+    reckless::log_options options;
+    options.worker_pool = ppool;
+    ordered_writer writer1(2);
+    ordered_writer writer2(1);
+    reckless::policy_log<> log1(&writer1, options);
+    reckless::policy_log<> log2(&writer2, options);
+
+    std::atomic<bool> batch_open(false);
+    std::atomic<bool> done(false);
+    bool before_written = false;
+    bool after_held = false;
+    bool others_written = false;
+    run_threads(2, [&](unsigned thread) {
+        if(thread == 0) {
+            log1.write("%d %d", 0, 0);
+            reckless::write_batch batch(log1);
+            log1.write("%d %d", 0, 1);
+            batch_open = true;
+            wait_until([&] { return done.load(); });
+        } else {
+            wait_until([&] { return batch_open.load(); });
+            log1.write("%d %d", 1, 0);
+            before_written = wait_until([&] {
+                return writer1.written(0) == 1; });
+            after_held = writer1.written(1) == 0;
+            if(ppool) {
+                for(unsigned i=0; i!=COUNT; ++i)
+                    log2.write("%d %d", 0, i);
+                log2.flush();
+                others_written = writer2.lines() == COUNT;
+            } else {
+                others_written = true;
+            }
+            done = true;
+        }
+    });
+    log1.close();
+    log2.close();
+
+    bool correct = before_written && after_held && others_written
+        && writer1.lines() == 3 && writer1.ordered() && writer2.ordered();
+    std::cout << "write_batch " << name << ": "
+        << (correct? "correct" : "INCORRECT") << std::endl;
+    return correct;
+}
+
+int main()
+{
+    bool correct = run("ordering", 0, ~0u);
+    correct = run("wrapping", 4096, ~0u) && correct;
+    correct = run("writer error", 0, 12345) && correct;
+    correct = run_crossing() && correct;
+    correct = run_stalled("stalled worker", nullptr) && correct;
+    {
+        reckless::log_worker_pool pool(1);
+        correct = run_stalled("stalled pool", &pool) && correct;
+    }
+    return correct? 0 : 1;
+}
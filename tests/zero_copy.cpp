@@ -0,0 +1,155 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <reckless/policy_log.hpp>
+
+#include "memory_writer.hpp"
+
+#include <string>
+#include <iostream>
+
+// Records whether writev() was used, and optionally accepts only a limited
+// number of bytes per call before reporting a temporary failure, to exercise
+// the paths that put an unwritten payload back into the output buffer.
+class gathering_writer : public memory_writer<std::string> {
+public:
+    std::size_t writev(reckless::write_segment const* psegments,
+            std::size_t segment_count, std::error_code& ec) noexcept override
+    {
+        ++writev_count;
+        std::size_t total = 0;
+        ec.clear();
+        if(fail_writev_count != 0) {
+            // Write the complete frames but none of the payload.
+            --fail_writev_count;
+            ec.assign(temporary_failure, error_category());
+            segment_count = 1;
+        }
+        for(std::size_t i=0; i!=segment_count; ++i) {
+            std::size_t count = psegments[i].count;
+            if(partial_limit != 0 && total + count > partial_limit) {
+                count = partial_limit - total;
+                ec.assign(temporary_failure, error_category());
+            }
+            auto p = static_cast<char const*>(psegments[i].pbuffer);
+            container.insert(container.end(), p, p+count);
+            total += count;
+            if(ec)
+                break;
+        }
+        return total;
+    }
+    unsigned writev_count = 0;
+    unsigned fail_writev_count = 0;
+    std::size_t partial_limit = 0;
+};
+
+bool report(char const* name, bool correct, unsigned writev_count)
+{
+    std::cout << name << ": " << (correct? "correct" : "INCORRECT")
+        << ", " << writev_count << " writev calls" << std::endl;
+    return correct;
+}
+
+reckless::log_options make_options()
+{
+    reckless::log_options options;
+    options.output_buffer_capacity = 4096;
+    options.zero_copy_threshold = 2048;
+    return options;
+}
+
+bool check(char const* name, bool partial)
+{
+    gathering_writer writer;
+    writer.partial_limit = partial? 1000 : 0;
+
+    reckless::policy_log<> log(&writer, make_options());
+    log.temporary_error_policy(reckless::error_policy::block);
+
+    std::string expected;
+    for(unsigned i=0; i!=100; ++i) {
+        // Alternate between small records, records that exceed the
+        // zero-copy threshold and records that exceed the whole output
+        // buffer.
+        std::size_t size = i%3 == 0? 10 : i%3 == 1? 3000 : 10000;
+        std::string s(size, static_cast<char>('a' + i%26));
+        log.write("%s %d", s, i);
+        expected += s + ' ' + std::to_string(i) + '\n';
+    }
+    log.close();
+
+    return report(name, writer.container == expected && writer.writev_count != 0,
+        writer.writev_count);
+}
+
+// Payloads below the threshold, or that follow other output for the same
+// record, are copied even when they do not fit in the remaining buffer
+// space.
+bool check_copied()
+{
+    gathering_writer writer;
+    reckless::policy_log<> log(&writer, make_options());
+
+    std::string expected;
+    for(unsigned i=0; i!=100; ++i) {
+        std::string s(i%2 == 0? 1500 : 3000, static_cast<char>('a' + i%26));
+        log.write("%d %s", i, s);
+        expected += std::to_string(i) + ' ' + s + '\n';
+    }
+    log.close();
+
+    return report("copied", writer.container == expected
+        && writer.writev_count == 0, writer.writev_count);
+}
+
+// If the writer fails before taking any of the payload then the record is
+// lost as a whole, like any other record that can't be flushed.
+bool check_lost()
+{
+    gathering_writer writer;
+    reckless::policy_log<> log(&writer, make_options());
+    log.temporary_error_policy(reckless::error_policy::ignore);
+
+    std::string expected;
+    for(unsigned i=0; i!=10; ++i) {
+        std::string s(3000, static_cast<char>('a' + i));
+        if(i == 5) {
+            log.flush();
+            writer.fail_writev_count = 1;
+        } else {
+            expected += s + ' ' + std::to_string(i) + '\n';
+        }
+        log.write("%s %d", s, i);
+    }
+    log.close();
+
+    return report("lost", writer.container == expected, writer.writev_count);
+}
+
+int main()
+{
+    bool success = check("complete writes", false);
+    success = check("partial writes", true) && success;
+    success = check_copied() && success;
+    success = check_lost() && success;
+    return success? 0 : 1;
+}
@@ -0,0 +1,6 @@
+table.insert(OPTIONS.includes, '../reckless/include')
+libreckless = '../reckless/lib/' .. LIBPREFIX .. 'reckless' .. LIBSUFFIX
+link('reckless-decode', {
+  compile('reckless_decode.cpp'),
+  libreckless
+})
@@ -0,0 +1,360 @@
+/* This file is part of reckless logging
+ * Copyright 2015-2020 Mattias Flodin <git@codepentry.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+// reckless-decode: turn a file written by binary_log into text.
+//
+//     reckless-decode [--utc] [FILE]
+//
+// Reads FILE, or standard input if no file is given, and writes the text to
+// standard output. Each line gets a timestamp in the same format as
+// timestamp_field, in local time unless --utc is given.
+#include <reckless/binary_log.hpp>
+#include <reckless/output_buffer.hpp>
+#include <reckless/stdout_writer.hpp>
+#include <reckless/template_formatter.hpp>
+#include <reckless/timestamp_field.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+namespace bf = reckless::binary_format;
+
+class decode_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class input_file {
+public:
+    explicit input_file(std::FILE* file) : file_(file) {}
+
+    // Returns false at a clean end of file, i.e. if there was nothing left
+    // to read at all. Throws if the file ends in the middle of the value.
+    bool try_read(void* p, std::size_t size)
+    {
+        std::size_t n = std::fread(p, 1, size, file_);
+        if(n == size)
+            return true;
+        if(std::ferror(file_))
+            throw decode_error("read error");
+        if(n == 0)
+            return false;
+        throw decode_error("unexpected end of file");
+    }
+
+    void read(void* p, std::size_t size)
+    {
+        if(size != 0 && !try_read(p, size))
+            throw decode_error("unexpected end of file");
+    }
+
+    template <typename T>
+    T read()
+    {
+        T value;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    std::string read_string(std::uint32_t length)
+    {
+        std::string s(length, '\0');
+        read(&s[0], length);
+        return s;
+    }
+
+private:
+    std::FILE* file_;
+};
+
+class decode_buffer : public reckless::output_buffer {
+public:
+    using output_buffer::output_buffer;
+    using output_buffer::frame_end;
+    using output_buffer::flush;
+};
+
+struct argument {
+    bf::arg_type type;
+    union {
+        char c;
+        signed char sc;
+        unsigned char uc;
+        std::int16_t i16;
+        std::uint16_t u16;
+        std::int32_t i32;
+        std::uint32_t u32;
+        std::int64_t i64;
+        std::uint64_t u64;
+        float f;
+        double d;
+        long double ld;
+    };
+    std::string s;
+};
+
+void read_argument(input_file* pinput, argument* parg)
+{
+    parg->type = static_cast<bf::arg_type>(pinput->read<std::uint8_t>());
+    switch(parg->type) {
+    case bf::arg_type::char_: parg->c = pinput->read<char>(); break;
+    case bf::arg_type::signed_char: parg->sc = pinput->read<signed char>(); break;
+    case bf::arg_type::unsigned_char: parg->uc = pinput->read<unsigned char>(); break;
+    case bf::arg_type::int16: parg->i16 = pinput->read<std::int16_t>(); break;
+    case bf::arg_type::uint16: parg->u16 = pinput->read<std::uint16_t>(); break;
+    case bf::arg_type::int32: parg->i32 = pinput->read<std::int32_t>(); break;
+    case bf::arg_type::uint32: parg->u32 = pinput->read<std::uint32_t>(); break;
+    case bf::arg_type::int64: parg->i64 = pinput->read<std::int64_t>(); break;
+    case bf::arg_type::uint64: parg->u64 = pinput->read<std::uint64_t>(); break;
+    case bf::arg_type::float_: parg->f = pinput->read<float>(); break;
+    case bf::arg_type::double_: parg->d = pinput->read<double>(); break;
+    case bf::arg_type::long_double: parg->ld = pinput->read<long double>(); break;
+    case bf::arg_type::string:
+        parg->s = pinput->read_string(pinput->read<std::uint32_t>());
+        break;
+    case bf::arg_type::pointer: parg->u64 = pinput->read<std::uint64_t>(); break;
+    default:
+        throw decode_error("unknown argument type "
+            + std::to_string(static_cast<unsigned>(parg->type)));
+    }
+}
+
+char const* format_argument(reckless::output_buffer* pbuffer,
+    char const* pformat, argument const& arg)
+{
+    using reckless::template_formatter;
+    switch(arg.type) {
+    case bf::arg_type::char_:
+        return template_formatter::format_argument(pbuffer, pformat, arg.c);
+    case bf::arg_type::signed_char:
+        return template_formatter::format_argument(pbuffer, pformat, arg.sc);
+    case bf::arg_type::unsigned_char:
+        return template_formatter::format_argument(pbuffer, pformat, arg.uc);
+    case bf::arg_type::int16:
+        return template_formatter::format_argument(pbuffer, pformat, arg.i16);
+    case bf::arg_type::uint16:
+        return template_formatter::format_argument(pbuffer, pformat, arg.u16);
+    case bf::arg_type::int32:
+        return template_formatter::format_argument(pbuffer, pformat, arg.i32);
+    case bf::arg_type::uint32:
+        return template_formatter::format_argument(pbuffer, pformat, arg.u32);
+    case bf::arg_type::int64:
+        return template_formatter::format_argument(pbuffer, pformat,
+            static_cast<long long>(arg.i64));
+    case bf::arg_type::uint64:
+        return template_formatter::format_argument(pbuffer, pformat,
+            static_cast<unsigned long long>(arg.u64));
+    case bf::arg_type::float_:
+        return template_formatter::format_argument(pbuffer, pformat, arg.f);
+    case bf::arg_type::double_:
+        return template_formatter::format_argument(pbuffer, pformat, arg.d);
+    case bf::arg_type::long_double:
+        return template_formatter::format_argument(pbuffer, pformat, arg.ld);
+    case bf::arg_type::string:
+        return template_formatter::format_argument(pbuffer, pformat, arg.s);
+    case bf::arg_type::pointer:
+        return template_formatter::format_argument(pbuffer, pformat,
+            reinterpret_cast<void const*>(static_cast<std::uintptr_t>(arg.u64)));
+    }
+    return nullptr;
+}
+
+// A format string to use for an argument when we don't have the real one.
+char const* fallback_format(bf::arg_type type)
+{
+    switch(type) {
+    case bf::arg_type::char_:
+    case bf::arg_type::signed_char:
+    case bf::arg_type::unsigned_char:
+    case bf::arg_type::string:
+        return " %s";
+    case bf::arg_type::float_:
+    case bf::arg_type::double_:
+    case bf::arg_type::long_double:
+        return " %f";
+    case bf::arg_type::pointer:
+        return " %p";
+    default:
+        return " %d";
+    }
+}
+
+// Same format as timestamp_field: YYYY-MM-DD HH:MM:SS.FFF
+void write_timestamp(reckless::output_buffer* pbuffer, std::int64_t timestamp,
+    bool utc)
+{
+    std::int64_t seconds = timestamp / 1000000000;
+    std::int64_t nanoseconds = timestamp % 1000000000;
+    if(nanoseconds < 0) {
+        seconds -= 1;
+        nanoseconds += 1000000000;
+    }
+    if(utc) {
+        reckless::basic_timestamp_field<reckless::timestamp_style::utc> field(
+            seconds, static_cast<unsigned>(nanoseconds));
+        field.format(pbuffer);
+    } else {
+        reckless::timestamp_field field(seconds,
+            static_cast<unsigned>(nanoseconds));
+        field.format(pbuffer);
+    }
+}
+
+void read_header(input_file* pinput)
+{
+    char magic[sizeof(bf::magic)];
+    magic[0] = bf::magic[0];
+    pinput->read(magic + 1, sizeof(magic) - 1);
+    if(0 != std::memcmp(magic, bf::magic, sizeof(magic)))
+        throw decode_error("not a binary_log file");
+    auto version = pinput->read<std::uint32_t>();
+    auto byte_order_mark = pinput->read<std::uint32_t>();
+    char sizes[4];
+    pinput->read(sizes, sizeof(sizes));
+    if(byte_order_mark != bf::byte_order_mark)
+        throw decode_error("the file was written with a different byte order");
+    if(version != bf::version)
+        throw decode_error("unsupported file version "
+            + std::to_string(version));
+    if(static_cast<std::size_t>(sizes[0]) != sizeof(long double))
+        throw decode_error("the file was written with a different long double"
+            " format");
+}
+
+void decode(input_file* pinput, decode_buffer* pbuffer, bool utc)
+{
+    std::vector<std::string> formats;
+    std::vector<argument> args;
+    bool have_header = false;
+    std::uint8_t type;
+    while(pinput->try_read(&type, 1)) {
+        switch(static_cast<bf::record_type>(type)) {
+        case bf::record_type::header:
+            read_header(pinput);
+            formats.clear();
+            have_header = true;
+            break;
+
+        case bf::record_type::format: {
+            if(!have_header)
+                throw decode_error("not a binary_log file");
+            auto id = pinput->read<std::uint32_t>();
+            auto length = pinput->read<std::uint32_t>();
+            if(id >= formats.size())
+                formats.resize(id + 1);
+            formats[id] = pinput->read_string(length);
+            break;
+        }
+
+        case bf::record_type::entry: {
+            if(!have_header)
+                throw decode_error("not a binary_log file");
+            auto id = pinput->read<std::uint32_t>();
+            auto timestamp = pinput->read<std::int64_t>();
+            auto count = pinput->read<std::uint8_t>();
+            args.resize(count);
+            for(auto& arg : args)
+                read_argument(pinput, &arg);
+
+            write_timestamp(pbuffer, timestamp, utc);
+            pbuffer->write(' ');
+            if(id < formats.size() && !formats[id].empty()) {
+                char const* pformat = formats[id].c_str();
+                for(auto const& arg : args) {
+                    pformat = format_argument(pbuffer, pformat, arg);
+                    if(!pformat)
+                        break;
+                }
+                if(pformat)
+                    reckless::template_formatter::format(pbuffer, pformat);
+            } else {
+                // The format record was lost, e.g. because of a write
+                // error. Show what we have.
+                pbuffer->write("<unknown format ");
+                pbuffer->write(std::to_string(id).c_str());
+                pbuffer->write('>');
+                for(auto const& arg : args)
+                    format_argument(pbuffer, fallback_format(arg.type), arg);
+            }
+            pbuffer->write('\n');
+            pbuffer->frame_end();
+            break;
+        }
+
+        default:
+            throw decode_error("unknown record type "
+                + std::to_string(static_cast<unsigned>(type)));
+        }
+    }
+}
+
+}   // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    bool utc = false;
+    char const* path = nullptr;
+    for(int i=1; i!=argc; ++i) {
+        if(0 == std::strcmp(argv[i], "--utc")) {
+            utc = true;
+        } else if(argv[i][0] == '-' && argv[i][1] != '\0') {
+            std::fprintf(stderr, "usage: %s [--utc] [FILE]\n", argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    std::FILE* file = stdin;
+    if(path && 0 != std::strcmp(path, "-")) {
+        file = std::fopen(path, "rb");
+        if(!file) {
+            std::perror(path);
+            return 1;
+        }
+    }
+
+    int result = 0;
+    reckless::stdout_writer writer;
+    decode_buffer buffer(&writer, 64*1024);
+    try {
+        input_file input(file);
+        decode(&input, &buffer, utc);
+    } catch(decode_error const& e) {
+        std::fprintf(stderr, "%s: %s\n", path? path : "<stdin>", e.what());
+        result = 1;
+    }
+    try {
+        buffer.frame_end();
+        buffer.flush();
+    } catch(reckless::flush_error const& e) {
+        std::fprintf(stderr, "write error: %s\n", e.code().message().c_str());
+        result = 1;
+    }
+    if(file != stdin)
+        std::fclose(file);
+    return result;
+}